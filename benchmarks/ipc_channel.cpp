@@ -0,0 +1,80 @@
+#include <benchmark/benchmark.h>
+
+#include <unorthodox/unix/shm_channel.hpp>
+
+#include <sys/wait.h>
+#include <vector>
+
+using unorthodox::unix::shm_channel;
+
+// A child process sends messages of state.range(0) bytes as fast as it can,
+// we receive them
+
+static void BM_shm_channel_messages(benchmark::State& state)
+{
+    const std::size_t size = static_cast<std::size_t>(state.range(0));
+    auto channel = shm_channel::create(1024 * 1024);
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        auto producer = shm_channel::attach(dup(channel.native_handle()));
+        const std::vector<std::byte> message(size);
+        while (!producer.send(message, 1000)) {}
+        _exit(0);
+    }
+
+    unorthodox::buffer received;
+    for (auto _ : state)
+    {
+        received.clear();
+        benchmark::DoNotOptimize(channel.receive(received, 1000));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * size);
+
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+}
+
+static void BM_pipe_messages(benchmark::State& state)
+{
+    const std::size_t size = static_cast<std::size_t>(state.range(0));
+
+    int fds[2];
+    if (pipe(fds) == -1)
+        return;
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        ::close(fds[0]);
+        const std::vector<std::byte> message(size);
+        while (write(fds[1], message.data(), message.size()) > 0) {}
+        _exit(0);
+    }
+    ::close(fds[1]);
+
+    std::vector<std::byte> message(size);
+    for (auto _ : state)
+    {
+        std::size_t got = 0;
+        while (got < size)
+            got += static_cast<std::size_t>(read(fds[0], message.data() + got, size - got));
+        benchmark::DoNotOptimize(message.data());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * size);
+
+    ::close(fds[0]);
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+}
+
+// argument is the message size in bytes
+BENCHMARK(BM_shm_channel_messages)->Arg(64)->Arg(4096);
+BENCHMARK(BM_pipe_messages)->Arg(64)->Arg(4096);
+
+BENCHMARK_MAIN();
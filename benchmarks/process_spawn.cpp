@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include <unorthodox/unix/pipe.hpp>
+#include <unorthodox/unix/process_pool.hpp>
+
+#include <vector>
+
+using unorthodox::unix::process;
+using unorthodox::unix::spawn_method;
+
+// Resident memory of the parent, fork() has to copy the page tables of all of it
+static std::vector<char> resident_memory;
+
+template <spawn_method Method>
+static void BM_spawn_and_wait(benchmark::State& state)
+{
+    resident_memory.assign(static_cast<std::size_t>(state.range(0)) * 1024 * 1024, 1);
+
+    for (auto _ : state)
+    {
+        process child(Method, "true");
+        child.close_stdin();
+        benchmark::DoNotOptimize(child.wait());
+    }
+
+    resident_memory.clear();
+    resident_memory.shrink_to_fit();
+}
+
+// argument is the resident set of the parent in MiB
+BENCHMARK_TEMPLATE(BM_spawn_and_wait, spawn_method::fork)->Arg(0)->Arg(256)->Arg(1024)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_spawn_and_wait, spawn_method::posix_spawn)->Arg(0)->Arg(256)->Arg(1024)->Unit(benchmark::kMicrosecond);
+
+// a short job on a warm worker, cat answers with the job itself
+static void BM_process_pool_job(benchmark::State& state)
+{
+    unorthodox::unix::process_pool_options options;
+    options.workers = 4;
+
+    unorthodox::unix::process_pool pool(unorthodox::unix::command("cat"), options);
+
+    const std::vector<std::byte> payload(64);
+    const auto batch = static_cast<int>(state.range(0));
+
+    std::vector<unorthodox::unix::job_result> results;
+    for (auto _ : state)
+    {
+        for (int i = 0; i < batch; ++i)
+            pool.submit(payload);
+
+        while (pool.in_flight() > 0)
+            pool.poll(results);
+
+        results.clear();
+    }
+
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+
+// argument is the number of jobs submitted before waiting for results
+BENCHMARK(BM_process_pool_job)->Arg(1)->Arg(64)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -1,19 +1,31 @@
 #include <iostream>
+#include <algorithm>
 
 #include <unorthodox/buffer.hpp>
 #include <unorthodox/file.hpp>
 
-int main()
+int main(int argc, char* argv[])
 {
     std::cout << std::boolalpha << unorthodox::big_endian_system() << "\n";
     std::cout << std::is_same<std::byte, unorthodox::buffer::value_type>::value << "\n";
 
     std::cout << sizeof(unorthodox::file) << "\n";
 
-    auto file = unorthodox::file::open("/etc/ld.so.conf");
+    const char* filename = argc > 1 ? argv[1] : "/etc/ld.so.conf";
 
-    if (file)
-        std::cout << "File open\n";
-    else
-        std::cout << "Can't open file: " << unorthodox::error_string(file.error()) << "\n";
+    // map the whole file, no read copies are made
+    auto file = unorthodox::file::open(filename, unorthodox::file::READ | unorthodox::file::MMAP);
+
+    if (!file)
+    {
+        std::cout << "Can't open file: " << filename << "\n";
+        return 1;
+    }
+
+    std::cout << "File open\n";
+
+    // we're going to go through it once from start to end
+    file.advise(unorthodox::file::access_hint::sequential);
+
+    std::cout << "lines: " << std::count(file.begin(), file.end(), std::byte('\n')) << "\n";
 }
@@ -1,14 +1,37 @@
 #include <unorthodox/unix/pipe.hpp>
 #include <iostream>
 
+#include <poll.h>
+
 int main()
 {
-    auto child = unorthodox::unix::process("ls");
+    using unorthodox::unix::command;
+
+    // the listing goes from ls to sort to head without passing through us
+    unorthodox::unix::pipeline chain(command("ls", "-1") | command("sort", "-r") | command("head", "-n", "5"));
+
+    if (!chain)
+    {
+        std::cout << "Could not start pipeline\n";
+        return 1;
+    }
+
+    // ls does not read anything
+    chain.front().close_stdin();
 
-    if (child)
+    unorthodox::buffer output;
+    while (!chain.back().stdout_closed())
     {
-        std::cout << "Process dead\n";
+        pollfd readable{ chain.stdout_fd(), POLLIN, 0 };
+        poll(&readable, 1, -1);
+
+        auto result = chain.back().read(output);
+        if (!result && result.error().code != unorthodox::error_code::would_block)
+            break;
     }
 
+    std::cout.write(reinterpret_cast<const char*>(output.data()), output.size());
+    std::cout << "Pipeline exited with " << chain.wait().value_or(-1) << "\n";
+
     return 0;
 }
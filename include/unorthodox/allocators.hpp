@@ -3,6 +3,8 @@
 
 #include <new>
 #include <limits>
+#include <array>
+#include <cstddef>
 
 namespace unorthodox::allocators
 {
@@ -29,6 +31,49 @@ namespace unorthodox::allocators
 
     template <typename T, typename U>
     bool operator!=(const nothrow_allocator<T>&, const nothrow_allocator<U>&) { return false; }
+
+    // Keeps freed blocks up to max_pooled_size in per-thread free lists, one
+    // list per granularity step, and hands them out again without touching the
+    // heap.  Meant for objects that come and go at a high rate with only a few
+    // distinct sizes, like coroutine frames.  A block may be freed on another
+    // thread than it was allocated on, it joins that thread's list.
+    class frame_pool
+    {
+        public:
+            constexpr static std::size_t granularity        = 64;
+            constexpr static std::size_t max_pooled_size    = 4096;
+
+            // per list and thread, anything above goes back to the heap
+            constexpr static std::size_t max_free_blocks    = 256;
+
+            [[nodiscard]] static void* allocate(std::size_t size);
+            static void deallocate(void* block, std::size_t size) noexcept;
+
+        private:
+            constexpr static std::size_t list_count = max_pooled_size / granularity;
+
+            struct free_block
+            {
+                free_block* next;
+            };
+
+            struct free_list
+            {
+                free_block* head    = nullptr;
+                std::size_t count   = 0;
+            };
+
+            struct thread_lists
+            {
+               ~thread_lists();
+
+                std::array<free_list, list_count> lists;
+            };
+
+            static std::size_t list_index(std::size_t size) noexcept { return (size + granularity - 1) / granularity - 1; }
+
+            static thread_lists* local() noexcept;
+    };
 }
 
 namespace unorthodox::allocators
@@ -48,6 +93,79 @@ namespace unorthodox::allocators
         ::operator delete(p, n);
     }
 
+    inline frame_pool::thread_lists::~thread_lists()
+    {
+        for (free_list& list : lists)
+        {
+            while (list.head != nullptr)
+            {
+                free_block* block = list.head;
+                list.head = block->next;
+                ::operator delete(block);
+            }
+        }
+    }
+
+    inline frame_pool::thread_lists* frame_pool::local() noexcept
+    {
+        // blocks freed while the thread is shutting down, after the lists are
+        // gone, go straight back to the heap
+        thread_local bool destroyed = false;
+        thread_local struct owner
+        {
+            thread_lists lists;
+           ~owner() { destroyed = true; }
+        } pool;
+
+        return destroyed ? nullptr : &pool.lists;
+    }
+
+    inline void* frame_pool::allocate(std::size_t size)
+    {
+        if (size == 0 || size > max_pooled_size)
+            return ::operator new(size);
+
+        const std::size_t index = list_index(size);
+
+        thread_lists* pool = local();
+        if (pool != nullptr && pool->lists[index].head != nullptr)
+        {
+            free_list& list = pool->lists[index];
+            free_block* block = list.head;
+            list.head = block->next;
+            --list.count;
+
+            return block;
+        }
+
+        // every block in a list has the full size of its step
+        return ::operator new((index + 1) * granularity);
+    }
+
+    inline void frame_pool::deallocate(void* block, std::size_t size) noexcept
+    {
+        if (block == nullptr)
+            return;
+
+        if (size == 0 || size > max_pooled_size)
+        {
+            ::operator delete(block);
+            return;
+        }
+
+        const std::size_t index = list_index(size);
+
+        thread_lists* pool = local();
+        if (pool == nullptr || pool->lists[index].count >= max_free_blocks)
+        {
+            ::operator delete(block);
+            return;
+        }
+
+        free_list& list = pool->lists[index];
+        list.head = new (block) free_block{ list.head };
+        ++list.count;
+    }
 }
 
 #endif
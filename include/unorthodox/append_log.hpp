@@ -0,0 +1,304 @@
+#ifndef UNORTHODOX_APPEND_LOG_HPP
+#define UNORTHODOX_APPEND_LOG_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <limits.h>
+
+#include "buffer.hpp"
+#include "file.hpp"
+
+namespace unorthodox
+{
+    struct append_log_options
+    {
+        // how long a record may wait for others to share its commit
+        std::chrono::microseconds   max_latency     = std::chrono::milliseconds(2);
+
+        // commit right away once this much is waiting
+        std::size_t                 max_batch_bytes = 1024 * 1024;
+
+        // disk space is reserved in steps of this size
+        std::size_t                 segment_size    = 64 * 1024 * 1024;
+    };
+
+    // Append-only log shared by many writers.  Records that arrive close to each
+    // other are written with a single pwritev and made durable with a single
+    // fdatasync, so the sync cost is shared by the whole batch.
+    class append_log
+    {
+        public:
+            using offset_type = uint64_t;
+            using append_result = tl::expected<offset_type, error_code>;
+
+            // Appends to the end of target
+            explicit append_log(file&& target, append_log_options options = {});
+           ~append_log();
+
+            append_log(const append_log&) = delete;
+
+            // The future resolves to the offset of the record once it is on disk.
+            // The buffer overload takes the data over without a copy.
+            std::future<append_result> append(std::span<const std::byte> record);
+            std::future<append_result> append(buffer&& record);
+
+            // everything before this is durable
+            offset_type durable_offset() const noexcept { return durable_end.load(std::memory_order_acquire); }
+
+            error_code  error() const noexcept;
+
+        private:
+            struct batch
+            {
+                std::vector<buffer>                     records;
+                std::vector<std::promise<append_result>> waiters;
+                std::vector<offset_type>                offsets;
+
+                offset_type                             start   = 0;
+                std::size_t                             bytes   = 0;
+
+                std::chrono::steady_clock::time_point   opened;
+            };
+
+            std::future<append_result> enqueue(buffer&& record);
+
+            void        commit_loop() noexcept;
+            error_code  commit(batch& current) noexcept;
+            void        preallocate(offset_type end) noexcept;
+
+            file                        target;
+            append_log_options          opts;
+
+            mutable std::mutex          batch_mutex;
+            std::condition_variable     batch_signal;
+            batch                       pending;
+            offset_type                 next_offset = 0;
+            error_code                  status      = error_code::success;
+            bool                        stopping    = false;
+
+            std::atomic<offset_type>    durable_end = 0;
+            offset_type                 allocated_end = 0;
+
+            std::thread                 committer;
+    };
+}
+
+namespace unorthodox
+{
+    inline append_log::append_log(file&& in_target, append_log_options options)
+        : target(std::move(in_target)), opts(options)
+    {
+        if (!target)
+        {
+            status = error_code(error_domain::file_error, error_code::uninitialised_value);
+            return;
+        }
+
+        next_offset = target.size();
+        durable_end = next_offset;
+        allocated_end = next_offset;
+        pending.start = next_offset;
+
+        committer = std::thread([this]{ commit_loop(); });
+    }
+
+    inline append_log::~append_log()
+    {
+        {
+            std::lock_guard lock(batch_mutex);
+            stopping = true;
+        }
+        batch_signal.notify_all();
+
+        if (committer.joinable())
+            committer.join();
+    }
+
+    inline error_code append_log::error() const noexcept
+    {
+        std::lock_guard lock(batch_mutex);
+        return status;
+    }
+
+    inline std::future<append_log::append_result> append_log::append(std::span<const std::byte> record)
+    {
+        buffer copy;
+        copy.append(record);
+        return enqueue(std::move(copy));
+    }
+
+    inline std::future<append_log::append_result> append_log::append(buffer&& record)
+    {
+        return enqueue(std::move(record));
+    }
+
+    inline std::future<append_log::append_result> append_log::enqueue(buffer&& record)
+    {
+        std::promise<append_result> waiter;
+        std::future<append_result> rval = waiter.get_future();
+
+        bool wake_committer = false;
+        {
+            std::lock_guard lock(batch_mutex);
+            if (status || stopping)
+            {
+                waiter.set_value(tl::unexpected(status ? status : error_code(error_domain::file_error, error_code::uninitialised_value)));
+                return rval;
+            }
+
+            if (pending.records.empty())
+            {
+                pending.opened = std::chrono::steady_clock::now();
+                wake_committer = true;
+            }
+
+            pending.offsets.push_back(next_offset);
+            next_offset += record.size();
+            pending.bytes += record.size();
+
+            pending.records.push_back(std::move(record));
+            pending.waiters.push_back(std::move(waiter));
+
+            if (pending.bytes >= opts.max_batch_bytes)
+                wake_committer = true;
+        }
+
+        if (wake_committer)
+            batch_signal.notify_one();
+
+        return rval;
+    }
+
+    inline void append_log::commit_loop() noexcept
+    {
+        batch current;
+
+        while (true)
+        {
+            error_code result;
+            {
+                std::unique_lock lock(batch_mutex);
+                batch_signal.wait(lock, [this]{ return stopping || !pending.records.empty(); });
+
+                if (pending.records.empty())
+                    return;
+
+                // hold the commit window open for more records, unless we are full
+                // or a commit failed and they fail anyway
+                const auto deadline = pending.opened + opts.max_latency;
+                batch_signal.wait_until(lock, deadline, [this]{ return stopping || status || pending.bytes >= opts.max_batch_bytes; });
+
+                std::swap(current, pending);
+                pending.start = next_offset;
+
+                result = status;
+            }
+
+            // Once a batch failed nothing after it is written, the log would
+            // have a hole and durable_end must never cover one
+            if (!result)
+            {
+                result = commit(current);
+
+                if (result)
+                {
+                    std::lock_guard lock(batch_mutex);
+                    status = result;
+                } else {
+                    durable_end.store(current.start + current.bytes, std::memory_order_release);
+                }
+            }
+
+            for (std::size_t i = 0; i < current.waiters.size(); ++i)
+            {
+                if (result)
+                    current.waiters[i].set_value(tl::unexpected(result));
+                else
+                    current.waiters[i].set_value(current.offsets[i]);
+            }
+
+            current.records.clear();
+            current.waiters.clear();
+            current.offsets.clear();
+            current.bytes = 0;
+        }
+    }
+
+    inline error_code append_log::commit(batch& current) noexcept
+    {
+        preallocate(current.start + current.bytes);
+
+        std::vector<iovec> io;
+        io.reserve(current.records.size());
+        for (const buffer& record : current.records)
+        {
+            if (!record.empty())
+                io.push_back({ record.data(), record.size() });
+        }
+
+        std::size_t first = 0;
+        offset_type offset = current.start;
+
+        while (first < io.size())
+        {
+            const int count = static_cast<int>(std::min<std::size_t>(io.size() - first, IOV_MAX));
+            ssize_t n = ::pwritev(target.native_handle(), io.data() + first, count, static_cast<off_t>(offset));
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                return error_code(error_domain::file_error, error_code::failed_to_write_file);
+            }
+
+            offset += static_cast<offset_type>(n);
+
+            // step over what got written, the kernel may stop short
+            std::size_t advance = static_cast<std::size_t>(n);
+            while (first < io.size() && advance >= io[first].iov_len)
+                advance -= io[first++].iov_len;
+
+            if (first < io.size())
+            {
+                io[first].iov_base = static_cast<std::byte*>(io[first].iov_base) + advance;
+                io[first].iov_len -= advance;
+            }
+        }
+
+        if (fdatasync(target.native_handle()) == -1)
+            return error_code(error_domain::file_error, error_code::failed_to_write_file);
+
+        return error_code::success;
+    }
+
+    inline void append_log::preallocate(offset_type end) noexcept
+    {
+        if (end <= allocated_end || opts.segment_size == 0)
+            return;
+
+        const offset_type new_end = (end + opts.segment_size - 1) / opts.segment_size * opts.segment_size;
+
+        #if defined(__linux__)
+        // keep the file size as it is, we only want the blocks reserved so the
+        // fdatasync after a write does not have to allocate them
+        if (fallocate(target.native_handle(), FALLOC_FL_KEEP_SIZE,
+                      static_cast<off_t>(allocated_end), static_cast<off_t>(new_end - allocated_end)) == -1)
+        {
+            // not supported by the filesystem, stop trying
+            opts.segment_size = 0;
+            return;
+        }
+        #endif
+
+        allocated_end = new_end;
+    }
+}
+
+#endif
@@ -0,0 +1,532 @@
+#ifndef UNORTHODOX_ASYNC_FILE_HPP
+#define UNORTHODOX_ASYNC_FILE_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "buffer.hpp"
+#include "file.hpp"
+#include "thread_pool.hpp"
+
+// UNORTHODOX_DISABLE_IO_URING leaves only the portable backends
+#if defined(__linux__) && !defined(UNORTHODOX_DISABLE_IO_URING)
+# define UNORTHODOX_HAS_IO_URING
+# include "linux/io_uring.hpp"
+#endif
+
+namespace unorthodox
+{
+    struct async_file_options
+    {
+        // io_uring submission queue size
+        unsigned    queue_depth         = 256;
+
+        // size of the io_uring fixed file table
+        unsigned    fixed_file_slots    = 64;
+
+        // thread count for the fallback when io_uring is not available
+        std::size_t fallback_threads    = 4;
+
+        // false forces the thread pool
+        bool        use_io_uring        = true;
+    };
+
+    struct file_completion
+    {
+        uint64_t    user_data   = 0;
+        std::size_t bytes       = 0;
+        error_code  error       = error_code::success;
+    };
+
+    // Submit reads and writes at offsets, collect completions with reap().
+    // Operations are queued until submit(), which hands the whole batch over
+    // at once.  Not thread-safe, one thread drives the engine.
+    class async_file_engine
+    {
+        public:
+            enum class backend_type
+            {
+                io_uring,
+                thread_pool,
+            };
+
+            explicit async_file_engine(async_file_options options = {});
+           ~async_file_engine();
+
+            async_file_engine(const async_file_engine&) = delete;
+
+            backend_type    backend() const noexcept;
+
+            // Fixed files skip the per-operation file table lookup in the kernel,
+            // the file must be unregistered before it is closed
+            error_code      register_file(const file& f) noexcept;
+            void            unregister_file(const file& f) noexcept;
+
+            // Registered buffers are pinned once instead of on every operation.  They
+            // must keep their storage (no growing past capacity()) while registered.
+            error_code      register_buffers(std::span<buffer* const> buffers) noexcept;
+            void            unregister_buffers() noexcept;
+
+            // The read target is resized to length right away and shrunk to the amount
+            // actually read on completion.  Buffers must stay alive until completion.
+            error_code      read(const file& source, std::size_t offset, buffer& target, std::size_t length, uint64_t user_data) noexcept;
+            error_code      write(const file& target, std::size_t offset, const buffer& source, uint64_t user_data) noexcept;
+
+            // Returns the amount of operations handed over
+            tl::expected<std::size_t, error_code> submit() noexcept;
+
+            // Collects finished operations to out, waits until at least min_completions
+            // are available (or nothing is in flight anymore).  Submits whatever is
+            // still queued first.
+            std::size_t     reap(std::span<file_completion> out, std::size_t min_completions = 0) noexcept;
+
+            std::size_t     in_flight() const noexcept { return outstanding; }
+
+        private:
+            struct operation
+            {
+                buffer*             target      = nullptr;
+                const std::byte*    source      = nullptr;
+                std::size_t         length      = 0;
+                std::size_t         offset      = 0;
+                std::size_t         done        = 0;
+                uint64_t            user_data   = 0;
+                int                 fd          = -1;
+                bool                is_read     = false;
+            };
+
+            struct finished_operation
+            {
+                uint32_t            slot;
+                ssize_t             result;
+            };
+
+            error_code      queue(operation op) noexcept;
+            bool            ring_start(uint32_t slot) noexcept;
+            file_completion complete(uint32_t slot, ssize_t result) noexcept;
+
+            int             fixed_slot(int fd) const noexcept;
+            int             buffer_index(const std::byte* data, std::size_t length) const noexcept;
+
+            async_file_options              opts;
+
+            std::vector<operation>          operations;
+            std::vector<uint32_t>           free_slots;
+            std::vector<uint32_t>           queued;
+            std::size_t                     outstanding = 0;
+
+            std::vector<int>                fixed_fds;
+            std::vector<iovec>              registered_buffers;
+
+            #if defined(UNORTHODOX_HAS_IO_URING)
+            std::unique_ptr<io_uring>       ring;
+            #endif
+
+            // fallback
+            std::mutex                      finished_mutex;
+            std::condition_variable         finished_signal;
+            std::deque<finished_operation>  finished;
+
+            // last, the workers still running finish before what they signal
+            // through goes away
+            std::unique_ptr<thread_pool>    pool;
+    };
+}
+
+namespace unorthodox
+{
+    inline async_file_engine::async_file_engine(async_file_options options) : opts(options)
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (opts.use_io_uring)
+        {
+            io_uring new_ring = io_uring::setup(opts.queue_depth);
+            if (new_ring)
+                ring = std::make_unique<io_uring>(std::move(new_ring));
+        }
+
+        if (ring)
+            return;
+        #endif
+
+        pool = std::make_unique<thread_pool>(opts.fallback_threads);
+    }
+
+    inline async_file_engine::~async_file_engine()
+    {
+        // the kernel or the pool may still be writing to our buffers
+        submit();
+
+        file_completion discard[32];
+        while (outstanding > 0)
+            reap(discard, 1);
+    }
+
+    inline async_file_engine::backend_type async_file_engine::backend() const noexcept
+    {
+        return pool ? backend_type::thread_pool : backend_type::io_uring;
+    }
+
+    inline error_code async_file_engine::register_file(const file& f) noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (!ring)
+            return error_code(error_code::unimplemented_feature);
+
+        if (fixed_fds.empty())
+        {
+            std::vector<int> sparse(opts.fixed_file_slots, -1);
+            if (ring->register_files(sparse) < 0)
+                return error_code(error_code::unimplemented_feature);
+
+            fixed_fds = std::move(sparse);
+        }
+
+        if (fixed_slot(f.native_handle()) >= 0)
+            return error_code::success;
+
+        auto slot = std::find(fixed_fds.begin(), fixed_fds.end(), -1);
+        if (slot == fixed_fds.end())
+            return error_code(error_code::resource_busy);
+
+        const int fd = f.native_handle();
+        if (ring->update_files(static_cast<unsigned>(slot - fixed_fds.begin()), std::span<const int>(&fd, 1)) < 0)
+            return error_code(error_code::undefined_error);
+
+        *slot = fd;
+        return error_code::success;
+        #else
+        (void) f;
+        return error_code(error_code::unimplemented_feature);
+        #endif
+    }
+
+    inline void async_file_engine::unregister_file(const file& f) noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        const int slot = fixed_slot(f.native_handle());
+        if (!ring || slot < 0)
+            return;
+
+        const int empty = -1;
+        ring->update_files(static_cast<unsigned>(slot), std::span<const int>(&empty, 1));
+        fixed_fds[slot] = -1;
+        #else
+        (void) f;
+        #endif
+    }
+
+    inline error_code async_file_engine::register_buffers(std::span<buffer* const> buffers) noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (!ring)
+            return error_code(error_code::unimplemented_feature);
+
+        unregister_buffers();
+
+        std::vector<iovec> vecs;
+        vecs.reserve(buffers.size());
+        for (buffer* buf : buffers)
+            vecs.push_back({ buf->data(), buf->capacity() });
+
+        if (ring->register_buffers(vecs) < 0)
+            return error_code(error_code::undefined_error);
+
+        registered_buffers = std::move(vecs);
+        return error_code::success;
+        #else
+        (void) buffers;
+        return error_code(error_code::unimplemented_feature);
+        #endif
+    }
+
+    inline void async_file_engine::unregister_buffers() noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring && !registered_buffers.empty())
+            ring->unregister_buffers();
+        #endif
+        registered_buffers.clear();
+    }
+
+    inline error_code async_file_engine::read(const file& source, std::size_t offset, buffer& target, std::size_t length, uint64_t user_data) noexcept
+    {
+        target.resize(length);
+        if (target.size() != length)
+            return error_code(error_domain::file_error, error_code::failed_to_read_file);
+
+        operation op;
+        op.target = &target;
+        op.length = length;
+        op.offset = offset;
+        op.user_data = user_data;
+        op.fd = source.native_handle();
+        op.is_read = true;
+
+        return queue(op);
+    }
+
+    inline error_code async_file_engine::write(const file& target, std::size_t offset, const buffer& source, uint64_t user_data) noexcept
+    {
+        operation op;
+        op.source = source.data();
+        op.length = source.size();
+        op.offset = offset;
+        op.user_data = user_data;
+        op.fd = target.native_handle();
+        op.is_read = false;
+
+        return queue(op);
+    }
+
+    inline error_code async_file_engine::queue(operation op) noexcept
+    {
+        if (op.fd < 0)
+            return error_code(error_domain::file_error, error_code::uninitialised_value);
+
+        uint32_t slot;
+        if (free_slots.empty())
+        {
+            slot = static_cast<uint32_t>(operations.size());
+            operations.push_back(op);
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+            operations[slot] = op;
+        }
+
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring)
+        {
+            if (!ring_start(slot))
+            {
+                free_slots.push_back(slot);
+                return error_code(error_code::resource_busy);
+            }
+
+            outstanding++;
+            return error_code::success;
+        }
+        #endif
+
+        queued.push_back(slot);
+        outstanding++;
+        return error_code::success;
+    }
+
+    inline bool async_file_engine::ring_start(uint32_t slot) noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        const operation& op = operations[slot];
+
+        io_uring_sqe* sqe = ring->get_sqe();
+        if (sqe == nullptr)
+        {
+            // queue is full, push the current batch out and try again
+            submit();
+            sqe = ring->get_sqe();
+        }
+        if (sqe == nullptr)
+            return false;
+
+        // the kernel moves at most this much in one read or write, anything
+        // longer goes in pieces like a short transfer would
+        constexpr std::size_t max_transfer = 0x7ffff000;
+        const std::size_t length = std::min(op.length - op.done, max_transfer);
+
+        std::byte* data = (op.is_read ? op.target->data() : const_cast<std::byte*>(op.source)) + op.done;
+        const int buf_index = buffer_index(data, length);
+        const int file_index = fixed_slot(op.fd);
+
+        if (buf_index >= 0)
+        {
+            sqe->opcode = op.is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            sqe->buf_index = static_cast<uint16_t>(buf_index);
+        } else {
+            sqe->opcode = op.is_read ? IORING_OP_READ : IORING_OP_WRITE;
+        }
+
+        if (file_index >= 0)
+        {
+            sqe->fd = file_index;
+            sqe->flags |= IOSQE_FIXED_FILE;
+        } else {
+            sqe->fd = op.fd;
+        }
+
+        sqe->addr = reinterpret_cast<std::uintptr_t>(data);
+        sqe->len = static_cast<uint32_t>(length);
+        sqe->off = op.offset + op.done;
+        sqe->user_data = slot;
+
+        return true;
+        #else
+        (void) slot;
+        return false;
+        #endif
+    }
+
+    inline tl::expected<std::size_t, error_code> async_file_engine::submit() noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring)
+        {
+            int result = ring->submit();
+            if (result < 0)
+                return tl::unexpected(error_code(error_code::undefined_error));
+            return static_cast<std::size_t>(result);
+        }
+        #endif
+
+        const std::size_t count = queued.size();
+        for (uint32_t slot : queued)
+        {
+            const operation op = operations[slot];
+            std::byte* data = op.is_read ? op.target->data() : const_cast<std::byte*>(op.source);
+
+            pool->post([this, op, data, slot]{
+                std::size_t done = 0;
+                ssize_t result = 0;
+                while (done < op.length)
+                {
+                    if (op.is_read)
+                        result = ::pread(op.fd, data + done, op.length - done, static_cast<off_t>(op.offset + done));
+                    else
+                        result = ::pwrite(op.fd, data + done, op.length - done, static_cast<off_t>(op.offset + done));
+
+                    if (result < 0 && errno == EINTR)
+                        continue;
+                    if (result <= 0)
+                        break;
+
+                    done += static_cast<std::size_t>(result);
+                }
+
+                // notified under the lock, the engine may be gone as soon as it
+                // is released
+                std::lock_guard lock(finished_mutex);
+                finished.push_back({ slot, result < 0 ? -errno : static_cast<ssize_t>(done) });
+                finished_signal.notify_one();
+            });
+        }
+        queued.clear();
+
+        return count;
+    }
+
+    inline std::size_t async_file_engine::reap(std::span<file_completion> out, std::size_t min_completions) noexcept
+    {
+        min_completions = std::min({ min_completions, out.size(), outstanding });
+        std::size_t count = 0;
+
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring)
+        {
+            while (count < out.size())
+            {
+                io_uring_cqe* cqe = ring->peek_cqe();
+                if (cqe == nullptr)
+                {
+                    if (count >= min_completions)
+                        break;
+
+                    const int result = ring->submit(static_cast<unsigned>(min_completions - count));
+                    if (result < 0 && result != -EBUSY && result != -EINTR)
+                        break;
+                    continue;
+                }
+
+                const uint32_t slot = static_cast<uint32_t>(cqe->user_data);
+                const int32_t result = cqe->res;
+                ring->cqe_seen();
+
+                operation& op = operations[slot];
+                if (result > 0)
+                {
+                    op.done += static_cast<std::size_t>(result);
+
+                    // short transfer, the rest goes next
+                    if (op.done < op.length && ring_start(slot))
+                        continue;
+                }
+
+                out[count++] = complete(slot, result < 0 ? result : static_cast<ssize_t>(op.done));
+            }
+
+            // follow-ups queued while completing, like the rest of a short read
+            if (ring->pending() > 0)
+                ring->submit();
+
+            return count;
+        }
+        #endif
+
+        // queued operations only complete once the pool has them, like the
+        // ring submits what it waits for
+        if (!queued.empty())
+            submit();
+
+        std::unique_lock lock(finished_mutex);
+        finished_signal.wait(lock, [&]{ return finished.size() >= min_completions; });
+
+        while (count < out.size() && !finished.empty())
+        {
+            finished_operation done = finished.front();
+            finished.pop_front();
+            out[count++] = complete(done.slot, done.result);
+        }
+
+        return count;
+    }
+
+    inline file_completion async_file_engine::complete(uint32_t slot, ssize_t result) noexcept
+    {
+        const operation& op = operations[slot];
+
+        file_completion rval;
+        rval.user_data = op.user_data;
+
+        if (result < 0)
+        {
+            rval.error = error_code(error_domain::file_error, op.is_read ? error_code::failed_to_read_file
+                                                                         : error_code::failed_to_write_file);
+            if (op.is_read)
+                op.target->resize(0);
+        } else {
+            rval.bytes = static_cast<std::size_t>(result);
+            if (op.is_read)
+                op.target->resize(rval.bytes);
+        }
+
+        free_slots.push_back(slot);
+        outstanding--;
+
+        return rval;
+    }
+
+    inline int async_file_engine::fixed_slot(int fd) const noexcept
+    {
+        if (fd < 0)
+            return -1;
+
+        auto it = std::find(fixed_fds.begin(), fixed_fds.end(), fd);
+        return it == fixed_fds.end() ? -1 : static_cast<int>(it - fixed_fds.begin());
+    }
+
+    inline int async_file_engine::buffer_index(const std::byte* data, std::size_t length) const noexcept
+    {
+        for (std::size_t i = 0; i < registered_buffers.size(); ++i)
+        {
+            const std::byte* start = static_cast<const std::byte*>(registered_buffers[i].iov_base);
+            if (data >= start && data + length <= start + registered_buffers[i].iov_len)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+}
+
+#endif
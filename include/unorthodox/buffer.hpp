@@ -3,6 +3,7 @@
 
 #include <string>
 #include <compare>
+#include <span>
 #include <unistd.h>
 
 #include "util.hpp"
@@ -30,8 +31,8 @@ namespace unorthodox
 
             explicit buffer() noexcept = default;
 
-            constexpr buffer(const buffer& other) noexcept;
-            constexpr buffer(buffer&& other) noexcept;
+            buffer(const buffer& other) noexcept;
+            buffer(buffer&& other) noexcept;
 
             template <typename InputIt>
             constexpr buffer(InputIt first, InputIt last) noexcept;
@@ -45,13 +46,16 @@ namespace unorthodox
            ~buffer();
 
             // Assignment
-            constexpr buffer& operator=(const buffer& other) noexcept;
-            constexpr buffer& operator=(buffer&& other) noexcept;
+            buffer& operator=(const buffer& other) noexcept;
+            buffer& operator=(buffer&& other) noexcept;
 
             // Concatenating
             buffer& operator+=(const buffer& other) noexcept;
             buffer operator+(const buffer& other) noexcept;
 
+            void append(const_pointer source, size_type count) noexcept;
+            void append(std::span<const std::byte> source) noexcept { append(source.data(), source.size()); }
+
             // Element access
             constexpr reference operator[](const size_type index) noexcept;
             constexpr const_reference operator[](const size_type index) const noexcept;
@@ -63,6 +67,12 @@ namespace unorthodox
             // Capacity
             void            reserve(size_type) noexcept;
             void            resize(size_type) noexcept;
+            void            clear() noexcept { element_count = 0; read_pos = 0; }
+
+            // Room for at least count more bytes past the end, to be filled in
+            // place and then added with commit().  Empty if it cannot grow.
+            std::span<std::byte> prepare(size_type count) noexcept;
+            void            commit(size_type count) noexcept { element_count = std::min(element_count + count, current_size); }
 
             size_type       capacity() const noexcept { return current_size; }
             size_type       size() const noexcept { return element_count; }
@@ -122,7 +132,7 @@ namespace unorthodox
             using reference         = typename std::conditional<is_const, value_type const&, value_type&>::type;
 
             constexpr iterator_type() noexcept = default;
-            constexpr iterator_type(pointer ptr) noexcept : ptr(ptr) {}
+            constexpr iterator_type(pointer p) noexcept : ptr(p) {}
             constexpr iterator_type(const iterator& other) noexcept : ptr(other.ptr) {}
 
             template <bool B1, bool B2>
@@ -162,13 +172,11 @@ namespace unorthodox
 
 namespace unorthodox
 {
-    constexpr buffer::buffer(const buffer& other) noexcept
+    inline buffer::buffer(const buffer& other) noexcept
     {
-        reserve(other.element_count);
-        element_count = other.element_count;
-        nothrow_copy(other.begin(), other.end(), begin());
+        *this = other;
     }
-    constexpr buffer::buffer(buffer&& other) noexcept
+    inline buffer::buffer(buffer&& other) noexcept
     {
         *this = std::move(other);
     }
@@ -194,15 +202,34 @@ namespace unorthodox
             free(data_ptr);
     }
 
-    constexpr buffer& buffer::operator=(buffer&& other) noexcept
+    inline buffer& buffer::operator=(const buffer& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        clear();
+        append(other.data(), other.size());
+
+        return *this;
+    }
+
+    inline buffer& buffer::operator=(buffer&& other) noexcept
     {
+        if (this == &other)
+            return *this;
+
+        if (data_ptr != nullptr)
+            free(data_ptr);
+
         data_ptr = other.data_ptr;
         element_count = other.element_count;
         current_size = other.current_size;
+        read_pos = other.read_pos;
 
         other.data_ptr = nullptr;
         other.element_count = 0;
         other.current_size = 0;
+        other.read_pos = 0;
 
         return *this;
     }
@@ -241,6 +268,21 @@ namespace unorthodox
         return rval;
     }
 
+    inline void buffer::append(const_pointer source, size_type count) noexcept
+    {
+        if (count == 0)
+            return;
+
+        if (element_count + count > capacity())
+            grow(element_count + count - capacity());
+
+        if (element_count + count > capacity())
+            return;
+
+        std::memcpy(data_ptr + element_count, source, count);
+        element_count += count;
+    }
+
     // Access
     constexpr inline buffer::reference buffer::operator[](const buffer::size_type index) noexcept { return data_ptr[index]; }
     constexpr inline buffer::const_reference buffer::operator[](const buffer::size_type index) const noexcept { return data_ptr[index]; }
@@ -270,27 +312,32 @@ namespace unorthodox
         current_size = new_size;
     }
 
+    inline std::span<std::byte> buffer::prepare(size_type count) noexcept
+    {
+        if (element_count + count > capacity())
+            grow(element_count + count - capacity());
+
+        if (element_count + count > capacity())
+            return {};
+
+        return { data_ptr + element_count, current_size - element_count };
+    }
+
     inline void buffer::resize(size_type new_size) noexcept
     {
-        if (current_size == new_size)
-            return;
-        if (current_size > new_size)
+        if (element_count >= new_size)
         {
-            current_size = new_size;
-            if (element_count > new_size)
-                element_count = new_size;
-        } else {
-            void* new_ptr = realloc(data_ptr, new_size);
-            if (new_ptr == nullptr)
-                return;
-
-            data_ptr = static_cast<pointer>(new_ptr);
-
-            for (size_type i = current_size; i < new_size; ++i)
-                ::new(data_ptr + i)(std::byte);
-            current_size = new_size;
             element_count = new_size;
+            return;
         }
+
+        reserve(new_size);
+        if (current_size < new_size)
+            return;
+
+        for (size_type i = element_count; i < new_size; ++i)
+            ::new(data_ptr + i)(std::byte);
+        element_count = new_size;
     }
 
     // Read / Write
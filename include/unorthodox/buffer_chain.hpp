@@ -0,0 +1,221 @@
+#ifndef UNORTHODOX_BUFFER_CHAIN_HPP
+#define UNORTHODOX_BUFFER_CHAIN_HPP
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <utility>
+
+namespace unorthodox
+{
+    // A byte queue made of blocks.  Appending copies into the last block and
+    // adds one more when that is full, consuming from the front frees blocks as
+    // they empty.  Nothing is moved once written, so the queue can grow without
+    // copying what is already in it, and gather() hands the blocks to writev or
+    // sendmsg as they are.
+    class buffer_chain
+    {
+        public:
+            using size_type = std::size_t;
+
+            constexpr static size_type default_block_size = 16 * 1024;
+
+            explicit buffer_chain(size_type block_size = default_block_size) noexcept;
+
+            buffer_chain(buffer_chain&& other) noexcept;
+            buffer_chain& operator=(buffer_chain&& other) noexcept;
+
+            buffer_chain(const buffer_chain&) = delete;
+           ~buffer_chain();
+
+            // false if a block could not be allocated, nothing is appended then
+            bool        append(std::span<const std::byte> source) noexcept;
+
+            // Fills regions with the queued bytes from the front, returns how many
+            // regions were used
+            size_type   gather(std::span<iovec> regions) const noexcept;
+
+            // drops count bytes from the front
+            void        consume(size_type count) noexcept;
+            void        clear() noexcept { consume(total); }
+
+            size_type   size() const noexcept { return total; }
+            [[nodiscard]] bool empty() const noexcept { return total == 0; }
+
+        private:
+            // the bytes follow the header in the same allocation
+            struct block
+            {
+                block*      next        = nullptr;
+                size_type   capacity    = 0;
+                size_type   begin       = 0;
+                size_type   end         = 0;
+
+                std::byte*  data() noexcept { return reinterpret_cast<std::byte*>(this + 1); }
+            };
+
+            block*      allocate(size_type capacity) noexcept;
+            void        release(block* target) noexcept;
+
+            block*      head        = nullptr;
+            block*      tail        = nullptr;
+
+            // the last block emptied, kept so a queue that keeps draining and
+            // refilling does not go back to malloc every time
+            block*      spare       = nullptr;
+
+            size_type   block_size  = default_block_size;
+            size_type   total       = 0;
+    };
+}
+
+namespace unorthodox
+{
+    inline buffer_chain::buffer_chain(size_type in_block_size) noexcept : block_size(std::max<size_type>(in_block_size, 1))
+    {
+    }
+
+    inline buffer_chain::buffer_chain(buffer_chain&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline buffer_chain& buffer_chain::operator=(buffer_chain&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        clear();
+        std::free(spare);
+
+        head = other.head;
+        tail = other.tail;
+        spare = other.spare;
+        block_size = other.block_size;
+        total = other.total;
+
+        other.head = other.tail = other.spare = nullptr;
+        other.total = 0;
+
+        return *this;
+    }
+
+    inline buffer_chain::~buffer_chain()
+    {
+        clear();
+        std::free(spare);
+    }
+
+    inline buffer_chain::block* buffer_chain::allocate(size_type capacity) noexcept
+    {
+        if (spare != nullptr && spare->capacity >= capacity)
+        {
+            block* reused = spare;
+            spare = nullptr;
+
+            *reused = block{ nullptr, reused->capacity, 0, 0 };
+            return reused;
+        }
+
+        void* memory = std::malloc(sizeof(block) + capacity);
+        if (memory == nullptr)
+            return nullptr;
+
+        return ::new(memory) block{ nullptr, capacity, 0, 0 };
+    }
+
+    inline void buffer_chain::release(block* target) noexcept
+    {
+        // oversized blocks from big appends are not worth keeping
+        if (spare == nullptr && target->capacity == block_size)
+            spare = target;
+        else
+            std::free(target);
+    }
+
+    inline bool buffer_chain::append(std::span<const std::byte> source) noexcept
+    {
+        if (source.empty())
+            return true;
+
+        const size_type room = tail != nullptr ? tail->capacity - tail->end : 0;
+        const size_type into_tail = std::min(room, source.size());
+
+        // whatever does not fit goes into a single new block, large enough for
+        // all of it, so a big append is one allocation and one region
+        block* extra = nullptr;
+        if (into_tail < source.size())
+        {
+            extra = allocate(std::max(block_size, source.size() - into_tail));
+            if (extra == nullptr)
+                return false;
+        }
+
+        if (into_tail > 0)
+        {
+            std::memcpy(tail->data() + tail->end, source.data(), into_tail);
+            tail->end += into_tail;
+        }
+
+        if (extra != nullptr)
+        {
+            std::memcpy(extra->data(), source.data() + into_tail, source.size() - into_tail);
+            extra->end = source.size() - into_tail;
+
+            if (tail != nullptr)
+                tail->next = extra;
+            else
+                head = extra;
+            tail = extra;
+        }
+
+        total += source.size();
+        return true;
+    }
+
+    inline buffer_chain::size_type buffer_chain::gather(std::span<iovec> regions) const noexcept
+    {
+        size_type used = 0;
+
+        for (block* current = head; current != nullptr && used < regions.size(); current = current->next)
+        {
+            if (current->end == current->begin)
+                continue;
+
+            regions[used++] = iovec{ current->data() + current->begin, current->end - current->begin };
+        }
+
+        return used;
+    }
+
+    inline void buffer_chain::consume(size_type count) noexcept
+    {
+        count = std::min(count, total);
+        total -= count;
+
+        while (head != nullptr)
+        {
+            const size_type taken = std::min(count, head->end - head->begin);
+            head->begin += taken;
+            count -= taken;
+
+            if (head->begin < head->end)
+                break;
+
+            // empty blocks are not kept in the chain, the next append takes
+            // the spare one instead
+            block* drained = head;
+            head = head->next;
+            if (head == nullptr)
+                tail = nullptr;
+
+            release(drained);
+        }
+    }
+}
+
+#endif
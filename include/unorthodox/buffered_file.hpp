@@ -0,0 +1,537 @@
+#ifndef UNORTHODOX_BUFFERED_FILE_HPP
+#define UNORTHODOX_BUFFERED_FILE_HPP
+
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <limits.h>
+
+#include "buffer.hpp"
+#include "file.hpp"
+
+namespace unorthodox
+{
+    struct buffered_file_options
+    {
+        constexpr static std::size_t default_block_size = 1024 * 1024;
+
+        // size of a single I/O, rounded up to direct_io_alignment
+        std::size_t block_size      = default_block_size;
+
+        // writer: how many full blocks are gathered into a single writev
+        std::size_t batch_blocks    = 4;
+
+        // reader: how many blocks ahead of the read position to posix_fadvise
+        std::size_t read_ahead      = 4;
+
+        // O_DIRECT, bypasses the page cache.  Falls back to normal I/O if the
+        // filesystem refuses it, check is_direct() if it matters.
+        bool        direct_io       = false;
+    };
+
+    namespace detail
+    {
+        // O_DIRECT wants the memory, the offset and the length aligned to the
+        // logical block size of the device, 4k covers everything in practice
+        constexpr static std::size_t direct_io_alignment = 4096;
+
+        constexpr std::size_t align_up(std::size_t value, std::size_t alignment) noexcept
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        constexpr std::size_t align_down(std::size_t value, std::size_t alignment) noexcept
+        {
+            return value / alignment * alignment;
+        }
+
+        class aligned_block
+        {
+            public:
+                aligned_block() noexcept = default;
+                explicit aligned_block(std::size_t size) noexcept
+                {
+                    void* ptr = nullptr;
+                    if (posix_memalign(&ptr, direct_io_alignment, size) == 0)
+                    {
+                        data_ptr = static_cast<std::byte*>(ptr);
+                        block_size = size;
+                    }
+                }
+
+                aligned_block(aligned_block&& other) noexcept { *this = std::move(other); }
+                aligned_block& operator=(aligned_block&& other) noexcept
+                {
+                    std::swap(data_ptr, other.data_ptr);
+                    std::swap(block_size, other.block_size);
+                    return *this;
+                }
+
+                aligned_block(const aligned_block&) = delete;
+
+               ~aligned_block() { free(data_ptr); }
+
+                std::byte*  data() const noexcept { return data_ptr; }
+                std::size_t size() const noexcept { return block_size; }
+
+            private:
+                std::byte*  data_ptr    = nullptr;
+                std::size_t block_size  = 0;
+        };
+
+        // switches O_DIRECT on an already open descriptor, returns the old flags
+        inline int enable_direct_io(int fd, bool& direct) noexcept
+        {
+            int old_flags = fcntl(fd, F_GETFL);
+            if (!direct || old_flags == -1)
+            {
+                direct = false;
+                return old_flags;
+            }
+
+            #if defined(O_DIRECT)
+            if (fcntl(fd, F_SETFL, old_flags | O_DIRECT) == -1)
+                direct = false;
+            #else
+            direct = false;
+            #endif
+
+            return old_flags;
+        }
+    }
+
+    class buffered_file_reader
+    {
+        public:
+            explicit buffered_file_reader(file& source, buffered_file_options options = {}) noexcept;
+           ~buffered_file_reader();
+
+            buffered_file_reader(const buffered_file_reader&) = delete;
+
+            // Appends up to count bytes to target, returns the amount read, 0 at end of file
+            tl::expected<std::size_t, error_code> read(buffer& target, std::size_t count) noexcept;
+            tl::expected<std::size_t, error_code> read(buffer& target) noexcept { return read(target, opts.block_size); }
+
+            error_code  seek(std::size_t offset) noexcept;
+            std::size_t tell() const noexcept { return block_offset + block_pos; }
+
+            bool        eof() const noexcept { return at_end && block_pos == block_fill; }
+            bool        is_direct() const noexcept { return opts.direct_io; }
+
+            error_code  error() const noexcept { return status; }
+
+        private:
+            error_code  fill() noexcept;
+            void        advise_ahead() noexcept;
+
+            file&                   source;
+            buffered_file_options   opts;
+            detail::aligned_block   block;
+
+            int                     original_flags  = -1;
+
+            std::size_t             block_offset    = 0;
+            std::size_t             block_fill      = 0;
+            std::size_t             block_pos       = 0;
+            std::size_t             advised_until   = 0;
+
+            bool                    at_end          = false;
+            error_code              status          = error_code::success;
+    };
+
+    class buffered_file_writer
+    {
+        public:
+            // starts writing at the current end of the file
+            explicit buffered_file_writer(file& target, buffered_file_options options = {}) noexcept;
+           ~buffered_file_writer();
+
+            buffered_file_writer(const buffered_file_writer&) = delete;
+
+            tl::expected<std::size_t, error_code> write(std::span<const std::byte> data) noexcept;
+            tl::expected<std::size_t, error_code> write(const buffer& data) noexcept { return write(std::span<const std::byte>(data.data(), data.size())); }
+
+            // Writes out everything that is buffered, including a partial block
+            error_code  flush() noexcept;
+
+            // flush() and fdatasync()
+            error_code  sync() noexcept;
+
+            std::size_t tell() const noexcept { return file_offset + pending_bytes(); }
+            bool        is_direct() const noexcept { return opts.direct_io; }
+
+            error_code  error() const noexcept { return status; }
+
+        private:
+            std::size_t pending_bytes() const noexcept { return current_block * opts.block_size + block_fill; }
+            error_code  write_out(std::size_t full_blocks, std::span<const std::byte> extra) noexcept;
+
+            file&                               target;
+            buffered_file_options               opts;
+            std::vector<detail::aligned_block>  blocks;
+
+            int                                 original_flags  = -1;
+
+            // file_offset is where blocks[0] goes in the file
+            std::size_t                         file_offset     = 0;
+            std::size_t                         current_block   = 0;
+            std::size_t                         block_fill      = 0;
+
+            // direct I/O writes the last partial block padded, so the file has to
+            // be truncated back to its real size
+            std::size_t                         logical_size    = 0;
+
+            error_code                          status          = error_code::success;
+    };
+}
+
+namespace unorthodox
+{
+    // Reader
+    // ------
+    inline buffered_file_reader::buffered_file_reader(file& in_source, buffered_file_options options) noexcept
+        : source(in_source), opts(options)
+    {
+        opts.block_size = detail::align_up(std::max<std::size_t>(opts.block_size, 1), detail::direct_io_alignment);
+        block = detail::aligned_block(opts.block_size);
+
+        if (block.data() == nullptr || !source)
+        {
+            status = error_code(error_domain::file_error, error_code::uninitialised_value);
+            at_end = true;
+            return;
+        }
+
+        original_flags = detail::enable_direct_io(source.native_handle(), opts.direct_io);
+
+        // the page cache is not in play with O_DIRECT, so advising it is pointless
+        if (!opts.direct_io)
+            source.advise(file::access_hint::sequential);
+    }
+
+    inline buffered_file_reader::~buffered_file_reader()
+    {
+        if (opts.direct_io && original_flags != -1)
+            fcntl(source.native_handle(), F_SETFL, original_flags);
+    }
+
+    inline tl::expected<std::size_t, error_code> buffered_file_reader::read(buffer& target, std::size_t count) noexcept
+    {
+        if (status)
+            return tl::unexpected(status);
+
+        std::size_t total = 0;
+
+        while (total < count)
+        {
+            if (block_pos == block_fill)
+            {
+                if (at_end)
+                    break;
+
+                // large reads skip the intermediate copy and go straight to the buffer
+                const std::size_t left = count - total;
+                if (!opts.direct_io && left >= opts.block_size)
+                {
+                    const std::size_t offset = block_offset + block_fill;
+                    const std::size_t old_size = target.size();
+
+                    target.resize(old_size + left);
+                    if (target.size() != old_size + left)
+                        return tl::unexpected(error_code(error_domain::file_error, error_code::failed_to_read_file));
+
+                    auto result = source.read(std::span<std::byte>(target.data() + old_size, left), offset);
+                    if (!result)
+                    {
+                        target.resize(old_size);
+                        status = result.error();
+                        return tl::unexpected(status);
+                    }
+
+                    target.resize(old_size + *result);
+                    total += *result;
+
+                    block_offset = offset + *result;
+                    block_fill = block_pos = 0;
+                    at_end = *result < left;
+
+                    advise_ahead();
+                    continue;
+                }
+
+                if (error_code err = fill(); err)
+                    return tl::unexpected(err);
+
+                continue;
+            }
+
+            const std::size_t amount = std::min(count - total, block_fill - block_pos);
+            target.append(block.data() + block_pos, amount);
+
+            block_pos += amount;
+            total += amount;
+        }
+
+        return total;
+    }
+
+    inline error_code buffered_file_reader::seek(std::size_t offset) noexcept
+    {
+        if (status)
+            return status;
+
+        if (offset >= block_offset && offset <= block_offset + block_fill)
+        {
+            block_pos = offset - block_offset;
+            return error_code::success;
+        }
+
+        // direct I/O can only start from an aligned offset
+        block_offset = detail::align_down(offset, detail::direct_io_alignment);
+        block_fill = block_pos = 0;
+        at_end = false;
+        advised_until = block_offset;
+
+        if (error_code err = fill(); err)
+            return err;
+
+        block_pos = std::min(offset - block_offset, block_fill);
+        return error_code::success;
+    }
+
+    inline error_code buffered_file_reader::fill() noexcept
+    {
+        block_offset += block_fill;
+        block_fill = block_pos = 0;
+
+        ssize_t n = 0;
+        do
+        {
+            n = ::pread(source.native_handle(), block.data(), block.size(), static_cast<off_t>(block_offset));
+        } while (n == -1 && errno == EINTR);
+
+        if (n == -1)
+        {
+            status = error_code(error_domain::file_error, error_code::failed_to_read_file);
+            return status;
+        }
+
+        block_fill = static_cast<std::size_t>(n);
+        at_end = block_fill < block.size();
+
+        advise_ahead();
+        return error_code::success;
+    }
+
+    inline void buffered_file_reader::advise_ahead() noexcept
+    {
+        if (opts.direct_io || opts.read_ahead == 0 || at_end)
+            return;
+
+        const std::size_t window_start = block_offset + block_fill;
+        const std::size_t window_end = window_start + opts.read_ahead * opts.block_size;
+
+        // only advise the part we have not asked for yet, and only once half
+        // of the previous window has been used up so we do not call it every block
+        if (advised_until > window_start + opts.read_ahead * opts.block_size / 2)
+            return;
+
+        const std::size_t start = std::max(advised_until, window_start);
+        source.advise(file::access_hint::willneed, start, window_end - start);
+        advised_until = window_end;
+    }
+
+    // Writer
+    // ------
+    inline buffered_file_writer::buffered_file_writer(file& in_target, buffered_file_options options) noexcept
+        : target(in_target), opts(options)
+    {
+        opts.block_size = detail::align_up(std::max<std::size_t>(opts.block_size, 1), detail::direct_io_alignment);
+        opts.batch_blocks = std::clamp<std::size_t>(opts.batch_blocks, 1, IOV_MAX - 1);
+
+        if (!target)
+        {
+            status = error_code(error_domain::file_error, error_code::uninitialised_value);
+            return;
+        }
+
+        blocks.reserve(opts.batch_blocks);
+        for (std::size_t i = 0; i < opts.batch_blocks; ++i)
+        {
+            blocks.emplace_back(opts.block_size);
+            if (blocks.back().data() == nullptr)
+            {
+                status = error_code(error_domain::file_error, error_code::uninitialised_value);
+                return;
+            }
+        }
+
+        file_offset = target.size();
+        logical_size = file_offset;
+
+        // can't do direct I/O from the middle of a block
+        if (file_offset % detail::direct_io_alignment != 0)
+            opts.direct_io = false;
+
+        original_flags = detail::enable_direct_io(target.native_handle(), opts.direct_io);
+    }
+
+    inline buffered_file_writer::~buffered_file_writer()
+    {
+        flush();
+
+        if (opts.direct_io && original_flags != -1)
+            fcntl(target.native_handle(), F_SETFL, original_flags);
+    }
+
+    inline tl::expected<std::size_t, error_code> buffered_file_writer::write(std::span<const std::byte> data) noexcept
+    {
+        if (status)
+            return tl::unexpected(status);
+
+        const std::size_t total = data.size();
+
+        while (!data.empty())
+        {
+            // big chunks of data can go out with the batch as they are, but with
+            // direct I/O the data has to be in our aligned blocks anyway
+            if (!opts.direct_io && block_fill == 0 && data.size() >= opts.block_size)
+            {
+                if (error_code err = write_out(current_block, data); err)
+                    return tl::unexpected(err);
+                break;
+            }
+
+            const std::size_t amount = std::min(data.size(), opts.block_size - block_fill);
+            std::memcpy(blocks[current_block].data() + block_fill, data.data(), amount);
+
+            block_fill += amount;
+            data = data.subspan(amount);
+
+            if (block_fill < opts.block_size)
+                continue;
+
+            current_block++;
+            block_fill = 0;
+
+            if (current_block == blocks.size())
+            {
+                if (error_code err = write_out(current_block, {}); err)
+                    return tl::unexpected(err);
+            }
+        }
+
+        return total;
+    }
+
+    inline error_code buffered_file_writer::flush() noexcept
+    {
+        if (status)
+            return status;
+
+        if (error_code err = write_out(current_block, {}); err)
+            return err;
+
+        if (block_fill == 0)
+            return error_code::success;
+
+        const std::size_t padded = opts.direct_io ? detail::align_up(block_fill, detail::direct_io_alignment) : block_fill;
+
+        auto result = target.write(std::span<const std::byte>(blocks[0].data(), padded), file_offset);
+        if (!result)
+        {
+            status = result.error();
+            return status;
+        }
+
+        if (!opts.direct_io)
+        {
+            file_offset += block_fill;
+            logical_size = file_offset;
+            block_fill = 0;
+            return error_code::success;
+        }
+
+        // keep the partial block around, it gets rewritten in full when it
+        // fills up, and cut off the padding from the file for now
+        logical_size = file_offset + block_fill;
+        if (target.resize(logical_size))
+        {
+            status = error_code(error_domain::file_error, error_code::failed_to_resize_file);
+            return status;
+        }
+
+        return error_code::success;
+    }
+
+    inline error_code buffered_file_writer::sync() noexcept
+    {
+        if (error_code err = flush(); err)
+            return err;
+
+        return target.sync();
+    }
+
+    // Writes the first full_blocks blocks and extra with one pwritev, leaves
+    // the partial block (if any) as the first block
+    inline error_code buffered_file_writer::write_out(std::size_t full_blocks, std::span<const std::byte> extra) noexcept
+    {
+        iovec io[IOV_MAX];
+        int io_count = 0;
+
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < full_blocks; ++i)
+        {
+            io[io_count++] = { blocks[i].data(), opts.block_size };
+            bytes += opts.block_size;
+        }
+
+        if (!extra.empty())
+        {
+            io[io_count++] = { const_cast<std::byte*>(extra.data()), extra.size() };
+            bytes += extra.size();
+        }
+
+        std::size_t written = 0;
+        int first = 0;
+        while (written < bytes)
+        {
+            ssize_t n = ::pwritev(target.native_handle(), io + first, io_count - first, static_cast<off_t>(file_offset + written));
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                status = error_code(error_domain::file_error, error_code::failed_to_write_file);
+                return status;
+            }
+
+            written += static_cast<std::size_t>(n);
+
+            // skip over whatever got written in full and adjust the partial one
+            std::size_t advance = static_cast<std::size_t>(n);
+            while (first < io_count && advance >= io[first].iov_len)
+                advance -= io[first++].iov_len;
+
+            if (first < io_count)
+            {
+                io[first].iov_base = static_cast<std::byte*>(io[first].iov_base) + advance;
+                io[first].iov_len -= advance;
+            }
+        }
+
+        file_offset += bytes;
+        logical_size = std::max(logical_size, file_offset);
+
+        // move the partially filled block to the front
+        if (full_blocks > 0 && full_blocks < blocks.size())
+            std::swap(blocks[0], blocks[full_blocks]);
+
+        current_block = 0;
+        return error_code::success;
+    }
+}
+
+#endif
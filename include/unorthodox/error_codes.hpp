@@ -12,6 +12,7 @@ namespace unorthodox
     {
         generic_error = 0,
         network_error = 1,
+        file_error    = 2,
     };
 
     // to be split to error_value and error_code
@@ -28,6 +29,7 @@ namespace unorthodox
         constexpr static err_value_type connection_reset        = 0xe003;
         constexpr static err_value_type uninitialised_value     = 0xe004;
         constexpr static err_value_type unimplemented_feature   = 0xe005;
+        constexpr static err_value_type invalid_argument        = 0xe006;
 
         // network
         constexpr static err_value_type setsockopt_failed       = 0xe010;
@@ -37,6 +39,24 @@ namespace unorthodox
         constexpr static err_value_type no_active_socket        = 0xe014;
         constexpr static err_value_type failed_to_send_data     = 0xe015;
         constexpr static err_value_type wrong_socket_type       = 0xe016;
+        constexpr static err_value_type would_block             = 0xe017;
+        constexpr static err_value_type host_not_found          = 0xe018;
+        constexpr static err_value_type invalid_frame           = 0xe019;
+
+        // files
+        constexpr static err_value_type cannot_open_file        = 0xe020;
+        constexpr static err_value_type cannot_map_file         = 0xe021;
+        constexpr static err_value_type file_not_mapped         = 0xe022;
+        constexpr static err_value_type failed_to_read_file     = 0xe023;
+        constexpr static err_value_type failed_to_write_file    = 0xe024;
+        constexpr static err_value_type failed_to_resize_file   = 0xe025;
+
+        // processes
+        constexpr static err_value_type cannot_create_pipe      = 0xe030;
+        constexpr static err_value_type cannot_spawn_process    = 0xe031;
+        constexpr static err_value_type no_such_process         = 0xe032;
+        constexpr static err_value_type process_crashed         = 0xe033;
+        constexpr static err_value_type broken_pipe             = 0xe034;
 
         // platform-specific
         constexpr static err_value_type poll_error              = 0xe100;
@@ -1,26 +1,25 @@
 #ifndef UNORTHODOX_FILE_HPP
 #define UNORTHODOX_FILE_HPP
 
-#include <unistd.h>
-#include <fcntl.h>
+#include <span>
 
-#include "util.hpp"
-#include "error_codes.hpp"
-
-namespace unorthodox
-{
 #ifdef _WIN32
+# error file is not implemented for WIN32 yet
 #else
+# include <unistd.h>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
 #endif
-}
+
+#include "util.hpp"
+#include "error_codes.hpp"
 
 namespace unorthodox
 {
     class file
     {
         public:
-            template <bool is_const> class iterator_type;
-
             using value_type        = std::byte;
             using size_type         = std::size_t;
             using difference_type   = std::ptrdiff_t;
@@ -29,8 +28,9 @@ namespace unorthodox
             using pointer           = std::byte*;
             using const_pointer     = const std::byte*;
 
-            using iterator          = iterator_type<false>;
-            using const_iterator    = iterator_type<true>;
+            // mapped files are contiguous, so plain pointers will do
+            using iterator          = pointer;
+            using const_iterator    = const_pointer;
         /*
         _O_APPEND                       O_APPEND
                                         O_ASYNC
@@ -77,80 +77,382 @@ namespace unorthodox
             
             constexpr static flagset RW         = READ | WRITE;
 
+            // hints for the kernel on how the file is going to be accessed
+            enum class access_hint
+            {
+                normal,
+                sequential,
+                random,
+                willneed,
+                dontneed,
+            };
+
             // use these to get actual file instances
             static file open(const char* file, flagset flags = READ | WRITE) noexcept;
             static file create(const char* file, flagset flags) noexcept;
 
+            file(file&& other) noexcept;
+            file& operator=(file&& other) noexcept;
+
+            file(const file&) = delete;
+            file& operator=(const file&) = delete;
+
            ~file();
 
-            void close();
+            void close() noexcept;
 
             // check if we're valid
-            operator bool() { return fd >= 0; }
+            operator bool() const noexcept { return fd >= 0; }
 
             // retrieve error if something has gone wrong
-            error_code error() { return fd < 0 ? fd : 0; }
+            error_code error() const noexcept { return status; }
+
+            // Capacity
+            size_type       size() const noexcept;
+            error_code      resize(size_type new_size) noexcept;
+
+            [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+            // Mapped access, these are only valid if the file was opened with MMAP
+            bool            is_mapped() const noexcept { return mmapped; }
+
+            pointer         data() noexcept { return mapping; }
+            const_pointer   data() const noexcept { return mapping; }
+
+            iterator        begin() noexcept { return mapping; }
+            const_iterator  begin() const noexcept { return mapping; }
+            iterator        end() noexcept { return mapping + mapping_size; }
+            const_iterator  end() const noexcept { return mapping + mapping_size; }
+
+            const_iterator  cbegin() const noexcept { return mapping; }
+            const_iterator  cend() const noexcept { return mapping + mapping_size; }
+
+            std::span<std::byte>        span() noexcept { return { mapping, mapping_size }; }
+            std::span<const std::byte>  span() const noexcept { return { mapping, mapping_size }; }
+
+            // Length of 0 means "until the end of the file"
+            error_code      advise(access_hint hint, size_type offset = 0, size_type length = 0) const noexcept;
+
+            // Flush written data to the storage device
+            error_code      sync() noexcept;
+
+            // Positional read / write, does not touch the file offset
+            tl::expected<size_type, error_code> read(std::span<std::byte> target, size_type offset) const noexcept;
+            tl::expected<size_type, error_code> write(std::span<const std::byte> source, size_type offset) noexcept;
+
+            int             native_handle() const noexcept { return fd; }
+            flagset         flags() const noexcept { return open_flags; }
 
         private:
-            static inline int translate_flags(flagset flags);
+            static inline int translate_flags(flagset flags) noexcept;
+            static file open_with(const char* file, flagset flags, int extra_flags) noexcept;
+
+            error_code map() noexcept;
+            void unmap() noexcept;
 
             // do not allow straight constructing
             file() = default;
 
-            int fd: 31 = error_code::uninitialised_value;
-            bool mmapped : 1 = false;
+            int         fd              = -1;
+            flagset     open_flags      = 0;
+            bool        mmapped         = false;
+
+            error_code  status          = error_code(error_domain::file_error, error_code::uninitialised_value);
+
+            pointer     mapping         = nullptr;
+            size_type   mapping_size    = 0;
     };
 }
 
 namespace unorthodox
 {
-    /*
-    inline int file::translate_flags(flagset flags)
+    inline int file::translate_flags(flagset flags) noexcept
     {
-        int rval = 0;
-        #ifdef _WIN32
-        #else
+        int rval = O_CLOEXEC;
+
         // POSIX
+        // mmap needs the descriptor to be readable even if we only write
         if ((flags & READ) && (flags & WRITE)) rval |= O_RDWR;
+        else if ((flags & WRITE) && (flags & MMAP)) rval |= O_RDWR;
         else if (flags & WRITE)  rval |= O_WRONLY;
         else rval |= O_RDONLY;
 
         if (flags & APPEND) rval |= O_APPEND;
+        if (flags & TRUNCATE) rval |= O_TRUNC;
 
-        #endif
         return rval;
     }
 
-    file file::open(const char* filename, flagset flags) noexcept
+    inline file file::open_with(const char* filename, flagset flags, int extra_flags) noexcept
     {
         file rval;
+        rval.open_flags = flags;
 
-        int filed = ::open(filename, translate_flags(flags));
+        int filed = ::open(filename, translate_flags(flags) | extra_flags, 0644);
         if (filed == -1)
-            rval.fd = translate_error(errno);
-        else
-            rval.fd = filed;
+        {
+            rval.status = error_code(error_domain::file_error, error_code::cannot_open_file);
+            return rval;
+        }
+
+        rval.fd = filed;
+        rval.status = error_code::success;
+
+        if (flags & MMAP)
+        {
+            rval.status = rval.map();
+            if (rval.status)
+                rval.close();
+        }
 
         return rval;
     }
 
-    file file::create(const char* filename, flagset flags) noexcept
+    inline file file::open(const char* filename, flagset flags) noexcept
     {
-        return file();
+        return open_with(filename, flags, 0);
     }
 
-    file::~file()
+    inline file file::create(const char* filename, flagset flags) noexcept
+    {
+        return open_with(filename, flags | WRITE, O_CREAT);
+    }
+
+    inline file::file(file&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline file& file::operator=(file&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        close();
+
+        fd = other.fd;
+        open_flags = other.open_flags;
+        mmapped = other.mmapped;
+        status = other.status;
+        mapping = other.mapping;
+        mapping_size = other.mapping_size;
+
+        other.fd = -1;
+        other.mmapped = false;
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+        other.status = error_code(error_domain::file_error, error_code::uninitialised_value);
+
+        return *this;
+    }
+
+    inline file::~file()
     {
         close();
     }
 
-    void file::close()
+    inline void file::close() noexcept
     {
+        unmap();
+
         if (fd >= 0)
             ::close(fd);
         fd = -1;
     }
-    */
+
+    inline file::size_type file::size() const noexcept
+    {
+        if (mmapped)
+            return mapping_size;
+
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) == -1)
+            return 0;
+
+        return static_cast<size_type>(info.st_size);
+    }
+
+    inline error_code file::resize(size_type new_size) noexcept
+    {
+        if (fd < 0)
+            return error_code(error_domain::file_error, error_code::uninitialised_value);
+
+        if (ftruncate(fd, static_cast<off_t>(new_size)) == -1)
+            return error_code(error_domain::file_error, error_code::failed_to_resize_file);
+
+        if (!mmapped)
+            return error_code::success;
+
+        #if defined(__linux__)
+        if (mapping != nullptr && new_size != 0)
+        {
+            void* new_mapping = mremap(mapping, mapping_size, new_size, MREMAP_MAYMOVE);
+            if (new_mapping == MAP_FAILED)
+                return error_code(error_domain::file_error, error_code::cannot_map_file);
+
+            mapping = static_cast<pointer>(new_mapping);
+            mapping_size = new_size;
+            return error_code::success;
+        }
+        #endif
+
+        unmap();
+        return map();
+    }
+
+    inline error_code file::advise(access_hint hint, size_type offset, size_type length) const noexcept
+    {
+        if (fd < 0)
+            return error_code(error_domain::file_error, error_code::uninitialised_value);
+
+        if (mmapped)
+        {
+            if (mapping == nullptr || offset >= mapping_size)
+                return error_code::success;
+
+            if (length == 0 || offset + length > mapping_size)
+                length = mapping_size - offset;
+
+            // madvise wants a page-aligned address
+            const size_type page_size = static_cast<size_type>(sysconf(_SC_PAGESIZE));
+            const size_type aligned_offset = offset - offset % page_size;
+            length += offset - aligned_offset;
+
+            int advice = MADV_NORMAL;
+            switch (hint)
+            {
+                case access_hint::normal:       advice = MADV_NORMAL;       break;
+                case access_hint::sequential:   advice = MADV_SEQUENTIAL;   break;
+                case access_hint::random:       advice = MADV_RANDOM;       break;
+                case access_hint::willneed:     advice = MADV_WILLNEED;     break;
+                case access_hint::dontneed:     advice = MADV_DONTNEED;     break;
+            }
+
+            if (madvise(mapping + aligned_offset, length, advice) == -1)
+                return error_code(error_domain::file_error, error_code::undefined_error);
+
+            return error_code::success;
+        }
+
+        int advice = POSIX_FADV_NORMAL;
+        switch (hint)
+        {
+            case access_hint::normal:       advice = POSIX_FADV_NORMAL;     break;
+            case access_hint::sequential:   advice = POSIX_FADV_SEQUENTIAL; break;
+            case access_hint::random:       advice = POSIX_FADV_RANDOM;     break;
+            case access_hint::willneed:     advice = POSIX_FADV_WILLNEED;   break;
+            case access_hint::dontneed:     advice = POSIX_FADV_DONTNEED;   break;
+        }
+
+        if (posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), advice) != 0)
+            return error_code(error_domain::file_error, error_code::undefined_error);
+
+        return error_code::success;
+    }
+
+    inline error_code file::sync() noexcept
+    {
+        if (fd < 0)
+            return error_code(error_domain::file_error, error_code::uninitialised_value);
+
+        if (mmapped && mapping != nullptr && (open_flags & WRITE))
+        {
+            if (msync(mapping, mapping_size, MS_SYNC) == -1)
+                return error_code(error_domain::file_error, error_code::failed_to_write_file);
+        }
+
+        if (fdatasync(fd) == -1)
+            return error_code(error_domain::file_error, error_code::failed_to_write_file);
+
+        return error_code::success;
+    }
+
+    inline tl::expected<file::size_type, error_code> file::read(std::span<std::byte> target, size_type offset) const noexcept
+    {
+        if (fd < 0)
+            return tl::unexpected(error_code(error_domain::file_error, error_code::uninitialised_value));
+
+        size_type total = 0;
+        while (total < target.size())
+        {
+            ssize_t n = ::pread(fd, target.data() + total, target.size() - total, static_cast<off_t>(offset + total));
+            if (n == 0)
+                break;
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                return tl::unexpected(error_code(error_domain::file_error, error_code::failed_to_read_file));
+            }
+            total += static_cast<size_type>(n);
+        }
+
+        return total;
+    }
+
+    inline tl::expected<file::size_type, error_code> file::write(std::span<const std::byte> source, size_type offset) noexcept
+    {
+        if (fd < 0)
+            return tl::unexpected(error_code(error_domain::file_error, error_code::uninitialised_value));
+
+        size_type total = 0;
+        while (total < source.size())
+        {
+            ssize_t n = ::pwrite(fd, source.data() + total, source.size() - total, static_cast<off_t>(offset + total));
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                return tl::unexpected(error_code(error_domain::file_error, error_code::failed_to_write_file));
+            }
+            total += static_cast<size_type>(n);
+        }
+
+        return total;
+    }
+
+    // private functions
+    // -----------------
+
+    inline error_code file::map() noexcept
+    {
+        struct stat info;
+        if (fstat(fd, &info) == -1)
+            return error_code(error_domain::file_error, error_code::cannot_map_file);
+
+        mmapped = true;
+        mapping = nullptr;
+        mapping_size = static_cast<size_type>(info.st_size);
+
+        // zero-length mappings are not allowed, treat those as an empty range
+        if (mapping_size == 0)
+            return error_code::success;
+
+        // read-only mapping unless we asked for write access, in which case
+        // writes are shared with the file
+        const int protection = (open_flags & WRITE) ? PROT_READ | PROT_WRITE : PROT_READ;
+
+        void* result = mmap(nullptr, mapping_size, protection, MAP_SHARED, fd, 0);
+        if (result == MAP_FAILED)
+        {
+            mmapped = false;
+            mapping_size = 0;
+            return error_code(error_domain::file_error, error_code::cannot_map_file);
+        }
+
+        mapping = static_cast<pointer>(result);
+        return error_code::success;
+    }
+
+    inline void file::unmap() noexcept
+    {
+        if (mapping != nullptr)
+            munmap(mapping, mapping_size);
+
+        mapping = nullptr;
+        mapping_size = 0;
+        mmapped = false;
+    }
 }
 
 #endif
@@ -0,0 +1,325 @@
+#ifndef UNORTHODOX_LINUX_IO_URING_HPP
+#define UNORTHODOX_LINUX_IO_URING_HPP
+
+#if !defined(__linux__)
+# error io_uring is only available on Linux
+#endif
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+#include <unorthodox/error_codes.hpp>
+
+namespace unorthodox
+{
+    // Minimal io_uring ring, talks to the kernel directly so there is no
+    // dependency on liburing.  Not thread-safe, one thread submits and reaps.
+    class io_uring
+    {
+        public:
+            static io_uring setup(unsigned entries, unsigned flags = 0) noexcept;
+
+            io_uring(io_uring&& other) noexcept;
+            io_uring& operator=(io_uring&& other) noexcept;
+
+            io_uring(const io_uring&) = delete;
+            io_uring& operator=(const io_uring&) = delete;
+
+           ~io_uring();
+
+            operator bool() const noexcept { return ring_fd >= 0; }
+            error_code error() const noexcept { return status; }
+
+            // Next free submission entry, zeroed, or nullptr if the queue is full.
+            // Nothing reaches the kernel before submit().
+            io_uring_sqe*   get_sqe() noexcept;
+
+            // Submits everything prepared since the last call with a single
+            // io_uring_enter, optionally waiting for completions
+            int             submit(unsigned wait_for = 0) noexcept;
+            unsigned        pending() const noexcept { return sqe_tail - sqe_head; }
+
+            // nullptr if there is no completion available
+            io_uring_cqe*   peek_cqe() noexcept;
+            void            cqe_seen() noexcept;
+
+            int             register_buffers(std::span<const iovec> buffers) noexcept;
+            int             unregister_buffers() noexcept;
+
+            // -1 entries leave the slot empty, those can be filled later with update_files
+            int             register_files(std::span<const int> fds) noexcept;
+            int             update_files(unsigned offset, std::span<const int> fds) noexcept;
+            int             unregister_files() noexcept;
+
+            int             register_raw(unsigned opcode, const void* arg, unsigned count) noexcept;
+
+            unsigned        sq_entries() const noexcept { return params.sq_entries; }
+            unsigned        features() const noexcept { return params.features; }
+            int             native_handle() const noexcept { return ring_fd; }
+
+        private:
+            io_uring() = default;
+
+            void release() noexcept;
+
+            int             ring_fd         = -1;
+            error_code      status          = error_code(error_domain::generic_error, error_code::uninitialised_value);
+            io_uring_params params{};
+
+            void*           sq_ring         = nullptr;
+            std::size_t     sq_ring_size    = 0;
+            void*           cq_ring         = nullptr;
+            std::size_t     cq_ring_size    = 0;
+            io_uring_sqe*   sqes            = nullptr;
+
+            unsigned*       sq_head         = nullptr;
+            unsigned*       sq_tail         = nullptr;
+            unsigned*       sq_mask         = nullptr;
+            unsigned*       sq_array        = nullptr;
+
+            unsigned*       cq_head         = nullptr;
+            unsigned*       cq_tail         = nullptr;
+            unsigned*       cq_mask         = nullptr;
+            io_uring_cqe*   cqes            = nullptr;
+
+            // prepared but not yet submitted entries are [sqe_head, sqe_tail)
+            unsigned        sqe_head        = 0;
+            unsigned        sqe_tail        = 0;
+    };
+}
+
+namespace unorthodox
+{
+    namespace detail
+    {
+        inline unsigned load_acquire(unsigned* p) noexcept
+        {
+            return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+        }
+
+        inline void store_release(unsigned* p, unsigned value) noexcept
+        {
+            std::atomic_ref<unsigned>(*p).store(value, std::memory_order_release);
+        }
+
+        template <typename T>
+        T* ring_offset(void* base, unsigned offset) noexcept
+        {
+            return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+        }
+    }
+
+    inline io_uring io_uring::setup(unsigned entries, unsigned flags) noexcept
+    {
+        io_uring rval;
+        rval.params.flags = flags;
+
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &rval.params));
+        if (fd < 0)
+        {
+            // ENOSYS on old kernels, EPERM when disabled by sysctl or seccomp
+            rval.status = error_code(error_domain::generic_error, errno == EPERM ? error_code::access_denied
+                                                                                 : error_code::unimplemented_feature);
+            return rval;
+        }
+
+        rval.ring_fd = fd;
+
+        io_uring_params& p = rval.params;
+        rval.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        rval.cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+        const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            rval.sq_ring_size = rval.cq_ring_size = std::max(rval.sq_ring_size, rval.cq_ring_size);
+
+        rval.sq_ring = mmap(nullptr, rval.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (rval.sq_ring == MAP_FAILED)
+        {
+            rval.sq_ring = nullptr;
+            rval.release();
+            rval.status = error_code(error_domain::generic_error, error_code::undefined_error);
+            return rval;
+        }
+
+        if (single_mmap)
+        {
+            rval.cq_ring = rval.sq_ring;
+        } else {
+            rval.cq_ring = mmap(nullptr, rval.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (rval.cq_ring == MAP_FAILED)
+            {
+                rval.cq_ring = nullptr;
+                rval.release();
+                rval.status = error_code(error_domain::generic_error, error_code::undefined_error);
+                return rval;
+            }
+        }
+
+        void* sqe_memory = mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqe_memory == MAP_FAILED)
+        {
+            rval.release();
+            rval.status = error_code(error_domain::generic_error, error_code::undefined_error);
+            return rval;
+        }
+        rval.sqes = static_cast<io_uring_sqe*>(sqe_memory);
+
+        rval.sq_head  = detail::ring_offset<unsigned>(rval.sq_ring, p.sq_off.head);
+        rval.sq_tail  = detail::ring_offset<unsigned>(rval.sq_ring, p.sq_off.tail);
+        rval.sq_mask  = detail::ring_offset<unsigned>(rval.sq_ring, p.sq_off.ring_mask);
+        rval.sq_array = detail::ring_offset<unsigned>(rval.sq_ring, p.sq_off.array);
+
+        rval.cq_head  = detail::ring_offset<unsigned>(rval.cq_ring, p.cq_off.head);
+        rval.cq_tail  = detail::ring_offset<unsigned>(rval.cq_ring, p.cq_off.tail);
+        rval.cq_mask  = detail::ring_offset<unsigned>(rval.cq_ring, p.cq_off.ring_mask);
+        rval.cqes     = detail::ring_offset<io_uring_cqe>(rval.cq_ring, p.cq_off.cqes);
+
+        rval.sqe_head = rval.sqe_tail = *rval.sq_tail;
+
+        rval.status = error_code::success;
+        return rval;
+    }
+
+    inline io_uring::io_uring(io_uring&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline io_uring& io_uring::operator=(io_uring&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        release();
+        std::memcpy(static_cast<void*>(this), static_cast<void*>(&other), sizeof(io_uring));
+
+        other.ring_fd = -1;
+        other.sq_ring = other.cq_ring = nullptr;
+        other.sqes = nullptr;
+
+        return *this;
+    }
+
+    inline io_uring::~io_uring()
+    {
+        release();
+    }
+
+    inline io_uring_sqe* io_uring::get_sqe() noexcept
+    {
+        if (ring_fd < 0)
+            return nullptr;
+
+        const unsigned head = detail::load_acquire(sq_head);
+        if (sqe_tail - head >= params.sq_entries)
+            return nullptr;
+
+        io_uring_sqe* sqe = &sqes[sqe_tail & *sq_mask];
+        sqe_tail++;
+
+        std::memset(static_cast<void*>(sqe), 0, sizeof(io_uring_sqe));
+        return sqe;
+    }
+
+    inline int io_uring::submit(unsigned wait_for) noexcept
+    {
+        // the entries go to the array in order, the kernel picks them up from there
+        unsigned tail = *sq_tail;
+        for (; sqe_head != sqe_tail; ++sqe_head, ++tail)
+            sq_array[tail & *sq_mask] = sqe_head & *sq_mask;
+
+        detail::store_release(sq_tail, tail);
+
+        // includes anything the kernel did not consume on the previous round
+        const unsigned to_submit = tail - detail::load_acquire(sq_head);
+
+        if (to_submit == 0 && wait_for == 0)
+            return 0;
+
+        const unsigned enter_flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+        int result = 0;
+        do
+        {
+            result = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_for, enter_flags, nullptr, 0));
+        } while (result < 0 && errno == EINTR);
+
+        return result < 0 ? -errno : result;
+    }
+
+    inline io_uring_cqe* io_uring::peek_cqe() noexcept
+    {
+        const unsigned head = *cq_head;
+        if (head == detail::load_acquire(cq_tail))
+            return nullptr;
+
+        return &cqes[head & *cq_mask];
+    }
+
+    inline void io_uring::cqe_seen() noexcept
+    {
+        detail::store_release(cq_head, *cq_head + 1);
+    }
+
+    inline int io_uring::register_raw(unsigned opcode, const void* arg, unsigned count) noexcept
+    {
+        int result = static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, count));
+        return result < 0 ? -errno : result;
+    }
+
+    inline int io_uring::register_buffers(std::span<const iovec> buffers) noexcept
+    {
+        return register_raw(IORING_REGISTER_BUFFERS, buffers.data(), buffers.size());
+    }
+
+    inline int io_uring::unregister_buffers() noexcept
+    {
+        return register_raw(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    }
+
+    inline int io_uring::register_files(std::span<const int> fds) noexcept
+    {
+        return register_raw(IORING_REGISTER_FILES, fds.data(), fds.size());
+    }
+
+    inline int io_uring::update_files(unsigned offset, std::span<const int> fds) noexcept
+    {
+        io_uring_files_update update{};
+        update.offset = offset;
+        update.fds = reinterpret_cast<std::uintptr_t>(fds.data());
+
+        return register_raw(IORING_REGISTER_FILES_UPDATE, &update, fds.size());
+    }
+
+    inline int io_uring::unregister_files() noexcept
+    {
+        return register_raw(IORING_UNREGISTER_FILES, nullptr, 0);
+    }
+
+    inline void io_uring::release() noexcept
+    {
+        if (sqes != nullptr)
+            munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+        if (cq_ring != nullptr && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sq_ring != nullptr)
+            munmap(sq_ring, sq_ring_size);
+        if (ring_fd >= 0)
+            ::close(ring_fd);
+
+        sqes = nullptr;
+        sq_ring = cq_ring = nullptr;
+        ring_fd = -1;
+    }
+}
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef UNORTHODOX_NETWORK_ACCEPTOR_GROUP_HPP
+#define UNORTHODOX_NETWORK_ACCEPTOR_GROUP_HPP
+
+#include <unorthodox/network/reactor.hpp>
+
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace unorthodox::net
+{
+    enum class connection_steering
+    {
+        // whatever the kernel's SO_REUSEPORT hash picks
+        none,
+
+        // SO_INCOMING_CPU on every listener, worker n prefers CPU n
+        incoming_cpu,
+
+        // a CBPF program that picks the listener by the CPU the connection arrived on
+        cbpf,
+    };
+
+    struct acceptor_group_options
+    {
+        std::size_t         threads         = std::max(std::thread::hardware_concurrency(), 1u);
+
+        // worker n runs on CPU n (modulo the number of CPUs)
+        bool                pin_threads     = true;
+
+        connection_steering steering        = connection_steering::none;
+
+        int                 backlog         = 1024;
+        std::size_t         max_events      = 1024;
+    };
+
+    // One listening socket and one reactor per thread, all on the same port with
+    // SO_REUSEPORT.  The kernel spreads the connections over the listeners, so
+    // there is no shared accept queue and no lock between the threads.
+    //
+    // New connections are handed to on_connection on the thread that accepted
+    // them, together with that thread's reactor to register them with.
+    template <typename Socket = tcp_socket_details>
+    class acceptor_group
+    {
+        public:
+            using connection_type = socket<Socket>;
+            using connection_function = std::function<void(std::size_t worker, reactor& loop, connection_type&& connection)>;
+
+            acceptor_group(connection_function on_connection, acceptor_group_options options = {}) noexcept;
+
+            acceptor_group(const acceptor_group&) = delete;
+            acceptor_group& operator=(const acceptor_group&) = delete;
+
+           ~acceptor_group();
+
+            // Opens every listener, then starts the threads.  Nothing is started
+            // if a listener cannot be opened.
+            error_code start(uint16_t port) noexcept;
+
+            // Stops every loop and joins the threads
+            void stop() noexcept;
+
+            std::size_t size() const noexcept { return workers.size(); }
+
+        private:
+            struct worker
+            {
+                acceptor_group*     owner       = nullptr;
+                std::size_t         index       = 0;
+
+                connection_type     listener;
+                reactor             loop;
+                int                 wake_fd     = -1;
+
+                std::thread         thread;
+
+                explicit worker(std::size_t max_events) noexcept : loop(max_events) {}
+               ~worker() { if (wake_fd >= 0) ::close(wake_fd); }
+
+                void on_listener(os::socket_type fd, uint32_t events) noexcept;
+                void on_wake(os::socket_type fd, uint32_t events) noexcept;
+            };
+
+            void run(worker& target) noexcept;
+
+            connection_function                     on_connection;
+            acceptor_group_options                  opts;
+
+            std::vector<std::unique_ptr<worker>>    workers;
+    };
+}
+
+namespace unorthodox::net
+{
+    template <typename Socket>
+    acceptor_group<Socket>::acceptor_group(connection_function in_on_connection, acceptor_group_options options) noexcept
+        : on_connection(std::move(in_on_connection)), opts(options)
+    {
+        opts.threads = std::max<std::size_t>(opts.threads, 1);
+    }
+
+    template <typename Socket>
+    acceptor_group<Socket>::~acceptor_group()
+    {
+        stop();
+    }
+
+    template <typename Socket>
+    error_code acceptor_group<Socket>::start(uint16_t port) noexcept
+    {
+        if (!workers.empty())
+            return error_code(error_domain::network_error, error_code::socket_already_open);
+
+        const int cpus = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+        listen_options listen_opts;
+        listen_opts.backlog = opts.backlog;
+        listen_opts.reuse_port = true;
+
+        // every listener is bound before any thread runs, the CBPF program
+        // relies on the order they joined the group in
+        for (std::size_t i = 0; i < opts.threads; ++i)
+        {
+            auto w = std::make_unique<worker>(opts.max_events);
+            w->owner = this;
+            w->index = i;
+
+            if (opts.steering == connection_steering::incoming_cpu)
+                listen_opts.incoming_cpu = static_cast<int>(i) % cpus;
+
+            error_code result = w->loop ? w->listener.listen(port, listen_opts) : w->loop.error();
+            if (!result)
+                result = w->loop.add(w->listener, reactor::readable, reactor_handler::member<&worker::on_listener>(w.get()));
+
+            if (!result)
+            {
+                w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                result = w->wake_fd == -1 ? error_code(error_domain::network_error, error_code::poll_error)
+                                          : w->loop.add(w->wake_fd, reactor::readable, reactor_handler::member<&worker::on_wake>(w.get()));
+            }
+
+            if (result)
+            {
+                workers.clear();
+                return result;
+            }
+
+            workers.push_back(std::move(w));
+        }
+
+        if (opts.steering == connection_steering::cbpf)
+        {
+            error_code result = workers.front()->listener.attach_cpu_steering(static_cast<unsigned>(workers.size()));
+            if (result)
+            {
+                workers.clear();
+                return result;
+            }
+        }
+
+        for (auto& w : workers)
+        {
+            worker* target = w.get();
+            target->thread = std::thread([this, target]{ run(*target); });
+
+            if (opts.pin_threads)
+            {
+                cpu_set_t cpu;
+                CPU_ZERO(&cpu);
+                CPU_SET(static_cast<int>(target->index) % cpus, &cpu);
+                pthread_setaffinity_np(target->thread.native_handle(), sizeof(cpu), &cpu);
+            }
+        }
+
+        return error_code::success;
+    }
+
+    template <typename Socket>
+    void acceptor_group<Socket>::stop() noexcept
+    {
+        // the loops are not thread-safe, wake each one and let it stop itself
+        for (auto& w : workers)
+        {
+            const uint64_t one = 1;
+            if (w->thread.joinable())
+                (void) !::write(w->wake_fd, &one, sizeof(one));
+        }
+
+        for (auto& w : workers)
+        {
+            if (w->thread.joinable())
+                w->thread.join();
+
+            w->loop.remove(w->listener);
+            w->loop.remove(w->wake_fd);
+        }
+
+        workers.clear();
+    }
+
+    template <typename Socket>
+    void acceptor_group<Socket>::run(worker& target) noexcept
+    {
+        target.loop.run();
+    }
+
+    template <typename Socket>
+    void acceptor_group<Socket>::worker::on_listener(os::socket_type fd, uint32_t) noexcept
+    {
+        const int family = fd == listener.native_handles()[0] ? AF_INET : AF_INET6;
+
+        // edge-triggered, take everything that is waiting
+        while (true)
+        {
+            os::socket_type connection = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (connection == os::invalid_socket)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+
+                // EAGAIN once the queue is empty, EMFILE and friends leave the
+                // rest in the queue for the next round
+                return;
+            }
+
+            owner->on_connection(index, loop, connection_type(connection, family));
+        }
+    }
+
+    template <typename Socket>
+    void acceptor_group<Socket>::worker::on_wake(os::socket_type fd, uint32_t) noexcept
+    {
+        uint64_t count;
+        (void) !::read(fd, &count, sizeof(count));
+        loop.stop();
+    }
+}
+
+#endif
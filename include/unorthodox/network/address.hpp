@@ -0,0 +1,176 @@
+#ifndef UNORTHODOX_NETWORK_ADDRESS_HPP
+#define UNORTHODOX_NETWORK_ADDRESS_HPP
+
+#include <unorthodox/error_codes.hpp>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace unorthodox::net
+{
+    // An IPv4 or IPv6 address and port, or a unix socket path, stored the way
+    // the kernel hands it over so receiving one never allocates.  Only
+    // to_string() formats it.
+    class address
+    {
+        public:
+            address() noexcept = default;
+            address(const sockaddr* source, socklen_t source_length) noexcept;
+
+            // Numeric addresses only, "127.0.0.1" or "::1", no lookups
+            static tl::expected<address, error_code> from_string(std::string_view host, uint16_t port) noexcept;
+
+            // AF_UNIX.  A path starting with '@' is in the abstract namespace, Linux
+            // only: nothing is created in the filesystem and it goes away with
+            // the last socket bound to it.
+            static tl::expected<address, error_code> from_unix_path(std::string_view path) noexcept;
+
+            int         family() const noexcept { return length == 0 ? AF_UNSPEC : storage.ss_family; }
+            uint16_t    port() const noexcept;
+
+            bool        empty() const noexcept { return length == 0; }
+
+            // "192.0.2.1:53" or "[2001:db8::1]:53"
+            std::string to_string() const;
+
+            // just the address, "192.0.2.1" or "2001:db8::1".  Unix paths as they
+            // were given, abstract ones with the '@'.
+            std::string host() const;
+
+            const sockaddr* data() const noexcept { return reinterpret_cast<const sockaddr*>(&storage); }
+            sockaddr*       data() noexcept { return reinterpret_cast<sockaddr*>(&storage); }
+
+            socklen_t   size() const noexcept { return length; }
+            constexpr static socklen_t capacity() noexcept { return sizeof(sockaddr_storage); }
+
+            // after the kernel filled data() in
+            void        resize(socklen_t new_length) noexcept { length = std::min(new_length, capacity()); }
+
+            bool operator==(const address& other) const noexcept
+            { return length == other.length && std::memcmp(&storage, &other.storage, length) == 0; }
+
+        private:
+            sockaddr_storage    storage{};
+            socklen_t           length      = 0;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline address::address(const sockaddr* source, socklen_t source_length) noexcept
+    {
+        length = std::min(source_length, capacity());
+        std::memcpy(&storage, source, length);
+    }
+
+    inline tl::expected<address, error_code> address::from_string(std::string_view host, uint16_t port) noexcept
+    {
+        // inet_pton wants a terminated string, anything longer is not an address
+        char text[INET6_ADDRSTRLEN];
+        if (host.size() >= sizeof(text))
+            return tl::unexpected(error_code(error_domain::network_error, error_code::invalid_argument));
+
+        std::memcpy(text, host.data(), host.size());
+        text[host.size()] = '\0';
+
+        sockaddr_in v4{};
+        if (inet_pton(AF_INET, text, &v4.sin_addr) == 1)
+        {
+            v4.sin_family = AF_INET;
+            v4.sin_port = htons(port);
+            return address(reinterpret_cast<const sockaddr*>(&v4), sizeof(v4));
+        }
+
+        sockaddr_in6 v6{};
+        if (inet_pton(AF_INET6, text, &v6.sin6_addr) == 1)
+        {
+            v6.sin6_family = AF_INET6;
+            v6.sin6_port = htons(port);
+            return address(reinterpret_cast<const sockaddr*>(&v6), sizeof(v6));
+        }
+
+        return tl::unexpected(error_code(error_domain::network_error, error_code::invalid_argument));
+    }
+
+    inline tl::expected<address, error_code> address::from_unix_path(std::string_view path) noexcept
+    {
+        sockaddr_un local{};
+        local.sun_family = AF_UNIX;
+
+        const bool abstract = !path.empty() && path.front() == '@';
+
+        // filesystem paths need room for the terminator, abstract names are
+        // as long as the address says and may not be empty
+        if (path.empty() || path.size() > sizeof(local.sun_path) - (abstract ? 0 : 1) || (abstract && path.size() == 1))
+            return tl::unexpected(error_code(error_domain::network_error, error_code::invalid_argument));
+
+        std::memcpy(local.sun_path, path.data(), path.size());
+
+        socklen_t used = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+        if (abstract)
+            local.sun_path[0] = '\0';
+        else
+            ++used;
+
+        return address(reinterpret_cast<const sockaddr*>(&local), used);
+    }
+
+    inline uint16_t address::port() const noexcept
+    {
+        if (family() == AF_INET)
+            return ntohs(reinterpret_cast<const sockaddr_in*>(&storage)->sin_port);
+        if (family() == AF_INET6)
+            return ntohs(reinterpret_cast<const sockaddr_in6*>(&storage)->sin6_port);
+
+        return 0;
+    }
+
+    inline std::string address::to_string() const
+    {
+        if (family() == AF_INET)
+            return host() + ":" + std::to_string(port());
+        if (family() == AF_INET6)
+            return "[" + host() + "]:" + std::to_string(port());
+        if (family() == AF_UNIX)
+            return host();
+
+        return {};
+    }
+
+    inline std::string address::host() const
+    {
+        char text[INET6_ADDRSTRLEN];
+
+        if (family() == AF_INET)
+            inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&storage)->sin_addr, text, sizeof(text));
+        else if (family() == AF_INET6)
+            inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&storage)->sin6_addr, text, sizeof(text));
+        else if (family() == AF_UNIX)
+        {
+            // unnamed sockets, the other end of a connect() that never bound
+            const std::size_t name_size = length > offsetof(sockaddr_un, sun_path) ? length - offsetof(sockaddr_un, sun_path) : 0;
+            if (name_size == 0)
+                return {};
+
+            const char* name = reinterpret_cast<const sockaddr_un*>(&storage)->sun_path;
+            if (name[0] == '\0')
+                return "@" + std::string(name + 1, name_size - 1);
+
+            return std::string(name, strnlen(name, name_size));
+        }
+        else
+            return {};
+
+        return text;
+    }
+}
+
+#endif
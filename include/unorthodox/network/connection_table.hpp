@@ -0,0 +1,142 @@
+#ifndef UNORTHODOX_NETWORK_CONNECTION_TABLE_HPP
+#define UNORTHODOX_NETWORK_CONNECTION_TABLE_HPP
+
+#include <unorthodox/network/address.hpp>
+
+#include <sys/socket.h>
+
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace unorthodox::net
+{
+    // What is known about the other end of a connection
+    struct connection_info
+    {
+        address     peer;
+
+        // peer formatted once, without the port
+        std::string host;
+    };
+
+    // Peer addresses by fd, recorded once when a connection is accepted or
+    // connected so the events for it do not need getpeername and inet_ntop
+    // every time.  An fd closed without socket::close() has to be forgotten
+    // by hand, its number is handed out again.
+    class connection_table
+    {
+        public:
+            // fds are per process, so is this
+            static connection_table& global() noexcept;
+
+            void record(int fd, const address& peer) noexcept;
+            void forget(int fd) noexcept;
+
+            // Calls function(const connection_info&) with the entry for fd.  One
+            // that was not recorded is looked up with getpeername and kept.
+            // False if fd is not a connected socket.
+            template <typename Function>
+            bool visit(int fd, Function&& function) noexcept;
+
+            std::size_t size() const noexcept;
+
+        private:
+            struct entry
+            {
+                connection_info info;
+                bool            used    = false;
+            };
+
+            mutable std::shared_mutex   lock;
+            std::vector<entry>          entries;
+            std::size_t                 used_count  = 0;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline connection_table& connection_table::global() noexcept
+    {
+        static connection_table table;
+        return table;
+    }
+
+    inline void connection_table::record(int fd, const address& peer) noexcept
+    {
+        if (fd < 0)
+            return;
+
+        // formatted outside the lock
+        std::string host = peer.host();
+
+        std::unique_lock guard(lock);
+
+        const std::size_t index = static_cast<std::size_t>(fd);
+        if (index >= entries.size())
+            entries.resize(std::max(index + 1, entries.size() * 2));
+
+        entry& target = entries[index];
+        if (!target.used)
+            ++used_count;
+
+        target.info.peer = peer;
+        target.info.host = std::move(host);
+        target.used = true;
+    }
+
+    inline void connection_table::forget(int fd) noexcept
+    {
+        std::unique_lock guard(lock);
+
+        const std::size_t index = static_cast<std::size_t>(fd);
+        if (fd < 0 || index >= entries.size() || !entries[index].used)
+            return;
+
+        entries[index].used = false;
+        --used_count;
+    }
+
+    template <typename Function>
+    bool connection_table::visit(int fd, Function&& function) noexcept
+    {
+        if (fd < 0)
+            return false;
+
+        const std::size_t index = static_cast<std::size_t>(fd);
+
+        {
+            std::shared_lock guard(lock);
+            if (index < entries.size() && entries[index].used)
+            {
+                function(static_cast<const connection_info&>(entries[index].info));
+                return true;
+            }
+        }
+
+        // a socket that did not come through accept or connect here
+        address peer;
+        socklen_t peer_size = address::capacity();
+        if (getpeername(fd, peer.data(), &peer_size) == -1)
+            return false;
+
+        peer.resize(peer_size);
+        record(fd, peer);
+
+        std::shared_lock guard(lock);
+        if (index >= entries.size() || !entries[index].used)
+            return false;
+
+        function(static_cast<const connection_info&>(entries[index].info));
+        return true;
+    }
+
+    inline std::size_t connection_table::size() const noexcept
+    {
+        std::shared_lock guard(lock);
+        return used_count;
+    }
+}
+
+#endif
@@ -0,0 +1,422 @@
+#ifndef UNORTHODOX_NETWORK_CONNECTOR_HPP
+#define UNORTHODOX_NETWORK_CONNECTOR_HPP
+
+#include <unorthodox/network/reactor.hpp>
+#include <unorthodox/network/resolver.hpp>
+
+#include <sys/eventfd.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace unorthodox::net
+{
+    struct connect_options
+    {
+        // Happy Eyeballs (RFC 8305): the next address is tried this long after
+        // the last one was started, without giving up on that one
+        std::chrono::milliseconds   attempt_delay   = std::chrono::milliseconds(250);
+
+        // for all the attempts together, the lookup before them not included
+        std::chrono::milliseconds   timeout         = std::chrono::seconds(10);
+    };
+
+    // The socket that won, blocking like one from socket::connect()
+    struct connected_fd
+    {
+        os::socket_type fd;
+        address         peer;
+    };
+
+    using connect_result = tl::expected<connected_fd, error_code>;
+    using connect_callback = std::function<void(connect_result)>;
+
+    // Non-blocking connects for every socket in the process on one thread.
+    // The addresses are tried in turn, alternating between the families, and a
+    // new attempt starts whenever the last one failed or has not finished
+    // within the attempt delay.  The first one to connect wins, the others are
+    // closed.  A peer that never answers costs a timer, not a thread.
+    class connector
+    {
+        public:
+            connector();
+           ~connector();
+
+            connector(const connector&) = delete;
+            connector& operator=(const connector&) = delete;
+
+            // the one socket::connect_async uses
+            static connector& global();
+
+            operator bool() const noexcept { return worker.joinable(); }
+
+            // Called on the connector's thread, which must not be held up.  The
+            // fd in the result belongs to the callback.  No candidates fails
+            // with host_not_found right away, on the calling thread.
+            void connect(std::vector<address> candidates, int type, connect_callback on_connected, const connect_options& options = {});
+            std::future<connect_result> connect(std::vector<address> candidates, int type, const connect_options& options = {});
+
+            // connects started and not finished yet
+            std::size_t in_flight() const noexcept;
+
+        private:
+            struct request
+            {
+                connector*              owner       = nullptr;
+
+                std::vector<address>    candidates;
+                std::size_t             next        = 0;
+                int                     type        = SOCK_STREAM;
+                connect_options         options;
+                connect_callback        on_connected;
+
+                // started and not failed yet, in the same order as in candidates
+                std::vector<os::socket_type>    racing;
+                std::vector<std::size_t>        racing_index;
+
+                timer                   stagger;
+                timer                   deadline;
+
+                void on_writable(os::socket_type fd, uint32_t events) noexcept;
+                void on_stagger(timer&) noexcept;
+                void on_deadline(timer&) noexcept;
+            };
+
+            void        run() noexcept;
+            void        on_wake(os::socket_type fd, uint32_t events) noexcept;
+
+            void        start(std::unique_ptr<request> target) noexcept;
+
+            // starts attempts until one is in progress, fails the request if
+            // there is nothing left to try or wait for
+            void        launch(request& target) noexcept;
+            void        finish(request& target, connect_result result) noexcept;
+
+            reactor                                 loop;
+            int                                     wake_fd     = -1;
+
+            mutable std::mutex                      queue_mutex;
+            std::vector<std::unique_ptr<request>>   incoming;
+            std::size_t                             pending     = 0;
+            bool                                    stopping    = false;
+
+            // owned by the thread
+            std::vector<std::unique_ptr<request>>   active;
+
+            std::thread                             worker;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline connector::connector() : loop(64)
+    {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (!loop || wake_fd < 0 || loop.add(wake_fd, reactor::readable, reactor_handler::member<&connector::on_wake>(this)))
+            return;
+
+        worker = std::thread([this]{ run(); });
+    }
+
+    inline connector::~connector()
+    {
+        {
+            std::lock_guard guard(queue_mutex);
+            stopping = true;
+        }
+
+        const uint64_t one = 1;
+        if (worker.joinable())
+        {
+            (void) !::write(wake_fd, &one, sizeof(one));
+            worker.join();
+        }
+
+        // whatever did not finish fails now
+        while (!active.empty())
+            finish(*active.front(), tl::unexpected(error_code(error_domain::network_error, error_code::cannot_open_socket)));
+        for (auto& target : incoming)
+            target->on_connected(tl::unexpected(error_code(error_domain::network_error, error_code::cannot_open_socket)));
+
+        if (wake_fd >= 0)
+        {
+            loop.remove(wake_fd);
+            ::close(wake_fd);
+        }
+    }
+
+    inline connector& connector::global()
+    {
+        static connector shared;
+        return shared;
+    }
+
+    inline void connector::connect(std::vector<address> candidates, int type, connect_callback on_connected, const connect_options& options)
+    {
+        if (!*this)
+        {
+            on_connected(tl::unexpected(error_code(error_domain::network_error, error_code::poll_error)));
+            return;
+        }
+
+        // nothing to try, like a lookup that found nothing
+        if (candidates.empty())
+        {
+            on_connected(tl::unexpected(error_code(error_domain::network_error, error_code::host_not_found)));
+            return;
+        }
+
+        auto target = std::make_unique<request>();
+        target->owner = this;
+        target->type = type;
+        target->options = options;
+        target->on_connected = std::move(on_connected);
+
+        // interleaved by family, starting with whichever getaddrinfo put first
+        std::vector<address> others;
+        for (address& candidate : candidates)
+        {
+            if (candidate.family() == candidates.front().family())
+                target->candidates.push_back(candidate);
+            else
+                others.push_back(candidate);
+        }
+
+        for (std::size_t i = 0; i < others.size(); ++i)
+            target->candidates.insert(target->candidates.begin() + static_cast<std::ptrdiff_t>(std::min(2 * i + 1, target->candidates.size())), others[i]);
+
+        {
+            std::lock_guard guard(queue_mutex);
+            incoming.push_back(std::move(target));
+            ++pending;
+        }
+
+        const uint64_t one = 1;
+        (void) !::write(wake_fd, &one, sizeof(one));
+    }
+
+    inline std::future<connect_result> connector::connect(std::vector<address> candidates, int type, const connect_options& options)
+    {
+        auto promise = std::make_shared<std::promise<connect_result>>();
+        std::future<connect_result> result = promise->get_future();
+
+        connect(std::move(candidates), type, [promise](connect_result connected) {
+            promise->set_value(std::move(connected));
+        }, options);
+
+        return result;
+    }
+
+    inline std::size_t connector::in_flight() const noexcept
+    {
+        std::lock_guard guard(queue_mutex);
+        return pending;
+    }
+
+    inline void connector::run() noexcept
+    {
+        loop.run();
+    }
+
+    inline void connector::on_wake(os::socket_type fd, uint32_t) noexcept
+    {
+        uint64_t count;
+        (void) !::read(fd, &count, sizeof(count));
+
+        std::vector<std::unique_ptr<request>> arrived;
+        {
+            std::lock_guard guard(queue_mutex);
+            if (stopping)
+            {
+                loop.stop();
+                return;
+            }
+
+            arrived.swap(incoming);
+        }
+
+        for (auto& target : arrived)
+            start(std::move(target));
+    }
+
+    inline void connector::start(std::unique_ptr<request> target) noexcept
+    {
+        request& started = *target;
+        active.push_back(std::move(target));
+
+        loop.timers().schedule(started.deadline, started.options.timeout, timer_handler::member<&request::on_deadline>(&started));
+        launch(started);
+    }
+
+    inline void connector::launch(request& target) noexcept
+    {
+        while (target.next < target.candidates.size())
+        {
+            const std::size_t index = target.next++;
+            const address& to = target.candidates[index];
+
+            const os::socket_type fd = ::socket(to.family(), target.type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd == os::invalid_socket)
+                continue;
+
+            if (::connect(fd, to.data(), to.size()) == 0)
+            {
+                target.racing.push_back(fd);
+                target.racing_index.push_back(index);
+
+                target.on_writable(fd, reactor::writable);
+                return;
+            }
+
+            // refused or unreachable right away, on to the next one
+            if (errno != EINPROGRESS || loop.add(fd, reactor::writable, reactor_handler::member<&request::on_writable>(&target)))
+            {
+                ::close(fd);
+                continue;
+            }
+
+            target.racing.push_back(fd);
+            target.racing_index.push_back(index);
+
+            if (target.next < target.candidates.size())
+                loop.timers().schedule(target.stagger, target.options.attempt_delay, timer_handler::member<&request::on_stagger>(&target));
+            return;
+        }
+
+        if (target.racing.empty())
+            finish(target, tl::unexpected(error_code(error_domain::network_error, error_code::cannot_open_socket)));
+    }
+
+    inline void connector::finish(request& target, connect_result result) noexcept
+    {
+        for (os::socket_type fd : target.racing)
+        {
+            loop.remove(fd);
+            if (!result || fd != result->fd)
+                ::close(fd);
+        }
+
+        if (result)
+        {
+            // like one from connect(), the caller decides whether it blocks
+            const int flags = fcntl(result->fd, F_GETFL);
+            if (flags != -1)
+                fcntl(result->fd, F_SETFL, flags & ~O_NONBLOCK);
+        }
+
+        connect_callback on_connected = std::move(target.on_connected);
+
+        // the request goes first, the callback may be anything
+        auto found = std::find_if(active.begin(), active.end(), [&](const auto& item) { return item.get() == &target; });
+        if (found != active.end())
+            active.erase(found);
+
+        {
+            std::lock_guard guard(queue_mutex);
+            --pending;
+        }
+
+        on_connected(std::move(result));
+    }
+
+    inline void connector::request::on_writable(os::socket_type fd, uint32_t) noexcept
+    {
+        int status = 0;
+        socklen_t status_size = sizeof(status);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &status, &status_size) == -1)
+            status = errno;
+
+        if (status == EINPROGRESS || status == EALREADY)
+            return;
+
+        const auto position = std::find(racing.begin(), racing.end(), fd);
+        if (position == racing.end())
+            return;
+
+        const std::size_t index = racing_index[static_cast<std::size_t>(position - racing.begin())];
+
+        if (status == 0)
+        {
+            owner->finish(*this, connected_fd{ fd, candidates[index] });
+            return;
+        }
+
+        // this one failed, the next starts right away instead of after the delay
+        owner->loop.remove(fd);
+        ::close(fd);
+
+        racing_index.erase(racing_index.begin() + (position - racing.begin()));
+        racing.erase(position);
+
+        owner->launch(*this);
+    }
+
+    inline void connector::request::on_stagger(timer&) noexcept
+    {
+        owner->launch(*this);
+    }
+
+    inline void connector::request::on_deadline(timer&) noexcept
+    {
+        owner->finish(*this, tl::unexpected(error_code(error_domain::network_error, error_code::cannot_open_socket)));
+    }
+
+    template <typename SocketType, bool Owner>
+    std::future<error_code> socket<SocketType, Owner>::connect_async(const char* host, uint16_t port) requires (SocketType::type == SOCK_STREAM)
+    {
+        return connect_async(host, port, connect_options{});
+    }
+
+    template <typename SocketType, bool Owner>
+    std::future<error_code> socket<SocketType, Owner>::connect_async(const char* host, uint16_t port, const connect_options& options) requires (SocketType::type == SOCK_STREAM)
+    {
+        auto promise = std::make_shared<std::promise<error_code>>();
+        std::future<error_code> result = promise->get_future();
+
+        if (os::is_active_socket(socket_ipv6) || os::is_active_socket(socket_ipv4))
+        {
+            promise->set_value(error_code(error_domain::network_error, error_value::socket_already_open));
+            return result;
+        }
+
+        resolver::global().resolve(host, port, [this, promise, options](resolve_result resolved) {
+            if (!resolved)
+            {
+                promise->set_value(resolved.error());
+                return;
+            }
+
+            connector::global().connect(std::move(*resolved), SocketType::type, [this, promise](connect_result connected) {
+                if (!connected)
+                {
+                    promise->set_value(connected.error());
+                    return;
+                }
+
+                // the slot for the family that won, the other one is not used
+                if (connected->peer.family() == AF_INET6)
+                {
+                    socket_ipv6 = connected->fd;
+                    socket_ipv4 = disabled;
+                } else {
+                    socket_ipv4 = connected->fd;
+                    socket_ipv6 = disabled;
+                }
+
+                #if defined(HAS_CPPEVENTS)
+                connection_table::global().record(connected->fd, connected->peer);
+                #endif
+
+                promise->set_value(error_code::success);
+            }, options);
+        });
+
+        return result;
+    }
+}
+
+#endif
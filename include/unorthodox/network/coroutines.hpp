@@ -0,0 +1,1075 @@
+#ifndef UNORTHODOX_NETWORK_COROUTINES_HPP
+#define UNORTHODOX_NETWORK_COROUTINES_HPP
+
+#include <unorthodox/network/reactor.hpp>
+#include <unorthodox/allocators.hpp>
+
+#include <sys/eventfd.h>
+#include <poll.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace unorthodox::net
+{
+    template <typename T = void>
+    class task;
+
+    namespace detail
+    {
+        // What every task promise shares: the frame comes from the frame pool,
+        // the body starts when it is awaited or spawned, and at the end control
+        // goes straight back to whoever awaited it.
+        class task_promise_base
+        {
+            public:
+                using done_function = void (*)(void* context) noexcept;
+
+                static void* operator new(std::size_t size) { return allocators::frame_pool::allocate(size); }
+                static void operator delete(void* frame, std::size_t size) noexcept { allocators::frame_pool::deallocate(frame, size); }
+
+                std::suspend_always initial_suspend() const noexcept { return {}; }
+
+                struct final_awaiter
+                {
+                    bool await_ready() const noexcept { return false; }
+                    void await_resume() const noexcept {}
+
+                    template <typename Promise>
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) const noexcept
+                    {
+                        task_promise_base& promise = finished.promise();
+                        if (promise.continuation)
+                            return promise.continuation;
+
+                        // nobody is waiting for a spawned task, it cleans up after itself
+                        const done_function on_done = promise.on_done;
+                        void* const context = promise.done_context;
+
+                        finished.destroy();
+                        if (on_done != nullptr)
+                            on_done(context);
+
+                        return std::noop_coroutine();
+                    }
+                };
+
+                final_awaiter final_suspend() const noexcept { return {}; }
+
+                // error_code and expected carry the errors, an exception has nowhere to go
+                void unhandled_exception() const noexcept { std::terminate(); }
+
+                std::coroutine_handle<>     continuation;
+
+                done_function               on_done         = nullptr;
+                void*                       done_context    = nullptr;
+        };
+
+        template <typename Task>
+        struct task_awaiter
+        {
+            typename Task::handle_type  handle;
+
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiting) const noexcept
+            {
+                handle.promise().continuation = waiting;
+                return handle;
+            }
+        };
+    }
+
+    // A coroutine returning T.  It does not start until it is awaited, or handed
+    // to an executor with spawn().
+    template <typename T>
+    class [[nodiscard]] task
+    {
+        public:
+            struct promise_type : detail::task_promise_base
+            {
+                task get_return_object() noexcept { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+                template <typename U>
+                void return_value(U&& result) noexcept(std::is_nothrow_constructible_v<T, U&&>) { value.emplace(std::forward<U>(result)); }
+
+                std::optional<T>    value;
+            };
+
+            using handle_type = std::coroutine_handle<promise_type>;
+
+            task() noexcept = default;
+            task(task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+            task& operator=(task&& other) noexcept { if (this != &other) { reset(); handle = std::exchange(other.handle, {}); } return *this; }
+
+           ~task() { reset(); }
+
+            auto operator co_await() && noexcept
+            {
+                struct awaiter : detail::task_awaiter<task>
+                {
+                    T await_resume() { return std::move(*this->handle.promise().value); }
+                };
+
+                return awaiter{ { handle } };
+            }
+
+            // hands the frame over, it is not destroyed with the task anymore
+            handle_type release() noexcept { return std::exchange(handle, {}); }
+
+        private:
+            explicit task(handle_type in_handle) noexcept : handle(in_handle) {}
+            void reset() noexcept { if (handle) handle.destroy(); handle = {}; }
+
+            handle_type handle;
+    };
+
+    template <>
+    class [[nodiscard]] task<void>
+    {
+        public:
+            struct promise_type : detail::task_promise_base
+            {
+                task get_return_object() noexcept { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+                void return_void() const noexcept {}
+            };
+
+            using handle_type = std::coroutine_handle<promise_type>;
+
+            task() noexcept = default;
+            task(task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+            task& operator=(task&& other) noexcept { if (this != &other) { reset(); handle = std::exchange(other.handle, {}); } return *this; }
+
+           ~task() { reset(); }
+
+            auto operator co_await() && noexcept
+            {
+                struct awaiter : detail::task_awaiter<task>
+                {
+                    void await_resume() const noexcept {}
+                };
+
+                return awaiter{ { handle } };
+            }
+
+            handle_type release() noexcept { return std::exchange(handle, {}); }
+
+        private:
+            explicit task(handle_type in_handle) noexcept : handle(in_handle) {}
+            void reset() noexcept { if (handle) handle.destroy(); handle = {}; }
+
+            handle_type handle;
+    };
+
+    class io_scheduler;
+
+    // An operation that has to wait for its fd.  perform() is tried before the
+    // coroutine suspends and then on every readiness edge, until it returns true
+    // with the result stored.
+    struct io_operation
+    {
+        using perform_function = bool (*)(io_operation* self) noexcept;
+
+        io_operation() noexcept = default;
+        io_operation(const io_operation&) = delete;
+
+        // one destroyed while parked, with its coroutine, is taken off the fd
+       ~io_operation();
+
+        perform_function            perform     = nullptr;
+        os::socket_type             fd          = os::invalid_socket;
+        bool                        writing     = false;
+
+        std::coroutine_handle<>     waiter;
+
+        // set instead of a result when the wait itself failed
+        error_code                  failure     = error_code::success;
+
+        // the scheduler it waits in, nullptr once it is done
+        io_scheduler*               parked      = nullptr;
+    };
+
+    // Parks coroutines on their sockets with an edge-triggered reactor and hands
+    // them back once their operation went through.  Every socket can have one
+    // reading and one writing operation waiting at a time.
+    //
+    // A shared scheduler may be used from several threads, one of them polling
+    // at a time.
+    class io_scheduler
+    {
+        public:
+            explicit io_scheduler(bool shared = false, std::size_t max_events = 1024) noexcept;
+
+            io_scheduler(const io_scheduler&) = delete;
+            io_scheduler& operator=(const io_scheduler&) = delete;
+
+           ~io_scheduler();
+
+            operator bool() const noexcept { return loop && wake_fd >= 0; }
+
+            // Tries the operation and parks it if it would block.  false if it
+            // finished (or failed) straight away and the caller should not suspend.
+            bool suspend(io_operation& operation) noexcept;
+
+            // Waits up to timeout_ms (-1 for ever) and appends the coroutines whose
+            // operations went through to ready
+            void poll(std::vector<std::coroutine_handle<>>& ready, int timeout_ms) noexcept;
+
+            // Interrupts a poll() on another thread
+            void wake() noexcept;
+
+            // Timers on the scheduler's wheel, their handlers run inside poll().
+            // Safe from any thread on a shared scheduler.
+            void schedule(timer& target, std::chrono::milliseconds after, timer_handler handler) noexcept;
+            void cancel(timer& target) noexcept;
+
+            // Fails whatever is waiting on the fd and stops watching it.
+            // socket::close() does this for the scheduler of the thread it runs on.
+            void release(os::socket_type fd) noexcept;
+
+            // the scheduler of the executor running on this thread
+            static io_scheduler*& current() noexcept
+            {
+                thread_local io_scheduler* scheduler = nullptr;
+                return scheduler;
+            }
+
+        private:
+            friend struct io_operation;
+
+            struct fd_state
+            {
+                io_operation*   reader          = nullptr;
+                io_operation*   writer          = nullptr;
+
+                // an edge came in with nobody waiting, the next wait tries once more
+                bool            read_ready      = false;
+                bool            write_ready     = false;
+            };
+
+            void on_event(os::socket_type fd, uint32_t events) noexcept;
+            void on_wake(os::socket_type fd, uint32_t events) noexcept;
+
+            void complete(io_operation*& slot, bool& ready) noexcept;
+
+            // takes an operation that is going away off its fd
+            void forget(io_operation& operation) noexcept;
+
+            static void release_current(os::socket_type fd) noexcept;
+
+            reactor                                 loop;
+            int                                     wake_fd     = -1;
+            bool                                    shared      = false;
+
+            std::mutex                              state_lock;
+            std::vector<fd_state>                   states;
+            std::vector<std::coroutine_handle<>>    completed;
+    };
+
+    // Base of the socket awaitables, Derived provides attempt() and await_resume()
+    template <typename Derived>
+    class io_awaitable : public io_operation
+    {
+        public:
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> waiting) noexcept
+            {
+                waiter = waiting;
+                perform = [](io_operation* self) noexcept { return static_cast<Derived*>(self)->attempt(); };
+
+                io_scheduler* scheduler = io_scheduler::current();
+                if (scheduler == nullptr)
+                {
+                    // nothing to wait on outside an executor, it goes through or fails
+                    if (!perform(this))
+                        failure = error_code(error_domain::network_error, error_code::would_block);
+                    return false;
+                }
+
+                return scheduler->suspend(*this);
+            }
+    };
+
+    class recv_awaitable : public io_awaitable<recv_awaitable>
+    {
+        public:
+            recv_awaitable(os::socket_type socket_fd, std::span<std::byte> in_target) noexcept : target(in_target) { fd = socket_fd; }
+
+            // bytes received, 0 once the peer closed
+            tl::expected<size_t, error_code> await_resume() noexcept
+            {
+                if (failure)
+                    return tl::unexpected(failure);
+                return result;
+            }
+
+            bool attempt() noexcept;
+
+        private:
+            std::span<std::byte>                target;
+            tl::expected<size_t, error_code>    result = 0;
+    };
+
+    class send_awaitable : public io_awaitable<send_awaitable>
+    {
+        public:
+            send_awaitable(os::socket_type socket_fd, std::span<const std::byte> in_data) noexcept : data(in_data) { fd = socket_fd; writing = true; }
+
+            // resumes once all of it went out
+            tl::expected<size_t, error_code> await_resume() noexcept
+            {
+                if (failure)
+                    return tl::unexpected(failure);
+                if (result)
+                    return tl::unexpected(result);
+                return sent;
+            }
+
+            bool attempt() noexcept;
+
+        private:
+            std::span<const std::byte>  data;
+            size_t                      sent    = 0;
+            error_code                  result  = error_code::success;
+    };
+
+    template <typename Socket>
+    class accept_awaitable : public io_awaitable<accept_awaitable<Socket>>
+    {
+        public:
+            accept_awaitable(os::socket_type listener, int in_family) noexcept : family(in_family) { this->fd = listener; }
+
+            // the new connection is non-blocking
+            tl::expected<accepted_connection<Socket>, error_code> await_resume() noexcept
+            {
+                if (this->failure)
+                    return tl::unexpected(this->failure);
+                return std::move(result);
+            }
+
+            bool attempt() noexcept;
+
+        private:
+            int                                                     family;
+            tl::expected<accepted_connection<Socket>, error_code>   result = tl::unexpected(error_code(error_code::uninitialised_value));
+    };
+
+    template <typename Socket, bool Owning>
+    class connect_awaitable : public io_awaitable<connect_awaitable<Socket, Owning>>
+    {
+        public:
+            connect_awaitable(socket<Socket, Owning>& in_target, const address& in_to) noexcept : target(in_target), to(in_to) { this->writing = true; }
+
+            error_code await_resume() noexcept { return this->failure ? this->failure : result; }
+
+            bool attempt() noexcept;
+
+        private:
+            socket<Socket, Owning>&     target;
+            address                     to;
+            error_code                  result      = error_code::success;
+    };
+
+    // Runs coroutines and their I/O on the thread that calls run()
+    class single_thread_executor
+    {
+        public:
+            explicit single_thread_executor(std::size_t max_events = 1024) noexcept : io(false, max_events) {}
+
+            operator bool() const noexcept { return io; }
+
+            // Starts the task on the next run(), the executor owns it from now on
+            void spawn(task<> work) noexcept;
+
+            // Until every spawned task has finished or stop() was called
+            error_code run() noexcept;
+
+            // may be called from any thread
+            void stop() noexcept { stopping = true; io.wake(); }
+
+            io_scheduler& scheduler() noexcept { return io; }
+            std::size_t size() const noexcept { return live; }
+
+        private:
+            static void on_done(void* context) noexcept { --static_cast<single_thread_executor*>(context)->live; }
+
+            io_scheduler                            io;
+            std::deque<std::coroutine_handle<>>     ready;
+            std::vector<std::coroutine_handle<>>    resumed;
+            std::size_t                             live        = 0;
+            std::atomic<bool>                       stopping    = false;
+    };
+
+    // A fixed number of threads with a queue each.  A thread runs its own queue
+    // first and steals from the others when it is empty; an idle thread polls
+    // for I/O, the coroutines that become ready go to its queue and the rest
+    // come to steal them.
+    //
+    // Tasks still suspended when the executor is destroyed are not resumed or
+    // freed, wait() for them first.
+    class work_stealing_executor
+    {
+        public:
+            explicit work_stealing_executor(std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u),
+                                            std::size_t max_events = 1024) noexcept;
+
+            work_stealing_executor(const work_stealing_executor&) = delete;
+            work_stealing_executor& operator=(const work_stealing_executor&) = delete;
+
+           ~work_stealing_executor();
+
+            operator bool() const noexcept { return io; }
+
+            // Thread-safe, starts the task on one of the threads
+            void spawn(task<> work) noexcept;
+
+            // Until every spawned task has finished
+            void wait() noexcept;
+
+            // Stops and joins the threads
+            void stop() noexcept;
+
+            io_scheduler& scheduler() noexcept { return io; }
+            std::size_t size() const noexcept { return workers.size(); }
+
+        private:
+            struct worker
+            {
+                std::mutex                              lock;
+                std::deque<std::coroutine_handle<>>     queue;
+                std::thread                             thread;
+            };
+
+            // which executor and worker the current thread is, if any
+            struct thread_identity
+            {
+                work_stealing_executor* owner   = nullptr;
+                std::size_t             index   = 0;
+            };
+
+            static thread_identity& identity() noexcept
+            {
+                thread_local thread_identity current;
+                return current;
+            }
+
+            static void on_done(void* context) noexcept;
+
+            void run(std::size_t index) noexcept;
+            void push(std::size_t index, std::coroutine_handle<> ready) noexcept;
+            std::coroutine_handle<> take(std::size_t index) noexcept;
+
+            io_scheduler                            io;
+            std::vector<std::unique_ptr<worker>>    workers;
+            std::atomic<std::size_t>                next_worker     = 0;
+
+            // a poller only sleeps in poll() while nothing is queued
+            std::mutex                              poll_lock;
+            std::atomic<bool>                       polling         = false;
+
+            std::atomic<std::size_t>                queued          = 0;
+            std::atomic<std::size_t>                sleepers        = 0;
+            std::mutex                              idle_lock;
+            std::condition_variable                 idle;
+
+            std::atomic<std::size_t>                live            = 0;
+            std::mutex                              finished_lock;
+            std::condition_variable                 finished;
+
+            std::atomic<bool>                       stopping        = false;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline io_scheduler::io_scheduler(bool in_shared, std::size_t max_events) noexcept
+        : loop(max_events), shared(in_shared)
+    {
+        if (!loop)
+            return;
+
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd >= 0 && loop.add(wake_fd, reactor::readable, reactor_handler::member<&io_scheduler::on_wake>(this)))
+        {
+            ::close(wake_fd);
+            wake_fd = -1;
+        }
+
+        detail::socket_close_hook.store(&io_scheduler::release_current, std::memory_order_release);
+    }
+
+    inline io_scheduler::~io_scheduler()
+    {
+        if (wake_fd >= 0)
+            ::close(wake_fd);
+    }
+
+    inline bool io_scheduler::suspend(io_operation& operation) noexcept
+    {
+        std::unique_lock lock(state_lock, std::defer_lock);
+
+        while (true)
+        {
+            if (operation.perform(&operation))
+                return false;
+
+            if (shared)
+                lock.lock();
+
+            const std::size_t index = static_cast<std::size_t>(operation.fd);
+            if (index >= states.size())
+                states.resize(std::max(index + 1, states.size() * 2));
+
+            fd_state& state = states[index];
+            bool& ready = operation.writing ? state.write_ready : state.read_ready;
+
+            // it became ready between the attempt and taking the lock
+            if (ready)
+            {
+                ready = false;
+                if (shared)
+                    lock.unlock();
+                continue;
+            }
+
+            (operation.writing ? state.writer : state.reader) = &operation;
+            operation.parked = this;
+
+            // Arming it on every wait costs a syscall, but a closed socket drops
+            // out of epoll by itself and its fd number comes back with the next
+            // accept.  Re-arming reports the current state as a new edge.  What
+            // waited on the old socket was released by socket::close(), an fd
+            // closed some other way needs a release() by hand.
+            const uint32_t interest = reactor::readable | reactor::writable;
+            const reactor_handler handler = reactor_handler::member<&io_scheduler::on_event>(this);
+
+            if (loop.modify(operation.fd, interest, handler) && loop.add(operation.fd, interest, handler))
+            {
+                (operation.writing ? state.writer : state.reader) = nullptr;
+                operation.parked = nullptr;
+                operation.failure = error_code(error_domain::network_error, error_code::poll_error);
+                return false;
+            }
+
+            // the poller may resume it as soon as the lock is gone, do not touch it after
+            return true;
+        }
+    }
+
+    inline void io_scheduler::poll(std::vector<std::coroutine_handle<>>& ready, int timeout_ms) noexcept
+    {
+        if (shared)
+        {
+            // wait without the lock so other threads can park operations
+            // meanwhile, no longer than until the next timer is due
+            if (timeout_ms != 0)
+            {
+                int wait_ms;
+                {
+                    std::lock_guard lock(state_lock);
+                    const int64_t next_timer = loop.timers().next_timeout().count();
+
+                    wait_ms = next_timer >= 0 && (timeout_ms < 0 || next_timer < timeout_ms)
+                            ? static_cast<int>(std::min<int64_t>(next_timer, std::numeric_limits<int>::max()))
+                            : timeout_ms;
+                }
+
+                pollfd waiting{ loop.native_handle(), POLLIN, 0 };
+                while (::poll(&waiting, 1, wait_ms) == -1 && errno == EINTR) {}
+            }
+
+            // dispatches the events and fires the timers that came due
+            std::lock_guard lock(state_lock);
+            loop.run_once(std::chrono::milliseconds(0));
+
+            ready.insert(ready.end(), completed.begin(), completed.end());
+            completed.clear();
+        } else {
+            loop.run_once(std::chrono::milliseconds(timeout_ms));
+
+            ready.insert(ready.end(), completed.begin(), completed.end());
+            completed.clear();
+        }
+    }
+
+    inline void io_scheduler::wake() noexcept
+    {
+        const uint64_t one = 1;
+        (void) !::write(wake_fd, &one, sizeof(one));
+    }
+
+    inline void io_scheduler::schedule(timer& target, std::chrono::milliseconds after, timer_handler handler) noexcept
+    {
+        std::unique_lock lock(state_lock, std::defer_lock);
+        if (shared)
+            lock.lock();
+
+        loop.timers().schedule(target, after, handler);
+
+        // a poller already waiting does not know about this one yet
+        if (shared)
+            wake();
+    }
+
+    inline void io_scheduler::cancel(timer& target) noexcept
+    {
+        std::unique_lock lock(state_lock, std::defer_lock);
+        if (shared)
+            lock.lock();
+
+        loop.timers().cancel(target);
+    }
+
+    inline void io_scheduler::release(os::socket_type fd) noexcept
+    {
+        std::unique_lock lock(state_lock, std::defer_lock);
+        if (shared)
+            lock.lock();
+
+        const std::size_t index = static_cast<std::size_t>(fd);
+        if (fd < 0 || index >= states.size())
+            return;
+
+        bool failed = false;
+        for (io_operation* waiting : { states[index].reader, states[index].writer })
+        {
+            if (waiting == nullptr)
+                continue;
+
+            waiting->failure = error_code(error_domain::network_error, error_code::connection_reset);
+            waiting->parked = nullptr;
+            completed.push_back(waiting->waiter);
+            failed = true;
+        }
+
+        states[index] = {};
+        loop.remove(fd);
+
+        // no event will come for them, the next poll must not wait
+        if (failed)
+            wake();
+    }
+
+    inline void io_scheduler::release_current(os::socket_type fd) noexcept
+    {
+        if (io_scheduler* scheduler = current())
+            scheduler->release(fd);
+    }
+
+    inline void io_scheduler::forget(io_operation& operation) noexcept
+    {
+        std::unique_lock lock(state_lock, std::defer_lock);
+        if (shared)
+            lock.lock();
+
+        const std::size_t index = static_cast<std::size_t>(operation.fd);
+        if (operation.fd >= 0 && index < states.size())
+        {
+            io_operation*& slot = operation.writing ? states[index].writer : states[index].reader;
+            if (slot == &operation)
+                slot = nullptr;
+        }
+
+        operation.parked = nullptr;
+    }
+
+    inline void io_scheduler::on_event(os::socket_type fd, uint32_t events) noexcept
+    {
+        const std::size_t index = static_cast<std::size_t>(fd);
+        if (index >= states.size())
+            return;
+
+        fd_state& state = states[index];
+
+        // errors and hang-ups end both directions, the operations find out themselves
+        if (events & (reactor::readable | reactor::closed | reactor::failed))
+            complete(state.reader, state.read_ready);
+        if (events & (reactor::writable | reactor::closed | reactor::failed))
+            complete(state.writer, state.write_ready);
+    }
+
+    inline void io_scheduler::complete(io_operation*& slot, bool& ready) noexcept
+    {
+        if (slot == nullptr)
+        {
+            ready = true;
+            return;
+        }
+
+        if (slot->perform(slot))
+        {
+            slot->parked = nullptr;
+            completed.push_back(slot->waiter);
+            slot = nullptr;
+        }
+    }
+
+    inline io_operation::~io_operation()
+    {
+        if (parked != nullptr)
+            parked->forget(*this);
+    }
+
+    inline void io_scheduler::on_wake(os::socket_type fd, uint32_t) noexcept
+    {
+        uint64_t count;
+        (void) !::read(fd, &count, sizeof(count));
+    }
+
+    inline bool recv_awaitable::attempt() noexcept
+    {
+        while (true)
+        {
+            ssize_t bytes = ::recv(fd, target.data(), target.size(), MSG_DONTWAIT);
+            if (bytes >= 0)
+            {
+                result = static_cast<size_t>(bytes);
+                return true;
+            }
+
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+
+            result = tl::unexpected(error_code(error_domain::network_error, error_code::connection_reset));
+            return true;
+        }
+    }
+
+    inline bool send_awaitable::attempt() noexcept
+    {
+        while (sent < data.size())
+        {
+            ssize_t bytes = ::send(fd, data.data() + sent, data.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (bytes >= 0)
+            {
+                sent += static_cast<size_t>(bytes);
+                continue;
+            }
+
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+
+            result = error_code(error_domain::network_error, error_code::failed_to_send_data);
+            return true;
+        }
+
+        return true;
+    }
+
+    template <typename Socket>
+    bool accept_awaitable<Socket>::attempt() noexcept
+    {
+        while (true)
+        {
+            address peer;
+            socklen_t peer_size = address::capacity();
+
+            os::socket_type connection = ::accept4(this->fd, peer.data(), &peer_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (connection != os::invalid_socket)
+            {
+                peer.resize(peer_size);
+                result = accepted_connection<Socket>{ socket<Socket>(connection, family), peer };
+                return true;
+            }
+
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+
+            result = tl::unexpected(error_code(error_domain::network_error, error_code::from_errno()));
+            return true;
+        }
+    }
+
+    template <typename Socket, bool Owning>
+    bool connect_awaitable<Socket, Owning>::attempt() noexcept
+    {
+        // the first attempt starts the connection, the ones after the socket
+        // became writable collect the outcome
+        if (this->fd == os::invalid_socket)
+        {
+            os::socket_type connection = ::socket(to.family(), Socket::type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (connection == os::invalid_socket)
+            {
+                result = error_code(error_domain::network_error, error_code::cannot_open_socket);
+                return true;
+            }
+
+            // the socket owns it from here, failures included
+            target = socket<Socket, Owning>(connection, to.family());
+            this->fd = connection;
+
+            if (::connect(connection, to.data(), to.size()) == 0)
+                return true;
+
+            if (errno != EINPROGRESS)
+            {
+                result = error_code(error_domain::network_error, error_code::cannot_open_socket);
+                return true;
+            }
+
+            return false;
+        }
+
+        int status = 0;
+        socklen_t status_size = sizeof(status);
+        if (getsockopt(this->fd, SOL_SOCKET, SO_ERROR, &status, &status_size) == -1)
+            status = errno;
+
+        if (status == EINPROGRESS || status == EALREADY)
+            return false;
+
+        if (status != 0)
+            result = error_code(error_domain::network_error, error_code::cannot_open_socket);
+
+        return true;
+    }
+
+    template <typename SocketType, bool Owner>
+    recv_awaitable socket<SocketType, Owner>::async_recv(std::span<std::byte> target) noexcept
+    {
+        return recv_awaitable(native_handle(), target);
+    }
+
+    template <typename SocketType, bool Owner>
+    send_awaitable socket<SocketType, Owner>::async_send(std::span<const std::byte> data) noexcept
+    {
+        return send_awaitable(native_handle(), data);
+    }
+
+    template <typename SocketType, bool Owner>
+    accept_awaitable<SocketType> socket<SocketType, Owner>::async_accept() noexcept requires (SocketType::type == SOCK_STREAM)
+    {
+        return accept_awaitable<SocketType>(native_handle(), socket_ipv4 == disabled ? AF_INET6 : AF_INET);
+    }
+
+    template <typename SocketType, bool Owner>
+    connect_awaitable<SocketType, Owner> socket<SocketType, Owner>::async_connect(const address& to) noexcept
+    {
+        return connect_awaitable<SocketType, Owner>(*this, to);
+    }
+
+    inline void single_thread_executor::spawn(task<> work) noexcept
+    {
+        auto handle = work.release();
+        if (!handle)
+            return;
+
+        handle.promise().on_done = &single_thread_executor::on_done;
+        handle.promise().done_context = this;
+
+        ++live;
+        ready.push_back(handle);
+    }
+
+    inline error_code single_thread_executor::run() noexcept
+    {
+        if (!io)
+            return error_code(error_domain::network_error, error_code::poll_error);
+
+        io_scheduler*& current = io_scheduler::current();
+        io_scheduler* const previous = std::exchange(current, &io);
+
+        stopping = false;
+
+        while (!stopping && live > 0)
+        {
+            // only what is ready now, I/O gets a look in between rounds
+            for (std::size_t count = ready.size(); count > 0 && !stopping; --count)
+            {
+                std::coroutine_handle<> next = ready.front();
+                ready.pop_front();
+                next.resume();
+            }
+
+            if (live == 0 || stopping)
+                break;
+
+            io.poll(resumed, ready.empty() ? -1 : 0);
+            ready.insert(ready.end(), resumed.begin(), resumed.end());
+            resumed.clear();
+        }
+
+        current = previous;
+        return error_code::success;
+    }
+
+    inline work_stealing_executor::work_stealing_executor(std::size_t threads, std::size_t max_events) noexcept
+        : io(true, max_events)
+    {
+        if (!io)
+            return;
+
+        threads = std::max<std::size_t>(threads, 1);
+
+        workers.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i)
+            workers.push_back(std::make_unique<worker>());
+
+        // every queue exists before any thread looks for work to steal
+        for (std::size_t i = 0; i < threads; ++i)
+            workers[i]->thread = std::thread([this, i]{ run(i); });
+    }
+
+    inline work_stealing_executor::~work_stealing_executor()
+    {
+        stop();
+    }
+
+    inline void work_stealing_executor::spawn(task<> work) noexcept
+    {
+        auto handle = work.release();
+        if (!handle || workers.empty())
+            return;
+
+        handle.promise().on_done = &work_stealing_executor::on_done;
+        handle.promise().done_context = this;
+
+        ++live;
+
+        // spawned from one of our threads it stays there, from anywhere else the
+        // threads take turns
+        const thread_identity& self = identity();
+        push(self.owner == this ? self.index : next_worker++ % workers.size(), handle);
+    }
+
+    inline void work_stealing_executor::on_done(void* context) noexcept
+    {
+        auto* self = static_cast<work_stealing_executor*>(context);
+        if (--self->live == 0)
+        {
+            std::lock_guard lock(self->finished_lock);
+            self->finished.notify_all();
+        }
+    }
+
+    inline void work_stealing_executor::wait() noexcept
+    {
+        std::unique_lock lock(finished_lock);
+        finished.wait(lock, [this]{ return live == 0; });
+    }
+
+    inline void work_stealing_executor::stop() noexcept
+    {
+        stopping = true;
+
+        if (io)
+            io.wake();
+
+        {
+            std::lock_guard lock(idle_lock);
+            idle.notify_all();
+        }
+
+        for (auto& w : workers)
+        {
+            if (w->thread.joinable())
+                w->thread.join();
+        }
+    }
+
+    inline void work_stealing_executor::push(std::size_t index, std::coroutine_handle<> ready) noexcept
+    {
+        {
+            std::lock_guard lock(workers[index]->lock);
+            workers[index]->queue.push_back(ready);
+        }
+
+        ++queued;
+
+        // Both sides announce themselves before checking the other, so either
+        // the sleeper sees the work or we see the sleeper
+        if (sleepers > 0)
+        {
+            { std::lock_guard lock(idle_lock); }
+            idle.notify_one();
+        }
+
+        if (polling)
+            io.wake();
+    }
+
+    inline std::coroutine_handle<> work_stealing_executor::take(std::size_t index) noexcept
+    {
+        for (std::size_t i = 0; i < workers.size(); ++i)
+        {
+            worker& victim = *workers[(index + i) % workers.size()];
+
+            std::lock_guard lock(victim.lock);
+            if (victim.queue.empty())
+                continue;
+
+            // our own work in order, stolen work from the other end
+            std::coroutine_handle<> next;
+            if (i == 0)
+            {
+                next = victim.queue.front();
+                victim.queue.pop_front();
+            } else {
+                next = victim.queue.back();
+                victim.queue.pop_back();
+            }
+
+            --queued;
+            return next;
+        }
+
+        return {};
+    }
+
+    inline void work_stealing_executor::run(std::size_t index) noexcept
+    {
+        io_scheduler::current() = &io;
+        identity() = { this, index };
+
+        std::vector<std::coroutine_handle<>> resumed;
+
+        while (!stopping)
+        {
+            if (std::coroutine_handle<> next = take(index))
+            {
+                next.resume();
+                continue;
+            }
+
+            if (poll_lock.try_lock())
+            {
+                polling = true;
+                io.poll(resumed, queued > 0 ? 0 : -1);
+                polling = false;
+                poll_lock.unlock();
+
+                for (std::coroutine_handle<> ready : resumed)
+                    push(index, ready);
+                resumed.clear();
+
+                continue;
+            }
+
+            // someone else is polling, wait for work
+            std::unique_lock lock(idle_lock);
+            ++sleepers;
+            idle.wait_for(lock, std::chrono::milliseconds(10), [this]{ return queued > 0 || stopping; });
+            --sleepers;
+        }
+
+        io_scheduler::current() = nullptr;
+        identity() = {};
+    }
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef UNORTHODOX_NETWORK_DATAGRAM_HPP
+#define UNORTHODOX_NETWORK_DATAGRAM_HPP
+
+#include <unorthodox/network/address.hpp>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/udp.h>
+
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace unorthodox::net
+{
+    template <typename Socket, bool Owning>
+    class socket;
+
+    // One datagram for send_batch.  The payload is not copied, it has to stay
+    // valid until send_batch returns.
+    struct outgoing_datagram
+    {
+        std::span<const std::byte> payload;
+
+        // nullptr on a connected socket
+        const address*  to              = nullptr;
+
+        // Linux GSO: the kernel splits payload into datagrams of this size, the
+        // last one may be shorter.  0 sends payload as a single datagram.
+        uint16_t        segment_size    = 0;
+    };
+
+    // What recv_batch filled in, valid until the next recv_batch
+    struct received_datagram
+    {
+        std::span<const std::byte>  payload;
+        const address&              from;
+
+        // Linux GRO: payload holds several datagrams of segment_size bytes from
+        // the same sender, the last may be shorter.  0 for a single datagram.
+        uint16_t                    segment_size;
+
+        // payload was cut to the slot size, the rest is lost
+        bool                        truncated;
+    };
+
+    // The message headers, payload slots and address slots for recv_batch, all
+    // allocated once up front.  Every slot holds one datagram, or with GRO one
+    // run of coalesced datagrams, so give those up to 64K.
+    class datagram_batch
+    {
+        public:
+            datagram_batch(std::size_t max_datagrams, std::size_t slot_size = 2048) noexcept;
+
+            datagram_batch(datagram_batch&&) noexcept = default;
+            datagram_batch& operator=(datagram_batch&&) noexcept = default;
+
+            // false if the allocation failed
+            operator bool() const noexcept { return headers != nullptr; }
+
+            // how many the last recv_batch received
+            std::size_t size() const noexcept { return count; }
+            std::size_t capacity() const noexcept { return slots; }
+            bool        empty() const noexcept { return count == 0; }
+
+            received_datagram operator[](std::size_t index) const noexcept;
+
+        private:
+            template <typename, bool> friend class socket;
+
+            // room for one UDP_GRO cmsg
+            constexpr static std::size_t control_size = CMSG_SPACE(sizeof(int));
+
+            // resets what the kernel overwrote last time
+            mmsghdr*    prepare() noexcept;
+            void        complete(std::size_t received) noexcept;
+
+            std::size_t                     slots       = 0;
+            std::size_t                     slot_size   = 0;
+            std::size_t                     count       = 0;
+
+            std::unique_ptr<std::byte[]>    payloads;
+            std::unique_ptr<mmsghdr[]>      headers;
+            std::unique_ptr<iovec[]>        vectors;
+            std::unique_ptr<address[]>      peers;
+            std::unique_ptr<uint16_t[]>     segments;
+            std::unique_ptr<char[]>         controls;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline datagram_batch::datagram_batch(std::size_t max_datagrams, std::size_t in_slot_size) noexcept
+        : slots(std::max<std::size_t>(max_datagrams, 1)), slot_size(std::max<std::size_t>(in_slot_size, 1))
+    {
+        payloads.reset(new (std::nothrow) std::byte[slots * slot_size]);
+        vectors.reset(new (std::nothrow) iovec[slots]);
+        peers.reset(new (std::nothrow) address[slots]);
+        segments.reset(new (std::nothrow) uint16_t[slots]);
+
+        // cmsg headers are read in place, keep every slot aligned for them
+        controls.reset(new (std::nothrow) char[slots * control_size]);
+
+        if (payloads && vectors && peers && segments && controls)
+            headers.reset(new (std::nothrow) mmsghdr[slots]);
+
+        if (!headers)
+            slots = 0;
+    }
+
+    inline mmsghdr* datagram_batch::prepare() noexcept
+    {
+        count = 0;
+
+        for (std::size_t i = 0; i < slots; ++i)
+        {
+            vectors[i].iov_base = payloads.get() + i * slot_size;
+            vectors[i].iov_len = slot_size;
+
+            msghdr& header = headers[i].msg_hdr;
+            header = msghdr{};
+            header.msg_name = peers[i].data();
+            header.msg_namelen = address::capacity();
+            header.msg_iov = &vectors[i];
+            header.msg_iovlen = 1;
+            header.msg_control = controls.get() + i * control_size;
+            header.msg_controllen = control_size;
+
+            headers[i].msg_len = 0;
+        }
+
+        return headers.get();
+    }
+
+    inline void datagram_batch::complete(std::size_t received) noexcept
+    {
+        count = received;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            msghdr& header = headers[i].msg_hdr;
+            peers[i].resize(header.msg_namelen);
+            segments[i] = 0;
+
+            #if defined(UDP_GRO)
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                {
+                    int segment;
+                    std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+
+                    // a single datagram reports its own size, that is not a run
+                    if (static_cast<unsigned>(segment) < headers[i].msg_len)
+                        segments[i] = static_cast<uint16_t>(segment);
+                }
+            }
+            #endif
+        }
+    }
+
+    inline received_datagram datagram_batch::operator[](std::size_t index) const noexcept
+    {
+        return { std::span<const std::byte>(payloads.get() + index * slot_size, headers[index].msg_len),
+                 peers[index],
+                 segments[index],
+                 (headers[index].msg_hdr.msg_flags & MSG_TRUNC) != 0 };
+    }
+}
+
+#endif
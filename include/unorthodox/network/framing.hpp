@@ -0,0 +1,381 @@
+#ifndef UNORTHODOX_NETWORK_FRAMING_HPP
+#define UNORTHODOX_NETWORK_FRAMING_HPP
+
+#include <unorthodox/buffer.hpp>
+#include <unorthodox/network/sockets.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace unorthodox::net
+{
+    // How a frame's payload length is written in front of it.  The fixed
+    // widths are big-endian, varint is LEB128 like protobuf uses.
+    enum class frame_prefix : uint8_t
+    {
+        u8      = 1,
+        u16     = 2,
+        u32     = 4,
+        u64     = 8,
+        varint  = 0,
+    };
+
+    struct frame_format
+    {
+        frame_prefix    prefix      = frame_prefix::u32;
+
+        // Longer frames fail with invalid_frame instead of being buffered, a
+        // peer cannot make the decoder allocate whatever it likes
+        std::size_t     max_frame   = 16 * 1024 * 1024;
+    };
+
+    // The length prefix at the start of some bytes
+    struct frame_header
+    {
+        std::size_t     header_size;
+        uint64_t        length;
+    };
+
+    // Bytes a varint needs for value, 1 to 10
+    constexpr std::size_t varint_size(uint64_t value) noexcept;
+
+    // Header bytes for a frame of length bytes, the fixed width or the
+    // shortest varint
+    constexpr std::size_t frame_header_size(const frame_format& format, uint64_t length) noexcept;
+
+    // Writes the header for length into target, which needs frame_header_size
+    // bytes, and returns how many were written.  0 if it does not fit or
+    // length cannot be expressed with the prefix.
+    std::size_t encode_frame_header(const frame_format& format, uint64_t length, std::span<std::byte> target) noexcept;
+
+    // would_block while the header is still incomplete, invalid_frame for a
+    // varint that runs on too long or a length over max_frame
+    tl::expected<frame_header, error_code> decode_frame_header(const frame_format& format, std::span<const std::byte> source) noexcept;
+
+    // Splits a byte stream into frames.  Data is received straight into one
+    // buffer and every complete frame is handed out as a view into it, nothing
+    // is copied out.  A frame that is only partly there stays where it is
+    // until the rest arrives; the space before it is only reclaimed once
+    // there is enough of it to be worth moving the partial frame down.
+    class frame_decoder
+    {
+        public:
+            using size_type = std::size_t;
+
+            explicit frame_decoder(frame_format format = {}) noexcept : fmt(format) {}
+
+            // Receives once into the buffer, what recv_into returns
+            template <typename Socket>
+            tl::expected<size_t, error_code> read_from(Socket& source, recv_mode mode = recv_mode::once) noexcept;
+
+            // For bytes that came from somewhere else
+            void        feed(std::span<const std::byte> data) noexcept;
+
+            // The payload of the next complete frame.  would_block until there is
+            // one, invalid_frame if the stream is broken, which it then stays.
+            // Views are valid until the next read_from or feed.
+            tl::expected<std::span<const std::byte>, error_code> next() noexcept;
+
+            // bytes received and not handed out yet
+            size_type   buffered() const noexcept { return incoming.size() - start; }
+            void        clear() noexcept { incoming.clear(); start = 0; wanted = 0; broken = false; }
+
+            const frame_format& format() const noexcept { return fmt; }
+
+        private:
+            // moves what is left to the front if that frees enough, then makes
+            // room for at least count more
+            void        make_room(size_type count) noexcept;
+
+            frame_format    fmt;
+            buffer          incoming;
+
+            // everything before this has been handed out
+            size_type       start       = 0;
+
+            // the length the frame at start needs in total, known once its
+            // header is in
+            size_type       wanted      = 0;
+            bool            broken      = false;
+    };
+
+    // Builds frames in a buffer with the payload written straight after the
+    // header.  begin() leaves room for the header, the payload is appended to
+    // the buffer as usual, and end() fills the header in.  A varint header is
+    // sized for max_frame up front and padded with continuation bytes, as
+    // varint decoders accept, so the payload never has to move.
+    class frame_encoder
+    {
+        public:
+            using size_type = std::size_t;
+
+            explicit frame_encoder(buffer& target, frame_format format = {}) noexcept : out(target), fmt(format) {}
+
+            // false if the buffer could not grow
+            bool        begin() noexcept;
+
+            // invalid_frame if the payload is over max_frame, the frame is
+            // dropped from the buffer then
+            error_code  end() noexcept;
+
+            // begin, append payload, end
+            error_code  write(std::span<const std::byte> payload) noexcept;
+
+            // the header size begin() reserves
+            size_type   reserved() const noexcept;
+
+        private:
+            constexpr static size_type npos = ~size_type(0);
+
+            buffer&         out;
+            frame_format    fmt;
+
+            // where the open frame's header starts, npos if none is open
+            size_type       frame_start = npos;
+    };
+}
+
+namespace unorthodox::net
+{
+    constexpr std::size_t varint_size(uint64_t value) noexcept
+    {
+        std::size_t size = 1;
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            ++size;
+        }
+
+        return size;
+    }
+
+    constexpr std::size_t frame_header_size(const frame_format& format, uint64_t length) noexcept
+    {
+        if (format.prefix == frame_prefix::varint)
+            return varint_size(length);
+
+        return static_cast<std::size_t>(format.prefix);
+    }
+
+    namespace detail
+    {
+        // a varint exactly width bytes long, padded with continuation bytes
+        inline void write_varint(uint64_t value, std::byte* target, std::size_t width) noexcept
+        {
+            for (std::size_t i = 0; i + 1 < width; ++i)
+            {
+                target[i] = static_cast<std::byte>((value & 0x7f) | 0x80);
+                value >>= 7;
+            }
+
+            target[width - 1] = static_cast<std::byte>(value & 0x7f);
+        }
+
+        inline void write_fixed(uint64_t value, std::byte* target, std::size_t width) noexcept
+        {
+            for (std::size_t i = width; i > 0; --i)
+            {
+                target[i - 1] = static_cast<std::byte>(value & 0xff);
+                value >>= 8;
+            }
+        }
+
+        constexpr bool fits_prefix(const frame_format& format, uint64_t length, std::size_t width) noexcept
+        {
+            if (format.prefix == frame_prefix::varint)
+                return width >= 10 || length < (uint64_t(1) << (7 * width));
+
+            return width >= 8 || length < (uint64_t(1) << (8 * width));
+        }
+    }
+
+    inline std::size_t encode_frame_header(const frame_format& format, uint64_t length, std::span<std::byte> target) noexcept
+    {
+        const std::size_t width = frame_header_size(format, length);
+        if (target.size() < width || !detail::fits_prefix(format, length, width))
+            return 0;
+
+        if (format.prefix == frame_prefix::varint)
+            detail::write_varint(length, target.data(), width);
+        else
+            detail::write_fixed(length, target.data(), width);
+
+        return width;
+    }
+
+    inline tl::expected<frame_header, error_code> decode_frame_header(const frame_format& format, std::span<const std::byte> source) noexcept
+    {
+        uint64_t length = 0;
+        std::size_t header_size = 0;
+
+        if (format.prefix == frame_prefix::varint)
+        {
+            for (std::size_t i = 0; ; ++i)
+            {
+                if (i == source.size())
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+
+                // ten bytes hold 64 bits, the tenth only has one to give
+                const uint64_t bits = std::to_integer<uint64_t>(source[i] & std::byte(0x7f));
+                if (i == 9 && bits > 1)
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::invalid_frame));
+
+                length |= bits << (7 * i);
+
+                if ((source[i] & std::byte(0x80)) == std::byte(0))
+                {
+                    header_size = i + 1;
+                    break;
+                }
+
+                if (i == 9)
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::invalid_frame));
+            }
+        } else {
+            header_size = static_cast<std::size_t>(format.prefix);
+            if (source.size() < header_size)
+                return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+
+            for (std::size_t i = 0; i < header_size; ++i)
+                length = (length << 8) | std::to_integer<uint64_t>(source[i]);
+        }
+
+        if (length > format.max_frame)
+            return tl::unexpected(error_code(error_domain::network_error, error_value::invalid_frame));
+
+        return frame_header{ header_size, length };
+    }
+
+    template <typename Socket>
+    tl::expected<size_t, error_code> frame_decoder::read_from(Socket& source, recv_mode mode) noexcept
+    {
+        make_room(wanted > buffered() ? wanted - buffered() : 0);
+        return source.recv_into(incoming, mode);
+    }
+
+    inline void frame_decoder::feed(std::span<const std::byte> data) noexcept
+    {
+        make_room(data.size());
+        incoming.append(data);
+    }
+
+    inline void frame_decoder::make_room(size_type count) noexcept
+    {
+        const size_type left = buffered();
+
+        // nothing left, starting over at the front costs nothing
+        if (left == 0)
+        {
+            incoming.clear();
+            start = 0;
+        }
+
+        // Moving the partial frame down is worth it once the space before it
+        // is at least as large as it is, then every byte is moved at most once
+        // for every byte handed out.  Until then the buffer grows instead.
+        else if (start > 0 && (start >= left || incoming.size() + count > incoming.capacity()))
+        {
+            std::memmove(incoming.data(), incoming.data() + start, left);
+            incoming.resize(left);
+            start = 0;
+        }
+
+        // the whole frame in one allocation rather than growing for every read
+        if (incoming.size() + count > incoming.capacity())
+            incoming.reserve(incoming.size() + count);
+    }
+
+    inline tl::expected<std::span<const std::byte>, error_code> frame_decoder::next() noexcept
+    {
+        if (broken)
+            return tl::unexpected(error_code(error_domain::network_error, error_value::invalid_frame));
+
+        const std::span<const std::byte> pending(incoming.data() + start, buffered());
+
+        auto header = decode_frame_header(fmt, pending);
+        if (!header)
+        {
+            if (header.error().code == error_value::invalid_frame)
+                broken = true;
+            return tl::unexpected(header.error());
+        }
+
+        const size_type total = header->header_size + static_cast<size_type>(header->length);
+        if (pending.size() < total)
+        {
+            wanted = total;
+            return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+        }
+
+        wanted = 0;
+        start += total;
+
+        return pending.subspan(header->header_size, static_cast<size_type>(header->length));
+    }
+
+    inline frame_encoder::size_type frame_encoder::reserved() const noexcept
+    {
+        if (fmt.prefix == frame_prefix::varint)
+            return varint_size(fmt.max_frame);
+
+        return static_cast<size_type>(fmt.prefix);
+    }
+
+    inline bool frame_encoder::begin() noexcept
+    {
+        const size_type header = reserved();
+        if (out.prepare(header).empty())
+            return false;
+
+        frame_start = out.size();
+        out.commit(header);
+        return true;
+    }
+
+    inline error_code frame_encoder::end() noexcept
+    {
+        if (frame_start == npos)
+            return error_code(error_domain::network_error, error_value::invalid_argument);
+
+        const size_type header = reserved();
+        const size_type length = out.size() - frame_start - header;
+
+        const size_type opened = frame_start;
+        frame_start = npos;
+
+        if (length > fmt.max_frame || !detail::fits_prefix(fmt, length, header))
+        {
+            out.resize(opened);
+            return error_code(error_domain::network_error, error_value::invalid_frame);
+        }
+
+        if (fmt.prefix == frame_prefix::varint)
+            detail::write_varint(length, out.data() + opened, header);
+        else
+            detail::write_fixed(length, out.data() + opened, header);
+
+        return error_code::success;
+    }
+
+    inline error_code frame_encoder::write(std::span<const std::byte> payload) noexcept
+    {
+        if (!begin())
+            return error_code(error_domain::network_error, error_value::undefined_error);
+
+        const size_type before = out.size();
+        out.append(payload);
+
+        if (out.size() - before != payload.size())
+        {
+            out.resize(frame_start);
+            frame_start = npos;
+            return error_code(error_domain::network_error, error_value::undefined_error);
+        }
+
+        return end();
+    }
+}
+
+#endif
@@ -0,0 +1,409 @@
+#ifndef UNORTHODOX_NETWORK_REACTOR_HPP
+#define UNORTHODOX_NETWORK_REACTOR_HPP
+
+#include <unorthodox/network/sockets.hpp>
+#include <unorthodox/timer_wheel.hpp>
+
+#if !defined(UNORTHODOX_OS_LINUX)
+# error the reactor is only implemented on top of epoll so far
+#endif
+
+#include <sys/epoll.h>
+#include <fcntl.h>
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace unorthodox::net
+{
+    class reactor;
+
+    #if defined(HAS_CPPEVENTS)
+    namespace detail
+    {
+        // re-points the cppevents entry for epoll_fd from one reactor to another
+        inline void point_events(int epoll_fd, const reactor* from, reactor* to) noexcept;
+    }
+    #endif
+
+    // What a handler gets called with: a context pointer it was registered with,
+    // the fd and the epoll event mask.  Plain function pointers so dispatching an
+    // event never allocates.
+    struct reactor_handler
+    {
+        using function_type = void (*)(void* context, os::socket_type fd, uint32_t events) noexcept;
+
+        function_type   function    = nullptr;
+        void*           context     = nullptr;
+
+        // Calls object->Method(fd, events)
+        template <auto Method, typename T>
+        static reactor_handler member(T* object) noexcept
+        {
+            return { [](void* context, os::socket_type fd, uint32_t events) noexcept {
+                         (static_cast<T*>(context)->*Method)(fd, events);
+                     }, object };
+        }
+    };
+
+    // Edge-triggered epoll loop for any number of sockets.  A handler is told
+    // once when its socket becomes readable or writable and has to read or
+    // write until would_block before it hears about that socket again.
+    //
+    // Registered fds are switched to non-blocking.  Handlers are kept in a table
+    // indexed by fd, a handler may add, modify or remove any fd including its own.
+    // Remove a socket before closing it.
+    //
+    // Read, write and idle timeouts go on timers(): arm a timer kept with the
+    // connection and re-arm it whenever there is progress.  The loop wakes up
+    // for the next one due and fires them after the events.
+    class reactor
+    {
+        public:
+            constexpr static uint32_t readable  = EPOLLIN | EPOLLRDHUP;
+            constexpr static uint32_t writable  = EPOLLOUT;
+
+            // reported in the event mask whether asked for or not
+            constexpr static uint32_t closed    = EPOLLRDHUP | EPOLLHUP;
+            constexpr static uint32_t failed    = EPOLLERR;
+
+            // max_events is how many events one epoll_wait can return
+            explicit reactor(std::size_t max_events = 1024) noexcept;
+
+            reactor(reactor&& other) noexcept;
+            reactor& operator=(reactor&& other) noexcept;
+
+            reactor(const reactor&) = delete;
+            reactor& operator=(const reactor&) = delete;
+
+           ~reactor();
+
+            operator bool() const noexcept { return epoll_fd >= 0; }
+            error_code error() const noexcept { return status; }
+
+            error_code add(os::socket_type fd, uint32_t interest, reactor_handler handler) noexcept;
+            error_code modify(os::socket_type fd, uint32_t interest, reactor_handler handler) noexcept;
+            error_code remove(os::socket_type fd) noexcept;
+
+            // every open fd of the socket, both of them for a dual-stack listener
+            template <typename Socket, bool Owner>
+            error_code add(const socket<Socket, Owner>& target, uint32_t interest, reactor_handler handler) noexcept;
+
+            template <typename Socket, bool Owner>
+            error_code remove(const socket<Socket, Owner>& target) noexcept;
+
+            // Waits up to timeout for events and dispatches them, then fires the
+            // timers that are due.  Returns how many events and timers were
+            // dispatched.  A negative timeout waits for ever, or until a timer.
+            tl::expected<std::size_t, error_code> run_once(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1)) noexcept;
+
+            // run_once until stop()
+            error_code run() noexcept;
+            void stop() noexcept { stopping = true; }
+
+            std::size_t size() const noexcept { return registered; }
+
+            timer_wheel& timers() noexcept { return *wheel; }
+
+            // The epoll fd, readable while any registered socket has events.  Lets
+            // the reactor run inside another loop: poll this, then run_once(0ms).
+            int native_handle() const noexcept { return epoll_fd; }
+
+            #if defined(HAS_CPPEVENTS)
+            // Dispatches from the cppevents loop, each wakeup runs run_once(0ms)
+            void connect_events(cppevents::event_queue& queue);
+            #endif
+
+        private:
+            void release() noexcept;
+
+            int                                 epoll_fd    = -1;
+            error_code                          status      = error_code(error_domain::network_error, error_code::uninitialised_value);
+
+            std::unique_ptr<epoll_event[]>      events;
+            std::size_t                         max_events  = 0;
+
+            // indexed by fd, fds are small and dense
+            std::vector<reactor_handler>        handlers;
+            std::size_t                         registered  = 0;
+
+            bool                                stopping    = false;
+
+            // behind a pointer, scheduled timers point into it and the reactor moves
+            std::unique_ptr<timer_wheel>        wheel;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline reactor::reactor(std::size_t in_max_events) noexcept
+        : max_events(std::max<std::size_t>(in_max_events, 1))
+    {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1)
+        {
+            status = error_code(error_domain::network_error, error_code::poll_error);
+            return;
+        }
+
+        events.reset(new (std::nothrow) epoll_event[max_events]);
+        wheel.reset(new (std::nothrow) timer_wheel());
+        if (!events || !wheel)
+        {
+            release();
+            status = error_code(error_domain::network_error, error_code::undefined_error);
+            return;
+        }
+
+        status = error_code::success;
+    }
+
+    inline reactor::reactor(reactor&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline reactor& reactor::operator=(reactor&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        release();
+
+        epoll_fd = other.epoll_fd;
+
+        #if defined(HAS_CPPEVENTS)
+        detail::point_events(epoll_fd, &other, this);
+        #endif
+
+        status = other.status;
+        events = std::move(other.events);
+        max_events = other.max_events;
+        handlers = std::move(other.handlers);
+        registered = other.registered;
+        stopping = other.stopping;
+        wheel = std::move(other.wheel);
+
+        other.epoll_fd = -1;
+        other.max_events = other.registered = 0;
+        other.status = error_code(error_domain::network_error, error_code::uninitialised_value);
+
+        return *this;
+    }
+
+    inline reactor::~reactor()
+    {
+        release();
+    }
+
+    inline void reactor::release() noexcept
+    {
+        if (epoll_fd >= 0)
+        {
+            // the queue may still wake up for this fd number, it must not find us
+            #if defined(HAS_CPPEVENTS)
+            detail::point_events(epoll_fd, this, nullptr);
+            #endif
+
+            ::close(epoll_fd);
+        }
+        epoll_fd = -1;
+    }
+
+    inline error_code reactor::add(os::socket_type fd, uint32_t interest, reactor_handler handler) noexcept
+    {
+        if (fd < 0 || handler.function == nullptr)
+            return error_code(error_domain::network_error, error_code::invalid_argument);
+
+        // edge-triggered only works if reads and writes never block
+        const int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1))
+            return error_code(error_domain::network_error, error_code::invalid_argument);
+
+        const std::size_t index = static_cast<std::size_t>(fd);
+        if (index >= handlers.size())
+            handlers.resize(std::max(index + 1, handlers.size() * 2));
+
+        epoll_event event{};
+        event.events = interest | EPOLLET;
+        event.data.fd = fd;
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+            return error_code(error_domain::network_error, error_code::poll_error);
+
+        // a slot still taken belonged to an fd closed without remove(), epoll
+        // dropped it by itself and this one takes its place
+        if (handlers[index].function == nullptr)
+            ++registered;
+        handlers[index] = handler;
+
+        return error_code::success;
+    }
+
+    inline error_code reactor::modify(os::socket_type fd, uint32_t interest, reactor_handler handler) noexcept
+    {
+        if (fd < 0 || static_cast<std::size_t>(fd) >= handlers.size() || handler.function == nullptr)
+            return error_code(error_domain::network_error, error_code::invalid_argument);
+
+        epoll_event event{};
+        event.events = interest | EPOLLET;
+        event.data.fd = fd;
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1)
+            return error_code(error_domain::network_error, error_code::poll_error);
+
+        handlers[static_cast<std::size_t>(fd)] = handler;
+
+        return error_code::success;
+    }
+
+    inline error_code reactor::remove(os::socket_type fd) noexcept
+    {
+        if (fd < 0 || static_cast<std::size_t>(fd) >= handlers.size() || handlers[static_cast<std::size_t>(fd)].function == nullptr)
+            return error_code(error_domain::network_error, error_code::invalid_argument);
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1)
+            return error_code(error_domain::network_error, error_code::poll_error);
+
+        // events for it that are already in this round are skipped in run_once
+        handlers[static_cast<std::size_t>(fd)] = {};
+        --registered;
+
+        return error_code::success;
+    }
+
+    template <typename Socket, bool Owner>
+    error_code reactor::add(const socket<Socket, Owner>& target, uint32_t interest, reactor_handler handler) noexcept
+    {
+        error_code result = error_code(error_domain::network_error, error_code::no_active_socket);
+
+        for (os::socket_type fd : target.native_handles())
+        {
+            if (!os::is_active_socket(fd))
+                continue;
+
+            result = add(fd, interest, handler);
+            if (result)
+                return result;
+        }
+
+        return result;
+    }
+
+    template <typename Socket, bool Owner>
+    error_code reactor::remove(const socket<Socket, Owner>& target) noexcept
+    {
+        error_code result = error_code(error_domain::network_error, error_code::no_active_socket);
+
+        for (os::socket_type fd : target.native_handles())
+        {
+            if (os::is_active_socket(fd))
+                result = remove(fd);
+        }
+
+        return result;
+    }
+
+    inline tl::expected<std::size_t, error_code> reactor::run_once(std::chrono::milliseconds timeout) noexcept
+    {
+        if (epoll_fd < 0)
+            return tl::unexpected(status);
+
+        // the next timer cuts the wait short
+        const std::chrono::milliseconds next_timer = wheel->next_timeout();
+        if (next_timer.count() >= 0 && (timeout.count() < 0 || next_timer < timeout))
+            timeout = next_timer;
+
+        const int wait_ms = timeout.count() < 0 ? -1 : static_cast<int>(std::min<int64_t>(timeout.count(), std::numeric_limits<int>::max()));
+
+        int count;
+        do
+        {
+            count = epoll_wait(epoll_fd, events.get(), static_cast<int>(max_events), wait_ms);
+        } while (count == -1 && errno == EINTR);
+
+        if (count == -1)
+            return tl::unexpected(error_code(error_domain::network_error, error_code::poll_error));
+
+        std::size_t dispatched = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const std::size_t fd = static_cast<std::size_t>(events[i].data.fd);
+
+            // read the slot every time, an earlier handler may have changed it
+            const reactor_handler handler = fd < handlers.size() ? handlers[fd] : reactor_handler{};
+            if (handler.function == nullptr)
+                continue;
+
+            handler.function(handler.context, events[i].data.fd, events[i].events);
+            ++dispatched;
+        }
+
+        dispatched += wheel->advance();
+
+        return dispatched;
+    }
+
+    inline error_code reactor::run() noexcept
+    {
+        stopping = false;
+
+        while (!stopping)
+        {
+            auto result = run_once();
+            if (!result)
+                return result.error();
+        }
+
+        return error_code::success;
+    }
+}
+
+#if defined(HAS_CPPEVENTS)
+namespace unorthodox::net
+{
+    namespace detail
+    {
+        // cppevents takes plain functions of the fd, this finds the reactor again
+        inline std::vector<reactor*>& reactors_by_fd()
+        {
+            static std::vector<reactor*> table;
+            return table;
+        }
+
+        inline cppevents::event create_reactor_event(os::socket_type fd)
+        {
+            auto& table = reactors_by_fd();
+            if (static_cast<std::size_t>(fd) < table.size() && table[fd] != nullptr)
+                table[fd]->run_once(std::chrono::milliseconds(0));
+
+            // the handlers did the work already, this only tells the queue which source woke up
+            cppevents::network_event ev;
+            ev.type = cppevents::network_event::socket_ready;
+            ev.sock_handle = fd;
+
+            return ev;
+        }
+    }
+
+    inline void detail::point_events(int epoll_fd, const reactor* from, reactor* to) noexcept
+    {
+        auto& table = reactors_by_fd();
+        if (epoll_fd >= 0 && static_cast<std::size_t>(epoll_fd) < table.size() && table[epoll_fd] == from)
+            table[epoll_fd] = to;
+    }
+
+    inline void reactor::connect_events(cppevents::event_queue& queue)
+    {
+        auto& table = detail::reactors_by_fd();
+        if (static_cast<std::size_t>(epoll_fd) >= table.size())
+            table.resize(epoll_fd + 1, nullptr);
+        table[epoll_fd] = this;
+
+        queue.add_native_source(epoll_fd, detail::create_reactor_event);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef UNORTHODOX_NETWORK_RESOLVER_HPP
+#define UNORTHODOX_NETWORK_RESOLVER_HPP
+
+#include <unorthodox/network/address.hpp>
+#include <unorthodox/thread_pool.hpp>
+
+#include <netdb.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace unorthodox::net
+{
+    struct resolver_options
+    {
+        // lookups that can run at the same time, the threads are only started
+        // by the first name that is not a literal
+        std::size_t             threads         = 2;
+
+        // getaddrinfo does not hand DNS TTLs over, names are kept this long
+        std::chrono::seconds    ttl             = std::chrono::seconds(60);
+
+        // failures are kept too, for less, so a bad name is not looked up again
+        // on every connect
+        std::chrono::seconds    negative_ttl    = std::chrono::seconds(5);
+
+        std::size_t             max_entries     = 4096;
+    };
+
+    // Every address a name resolved to, with the port asked for filled in
+    using resolve_result = tl::expected<std::vector<address>, error_code>;
+    using resolve_callback = std::function<void(resolve_result)>;
+
+    // Name lookups on background threads with getaddrinfo, so /etc/hosts and
+    // the rest of nsswitch work as usual.  Results are cached per name for the
+    // TTL, and asking for a name that is being looked up already waits for that
+    // lookup instead of starting another.  Numeric addresses never get here,
+    // they are parsed in place.
+    class resolver
+    {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            explicit resolver(resolver_options options = {}) noexcept : opts(options) {}
+           ~resolver();
+
+            resolver(const resolver&) = delete;
+            resolver& operator=(const resolver&) = delete;
+
+            // the one socket::connect uses
+            static resolver& global() noexcept;
+
+            // Ready right away for literals and cached names.  Addresses are in the
+            // order getaddrinfo sorted them, host_not_found if there are none.
+            std::future<resolve_result> resolve(std::string_view host, uint16_t port);
+
+            // The same, for event loops that cannot wait on a future.  Called
+            // right away for literals and cached names, on a lookup thread
+            // otherwise.
+            void        resolve(std::string_view host, uint16_t port, resolve_callback on_resolved);
+
+            // forgets every finished entry, lookups in flight still complete
+            void        clear() noexcept;
+
+            std::size_t cached() const noexcept;
+
+            // how many times getaddrinfo ran
+            std::size_t lookups() const noexcept { return lookup_count.load(std::memory_order_relaxed); }
+
+        private:
+            struct waiter
+            {
+                resolve_callback    on_resolved;
+                uint16_t            port;
+            };
+
+            struct entry
+            {
+                std::vector<address>    addresses;
+                error_code              failure     = error_code::success;
+                clock::time_point       expires;
+
+                // a lookup is running, everyone asking meanwhile waits here
+                bool                    pending     = false;
+                std::vector<waiter>     waiters;
+            };
+
+            static resolve_result   with_port(const std::vector<address>& addresses, error_code failure, uint16_t port);
+
+            void        lookup(const std::string& host);
+
+            // makes room for one more, expired entries go first
+            void        evict(clock::time_point now) noexcept;
+
+            resolver_options                        opts;
+
+            mutable std::mutex                      cache_mutex;
+            std::unordered_map<std::string, entry>  entries;
+
+            std::atomic<std::size_t>                lookup_count{ 0 };
+
+            // last, the lookups still running finish before the cache goes away
+            std::unique_ptr<thread_pool>            pool;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline resolver::~resolver()
+    {
+        pool.reset();
+    }
+
+    inline resolver& resolver::global() noexcept
+    {
+        static resolver shared;
+        return shared;
+    }
+
+    inline resolve_result resolver::with_port(const std::vector<address>& addresses, error_code failure, uint16_t port)
+    {
+        if (failure)
+            return tl::unexpected(failure);
+
+        std::vector<address> result = addresses;
+        for (address& entry : result)
+        {
+            if (entry.family() == AF_INET)
+                reinterpret_cast<sockaddr_in*>(entry.data())->sin_port = htons(port);
+            else if (entry.family() == AF_INET6)
+                reinterpret_cast<sockaddr_in6*>(entry.data())->sin6_port = htons(port);
+        }
+
+        return result;
+    }
+
+    inline std::future<resolve_result> resolver::resolve(std::string_view host, uint16_t port)
+    {
+        auto promise = std::make_shared<std::promise<resolve_result>>();
+        std::future<resolve_result> result = promise->get_future();
+
+        resolve(host, port, [promise](resolve_result resolved) {
+            promise->set_value(std::move(resolved));
+        });
+
+        return result;
+    }
+
+    inline void resolver::resolve(std::string_view host, uint16_t port, resolve_callback on_resolved)
+    {
+        if (auto literal = address::from_string(host, port))
+        {
+            on_resolved(std::vector<address>{ *literal });
+            return;
+        }
+
+        std::string key(host);
+        std::unique_lock guard(cache_mutex);
+
+        const clock::time_point now = clock::now();
+        auto found = entries.find(key);
+
+        if (found != entries.end() && !found->second.pending && found->second.expires > now)
+        {
+            resolve_result cached = with_port(found->second.addresses, found->second.failure, port);
+            guard.unlock();
+
+            on_resolved(std::move(cached));
+            return;
+        }
+
+        if (found == entries.end())
+        {
+            evict(now);
+            found = entries.emplace(key, entry{}).first;
+        }
+
+        entry& target = found->second;
+        target.waiters.push_back({ std::move(on_resolved), port });
+
+        if (target.pending)
+            return;
+
+        target.pending = true;
+
+        if (!pool)
+            pool = std::make_unique<thread_pool>(opts.threads);
+
+        pool->post([this, key = std::move(key)]{ lookup(key); });
+    }
+
+    inline void resolver::lookup(const std::string& host)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+
+        // one entry per address, not one per socket type as well
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* found = nullptr;
+        const int status = getaddrinfo(host.c_str(), nullptr, &hints, &found);
+        lookup_count.fetch_add(1, std::memory_order_relaxed);
+
+        std::vector<address> addresses;
+        if (status == 0)
+        {
+            for (addrinfo* info = found; info != nullptr; info = info->ai_next)
+                addresses.emplace_back(info->ai_addr, static_cast<socklen_t>(info->ai_addrlen));
+
+            freeaddrinfo(found);
+        }
+
+        const error_code failure = addresses.empty() ? error_code(error_domain::network_error, error_code::host_not_found)
+                                                     : error_code(error_code::success);
+
+        std::vector<waiter> waiting;
+        {
+            std::lock_guard guard(cache_mutex);
+
+            // pending entries are never evicted, it is still there
+            entry& target = entries[host];
+            target.addresses = addresses;
+            target.failure = failure;
+            target.expires = clock::now() + (failure ? opts.negative_ttl : opts.ttl);
+            target.pending = false;
+
+            waiting.swap(target.waiters);
+        }
+
+        for (waiter& next : waiting)
+            next.on_resolved(with_port(addresses, failure, next.port));
+    }
+
+    inline void resolver::evict(clock::time_point now) noexcept
+    {
+        if (entries.size() < opts.max_entries)
+            return;
+
+        std::erase_if(entries, [now](const auto& item) {
+            return !item.second.pending && item.second.expires <= now;
+        });
+
+        // all still fresh, any one will do
+        for (auto item = entries.begin(); item != entries.end() && entries.size() >= opts.max_entries; ++item)
+        {
+            if (!item->second.pending)
+            {
+                entries.erase(item);
+                break;
+            }
+        }
+    }
+
+    inline void resolver::clear() noexcept
+    {
+        std::lock_guard guard(cache_mutex);
+        std::erase_if(entries, [](const auto& item) { return !item.second.pending; });
+    }
+
+    inline std::size_t resolver::cached() const noexcept
+    {
+        std::lock_guard guard(cache_mutex);
+        return entries.size();
+    }
+}
+
+#endif
@@ -0,0 +1,1113 @@
+#ifndef UNORTHODOX_NETWORK_SOCKET_ENGINE_HPP
+#define UNORTHODOX_NETWORK_SOCKET_ENGINE_HPP
+
+#include <unorthodox/network/reactor.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// UNORTHODOX_DISABLE_IO_URING builds the epoll backend only
+#if defined(__linux__) && !defined(UNORTHODOX_DISABLE_IO_URING)
+# define UNORTHODOX_HAS_IO_URING
+# include <unorthodox/linux/io_uring.hpp>
+#endif
+
+namespace unorthodox::net
+{
+    struct socket_engine_options
+    {
+        // io_uring submission queue size
+        unsigned    queue_depth         = 256;
+
+        // recv lands in these, handed to the kernel as a provided buffer ring
+        // (or provided one by one before 5.19).  Rounded up to a power of two.
+        unsigned    recv_buffers        = 256;
+        std::size_t recv_buffer_size    = 16 * 1024;
+
+        // how many events one epoll_wait can return in the fallback
+        std::size_t max_events          = 1024;
+
+        // false forces the epoll fallback, which is also what runs when the
+        // kernel has no io_uring
+        bool        use_io_uring        = true;
+    };
+
+    enum class socket_operation
+    {
+        accept,
+        recv,
+        send,
+        connect,
+    };
+
+    struct socket_completion
+    {
+        socket_operation            operation   = socket_operation::recv;
+        uint64_t                    user_data   = 0;
+
+        // the socket the operation was for, the new one for accept and connect
+        os::socket_type             fd          = os::invalid_socket;
+
+        // recv only, valid until the next reap()
+        std::span<const std::byte>  data;
+
+        std::size_t                 bytes       = 0;
+        error_code                  error       = error_code::success;
+
+        // accept and recv keep going until the peer closes, an error or
+        // cancel(); the last completion has this cleared
+        bool                        more        = false;
+    };
+
+    // Completion-based socket I/O.  On io_uring accept and recv are multishot:
+    // queued once, they complete once per connection or per chunk received,
+    // and recv picks its buffers from a ring the kernel shares with us.
+    // Everything queued between two reap() calls goes to the kernel with a
+    // single io_uring_enter.  Without io_uring the same interface runs on an
+    // edge-triggered epoll reactor.
+    //
+    // Sends on a socket go out in the order they were queued, one at a time.
+    // Not thread-safe, one thread drives the engine.
+    class socket_engine
+    {
+        public:
+            enum class backend_type
+            {
+                io_uring,
+                epoll,
+            };
+
+            explicit socket_engine(socket_engine_options options = {}) noexcept;
+           ~socket_engine();
+
+            socket_engine(const socket_engine&) = delete;
+            socket_engine& operator=(const socket_engine&) = delete;
+
+            operator bool() const noexcept { return !status; }
+            error_code error() const noexcept { return status; }
+
+            backend_type    backend() const noexcept;
+
+            // New connections are non-blocking and close-on-exec
+            error_code      accept(os::socket_type listener, uint64_t user_data) noexcept;
+            error_code      recv(os::socket_type fd, uint64_t user_data) noexcept;
+
+            // Completes once all of data went out, which has to stay valid until then
+            error_code      send(os::socket_type fd, std::span<const std::byte> data, uint64_t user_data) noexcept;
+
+            // Opens a stream socket and connects it, the completion carries it
+            error_code      connect(const address& to, uint64_t user_data) noexcept;
+
+            // Ends every operation on the fd, each completes one last time.  Cancel
+            // before closing a socket.
+            error_code      cancel(os::socket_type fd) noexcept;
+
+            // every fd of the socket, both of them for a dual-stack listener
+            template <typename Socket, bool Owner>
+            error_code      accept(const socket<Socket, Owner>& listener, uint64_t user_data) noexcept;
+
+            template <typename Socket, bool Owner>
+            error_code      recv(const socket<Socket, Owner>& source, uint64_t user_data) noexcept { return recv(source.native_handle(), user_data); }
+
+            template <typename Socket, bool Owner>
+            error_code      send(const socket<Socket, Owner>& target, std::span<const std::byte> data, uint64_t user_data) noexcept
+            { return send(target.native_handle(), data, user_data); }
+
+            // Hands everything queued to the kernel, returns how many went
+            tl::expected<std::size_t, error_code> submit() noexcept;
+
+            // Submits, then collects completions to out and waits until at least
+            // min_completions are available (or nothing is in flight anymore).
+            // Buffers from the previous reap go back to the pool first.
+            std::size_t     reap(std::span<socket_completion> out, std::size_t min_completions = 0) noexcept;
+
+            std::size_t     in_flight() const noexcept { return outstanding; }
+
+        private:
+            struct operation
+            {
+                socket_operation            type        = socket_operation::recv;
+                os::socket_type             fd          = os::invalid_socket;
+                uint64_t                    user_data   = 0;
+
+                std::span<const std::byte>  data;
+                std::size_t                 sent        = 0;
+
+                address                     to;
+            };
+
+            // per fd, slots of the operations on it or -1
+            struct fd_state
+            {
+                int32_t                 accept_slot     = -1;
+                int32_t                 recv_slot       = -1;
+                int32_t                 connect_slot    = -1;
+
+                // only the front one is in progress
+                std::deque<uint32_t>    sends;
+            };
+
+            constexpr static uint64_t   ignored_completion  = ~uint64_t(0);
+            constexpr static uint16_t   buffer_group        = 0;
+
+            uint32_t        allocate_slot(const operation& op) noexcept;
+            void            free_slot(uint32_t slot) noexcept;
+            fd_state&       state_for(os::socket_type fd) noexcept;
+            std::byte*      buffer_data(uint16_t id) const noexcept { return buffer_memory.get() + id * opts.recv_buffer_size; }
+            uint16_t        buffer_id(const std::byte* data) const noexcept
+            { return static_cast<uint16_t>((data - buffer_memory.get()) / static_cast<std::ptrdiff_t>(opts.recv_buffer_size)); }
+
+            void            recycle_buffers() noexcept;
+            void            restart_starved() noexcept;
+
+            // the operation on a freshly allocated slot is started
+            error_code      start(uint32_t slot) noexcept;
+
+            // takes the slot off its fd, closes the socket of an unfinished
+            // connect and frees it
+            void            release(uint32_t slot) noexcept;
+
+            // ends an operation early with one last completion
+            void            abandon(uint32_t slot, error_code error) noexcept;
+            void            finish(uint32_t slot, socket_completion completion) noexcept;
+
+            #if defined(UNORTHODOX_HAS_IO_URING)
+            bool            setup_ring() noexcept;
+            bool            setup_buffer_ring() noexcept;
+            io_uring_sqe*   next_sqe() noexcept;
+            error_code      ring_start(uint32_t slot) noexcept;
+            bool            ring_complete(uint32_t slot, int32_t result, uint32_t flags, socket_completion& out) noexcept;
+            #endif
+
+            error_code      watch(os::socket_type fd) noexcept;
+            void            on_event(os::socket_type fd, uint32_t events) noexcept;
+            void            drain_accept(uint32_t slot) noexcept;
+            void            drain_recv(uint32_t slot) noexcept;
+            void            progress_sends(fd_state& state) noexcept;
+            void            finish_connect(uint32_t slot) noexcept;
+
+            socket_engine_options               opts;
+            error_code                          status          = error_code::success;
+
+            std::deque<operation>               operations;
+            std::vector<uint32_t>               free_slots;
+            std::size_t                         outstanding     = 0;
+
+            std::vector<fd_state>               states;
+
+            // recv buffers: the ids handed out with the last reap, and recv
+            // operations that stopped because the pool ran dry
+            std::unique_ptr<std::byte[]>        buffer_memory;
+            unsigned                            buffer_count    = 0;
+            std::vector<uint16_t>               lent;
+            std::vector<uint32_t>               starved;
+
+            #if defined(UNORTHODOX_HAS_IO_URING)
+            std::unique_ptr<io_uring>           ring;
+            io_uring_buf*                       buffer_ring     = nullptr;
+            uint16_t                            buffer_tail     = 0;
+            #endif
+
+            // completions that did not come from the kernel, and everything in
+            // the fallback
+            std::deque<socket_completion>       ready;
+
+            // fallback
+            std::unique_ptr<reactor>            loop;
+            std::vector<uint16_t>               free_buffers;
+    };
+}
+
+namespace unorthodox::net
+{
+    inline socket_engine::socket_engine(socket_engine_options options) noexcept : opts(options)
+    {
+        opts.recv_buffer_size = std::max<std::size_t>(opts.recv_buffer_size, 1);
+
+        // the kernel wants a power of two, and buffer ids are 16 bits
+        buffer_count = 1;
+        while (buffer_count < std::clamp(opts.recv_buffers, 1u, 32768u))
+            buffer_count *= 2;
+
+        buffer_memory.reset(new (std::nothrow) std::byte[buffer_count * opts.recv_buffer_size]);
+        if (!buffer_memory)
+        {
+            status = error_code(error_domain::network_error, error_code::undefined_error);
+            return;
+        }
+
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (opts.use_io_uring && setup_ring())
+            return;
+        #endif
+
+        loop = std::make_unique<reactor>(opts.max_events);
+        if (!*loop)
+        {
+            status = loop->error();
+            return;
+        }
+
+        free_buffers.reserve(buffer_count);
+        for (unsigned i = buffer_count; i > 0; --i)
+            free_buffers.push_back(static_cast<uint16_t>(i - 1));
+    }
+
+    inline socket_engine::~socket_engine()
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        // closing the ring cancels whatever it still had, the buffers go after that
+        ring.reset();
+        if (buffer_ring != nullptr)
+            munmap(buffer_ring, buffer_count * sizeof(io_uring_buf));
+        #endif
+
+        // the connection of an unfinished connect was never handed over
+        for (const operation& op : operations)
+        {
+            if (op.type == socket_operation::connect && os::is_active_socket(op.fd) && op.user_data != ignored_completion)
+                ::close(op.fd);
+        }
+    }
+
+    inline socket_engine::backend_type socket_engine::backend() const noexcept
+    {
+        return loop ? backend_type::epoll : backend_type::io_uring;
+    }
+
+    inline uint32_t socket_engine::allocate_slot(const operation& op) noexcept
+    {
+        uint32_t slot;
+        if (free_slots.empty())
+        {
+            slot = static_cast<uint32_t>(operations.size());
+            operations.push_back(op);
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+            operations[slot] = op;
+        }
+
+        outstanding++;
+        return slot;
+    }
+
+    inline void socket_engine::free_slot(uint32_t slot) noexcept
+    {
+        // marks it as finished for the destructor
+        operations[slot].user_data = ignored_completion;
+        operations[slot].fd = os::invalid_socket;
+        std::erase(starved, slot);
+
+        free_slots.push_back(slot);
+        outstanding--;
+    }
+
+    inline socket_engine::fd_state& socket_engine::state_for(os::socket_type fd) noexcept
+    {
+        const std::size_t index = static_cast<std::size_t>(fd);
+        if (index >= states.size())
+            states.resize(std::max(index + 1, states.size() * 2));
+
+        return states[index];
+    }
+
+    inline error_code socket_engine::accept(os::socket_type listener, uint64_t user_data) noexcept
+    {
+        if (!os::is_active_socket(listener) || status)
+            return error_code(error_domain::network_error, error_code::no_active_socket);
+
+        operation op;
+        op.type = socket_operation::accept;
+        op.fd = listener;
+        op.user_data = user_data;
+
+        const uint32_t slot = allocate_slot(op);
+        state_for(listener).accept_slot = static_cast<int32_t>(slot);
+
+        return start(slot);
+    }
+
+    template <typename Socket, bool Owner>
+    error_code socket_engine::accept(const socket<Socket, Owner>& listener, uint64_t user_data) noexcept
+    {
+        error_code result = error_code(error_domain::network_error, error_code::no_active_socket);
+
+        for (os::socket_type fd : listener.native_handles())
+        {
+            if (!os::is_active_socket(fd))
+                continue;
+
+            result = accept(fd, user_data);
+            if (result)
+                return result;
+        }
+
+        return result;
+    }
+
+    inline error_code socket_engine::recv(os::socket_type fd, uint64_t user_data) noexcept
+    {
+        if (!os::is_active_socket(fd) || status)
+            return error_code(error_domain::network_error, error_code::no_active_socket);
+
+        operation op;
+        op.type = socket_operation::recv;
+        op.fd = fd;
+        op.user_data = user_data;
+
+        const uint32_t slot = allocate_slot(op);
+        state_for(fd).recv_slot = static_cast<int32_t>(slot);
+
+        return start(slot);
+    }
+
+    inline error_code socket_engine::send(os::socket_type fd, std::span<const std::byte> data, uint64_t user_data) noexcept
+    {
+        if (!os::is_active_socket(fd) || status)
+            return error_code(error_domain::network_error, error_code::no_active_socket);
+
+        operation op;
+        op.type = socket_operation::send;
+        op.fd = fd;
+        op.user_data = user_data;
+        op.data = data;
+
+        const uint32_t slot = allocate_slot(op);
+
+        // the ones before it start it when they are done
+        fd_state& state = state_for(fd);
+        state.sends.push_back(slot);
+        if (state.sends.size() > 1)
+            return error_code::success;
+
+        return start(slot);
+    }
+
+    inline error_code socket_engine::connect(const address& to, uint64_t user_data) noexcept
+    {
+        if (status)
+            return status;
+
+        os::socket_type fd = ::socket(to.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == os::invalid_socket)
+            return error_code(error_domain::network_error, error_code::cannot_open_socket);
+
+        operation op;
+        op.type = socket_operation::connect;
+        op.fd = fd;
+        op.user_data = user_data;
+        op.to = to;
+
+        const uint32_t slot = allocate_slot(op);
+        state_for(fd).connect_slot = static_cast<int32_t>(slot);
+
+        return start(slot);
+    }
+
+    inline error_code socket_engine::start(uint32_t slot) noexcept
+    {
+        const operation& op = operations[slot];
+
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        error_code result = ring ? ring_start(slot) : watch(op.fd);
+        #else
+        error_code result = watch(op.fd);
+        #endif
+
+        if (result)
+        {
+            release(slot);
+            return result;
+        }
+
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring)
+            return error_code::success;
+        #endif
+
+        // whatever is possible right now, the reactor reports the rest
+        switch (op.type)
+        {
+            case socket_operation::accept:  drain_accept(slot); break;
+            case socket_operation::recv:    drain_recv(slot); break;
+            case socket_operation::send:    progress_sends(state_for(op.fd)); break;
+            case socket_operation::connect:
+            {
+                if (::connect(op.fd, op.to.data(), op.to.size()) == 0)
+                    finish_connect(slot);
+                else if (errno != EINPROGRESS)
+                    abandon(slot, error_code(error_domain::network_error, error_code::cannot_open_socket));
+                break;
+            }
+        }
+
+        return error_code::success;
+    }
+
+    inline void socket_engine::release(uint32_t slot) noexcept
+    {
+        const operation& op = operations[slot];
+        fd_state& state = state_for(op.fd);
+
+        switch (op.type)
+        {
+            case socket_operation::accept:  state.accept_slot = -1; break;
+            case socket_operation::recv:    state.recv_slot = -1; break;
+            case socket_operation::send:    std::erase(state.sends, slot); break;
+            case socket_operation::connect:
+            {
+                state.connect_slot = -1;
+                if (loop)
+                    loop->remove(op.fd);
+                ::close(op.fd);
+                break;
+            }
+        }
+
+        free_slot(slot);
+    }
+
+    inline void socket_engine::abandon(uint32_t slot, error_code error) noexcept
+    {
+        const operation& op = operations[slot];
+
+        socket_completion completion;
+        completion.operation = op.type;
+        completion.user_data = op.user_data;
+        completion.fd = op.type == socket_operation::connect ? os::invalid_socket : op.fd;
+        completion.bytes = op.sent;
+        completion.error = error;
+
+        release(slot);
+        ready.push_back(completion);
+    }
+
+    inline error_code socket_engine::cancel(os::socket_type fd) noexcept
+    {
+        if (!os::is_active_socket(fd) || static_cast<std::size_t>(fd) >= states.size())
+            return error_code(error_domain::network_error, error_code::no_active_socket);
+
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring)
+        {
+            // the queued sends never reached the kernel, they end here
+            fd_state& state = states[static_cast<std::size_t>(fd)];
+            while (state.sends.size() > 1)
+                abandon(state.sends.back(), error_code::success);
+
+            io_uring_sqe* sqe = next_sqe();
+            if (sqe == nullptr)
+                return error_code(error_code::resource_busy);
+
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = ignored_completion;
+
+            return error_code::success;
+        }
+        #endif
+
+        // out of epoll before a connecting socket gets closed
+        loop->remove(fd);
+
+        fd_state& state = states[static_cast<std::size_t>(fd)];
+        while (!state.sends.empty())
+            abandon(state.sends.back(), error_code::success);
+
+        if (state.accept_slot >= 0)
+            abandon(static_cast<uint32_t>(state.accept_slot), error_code::success);
+        if (state.recv_slot >= 0)
+            abandon(static_cast<uint32_t>(state.recv_slot), error_code::success);
+        if (state.connect_slot >= 0)
+            abandon(static_cast<uint32_t>(state.connect_slot), error_code(error_domain::network_error, error_code::cannot_open_socket));
+
+        return error_code::success;
+    }
+
+    inline tl::expected<std::size_t, error_code> socket_engine::submit() noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring)
+        {
+            int result = ring->submit();
+            if (result < 0)
+                return tl::unexpected(error_code(error_code::undefined_error));
+            return static_cast<std::size_t>(result);
+        }
+        #endif
+
+        // the fallback starts operations right away
+        return 0;
+    }
+
+    inline void socket_engine::recycle_buffers() noexcept
+    {
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring && buffer_ring != nullptr)
+        {
+            const uint16_t mask = static_cast<uint16_t>(buffer_count - 1);
+            for (uint16_t id : lent)
+            {
+                io_uring_buf& entry = buffer_ring[buffer_tail & mask];
+                entry.addr = reinterpret_cast<std::uintptr_t>(buffer_data(id));
+                entry.len = static_cast<uint32_t>(opts.recv_buffer_size);
+                entry.bid = id;
+                ++buffer_tail;
+            }
+
+            // The tail shares its spot with the reserved field of the first entry.
+            // Not through io_uring_buf_ring, in C++ its flexible array member
+            // starts 8 bytes too late.
+            if (!lent.empty())
+                std::atomic_ref<uint16_t>(buffer_ring[0].resv).store(buffer_tail, std::memory_order_release);
+            lent.clear();
+        }
+        else if (ring)
+        {
+            // one entry per run of consecutive ids, they go in with the next submit
+            std::sort(lent.begin(), lent.end());
+
+            std::size_t first = 0;
+            while (first < lent.size())
+            {
+                std::size_t last = first + 1;
+                while (last < lent.size() && lent[last] == lent[last - 1] + 1)
+                    ++last;
+
+                io_uring_sqe* sqe = next_sqe();
+                if (sqe == nullptr)
+                    break;
+
+                sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+                sqe->fd = static_cast<int32_t>(last - first);
+                sqe->addr = reinterpret_cast<std::uintptr_t>(buffer_data(lent[first]));
+                sqe->len = static_cast<uint32_t>(opts.recv_buffer_size);
+                sqe->off = lent[first];
+                sqe->buf_group = buffer_group;
+                sqe->user_data = ignored_completion;
+
+                first = last;
+            }
+
+            lent.erase(lent.begin(), lent.begin() + static_cast<std::ptrdiff_t>(first));
+        }
+
+        if (ring)
+        {
+            restart_starved();
+            return;
+        }
+        #endif
+
+        free_buffers.insert(free_buffers.end(), lent.begin(), lent.end());
+        lent.clear();
+
+        restart_starved();
+    }
+
+    inline void socket_engine::restart_starved() noexcept
+    {
+        std::vector<uint32_t> waiting;
+        waiting.swap(starved);
+
+        for (uint32_t slot : waiting)
+        {
+            #if defined(UNORTHODOX_HAS_IO_URING)
+            if (ring)
+            {
+                error_code result = ring_start(slot);
+                if (result)
+                    abandon(slot, result);
+                continue;
+            }
+            #endif
+
+            drain_recv(slot);
+        }
+    }
+
+    inline std::size_t socket_engine::reap(std::span<socket_completion> out, std::size_t min_completions) noexcept
+    {
+        if (status)
+            return 0;
+
+        recycle_buffers();
+
+        std::size_t count = 0;
+
+        #if defined(UNORTHODOX_HAS_IO_URING)
+        if (ring)
+        {
+            for (; count < out.size() && !ready.empty(); ++count)
+            {
+                out[count] = ready.front();
+                ready.pop_front();
+            }
+
+            min_completions = std::min(min_completions, out.size());
+
+            // submitting and waiting is the same io_uring_enter
+            ring->submit();
+
+            while (count < out.size())
+            {
+                io_uring_cqe* cqe = ring->peek_cqe();
+                if (cqe == nullptr)
+                {
+                    if (count >= min_completions || outstanding == 0 || !ready.empty())
+                        break;
+
+                    // an ENOBUFS from before the buffers came back, only worth
+                    // another try while none are out with the caller
+                    if (!starved.empty())
+                    {
+                        if (!lent.empty())
+                            break;
+                        restart_starved();
+                    }
+
+                    const int result = ring->submit(static_cast<unsigned>(min_completions - count));
+                    if (result < 0 && result != -EBUSY && result != -EINTR)
+                        break;
+                    continue;
+                }
+
+                const uint64_t user_data = cqe->user_data;
+                const int32_t result = cqe->res;
+                const uint32_t flags = cqe->flags;
+                ring->cqe_seen();
+
+                if (user_data == ignored_completion)
+                    continue;
+
+                if (ring_complete(static_cast<uint32_t>(user_data), result, flags, out[count]))
+                    ++count;
+            }
+
+            // follow-ups queued while completing, like the rest of a short send
+            if (ring->pending() > 0)
+                ring->submit();
+
+            for (; count < out.size() && !ready.empty(); ++count)
+            {
+                out[count] = ready.front();
+                ready.pop_front();
+            }
+
+            return count;
+        }
+        #endif
+
+        min_completions = std::min(min_completions, out.size());
+
+        loop->run_once(std::chrono::milliseconds(0));
+
+        // starved recvs only come back with the next reap
+        while (ready.size() < min_completions && outstanding > 0 && starved.empty())
+        {
+            if (!loop->run_once())
+                break;
+        }
+
+        while (count < out.size() && !ready.empty())
+        {
+            out[count] = ready.front();
+            ready.pop_front();
+
+            if (out[count].operation == socket_operation::recv && !out[count].data.empty())
+                lent.push_back(buffer_id(out[count].data.data()));
+
+            ++count;
+        }
+
+        return count;
+    }
+
+    inline void socket_engine::finish(uint32_t slot, socket_completion completion) noexcept
+    {
+        completion.user_data = operations[slot].user_data;
+        if (!completion.more)
+            free_slot(slot);
+
+        ready.push_back(completion);
+    }
+
+    #if defined(UNORTHODOX_HAS_IO_URING)
+    inline bool socket_engine::setup_ring() noexcept
+    {
+        io_uring new_ring = io_uring::setup(opts.queue_depth);
+        if (!new_ring)
+            return false;
+
+        ring = std::make_unique<io_uring>(std::move(new_ring));
+
+        // before 5.19 the buffers are handed over with IORING_OP_PROVIDE_BUFFERS
+        setup_buffer_ring();
+
+        for (unsigned i = 0; i < buffer_count; ++i)
+            lent.push_back(static_cast<uint16_t>(i));
+        recycle_buffers();
+
+        return true;
+    }
+
+    inline bool socket_engine::setup_buffer_ring() noexcept
+    {
+        // the ring of recv buffers is shared with the kernel, it wants it page aligned
+        const std::size_t ring_size = buffer_count * sizeof(io_uring_buf);
+        void* memory = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return false;
+
+        io_uring_buf_reg registration{};
+        registration.ring_addr = reinterpret_cast<std::uintptr_t>(memory);
+        registration.ring_entries = buffer_count;
+        registration.bgid = buffer_group;
+
+        // provided buffer rings need 5.19
+        if (ring->register_raw(IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+        {
+            munmap(memory, ring_size);
+            return false;
+        }
+
+        buffer_ring = static_cast<io_uring_buf*>(memory);
+        return true;
+    }
+
+    inline io_uring_sqe* socket_engine::next_sqe() noexcept
+    {
+        io_uring_sqe* sqe = ring->get_sqe();
+        if (sqe == nullptr)
+        {
+            // queue is full, push the current batch out and try again
+            ring->submit();
+            sqe = ring->get_sqe();
+        }
+
+        return sqe;
+    }
+
+    inline error_code socket_engine::ring_start(uint32_t slot) noexcept
+    {
+        operation& op = operations[slot];
+
+        io_uring_sqe* sqe = next_sqe();
+        if (sqe == nullptr)
+            return error_code(error_code::resource_busy);
+
+        sqe->fd = op.fd;
+        sqe->user_data = slot;
+
+        switch (op.type)
+        {
+            case socket_operation::accept:
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+                break;
+
+            case socket_operation::recv:
+                // the kernel picks a buffer from the ring for every chunk
+                sqe->opcode = IORING_OP_RECV;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = buffer_group;
+                break;
+
+            case socket_operation::send:
+                sqe->opcode = IORING_OP_SEND;
+                sqe->addr = reinterpret_cast<std::uintptr_t>(op.data.data() + op.sent);
+                sqe->len = static_cast<uint32_t>(std::min<std::size_t>(op.data.size() - op.sent, std::numeric_limits<int32_t>::max()));
+                sqe->msg_flags = MSG_NOSIGNAL;
+                break;
+
+            case socket_operation::connect:
+                sqe->opcode = IORING_OP_CONNECT;
+                sqe->addr = reinterpret_cast<std::uintptr_t>(op.to.data());
+                sqe->off = op.to.size();
+                break;
+        }
+
+        return error_code::success;
+    }
+
+    inline bool socket_engine::ring_complete(uint32_t slot, int32_t result, uint32_t flags, socket_completion& out) noexcept
+    {
+        operation& op = operations[slot];
+        fd_state& state = state_for(op.fd);
+
+        // the end of the line for a cancelled operation, without an error
+        const bool cancelled = result == -ECANCELED;
+
+        out = socket_completion{};
+        out.operation = op.type;
+        out.user_data = op.user_data;
+        out.fd = op.fd;
+        out.more = (flags & IORING_CQE_F_MORE) != 0;
+
+        switch (op.type)
+        {
+            case socket_operation::accept:
+                if (result >= 0)
+                    out.fd = result;
+                else if (!cancelled)
+                    out.error = error_code(error_domain::network_error, error_code::from_errno());
+
+                if (!out.more)
+                    state.accept_slot = -1;
+                break;
+
+            case socket_operation::recv:
+                if (result == -ENOBUFS)
+                {
+                    // every buffer is out with the caller, it starts again once
+                    // some come back
+                    if (!out.more)
+                        starved.push_back(slot);
+                    return false;
+                }
+
+                if (result > 0 && (flags & IORING_CQE_F_BUFFER))
+                {
+                    const uint16_t id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+                    out.data = std::span<const std::byte>(buffer_data(id), static_cast<std::size_t>(result));
+                    out.bytes = static_cast<std::size_t>(result);
+                    lent.push_back(id);
+
+                    // multishot may stop on its own, keep it going
+                    if (!out.more)
+                        out.more = !ring_start(slot);
+                }
+                else if (result < 0 && !cancelled)
+                    out.error = error_code(error_domain::network_error, error_code::connection_reset);
+
+                if (!out.more)
+                    state.recv_slot = -1;
+                break;
+
+            case socket_operation::send:
+                if (result > 0)
+                {
+                    op.sent += static_cast<std::size_t>(result);
+
+                    // short send, the rest goes next
+                    if (op.sent < op.data.size() && !ring_start(slot))
+                        return false;
+                }
+
+                if (op.sent < op.data.size() && !cancelled)
+                    out.error = error_code(error_domain::network_error, error_code::failed_to_send_data);
+
+                out.bytes = op.sent;
+                out.more = false;
+
+                if (!state.sends.empty())
+                    state.sends.pop_front();
+
+                while (!state.sends.empty())
+                {
+                    error_code next = ring_start(state.sends.front());
+                    if (!next)
+                        break;
+                    abandon(state.sends.front(), next);
+                }
+                break;
+
+            case socket_operation::connect:
+                if (result < 0)
+                {
+                    ::close(op.fd);
+                    out.fd = os::invalid_socket;
+                    out.error = error_code(error_domain::network_error, error_code::cannot_open_socket);
+                }
+
+                out.more = false;
+                state.connect_slot = -1;
+                break;
+        }
+
+        if (!out.more)
+            free_slot(slot);
+
+        return true;
+    }
+    #endif
+
+    inline error_code socket_engine::watch(os::socket_type fd) noexcept
+    {
+        // as with the coroutine scheduler, a closed fd drops out of epoll and its
+        // number comes back, so arm it every time
+        const uint32_t interest = reactor::readable | reactor::writable;
+        const reactor_handler handler = reactor_handler::member<&socket_engine::on_event>(this);
+
+        if (!loop->modify(fd, interest, handler))
+            return error_code::success;
+
+        return loop->add(fd, interest, handler);
+    }
+
+    inline void socket_engine::on_event(os::socket_type fd, uint32_t events) noexcept
+    {
+        if (static_cast<std::size_t>(fd) >= states.size())
+            return;
+
+        // the handlers below may change the state
+        fd_state& state = states[static_cast<std::size_t>(fd)];
+
+        if (events & (reactor::readable | reactor::closed | reactor::failed))
+        {
+            if (state.accept_slot >= 0)
+                drain_accept(static_cast<uint32_t>(state.accept_slot));
+            if (state.recv_slot >= 0)
+                drain_recv(static_cast<uint32_t>(state.recv_slot));
+        }
+
+        if (events & (reactor::writable | reactor::closed | reactor::failed))
+        {
+            if (state.connect_slot >= 0)
+                finish_connect(static_cast<uint32_t>(state.connect_slot));
+            if (!state.sends.empty())
+                progress_sends(state);
+        }
+    }
+
+    inline void socket_engine::drain_accept(uint32_t slot) noexcept
+    {
+        const os::socket_type listener = operations[slot].fd;
+
+        while (true)
+        {
+            os::socket_type connection = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (connection == os::invalid_socket)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+
+                // EAGAIN, or EMFILE and friends leave the rest for the next edge
+                return;
+            }
+
+            socket_completion completion;
+            completion.operation = socket_operation::accept;
+            completion.fd = connection;
+            completion.more = true;
+            finish(slot, completion);
+        }
+    }
+
+    inline void socket_engine::drain_recv(uint32_t slot) noexcept
+    {
+        const os::socket_type fd = operations[slot].fd;
+
+        while (true)
+        {
+            if (free_buffers.empty())
+            {
+                starved.push_back(slot);
+                return;
+            }
+
+            const uint16_t id = free_buffers.back();
+            ssize_t bytes = ::recv(fd, buffer_data(id), opts.recv_buffer_size, MSG_DONTWAIT);
+
+            if (bytes < 0 && errno == EINTR)
+                continue;
+            if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+
+            socket_completion completion;
+            completion.operation = socket_operation::recv;
+            completion.fd = fd;
+
+            if (bytes > 0)
+            {
+                free_buffers.pop_back();
+                completion.data = std::span<const std::byte>(buffer_data(id), static_cast<std::size_t>(bytes));
+                completion.bytes = static_cast<std::size_t>(bytes);
+                completion.more = true;
+                finish(slot, completion);
+                continue;
+            }
+
+            // closed or failed, either way the last one
+            if (bytes < 0)
+                completion.error = error_code(error_domain::network_error, error_code::connection_reset);
+
+            state_for(fd).recv_slot = -1;
+            finish(slot, completion);
+            return;
+        }
+    }
+
+    inline void socket_engine::progress_sends(fd_state& state) noexcept
+    {
+        while (!state.sends.empty())
+        {
+            const uint32_t slot = state.sends.front();
+            operation& op = operations[slot];
+
+            while (op.sent < op.data.size())
+            {
+                ssize_t bytes = ::send(op.fd, op.data.data() + op.sent, op.data.size() - op.sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (bytes < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        return;
+                    break;
+                }
+
+                op.sent += static_cast<std::size_t>(bytes);
+            }
+
+            socket_completion completion;
+            completion.operation = socket_operation::send;
+            completion.fd = op.fd;
+            completion.bytes = op.sent;
+            if (op.sent < op.data.size())
+                completion.error = error_code(error_domain::network_error, error_code::failed_to_send_data);
+
+            state.sends.pop_front();
+            finish(slot, completion);
+        }
+    }
+
+    inline void socket_engine::finish_connect(uint32_t slot) noexcept
+    {
+        const os::socket_type fd = operations[slot].fd;
+
+        int result = 0;
+        socklen_t result_size = sizeof(result);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &result, &result_size) == -1)
+            result = errno;
+
+        if (result == EINPROGRESS || result == EALREADY)
+            return;
+
+        socket_completion completion;
+        completion.operation = socket_operation::connect;
+        completion.fd = fd;
+
+        state_for(fd).connect_slot = -1;
+
+        if (result != 0)
+        {
+            loop->remove(fd);
+            ::close(fd);
+            completion.fd = os::invalid_socket;
+            completion.error = error_code(error_domain::network_error, error_code::cannot_open_socket);
+        }
+
+        finish(slot, completion);
+    }
+}
+
+#endif
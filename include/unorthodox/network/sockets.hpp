@@ -2,11 +2,19 @@
 #define UNORTHODOX_NETWORK_SOCKETS_HPP
 
 #include <unorthodox/buffer.hpp>
+#include <unorthodox/buffer_chain.hpp>
+#include <unorthodox/file.hpp>
 #include <unorthodox/extra_type_traits.hpp>
 #include <unorthodox/error_codes.hpp>
+#include <unorthodox/network/datagram.hpp>
+#include <unorthodox/network/connection_table.hpp>
+#include <unorthodox/network/resolver.hpp>
 
 #include <functional>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <future>
 
 #if defined(HAS_CPPEVENTS)
 #include <cppevents/network.hpp>
@@ -16,7 +24,12 @@
 # define UNORTHODOX_OS_LINUX
 # define QUEUE_MAX_EVENTS 32
 # include <sys/socket.h>
+# include <sys/sendfile.h>
+# include <fcntl.h>
+# include <linux/filter.h>
+# include <linux/errqueue.h>
 # include "sockets_os_posix.hpp"
+# include <unorthodox/unix/sigpipe_guard.hpp>
 #elif defined(__bsdi__) || defined(__DragonFly__) \
     || defined(__FreeBSD__) || defined(__FreeBSD_kernel__) \
     || defined(__OpenBSD__) || defined(__NetBSD__)
@@ -42,8 +55,62 @@
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <cstring>
 
+namespace unorthodox::net::detail
+{
+    // Called with every fd socket::close() is about to close, so operations
+    // parked on it are let go before the kernel hands the number out again.
+    // The coroutine scheduler sets it.
+    using close_hook = void (*)(os::socket_type fd) noexcept;
+    inline std::atomic<close_hook> socket_close_hook{ nullptr };
+
+    #if defined(UNORTHODOX_OS_LINUX)
+    // The pipe send_file() splices through when sendfile() cannot be used.
+    // One per thread, kept open and empty between calls, so a file sent that
+    // way does not cost a pipe2() and two close() every time.
+    struct splice_relay
+    {
+        int fds[2] = { -1, -1 };
+
+        splice_relay() noexcept = default;
+        splice_relay(const splice_relay&) = delete;
+       ~splice_relay() { reset(); }
+
+        bool open() noexcept
+        {
+            if (fds[0] >= 0)
+                return true;
+
+            if (pipe2(fds, O_CLOEXEC) == 0)
+                return true;
+
+            fds[0] = fds[1] = -1;
+            return false;
+        }
+
+        // drops whatever is still in it along with the pipe
+        void reset() noexcept
+        {
+            for (int& fd : fds)
+            {
+                if (fd >= 0)
+                    ::close(fd);
+                fd = -1;
+            }
+        }
+
+        static splice_relay& for_thread() noexcept
+        {
+            thread_local splice_relay relay;
+            return relay;
+        }
+    };
+    #endif
+}
+
 #if defined(HAS_CPPEVENTS)
 namespace unorthodox::net::detail
 {
@@ -57,13 +124,17 @@ namespace unorthodox::net
 {
     namespace helpers
     {
+        // AF_UNSPEC if s does not resolve
         inline int deduce_protocol_from_address(const char* s)
         {
-            addrinfo* result;
-            getaddrinfo(s, nullptr, nullptr, &result);
-            int rval = result->ai_family;
-            freeaddrinfo(result);
-            return rval;
+            if (s == nullptr)
+                return AF_UNSPEC;
+
+            auto resolved = resolver::global().resolve(s, 0).get();
+            if (!resolved)
+                return AF_UNSPEC;
+
+            return resolved->front().family();
         }
 
         inline int deduce_protocol_from_address(const std::string& s)
@@ -123,12 +194,80 @@ namespace unorthodox::net
         constexpr static bool   secure  = false;
     };
 
+    // AF_UNIX, SOCK_STREAM or SOCK_SEQPACKET.  Seqpacket is connected and
+    // reliable like a stream but keeps message boundaries, every recv gets one
+    // whole message.
+    template <int Type = SOCK_STREAM>
+    struct unix_socket_details
+    {
+        static_assert(Type == SOCK_STREAM || Type == SOCK_SEQPACKET, "unix sockets are either streams or seqpacket");
+
+        constexpr static int    domain  = PF_UNIX;
+        constexpr static int    type    = Type;
+        constexpr static bool   secure  = false;
+    };
+
+    // SCM_MAX_FD, the most fds one message can carry
+    inline constexpr std::size_t max_passed_fds = 253;
+
+    // What recv_fds() got: bytes of data, and how many of the fds were filled in
+    struct fd_message
+    {
+        std::size_t bytes   = 0;
+        std::size_t fds     = 0;
+
+        // more fds were sent than there was room for, the kernel closed the rest
+        bool        truncated = false;
+    };
+
     #if defined(UNORTHODOX_SSL_PROVIDER)
     struct ssl_socket_details
     {
     };
     #endif
 
+    struct listen_options
+    {
+        int     backlog         = 20;
+
+        // Several sockets, usually one per thread, can listen on the same port.
+        // The kernel spreads new connections over them.
+        bool    reuse_port      = false;
+
+        // Linux: prefer this listener for connections whose packets arrive on
+        // this CPU, -1 to leave it to the kernel
+        int     incoming_cpu    = -1;
+    };
+
+    enum class recv_mode
+    {
+        // a single recv, whatever it returns
+        once,
+
+        // keep reading until the socket would block, the target is full or the
+        // peer closes.  For non-blocking sockets.
+        drain,
+    };
+
+    enum class accept_mode
+    {
+        // one connection per ready listener
+        once,
+
+        // every connection waiting in the backlog, into a container only.
+        // Accepted sockets are non-blocking.
+        drain,
+    };
+
+    // defined in network/coroutines.hpp
+    class recv_awaitable;
+    class send_awaitable;
+    template <typename Socket> class accept_awaitable;
+    template <typename Socket, bool Owning> class connect_awaitable;
+
+    // defined in network/connector.hpp
+    struct connect_options;
+
     #if defined(HAS_CPPEVENTS)
     enum class fd_role {
         listening_socket,
@@ -137,6 +276,25 @@ namespace unorthodox::net
     };
     #endif
 
+    // Told when a socket's queued writes grow to the high watermark (above is
+    // true, stop producing for it) and when they drain to the low one again
+    struct watermark_handler
+    {
+        using function_type = void (*)(void* context, bool above) noexcept;
+
+        function_type   function    = nullptr;
+        void*           context     = nullptr;
+
+        // Calls object->Method(above)
+        template <auto Method, typename T>
+        static watermark_handler member(T* object) noexcept
+        {
+            return { [](void* context, bool above) noexcept {
+                         (static_cast<T*>(context)->*Method)(above);
+                     }, object };
+        }
+    };
+
     template <typename Socket, bool Owning = true>
     class socket : public Socket, os::socket_specifics
     {
@@ -151,6 +309,9 @@ namespace unorthodox::net
 
             size_t mtu_size = 1200;
 
+            // how much recv() and recv_into(buffer&) ask the kernel for at a time
+            size_t recv_size = 16 * 1024;
+
             socket() noexcept requires (Owning == true);
             socket(os::socket_type in_socket_fd, int protocol) noexcept;
 
@@ -164,15 +325,48 @@ namespace unorthodox::net
             error_code open(const char* host, uint16_t port) noexcept;
             error_code connect(const char* host, uint16_t port) noexcept;
 
+            // Looks host up and connects without blocking the caller, racing the
+            // addresses Happy Eyeballs style; the future says how it went.  Needs
+            // network/connector.hpp.  The socket must stay where it is and be left
+            // alone until the future is ready, the winner is put into it from
+            // the connector's thread.
+            std::future<error_code> connect_async(const char* host, uint16_t port) requires (Socket::type == SOCK_STREAM);
+            std::future<error_code> connect_async(const char* host, uint16_t port, const connect_options& options) requires (Socket::type == SOCK_STREAM);
+
             // Stream-specific
             error_code listen(uint16_t port, int backlog_size = default_backlog_size) noexcept requires (Socket::type == SOCK_STREAM);
+            error_code listen(uint16_t port, const listen_options& options) noexcept requires (Socket::type == SOCK_STREAM);
+
+            // Any one address, a unix path from address::from_unix_path() included.
+            // A path that exists already is not replaced, unlink it first.
+            error_code listen(const address& local, const listen_options& options = {}) noexcept requires (Socket::type != SOCK_DGRAM);
+            error_code connect(const address& to) noexcept;
+
+            #if defined(UNORTHODOX_OS_LINUX)
+            // Attaches a classic BPF program to this socket's SO_REUSEPORT group
+            // that hands each connection to the group_size listeners by the CPU
+            // it arrived on: CPU n goes to the (n % group_size)th socket bound.
+            error_code attach_cpu_steering(unsigned group_size) noexcept;
+            #endif
 
-            template <typename Output> requires (Socket::type == SOCK_STREAM)
-            error_code accept(Output& target, std::chrono::milliseconds timeout = std::chrono::milliseconds(-1)) noexcept;
+            // Output is a socket, an accepted_connection, or a container of either
+            // that new connections are appended to; reserve it to keep a storm of
+            // connections from reallocating.  Returns success when the timeout
+            // passes with nothing accepted.
+            template <typename Output> requires (Socket::type != SOCK_DGRAM)
+            error_code accept(Output& target, std::chrono::milliseconds timeout = std::chrono::milliseconds(-1),
+                              accept_mode mode = accept_mode::once) noexcept;
 
             // cleanup
             void close() noexcept;
 
+            // the fd in use, IPv4 if the socket has both
+            os::socket_type native_handle() const noexcept { return socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4; }
+
+            // both fds, a listening socket can have one per address family.
+            // Entries that are not open are negative.
+            std::array<os::socket_type, 2> native_handles() const noexcept { return { socket_ipv4, socket_ipv6 }; }
+
             // communicating
             template <typename T> requires stl_compatible_container<T>
             tl::expected<size_t, error_code> send(const T& data) const noexcept;
@@ -180,9 +374,117 @@ namespace unorthodox::net
             template <typename T>
             tl::expected<size_t, error_code> send(const T& data) const noexcept;
 
+            // Gathers all the regions into one sendmsg.  Blocking sockets send
+            // everything, non-blocking ones return what went out before the socket
+            // would block, or would_block if nothing did.
+            tl::expected<size_t, error_code> send(std::span<const iovec> regions) const noexcept;
+
+            // Queued writes, for serving many peers from one thread.  send_queued()
+            // sends what the socket takes right away and keeps the rest, in
+            // order, to go out with flush() once the socket is writable again.
+            // Neither ever blocks, not even on a blocking socket, and the
+            // data is copied so the caller's memory is free on return.  Returns
+            // how much went out now.
+            tl::expected<size_t, error_code> send_queued(std::span<const std::byte> data) noexcept;
+            tl::expected<size_t, error_code> flush() noexcept;
+
+            // what send_queued() is holding back
+            size_t      queued() const noexcept { return write_queue.size(); }
+
+            // handler hears about queued() reaching high, then about it dropping
+            // to low, then about high again and so on
+            void        set_watermarks(size_t low, size_t high, watermark_handler handler) noexcept;
+            bool        above_watermark() const noexcept { return write_blocked; }
+
+            // MSG_ZEROCOPY: sends of at least zerocopy_threshold bytes are pinned
+            // and sent from the caller's memory instead of being copied.  The
+            // memory must stay untouched until reap_zerocopy() says the send is
+            // complete.  Every such sendmsg gets the next sequence number.
+            error_code  enable_zerocopy(bool enabled = true) noexcept;
+            size_t      zerocopy_threshold = 16 * 1024;
+
+            // Reads completions from the error queue without blocking.  Returns the
+            // number of sends completed by this call; all sends with a sequence
+            // number below zerocopy_completed() are done.
+            tl::expected<size_t, error_code> reap_zerocopy() noexcept;
+            uint32_t    zerocopy_sequence() const noexcept { return zerocopy_next; }
+            uint32_t    zerocopy_completed() const noexcept { return zerocopy_done; }
+
+            // true if the kernel had to copy anyway (loopback, no NIC support),
+            // zero-copy does not pay off on this socket then
+            bool        zerocopy_copied() const noexcept { return zerocopy_was_copied; }
+
+            // Holds small writes back with TCP_CORK until it goes out of scope,
+            // then sends them in as few segments as possible
+            class cork_guard
+            {
+                public:
+                    explicit cork_guard(os::socket_type fd) noexcept;
+                    cork_guard(cork_guard&& other) noexcept : socket_fd(other.socket_fd) { other.socket_fd = os::invalid_socket; }
+                   ~cork_guard();
+
+                    cork_guard(const cork_guard&) = delete;
+
+                private:
+                    os::socket_type socket_fd;
+            };
+
+            [[nodiscard]] cork_guard cork() const noexcept requires (Socket::type == SOCK_STREAM) { return cork_guard(native_handle()); }
+
+            // Streams the file straight from the page cache, no copies through user space.
+            // Non-blocking sockets return the amount sent so far when they would block.
+            tl::expected<size_t, error_code> send_file(const file& source, size_t offset, size_t length) const noexcept requires (Socket::type == SOCK_STREAM);
+            tl::expected<size_t, error_code> send(const file& source) const noexcept requires (Socket::type == SOCK_STREAM)
+            { return send_file(source, 0, source.size()); }
+
             template <typename T> requires stl_compatible_container<T>
             tl::expected<T, error_code> recv() noexcept;
 
+            // Receive straight into memory the caller owns, nothing is allocated.
+            // Return the number of bytes received, 0 once the peer has closed and
+            // would_block if a non-blocking socket has nothing yet.
+            tl::expected<size_t, error_code> recv_into(std::span<std::byte> target, recv_mode mode = recv_mode::once) noexcept;
+
+            // Appends to target, in recv_size steps
+            tl::expected<size_t, error_code> recv_into(buffer& target, recv_mode mode = recv_mode::once) noexcept;
+
+            // Scatters one read over several regions with readv
+            tl::expected<size_t, error_code> recv_into(std::span<const iovec> regions) noexcept;
+
+            // Unix-specific
+            // SCM_RIGHTS: the fds arrive in the other process as new fds for the
+            // same files or sockets, together with data, which must not be empty.
+            // At most max_passed_fds at a time.  Returns the bytes of data sent;
+            // if that is not all of it, the fds went out with the first part.
+            tl::expected<size_t, error_code> send_fds(std::span<const std::byte> data, std::span<const int> fds) const noexcept requires (Socket::domain == PF_UNIX);
+
+            // One recvmsg into data, with up to fds.size() fds that came with it.
+            // They are close-on-exec and belong to the caller.
+            tl::expected<fd_message, error_code> recv_fds(std::span<std::byte> data, std::span<int> fds) noexcept requires (Socket::domain == PF_UNIX);
+
+            // Datagram-specific
+            // Fills the batch with one recvmmsg.  Blocking sockets wait for the first
+            // datagram and then take whatever else is queued, non-blocking ones
+            // return would_block if nothing is.  Returns batch.size().
+            tl::expected<size_t, error_code> recv_batch(datagram_batch& batch) noexcept requires (Socket::type == SOCK_DGRAM);
+
+            // Sends with as few sendmmsg calls as possible and returns how many
+            // datagrams went out, fewer than asked if a non-blocking socket filled up.
+            // Each one goes out on the fd for the family of its address.
+            tl::expected<size_t, error_code> send_batch(std::span<const outgoing_datagram> datagrams) const noexcept requires (Socket::type == SOCK_DGRAM);
+
+            // Linux UDP_GRO: the kernel hands runs of datagrams from the same
+            // sender over as one, see received_datagram::segment_size
+            error_code enable_gro(bool enabled = true) noexcept requires (Socket::type == SOCK_DGRAM);
+
+            // Awaitables for coroutines on an executor from network/coroutines.hpp,
+            // which has to be included to use them.  Each suspends only while the
+            // socket would block.
+            recv_awaitable                      async_recv(std::span<std::byte> target) noexcept;
+            send_awaitable                      async_send(std::span<const std::byte> data) noexcept;
+            accept_awaitable<Socket>            async_accept() noexcept requires (Socket::type == SOCK_STREAM);
+            connect_awaitable<Socket, Owning>   async_connect(const address& to) noexcept;
+
             #if defined(HAS_CPPEVENTS)
             constexpr static bool cppevent_unorthodox_socket = true;
 
@@ -193,10 +495,38 @@ namespace unorthodox::net
             #endif
 
         private:
-            tl::expected<os::socket_type, error_code> get_socket(const char* host, uint16_t port, int family) noexcept;
+            // TCP_NODELAY and TCP_QUICKACK, on the details that have them
+            void setup_toggles() noexcept;
+
+            error_code open_with(const char* host, uint16_t port, bool reuse_port) noexcept;
+
+            // send(regions) with extra sendmsg flags, the queued writes use it
+            // without MSG_ZEROCOPY since their memory is reused right away
+            tl::expected<size_t, error_code> send_with(std::span<const iovec> regions, int extra_flags, bool allow_zerocopy) const noexcept;
+            void        check_watermarks() noexcept;
+            tl::expected<os::socket_type, error_code> get_socket(const char* host, uint16_t port, int family, bool reuse_port = false) noexcept;
 
             os::socket_type socket_ipv6 = uninitialised;
             os::socket_type socket_ipv4 = uninitialised;
+
+            bool            zerocopy_enabled    = false;
+            mutable uint32_t zerocopy_next      = 0;
+            uint32_t        zerocopy_done       = 0;
+            bool            zerocopy_was_copied = false;
+
+            buffer_chain        write_queue;
+            size_t              low_watermark   = 16 * 1024;
+            size_t              high_watermark  = 64 * 1024;
+            watermark_handler   on_watermark;
+            bool                write_blocked   = false;
+    };
+
+    // A connection from accept() together with the address it came from
+    template <typename Socket>
+    struct accepted_connection
+    {
+        socket<Socket>  connection;
+        address         peer;
     };
 
     using udp_socket = unorthodox::net::socket<udp_socket_details>;
@@ -205,6 +535,12 @@ namespace unorthodox::net
     using udp_socket_view = unorthodox::net::socket<udp_socket_details, false>;
     using tcp_socket_view = unorthodox::net::socket<tcp_socket_details, false>;
 
+    using unix_socket = unorthodox::net::socket<unix_socket_details<SOCK_STREAM>>;
+    using unix_seqpacket_socket = unorthodox::net::socket<unix_socket_details<SOCK_SEQPACKET>>;
+
+    using unix_socket_view = unorthodox::net::socket<unix_socket_details<SOCK_STREAM>, false>;
+    using unix_seqpacket_socket_view = unorthodox::net::socket<unix_socket_details<SOCK_SEQPACKET>, false>;
+
     #if defined(UNORTHODOX_SSL_PROVIDER)
     using ssl_socket = unorthodox::net::socket<ssl_socket_details>;
     #endif
@@ -215,9 +551,15 @@ namespace unorthodox::net {
     socket<SocketType, Own>::socket() noexcept requires (Own == true)
     {
         // openssl stuff should be handled by ssl_socket_details
+        setup_toggles();
+    }
 
-        // setup toggles for stream sockets
-        if constexpr(SocketType::type == SOCK_STREAM)
+    template <typename SocketType, bool Owner>
+    void socket<SocketType, Owner>::setup_toggles() noexcept
+    {
+        // the lambdas point back at this socket, every constructor sets them up
+        // again for the object it makes
+        if constexpr (requires (SocketType& details) { details.tcp_nodelay; details.tcp_quickack; })
         {
             this->tcp_nodelay.on_toggle([&](bool& state, bool requested_state) {
                 int flag = requested_state ? 1 : 0;
@@ -256,10 +598,27 @@ namespace unorthodox::net {
     template <typename SocketType, bool Owner>
     void socket<SocketType, Owner>::close() noexcept
     {
+        for (os::socket_type fd : { socket_ipv6, socket_ipv4 })
+        {
+            if (!os::is_active_socket(fd))
+                continue;
+
+            if (const detail::close_hook hook = detail::socket_close_hook.load(std::memory_order_acquire))
+                hook(fd);
+
+            // only the cppevents events record peers, without them the table
+            // stays empty and its lock is better left alone
+            #if defined(HAS_CPPEVENTS)
+            connection_table::global().forget(fd);
+            #endif
+            ::close(fd);
+        }
+
+        // closed fds get reused, a second close() must not touch them
         if (os::is_active_socket(socket_ipv6))
-            ::close(socket_ipv6);
+            socket_ipv6 = uninitialised;
         if (os::is_active_socket(socket_ipv4))
-            ::close(socket_ipv4);
+            socket_ipv4 = uninitialised;
 
         stop_listening();
     }
@@ -274,6 +633,7 @@ namespace unorthodox::net {
     template <typename SocketType, bool Owner>
     socket<SocketType, Owner>::socket(socket&& other) noexcept : os::socket_specifics(std::move(other))
     {
+        setup_toggles();
         *this = std::move(other);
     }
 
@@ -291,7 +651,17 @@ namespace unorthodox::net {
         other.socket_ipv6 = other.socket_ipv6 == disabled ? disabled : uninitialised;
         other.socket_ipv4 = other.socket_ipv4 == disabled ? disabled : uninitialised;
 
-        other.socket_ipv4 = other.socket_ipv4 == disabled ? disabled : uninitialised;
+        zerocopy_enabled = other.zerocopy_enabled;
+        zerocopy_next = other.zerocopy_next;
+        zerocopy_done = other.zerocopy_done;
+        zerocopy_was_copied = other.zerocopy_was_copied;
+
+        write_queue = std::move(other.write_queue);
+        low_watermark = other.low_watermark;
+        high_watermark = other.high_watermark;
+        on_watermark = other.on_watermark;
+        write_blocked = other.write_blocked;
+        other.write_blocked = false;
 
         this->listen_fd = other.listen_fd;
         other.listen_fd = other.listen_fd == disabled ? disabled : uninitialised;
@@ -300,74 +670,107 @@ namespace unorthodox::net {
     }
 
     template <typename SocketType, bool Owning>
-    tl::expected<os::socket_type, error_code> socket<SocketType, Owning>::get_socket(const char* host, uint16_t port, int family) noexcept
+    tl::expected<os::socket_type, error_code> socket<SocketType, Owning>::get_socket(const char* host, uint16_t port, int family, bool reuse_port) noexcept
     {
+        const int yes = 1;
+
+        auto open_fd = [&](int socket_family, int protocol) -> tl::expected<os::socket_type, error_code> {
+            const os::socket_type socket_fd = ::socket(socket_family, SocketType::type, protocol);
+            if (socket_fd == os::invalid_socket)
+                return disabled;
+
+            if ((family == AF_INET6 && setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &yes, sizeof(int)) == os::invalid_socket)
+                || setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == os::invalid_socket
+                || (reuse_port && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == os::invalid_socket))
+            {
+                ::close(socket_fd);
+                return tl::unexpected(error_code(error_domain::network_error, error_code::setsockopt_failed));
+            }
+
+            return socket_fd;
+        };
+
+        if (host != nullptr)
+        {
+            // cached, and addresses given as numbers are not looked up at all
+            auto resolved = resolver::global().resolve(host, port).get();
+            if (!resolved)
+                return disabled;
+
+            for (const address& to : *resolved)
+            {
+                if (to.family() != family)
+                    continue;
+
+                auto socket_fd = open_fd(family, 0);
+                if (!socket_fd)
+                    return socket_fd;
+                if (*socket_fd == disabled)
+                    continue;
+
+                if (::connect(*socket_fd, to.data(), to.size()) == os::invalid_socket)
+                {
+                    ::close(*socket_fd);
+                    continue;
+                }
+
+                #if defined(HAS_CPPEVENTS)
+                connection_table::global().record(*socket_fd, to);
+                #endif
+
+                return socket_fd;
+            }
+
+            return disabled;
+        }
+
+        // the wildcard address to listen on, getaddrinfo does not ask DNS for it
         addrinfo    hints{};
         addrinfo*   server_info = nullptr;
-        addrinfo*   info = nullptr;
-
-        const int yes = 1;
 
         char portstr[6]; sprintf(portstr, "%d", port);
 
         hints.ai_family = family;
         hints.ai_socktype = SocketType::type;
+        hints.ai_flags = AI_PASSIVE;
 
-        if (host == nullptr)
-            hints.ai_flags = AI_PASSIVE;
-
-        if (getaddrinfo(host, portstr, &hints, &server_info) != 0)
+        if (getaddrinfo(nullptr, portstr, &hints, &server_info) != 0)
             return disabled;
 
-        int socket_fd;
+        tl::expected<os::socket_type, error_code> result = disabled;
 
-        for (info = server_info; info != nullptr; info = info->ai_next)
+        for (addrinfo* info = server_info; info != nullptr; info = info->ai_next)
         {
-            if ((socket_fd = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol)) == os::invalid_socket)
-                continue;
-
-            if (family == AF_INET6)
-            {
-                if (setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &yes, sizeof(int)) == os::invalid_socket)
-                {
-                    freeaddrinfo(server_info);
-                    return tl::unexpected(error_code(error_domain::network_error, error_code::setsockopt_failed));
-                }
-            }
-            if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == os::invalid_socket)
+            auto socket_fd = open_fd(info->ai_family, info->ai_protocol);
+            if (!socket_fd)
             {
-                freeaddrinfo(server_info);
-                return tl::unexpected(error_code(error_domain::network_error, error_code::setsockopt_failed));
+                result = socket_fd;
+                break;
             }
+            if (*socket_fd == disabled)
+                continue;
 
-            if (host == nullptr)
+            if (::bind(*socket_fd, info->ai_addr, info->ai_addrlen) == os::invalid_socket)
             {
-                if (::bind(socket_fd, info->ai_addr, info->ai_addrlen) == os::invalid_socket)
-                {
-                    ::close(socket_fd);
-                    continue;
-                }
-            } else {
-                if (::connect(socket_fd, info->ai_addr, info->ai_addrlen) == os::invalid_socket)
-                {
-                    ::close(socket_fd);
-                    continue;
-                }
+                ::close(*socket_fd);
+                continue;
             }
+
+            result = socket_fd;
             break;
         }
 
         freeaddrinfo(server_info);
-        if (info == nullptr)
-            return disabled;
-
-        return socket_fd;
+        return result;
     }
 
     template <typename SocketType, bool Owner>
     socket<SocketType, Owner>::socket(os::socket_type in_socket_fd, int protocol) noexcept
     {
-        if (protocol == AF_INET)
+        setup_toggles();
+
+        // unix sockets go where IPv4 would, native_handle() looks there first
+        if (protocol == AF_INET || protocol == AF_UNIX)
         {
             socket_ipv4 = in_socket_fd;
             socket_ipv6 = disabled;
@@ -388,18 +791,24 @@ namespace unorthodox::net {
 
     template <typename SocketType, bool Owner>
     error_code socket<SocketType, Owner>::open(const char* host, uint16_t port) noexcept
+    {
+        return open_with(host, port, false);
+    }
+
+    template <typename SocketType, bool Owner>
+    error_code socket<SocketType, Owner>::open_with(const char* host, uint16_t port, bool reuse_port) noexcept
     {
         if (os::is_active_socket(socket_ipv6) || os::is_active_socket(socket_ipv4))
             return error_code(error_domain::network_error, error_value::socket_already_open);
 
         if (host == nullptr)
         {
-            socket_ipv6 = get_socket(host, port, AF_INET6).value_or(disabled);
-            socket_ipv4 = get_socket(host, port, AF_INET).value_or(disabled);
+            socket_ipv6 = get_socket(host, port, AF_INET6, reuse_port).value_or(disabled);
+            socket_ipv4 = get_socket(host, port, AF_INET, reuse_port).value_or(disabled);
         } else {
-            socket_ipv6 = get_socket(host, port, AF_INET6).value_or(disabled);
+            socket_ipv6 = get_socket(host, port, AF_INET6, reuse_port).value_or(disabled);
             if (socket_ipv6 == disabled)
-                socket_ipv4 = get_socket(host, port, AF_INET).value_or(disabled);
+                socket_ipv4 = get_socket(host, port, AF_INET, reuse_port).value_or(disabled);
         }
 
         if (os::is_active_socket(socket_ipv6) || os::is_active_socket(socket_ipv4))
@@ -414,12 +823,64 @@ namespace unorthodox::net {
         return open(host, port);
     }
 
+    template <typename SocketType, bool Owner>
+    error_code socket<SocketType, Owner>::connect(const address& to) noexcept
+    {
+        if (os::is_active_socket(socket_ipv6) || os::is_active_socket(socket_ipv4))
+            return error_code(error_domain::network_error, error_value::socket_already_open);
+
+        const os::socket_type socket_fd = ::socket(to.family(), SocketType::type | SOCK_CLOEXEC, 0);
+        if (socket_fd == os::invalid_socket)
+            return error_code(error_domain::network_error, error_value::cannot_open_socket);
+
+        int result;
+        do
+        {
+            result = ::connect(socket_fd, to.data(), to.size());
+        } while (result == -1 && errno == EINTR);
+
+        if (result == -1)
+        {
+            ::close(socket_fd);
+            return error_code(error_domain::network_error, error_value::cannot_open_socket);
+        }
+
+        #if defined(HAS_CPPEVENTS)
+        connection_table::global().record(socket_fd, to);
+        #endif
+
+        *this = socket(socket_fd, to.family());
+        return error_code::success;
+    }
+
     template <typename SocketType, bool Owner>
     error_code socket<SocketType, Owner>::listen(uint16_t port, int backlog_size) noexcept requires (SocketType::type == SOCK_STREAM)
     {
-        error_code status = open(nullptr, port);
+        listen_options options;
+        options.backlog = backlog_size;
+
+        return listen(port, options);
+    }
+
+    template <typename SocketType, bool Owner>
+    error_code socket<SocketType, Owner>::listen(uint16_t port, const listen_options& options) noexcept requires (SocketType::type == SOCK_STREAM)
+    {
+        const int backlog_size = options.backlog;
+
+        error_code status = open_with(nullptr, port, options.reuse_port);
         if (status) return status;
 
+        #if defined(UNORTHODOX_OS_LINUX)
+        if (options.incoming_cpu >= 0)
+        {
+            for (os::socket_type fd : { socket_ipv4, socket_ipv6 })
+            {
+                if (os::is_active_socket(fd) && setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &options.incoming_cpu, sizeof(int)) == -1)
+                    return error_code(error_domain::network_error, error_value::setsockopt_failed);
+            }
+        }
+        #endif
+
         if (os::is_active_socket(socket_ipv4))
         {
             status = platform_listen_socket(port, backlog_size, socket_ipv4, AF_INET);
@@ -447,155 +908,633 @@ namespace unorthodox::net {
         return status;
     }
 
-    template <typename SocketType, bool Owner> template <typename Output> requires (SocketType::type == SOCK_STREAM)
-    error_code socket<SocketType, Owner>::accept(Output& out_target, std::chrono::milliseconds timeout) noexcept
+    template <typename SocketType, bool Owner>
+    error_code socket<SocketType, Owner>::listen(const address& local, const listen_options& options) noexcept requires (SocketType::type != SOCK_DGRAM)
     {
-        static_assert(is_stl_like_container<Output>() || std::is_same<Output&, socket<SocketType>&>::value,
-                "Output parameter needs to be either socket reference or stl-compatible array of such");
-
-        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
-            return error_code(error_domain::network_error, error_value::no_active_socket);
-
-        sockaddr_storage their_addr;
-        socklen_t addr_size = sizeof(their_addr);
-
-        int event_count = 0;
-        int max_events = 0;
+        if (os::is_active_socket(socket_ipv6) || os::is_active_socket(socket_ipv4))
+            return error_code(error_domain::network_error, error_value::socket_already_open);
 
-        platform_event_type* target = nullptr;
-        platform_event_type events[QUEUE_MAX_EVENTS];
+        const os::socket_type socket_fd = ::socket(local.family(), SocketType::type | SOCK_CLOEXEC, 0);
+        if (socket_fd == os::invalid_socket)
+            return error_code(error_domain::network_error, error_value::cannot_open_socket);
 
-        if constexpr (is_stl_like_container<Output>())
+        // the address options only mean something for IP
+        const int yes = 1;
+        if (local.family() != AF_UNIX)
         {
-            static_assert(std::is_same<typename Output::value_type, socket<SocketType>>::value);
-            target = events;
-            max_events = QUEUE_MAX_EVENTS;
-        } else {
-            platform_event_type event;
-            target = &event;
-            max_events = 1;
+            if ((local.family() == AF_INET6 && setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &yes, sizeof(int)) == -1)
+                || setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1
+                || (options.reuse_port && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1))
+            {
+                ::close(socket_fd);
+                return error_code(error_domain::network_error, error_value::setsockopt_failed);
+            }
         }
 
-        event_count = block_until_listen_event(target, max_events, timeout);
-
-        for (int i = 0; i < event_count; ++i)
+        if (::bind(socket_fd, local.data(), local.size()) == -1)
         {
-            os::socket_type new_socket = ::accept(platform_get_socket_from_event(*(target + i)),
-                                                  reinterpret_cast<sockaddr*>(&their_addr),
-                                                  &addr_size);
+            ::close(socket_fd);
+            return error_code(error_domain::network_error, error_value::cannot_open_socket);
+        }
 
-            if (new_socket == os::invalid_socket)
-               continue;
+        if (local.family() == AF_INET6)
+        {
+            socket_ipv6 = socket_fd;
+            socket_ipv4 = disabled;
+        } else {
+            socket_ipv4 = socket_fd;
+            socket_ipv6 = disabled;
+        }
 
-            char s[INET6_ADDRSTRLEN];
-            inet_ntop(their_addr.ss_family,
-                      helpers::get_in_addr(reinterpret_cast<sockaddr*>(&their_addr)),
-                      s, sizeof(s));
+        os::socket_type& listener = local.family() == AF_INET6 ? socket_ipv6 : socket_ipv4;
 
-            int af_type = platform_get_socket_from_event(*(target + i)) == socket_ipv4 ? AF_INET : AF_INET6;
+        error_code status = platform_listen_socket(local.port(), options.backlog, listener, local.family());
+        if (status)
+            close();
 
-            if constexpr(is_stl_like_container<Output>())
-               out_target.emplace_back(socket(new_socket, af_type));
-            else 
-               out_target = socket(new_socket, af_type);
-        }
-        return 0;
+        return status;
     }
 
-    template <typename SocketType, bool Owner> template <typename T> requires stl_compatible_container<T>
-    tl::expected<size_t, error_code> socket<SocketType, Owner>::send(const T& data) const noexcept
+    #if defined(UNORTHODOX_OS_LINUX)
+    template <typename SocketType, bool Owner>
+    error_code socket<SocketType, Owner>::attach_cpu_steering(unsigned group_size) noexcept
     {
-        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
-            return error_code(error_domain::network_error, error_value::no_active_socket);
-
-        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+        if (group_size == 0)
+            return error_code(error_domain::network_error, error_value::invalid_argument);
 
-        int sent = 0;
-        int left = data.size();
+        // A = current cpu; A %= group_size; return A
+        sock_filter program[] = {
+            { BPF_LD  | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU) },
+            { BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+            { BPF_RET | BPF_A,           0, 0, 0 },
+        };
 
-        int n = 0;
+        sock_fprog filter{ static_cast<unsigned short>(std::size(program)), program };
 
-        while (sent < static_cast<int>(data.size()))
+        // the ipv4 and ipv6 sockets are in separate groups, both need it
+        bool attached = false;
+        for (os::socket_type fd : { socket_ipv4, socket_ipv6 })
         {
-           n = ::send(socket_fd, data.data() + sent, left, 0);
-           if (n == -1)
-              return error_code(error_domain::network_error, error_value::failed_to_send_data);
+            if (!os::is_active_socket(fd))
+                continue;
 
-           sent += n;
-           left -= n;
+            if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &filter, sizeof(filter)) == -1)
+                return error_code(error_domain::network_error, error_value::setsockopt_failed);
+            attached = true;
         }
 
-        return sent;
+        if (!attached)
+            return error_code(error_domain::network_error, error_value::no_active_socket);
+
+        return error_code::success;
     }
+    #endif
 
-    // this probably requires a small refactor with the sent < total - duplication...
-    template <typename SocketType, bool Owner> template <typename T>
-    tl::expected<size_t, error_code> socket<SocketType, Owner>::send(const T& data) const noexcept
+    template <typename SocketType, bool Owner> template <typename Output> requires (SocketType::type != SOCK_DGRAM)
+    error_code socket<SocketType, Owner>::accept(Output& out_target, std::chrono::milliseconds timeout, accept_mode mode) noexcept
     {
+        using connection_type = socket<SocketType>;
+        using accepted_type = accepted_connection<SocketType>;
+
+        constexpr bool is_container = is_stl_like_container<Output>();
+
+        if constexpr (is_container)
+        {
+            static_assert(std::is_same_v<typename Output::value_type, connection_type> || std::is_same_v<typename Output::value_type, accepted_type>,
+                          "Output container needs to hold sockets or accepted_connections");
+        } else {
+            static_assert(std::is_same_v<Output, connection_type> || std::is_same_v<Output, accepted_type>,
+                          "Output parameter needs to be either socket reference or stl-compatible array of such");
+        }
+
         if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
             return error_code(error_domain::network_error, error_value::no_active_socket);
 
-        constexpr static int extent = std::extent_v<T>;
+        platform_event_type events[QUEUE_MAX_EVENTS];
+        const int max_events = is_container ? QUEUE_MAX_EVENTS : 1;
 
-        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+        const int event_count = block_until_listen_event(events, max_events, timeout);
+        if (event_count == -1 && errno != EINTR)
+            return error_code(error_domain::network_error, error_value::poll_error);
 
-        int sent = 0;
-        int n = 0;
+        const bool drain = is_container && mode == accept_mode::drain;
+        const int flags = drain ? SOCK_NONBLOCK | SOCK_CLOEXEC : SOCK_CLOEXEC;
 
-        if constexpr(extent == 0)
+        for (int i = 0; i < event_count; ++i)
         {
-            const int total = sizeof(T);
-            int left = total;
+            const os::socket_type listener = platform_get_socket_from_event(events[i]);
+            const int af_type = SocketType::domain == PF_UNIX ? AF_UNIX : listener == socket_ipv4 ? AF_INET : AF_INET6;
 
-            while (sent < total)
+            while (true)
             {
-                n = ::send(socket_fd, &data, left, 0);
-                if (n == -1)
-                    return error_code(error_domain::network_error, error_value::failed_to_send_data);
+                // the address is kept as the kernel wrote it, to_string() is up to the caller
+                address peer;
+                socklen_t peer_size = address::capacity();
 
-                sent += n;
-                left -= n;
-            }
-        }
-        else // we are dealing with an array of some kind
-        {
-            const int total = extent * sizeof(decltype(data[0]));
-            int left = total;
+                os::socket_type new_socket = ::accept4(listener, peer.data(), &peer_size, flags);
+                if (new_socket == os::invalid_socket)
+                {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
 
-            while (sent < total)
-            {
-                n = ::send(socket_fd, &data[sent], left, 0);
-                if (n == -1)
-                    return error_code(error_domain::network_error, error_value::failed_to_send_data);
+                    // EAGAIN once the backlog is empty, EMFILE and friends leave
+                    // the rest for the next call
+                    break;
+                }
 
-                sent += n;
-                left -= n;
+                peer.resize(peer_size);
+
+                #if defined(HAS_CPPEVENTS)
+                connection_table::global().record(new_socket, peer);
+                #endif
+
+                if constexpr (is_container)
+                {
+                    if constexpr (std::is_same_v<typename Output::value_type, accepted_type>)
+                        out_target.push_back(accepted_type{ connection_type(new_socket, af_type), peer });
+                    else
+                        out_target.emplace_back(connection_type(new_socket, af_type));
+                } else {
+                    if constexpr (std::is_same_v<Output, accepted_type>)
+                        out_target = accepted_type{ connection_type(new_socket, af_type), peer };
+                    else
+                        out_target = connection_type(new_socket, af_type);
+                }
+
+                if (!drain)
+                    break;
             }
+
+            if constexpr (!is_container)
+                break;
         }
-        return sent;
+
+        return error_code::success;
     }
 
-    // UNSTABLE
     template <typename SocketType, bool Owner> template <typename T> requires stl_compatible_container<T>
-    tl::expected<T, error_code> socket<SocketType, Owner>::recv() noexcept
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send(const T& data) const noexcept
     {
-        constexpr static int no_flags = 0;
-
-        T rval{};
-        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
-            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+        using value_type = std::remove_cv_t<typename T::value_type>;
 
-        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
-        std::array<std::byte, recv_buffer_size> chunk;
-
-        size_t total_recv = 0;
+        // containers of regions are gathered, not sent as they are
+        if constexpr (std::is_same_v<value_type, iovec>)
+        {
+            return send(std::span<const iovec>(data.data(), data.size()));
+        } else {
+            const iovec whole{ const_cast<value_type*>(data.data()), data.size() * sizeof(value_type) };
+            return send(std::span<const iovec>(&whole, 1));
+        }
+    }
 
-        bool multiple_chunks = false;
-        while(true)
+    template <typename SocketType, bool Owner> template <typename T>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send(const T& data) const noexcept
+    {
+        if constexpr (std::is_array_v<T> && std::is_same_v<std::remove_cv_t<std::remove_extent_t<T>>, iovec>)
         {
-            chunk.fill(std::byte(0));
-            ssize_t bytes = ::recv(socket_fd, chunk.data(), recv_buffer_size, multiple_chunks ? no_flags | MSG_DONTWAIT : no_flags);
-            if (bytes == 0)
+            return send(std::span<const iovec>(data, std::extent_v<T>));
+        } else {
+            // a single object or a C array, either way all of its bytes
+            const iovec whole{ const_cast<void*>(static_cast<const void*>(&data)), sizeof(T) };
+            return send(std::span<const iovec>(&whole, 1));
+        }
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send(std::span<const iovec> regions) const noexcept
+    {
+        return send_with(regions, 0, true);
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send_with(std::span<const iovec> regions, int extra_flags, bool allow_zerocopy) const noexcept
+    {
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+
+        // a peer that went away is an error code, not a SIGPIPE
+        #if defined(MSG_NOSIGNAL)
+        constexpr int base_flags = MSG_NOSIGNAL;
+        #else
+        constexpr int base_flags = 0;
+        #endif
+
+        // sendmsg may stop part way, the window holds the regions still to go
+        // so the caller's array is never touched
+        constexpr size_t window_size = 64;
+        std::array<iovec, window_size> window;
+
+        size_t sent = 0;
+        size_t next = 0;
+
+        while (next < regions.size())
+        {
+            size_t count = std::min(window_size, regions.size() - next);
+            std::copy_n(regions.begin() + next, count, window.begin());
+            next += count;
+
+            size_t first = 0;
+            while (first < count)
+            {
+                size_t pending = 0;
+                for (size_t i = first; i < count; ++i)
+                    pending += window[i].iov_len;
+
+                if (pending == 0)
+                    break;
+
+                msghdr message{};
+                message.msg_iov = window.data() + first;
+                message.msg_iovlen = count - first;
+
+                int flags = base_flags | extra_flags;
+                #if defined(MSG_ZEROCOPY)
+                if (allow_zerocopy && zerocopy_enabled && pending >= zerocopy_threshold)
+                    flags |= MSG_ZEROCOPY;
+                #endif
+
+                ssize_t n = ::sendmsg(socket_fd, &message, flags);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        if (sent > 0)
+                            return sent;
+                        return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+                    }
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+                }
+
+                #if defined(MSG_ZEROCOPY)
+                if (flags & MSG_ZEROCOPY)
+                    ++zerocopy_next;
+                #endif
+
+                sent += static_cast<size_t>(n);
+
+                // step over what went out
+                size_t advance = static_cast<size_t>(n);
+                while (first < count && advance >= window[first].iov_len)
+                    advance -= window[first++].iov_len;
+
+                if (first < count)
+                {
+                    window[first].iov_base = static_cast<std::byte*>(window[first].iov_base) + advance;
+                    window[first].iov_len -= advance;
+                }
+            }
+        }
+
+        return sent;
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send_queued(std::span<const std::byte> data) noexcept
+    {
+        size_t sent = 0;
+
+        // anything already waiting has to go first, flush() sends it
+        if (write_queue.empty())
+        {
+            const iovec whole{ const_cast<std::byte*>(data.data()), data.size() };
+            auto result = send_with(std::span<const iovec>(&whole, 1), MSG_DONTWAIT, false);
+
+            if (result)
+                sent = *result;
+            else if (result.error().code != error_code::would_block)
+                return result;
+        }
+
+        if (!write_queue.append(data.subspan(sent)))
+            return tl::unexpected(error_code(error_domain::network_error, error_code::undefined_error));
+
+        check_watermarks();
+        return sent;
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::flush() noexcept
+    {
+        size_t sent = 0;
+        std::array<iovec, 64> regions;
+
+        while (!write_queue.empty())
+        {
+            const size_t count = write_queue.gather(regions);
+
+            size_t pending = 0;
+            for (size_t i = 0; i < count; ++i)
+                pending += regions[i].iov_len;
+
+            auto result = send_with(std::span<const iovec>(regions.data(), count), MSG_DONTWAIT, false);
+            if (!result)
+            {
+                if (result.error().code == error_code::would_block)
+                    break;
+
+                check_watermarks();
+                return result;
+            }
+
+            write_queue.consume(*result);
+            sent += *result;
+
+            // the socket is full again
+            if (*result < pending)
+                break;
+        }
+
+        check_watermarks();
+        return sent;
+    }
+
+    template <typename SocketType, bool Owner>
+    void socket<SocketType, Owner>::set_watermarks(size_t low, size_t high, watermark_handler handler) noexcept
+    {
+        high_watermark = std::max<size_t>(high, 1);
+        low_watermark = std::min(low, high_watermark - 1);
+        on_watermark = handler;
+
+        check_watermarks();
+    }
+
+    template <typename SocketType, bool Owner>
+    void socket<SocketType, Owner>::check_watermarks() noexcept
+    {
+        // the gap between the two keeps a queue hovering around one of them
+        // from flapping back and forth
+        if (!write_blocked && write_queue.size() >= high_watermark)
+            write_blocked = true;
+        else if (write_blocked && write_queue.size() <= low_watermark)
+            write_blocked = false;
+        else
+            return;
+
+        if (on_watermark.function != nullptr)
+            on_watermark.function(on_watermark.context, write_blocked);
+    }
+
+    template <typename SocketType, bool Owner>
+    error_code socket<SocketType, Owner>::enable_zerocopy(bool enabled) noexcept
+    {
+        #if defined(SO_ZEROCOPY)
+        const int flag = enabled ? 1 : 0;
+        for (os::socket_type fd : { socket_ipv4, socket_ipv6 })
+        {
+            if (os::is_active_socket(fd) && setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &flag, sizeof(flag)) == -1)
+                return error_code(error_domain::network_error, error_value::setsockopt_failed);
+        }
+
+        zerocopy_enabled = enabled;
+        return error_code::success;
+        #else
+        (void) enabled;
+        return error_code(error_domain::network_error, error_value::unimplemented_feature);
+        #endif
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::reap_zerocopy() noexcept
+    {
+        #if defined(SO_EE_ORIGIN_ZEROCOPY)
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+
+        size_t completed = 0;
+        while (true)
+        {
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err)) + 64];
+
+            msghdr message{};
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            if (::recvmsg(socket_fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                return tl::unexpected(error_code(error_domain::network_error, error_value::from_errno()));
+            }
+
+            for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+            {
+                if (!((header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) ||
+                      (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR)))
+                    continue;
+
+                sock_extended_err notification;
+                std::memcpy(&notification, CMSG_DATA(header), sizeof(notification));
+
+                if (notification.ee_errno != 0 || notification.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                    continue;
+
+                // sends [ee_info, ee_data] are complete, TCP completes them in order
+                completed += notification.ee_data - notification.ee_info + 1;
+                zerocopy_done = std::max(zerocopy_done, notification.ee_data + 1);
+
+                if (notification.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                    zerocopy_was_copied = true;
+            }
+        }
+
+        return completed;
+        #else
+        return tl::unexpected(error_code(error_domain::network_error, error_value::unimplemented_feature));
+        #endif
+    }
+
+    template <typename SocketType, bool Owner>
+    socket<SocketType, Owner>::cork_guard::cork_guard(os::socket_type fd) noexcept : socket_fd(fd)
+    {
+        #if defined(TCP_CORK)
+        const int flag = 1;
+        if (os::is_active_socket(socket_fd))
+            setsockopt(socket_fd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(flag));
+        #endif
+    }
+
+    template <typename SocketType, bool Owner>
+    socket<SocketType, Owner>::cork_guard::~cork_guard()
+    {
+        #if defined(TCP_CORK)
+        // uncorking sends whatever is held back right away
+        const int flag = 0;
+        if (os::is_active_socket(socket_fd))
+            setsockopt(socket_fd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(flag));
+        #endif
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send_file(const file& source, size_t offset, size_t length) const noexcept
+        requires (SocketType::type == SOCK_STREAM)
+    {
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        if (!source)
+            return tl::unexpected(error_code(error_domain::file_error, error_value::uninitialised_value));
+
+        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+        const int file_fd = source.native_handle();
+
+        size_t sent = 0;
+
+        #if defined(UNORTHODOX_OS_LINUX)
+        // neither sendfile nor splice take MSG_NOSIGNAL, a peer that went away
+        // would raise SIGPIPE like a plain write does
+        unix::detail::sigpipe_guard guard;
+
+        bool use_splice = false;
+
+        while (sent < length)
+        {
+            off_t file_offset = static_cast<off_t>(offset + sent);
+            ssize_t n = ::sendfile(socket_fd, file_fd, &file_offset, length - sent);
+
+            if (n > 0)
+            {
+                sent += n;
+                continue;
+            }
+            if (n == 0)
+                return sent;    // file ended before length
+
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (sent > 0)
+                    return sent;
+                return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+            }
+            if (errno == EINVAL || errno == ENOSYS)
+            {
+                // this file can't be sendfile()d, try splicing it through a pipe
+                use_splice = true;
+                break;
+            }
+
+            return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+        }
+
+        if (!use_splice)
+            return sent;
+
+        detail::splice_relay& relay_pipe = detail::splice_relay::for_thread();
+        if (!relay_pipe.open())
+            return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+
+        const int (&relay)[2] = relay_pipe.fds;
+
+        // the socket decides if we block, the pipe never should
+        const unsigned socket_flags = (fcntl(socket_fd, F_GETFL) & O_NONBLOCK) ? SPLICE_F_NONBLOCK : 0;
+
+        while (sent < length)
+        {
+            loff_t file_offset = static_cast<loff_t>(offset + sent);
+            ssize_t in_pipe = ::splice(file_fd, &file_offset, relay[1], nullptr, length - sent, SPLICE_F_MOVE);
+            if (in_pipe == 0)
+                break;
+            if (in_pipe < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                // the pipe is empty here, it stays for the next call
+                return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+            }
+
+            while (in_pipe > 0)
+            {
+                ssize_t n = ::splice(relay[0], nullptr, socket_fd, nullptr, in_pipe, SPLICE_F_MOVE | socket_flags);
+                if (n > 0)
+                {
+                    sent += n;
+                    in_pipe -= n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                    continue;
+
+                // whatever is left in the pipe is dropped with it, the caller
+                // continues from offset + sent anyway
+                relay_pipe.reset();
+
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && sent == 0)
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+
+                return sent;
+            }
+        }
+
+        return sent;
+        #else
+        // no zero-copy path for this platform yet, go through a bounce buffer
+        std::array<std::byte, 64 * 1024> chunk;
+        while (sent < length)
+        {
+            auto count = source.read(std::span<std::byte>(chunk.data(), std::min(chunk.size(), length - sent)), offset + sent);
+            if (!count)
+                return tl::unexpected(count.error());
+            if (*count == 0)
+                break;
+
+            size_t chunk_sent = 0;
+            while (chunk_sent < *count)
+            {
+                ssize_t n = ::send(socket_fd, chunk.data() + chunk_sent, *count - chunk_sent, 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    if (sent + chunk_sent > 0)
+                        return sent + chunk_sent;
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+                }
+                if (n < 0)
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+                chunk_sent += n;
+            }
+            sent += chunk_sent;
+        }
+        return sent;
+        #endif
+    }
+
+    // UNSTABLE
+    template <typename SocketType, bool Owner> template <typename T> requires stl_compatible_container<T>
+    tl::expected<T, error_code> socket<SocketType, Owner>::recv() noexcept
+    {
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+        const size_t step = std::max<size_t>(recv_size, 1);
+
+        // Received into a buffer, which grows without filling what it has not
+        // received yet, and handed over as T in one copy at the end
+        buffer incoming;
+
+        // wait for the first bytes, then take whatever else is already there
+        bool multiple_chunks = false;
+        while(true)
+        {
+            std::span<std::byte> space = incoming.prepare(step);
+            if (space.empty())
+                return tl::unexpected(error_code(error_domain::network_error, error_value::undefined_error));
+
+            ssize_t bytes = ::recv(socket_fd, space.data(), space.size(), multiple_chunks ? MSG_DONTWAIT : 0);
+            if (bytes == 0)
             {
                 #if defined(HAS_CPPEVENTS)
                 cppevents::network_event dc = detail::create_disconnect_event(socket_fd);
@@ -606,21 +1545,357 @@ namespace unorthodox::net {
             }
             else if (bytes < 0)
             {
+                if (errno == EINTR)
+                    continue;
+                if (multiple_chunks && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+
                 return tl::unexpected(error_code(error_domain::network_error, error_value::from_errno()));
             }
 
-            rval.resize(total_recv + bytes);
-            std::memmove(rval.data() + total_recv, chunk.data(), bytes);
-            total_recv += bytes;
+            incoming.commit(static_cast<size_t>(bytes));
+            multiple_chunks = true;
+        }
+
+        using value_type = typename T::value_type;
+        const value_type* first = reinterpret_cast<const value_type*>(incoming.data());
+
+        T rval(first, first + incoming.size() / sizeof(value_type));
+        return rval;
+    }
 
-            // did we read all there was?
-            if (bytes < recv_buffer_size)
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::recv_into(std::span<std::byte> target, recv_mode mode) noexcept
+    {
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+
+        size_t received = 0;
+        while (received < target.size())
+        {
+            ssize_t bytes = ::recv(socket_fd, target.data() + received, target.size() - received, 0);
+            if (bytes > 0)
+            {
+                received += bytes;
+                if (mode == recv_mode::once)
+                    break;
+                continue;
+            }
+            if (bytes == 0)
                 break;
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (received > 0)
+                    break;
+                return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+            }
 
-            multiple_chunks = true;
+            return tl::unexpected(error_code(error_domain::network_error, error_value::from_errno()));
         }
 
-        return rval;
+        return received;
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::recv_into(buffer& target, recv_mode mode) noexcept
+    {
+        const size_t step = std::max<size_t>(recv_size, 1);
+        size_t received = 0;
+
+        while (true)
+        {
+            std::span<std::byte> space = target.prepare(step);
+            if (space.empty())
+                return tl::unexpected(error_code(error_domain::network_error, error_value::undefined_error));
+
+            auto bytes = recv_into(space, recv_mode::once);
+            if (!bytes)
+            {
+                // data from earlier rounds is already in the buffer
+                if (received > 0 && bytes.error().code == error_value::would_block)
+                    break;
+                return bytes;
+            }
+
+            target.commit(*bytes);
+            received += *bytes;
+
+            if (*bytes == 0 || mode == recv_mode::once)
+                break;
+        }
+
+        return received;
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::recv_into(std::span<const iovec> regions) noexcept
+    {
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+        const int count = static_cast<int>(std::min<size_t>(regions.size(), IOV_MAX));
+
+        ssize_t bytes;
+        do
+        {
+            bytes = ::readv(socket_fd, regions.data(), count);
+        } while (bytes == -1 && errno == EINTR);
+
+        if (bytes >= 0)
+            return static_cast<size_t>(bytes);
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+
+        return tl::unexpected(error_code(error_domain::network_error, error_value::from_errno()));
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send_fds(std::span<const std::byte> data, std::span<const int> fds) const noexcept requires (SocketType::domain == PF_UNIX)
+    {
+        if (!os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        // fds ride along with data, a message with none is not delivered
+        if (data.empty() || fds.size() > max_passed_fds)
+            return tl::unexpected(error_code(error_domain::network_error, error_value::invalid_argument));
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_passed_fds)];
+
+        iovec payload{ const_cast<std::byte*>(data.data()), data.size() };
+
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+
+        if (!fds.empty())
+        {
+            message.msg_control = control;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+        }
+
+        ssize_t sent;
+        do
+        {
+            sent = ::sendmsg(socket_ipv4, &message, MSG_NOSIGNAL);
+        } while (sent == -1 && errno == EINTR);
+
+        if (sent >= 0)
+            return static_cast<size_t>(sent);
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+
+        return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<fd_message, error_code> socket<SocketType, Owner>::recv_fds(std::span<std::byte> data, std::span<int> fds) noexcept requires (SocketType::domain == PF_UNIX)
+    {
+        if (!os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        const std::size_t room = std::min(fds.size(), max_passed_fds);
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_passed_fds)];
+
+        iovec payload{ data.data(), data.size() };
+
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = room > 0 ? control : nullptr;
+        message.msg_controllen = room > 0 ? CMSG_SPACE(sizeof(int) * room) : 0;
+
+        ssize_t bytes;
+        do
+        {
+            bytes = ::recvmsg(socket_ipv4, &message, MSG_CMSG_CLOEXEC);
+        } while (bytes == -1 && errno == EINTR);
+
+        if (bytes == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+
+            return tl::unexpected(error_code(error_domain::network_error, error_value::from_errno()));
+        }
+
+        fd_message result;
+        result.bytes = static_cast<size_t>(bytes);
+        result.truncated = (message.msg_flags & MSG_CTRUNC) != 0;
+
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            const std::size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+
+                // CMSG_SPACE rounds up, the kernel can fit one more than was
+                // asked for.  Those are dropped like the ones it cut off.
+                if (result.fds < fds.size())
+                    fds[result.fds++] = fd;
+                else
+                {
+                    ::close(fd);
+                    result.truncated = true;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::recv_batch(datagram_batch& batch) noexcept requires (SocketType::type == SOCK_DGRAM)
+    {
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        if (!batch)
+            return tl::unexpected(error_code(error_domain::network_error, error_value::invalid_argument));
+
+        const int socket_fd = socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4;
+
+        int received;
+        do
+        {
+            received = ::recvmmsg(socket_fd, batch.prepare(), static_cast<unsigned>(batch.capacity()), MSG_WAITFORONE, nullptr);
+        } while (received == -1 && errno == EINTR);
+
+        if (received == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+
+            return tl::unexpected(error_code(error_domain::network_error, error_value::from_errno()));
+        }
+
+        batch.complete(static_cast<size_t>(received));
+        return batch.size();
+    }
+
+    template <typename SocketType, bool Owner>
+    tl::expected<size_t, error_code> socket<SocketType, Owner>::send_batch(std::span<const outgoing_datagram> datagrams) const noexcept requires (SocketType::type == SOCK_DGRAM)
+    {
+        if (!os::is_active_socket(socket_ipv6) && !os::is_active_socket(socket_ipv4))
+            return tl::unexpected(error_code(error_domain::network_error, error_value::no_active_socket));
+
+        // the headers live on the stack, larger spans go out in several calls
+        constexpr size_t window_size = 64;
+        constexpr size_t control_size = CMSG_SPACE(sizeof(uint16_t));
+
+        std::array<mmsghdr, window_size> headers;
+        std::array<iovec, window_size> vectors;
+        alignas(cmsghdr) std::array<char, window_size * control_size> controls;
+
+        size_t sent = 0;
+
+        while (sent < datagrams.size())
+        {
+            // a dual-stack socket has one fd per family, a call only goes to one
+            const int family = datagrams[sent].to ? datagrams[sent].to->family() : AF_UNSPEC;
+            const int socket_fd = family == AF_INET6 && os::is_active_socket(socket_ipv6) ? socket_ipv6
+                                : family == AF_INET && os::is_active_socket(socket_ipv4) ? socket_ipv4
+                                : native_handle();
+
+            size_t count = 0;
+            while (count < window_size && sent + count < datagrams.size())
+            {
+                const outgoing_datagram& datagram = datagrams[sent + count];
+                if ((datagram.to ? datagram.to->family() : AF_UNSPEC) != family)
+                    break;
+
+                vectors[count].iov_base = const_cast<std::byte*>(datagram.payload.data());
+                vectors[count].iov_len = datagram.payload.size();
+
+                msghdr& header = headers[count].msg_hdr;
+                header = msghdr{};
+                header.msg_iov = &vectors[count];
+                header.msg_iovlen = 1;
+
+                if (datagram.to)
+                {
+                    header.msg_name = const_cast<sockaddr*>(datagram.to->data());
+                    header.msg_namelen = datagram.to->size();
+                }
+
+                #if defined(UDP_SEGMENT)
+                if (datagram.segment_size != 0)
+                {
+                    header.msg_control = controls.data() + count * control_size;
+                    header.msg_controllen = control_size;
+
+                    cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+                    cmsg->cmsg_level = SOL_UDP;
+                    cmsg->cmsg_type = UDP_SEGMENT;
+                    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                    std::memcpy(CMSG_DATA(cmsg), &datagram.segment_size, sizeof(uint16_t));
+                }
+                #endif
+
+                ++count;
+            }
+
+            int n;
+            do
+            {
+                n = ::sendmmsg(socket_fd, headers.data(), static_cast<unsigned>(count), MSG_NOSIGNAL);
+            } while (n == -1 && errno == EINTR);
+
+            if (n == -1)
+            {
+                // the ones before went out, report those first
+                if (sent > 0)
+                    return sent;
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return tl::unexpected(error_code(error_domain::network_error, error_value::would_block));
+
+                return tl::unexpected(error_code(error_domain::network_error, error_value::failed_to_send_data));
+            }
+
+            sent += static_cast<size_t>(n);
+
+            // sendmmsg stops at the first one that fails, the next call reports why
+            if (static_cast<size_t>(n) < count)
+                return sent;
+        }
+
+        return sent;
+    }
+
+    template <typename SocketType, bool Owner>
+    error_code socket<SocketType, Owner>::enable_gro(bool enabled) noexcept requires (SocketType::type == SOCK_DGRAM)
+    {
+        #if defined(UDP_GRO)
+        const int flag = enabled ? 1 : 0;
+        for (os::socket_type fd : { socket_ipv4, socket_ipv6 })
+        {
+            if (os::is_active_socket(fd) && setsockopt(fd, SOL_UDP, UDP_GRO, &flag, sizeof(flag)) == -1)
+                return error_code(error_domain::network_error, error_value::setsockopt_failed);
+        }
+
+        return error_code::success;
+        #else
+        (void) enabled;
+        return error_code(error_domain::network_error, error_value::unimplemented_feature);
+        #endif
     }
 }
 
@@ -629,40 +1904,51 @@ namespace unorthodox::net
 {
     namespace detail
     {
-        inline cppevents::event create_socket_listen_event(os::socket_type fd)
+        // From the connection table, so a busy connection costs no syscalls.
+        // peer_address is a std::string the event owns, so the host is still
+        // copied; IPv4 text fits its inline storage, IPv6 text allocates.
+        inline void fill_peer(cppevents::network_event& ev, os::socket_type fd)
         {
-            // we do not need this
-            (void) fd;
+            connection_table::global().visit(fd, [&](const connection_info& info) {
+                ev.peer_address = info.host;
+                ev.peer_port = info.peer.port();
+            });
+        }
 
-            cppevents::network_event ev;
+        inline int family_of(const cppevents::network_event& ev)
+        {
+            int family = AF_UNSPEC;
+            connection_table::global().visit(ev.sock_handle, [&](const connection_info& info) { family = info.peer.family(); });
 
-            sockaddr_storage their_addr;
-            socklen_t addr_size = sizeof(their_addr);
+            return family != AF_UNSPEC ? family : helpers::deduce_protocol_from_address(ev.peer_address);
+        }
+
+        inline cppevents::event create_socket_listen_event(os::socket_type fd)
+        {
+            cppevents::network_event ev;
 
             os::socket_type actual_socket_fd = os::invalid_socket;
 
             // LINUX-ONLY, move to sockets_os_posix.hpp
+            // the queue woke us because a listener is ready, so this never has to wait
             epoll_event event;
-            epoll_wait(fd, &event, 1, -1);
+            if (epoll_wait(fd, &event, 1, 0) != 1)
+                return ev;
             actual_socket_fd = event.data.fd;
 
-            os::socket_type new_fd = ::accept(actual_socket_fd, reinterpret_cast<sockaddr*>(&their_addr), &addr_size);
+            address peer;
+            socklen_t peer_size = address::capacity();
+
+            os::socket_type new_fd = ::accept(actual_socket_fd, peer.data(), &peer_size);
             if (new_fd == os::invalid_socket)
                 return ev;
 
-            char s[INET6_ADDRSTRLEN];
-            inet_ntop(their_addr.ss_family,
-                      helpers::get_in_addr(reinterpret_cast<sockaddr*>(&their_addr)),
-                      s, sizeof(s));
+            peer.resize(peer_size);
+            connection_table::global().record(new_fd, peer);
 
             ev.type = cppevents::network_event::new_connection;
-            ev.peer_address = s;
             ev.sock_handle = new_fd;
-
-            if (their_addr.ss_family == AF_INET)
-                ev.peer_port = ntohs(reinterpret_cast<sockaddr_in*>(&their_addr)->sin_port);
-            else if (their_addr.ss_family == AF_INET6)
-                ev.peer_port = ntohs(reinterpret_cast<sockaddr_in6*>(&their_addr)->sin6_port);
+            fill_peer(ev, new_fd);
 
             return std::move(ev);
         }
@@ -672,21 +1958,7 @@ namespace unorthodox::net
             cppevents::network_event ev;
             ev.type = cppevents::network_event::socket_ready;
             ev.sock_handle = fd;
-
-            sockaddr_storage their_addr;
-            socklen_t addr_size = sizeof(their_addr);
-
-            getpeername(fd, reinterpret_cast<sockaddr*>(&their_addr), &addr_size);
-            char s[INET6_ADDRSTRLEN];
-            inet_ntop(their_addr.ss_family,
-                      helpers::get_in_addr(reinterpret_cast<sockaddr*>(&their_addr)),
-                      s, sizeof(s));
-
-            ev.peer_address = s;
-            if (their_addr.ss_family == AF_INET)
-                ev.peer_port = ntohs(reinterpret_cast<sockaddr_in*>(&their_addr)->sin_port);
-            else if (their_addr.ss_family == AF_INET6)
-                ev.peer_port = ntohs(reinterpret_cast<sockaddr_in6*>(&their_addr)->sin6_port);
+            fill_peer(ev, fd);
 
             return std::move(ev);
         }
@@ -696,22 +1968,7 @@ namespace unorthodox::net
             cppevents::network_event ev;
             ev.type = cppevents::network_event::connection_closed;
             ev.sock_handle = fd;
-
-            sockaddr_storage their_addr;
-            socklen_t addr_size = sizeof(their_addr);
-
-            getpeername(fd, reinterpret_cast<sockaddr*>(&their_addr), &addr_size);
-            char s[INET6_ADDRSTRLEN];
-            inet_ntop(their_addr.ss_family,
-                      helpers::get_in_addr(reinterpret_cast<sockaddr*>(&their_addr)),
-                      s, sizeof(s));
-
-            ev.peer_address = s;
-
-            if (their_addr.ss_family == AF_INET)
-                ev.peer_port = ntohs(reinterpret_cast<sockaddr_in*>(&their_addr)->sin_port);
-            else if (their_addr.ss_family == AF_INET6)
-                ev.peer_port = ntohs(reinterpret_cast<sockaddr_in6*>(&their_addr)->sin6_port);
+            fill_peer(ev, fd);
 
             return ev;
         }
@@ -720,13 +1977,13 @@ namespace unorthodox::net
     // cppevents-enabled socket constructor
     template <typename SocketType, bool Owner>
     socket<SocketType, Owner>::socket(const cppevents::network_event& ev) noexcept
-        : socket(ev.sock_handle, helpers::deduce_protocol_from_address(ev.peer_address))
+        : socket(ev.sock_handle, detail::family_of(ev))
     {}
 
     template <typename SocketType, bool Owner>
     socket<SocketType, false> socket<SocketType, Owner>::get_socket_from_event(const cppevents::network_event& ev) noexcept
     {
-        return socket<SocketType, false>(ev.sock_handle, helpers::deduce_protocol_from_address(ev.peer_address));
+        return socket<SocketType, false>(ev.sock_handle, detail::family_of(ev));
     }
 
     template <typename SocketType, bool Owner>
@@ -10,6 +10,7 @@
 #include <netdb.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #if defined(UNORTHODOX_OS_LINUX)
 # include <sys/epoll.h>
@@ -65,7 +66,7 @@ namespace unorthodox::net::os
             #endif
     };
 
-    error_code socket_specifics::platform_listen_socket(uint16_t port, int backlog_size, os::socket_type& sock, int socktype) noexcept
+    inline error_code socket_specifics::platform_listen_socket(uint16_t port, int backlog_size, os::socket_type& sock, int socktype) noexcept
     {
         (void) port;
         (void) socktype;
@@ -88,6 +89,12 @@ namespace unorthodox::net::os
         if (::listen(sock, backlog_size) == -1)
             return error_code(error_domain::network_error, error_value::from_errno());
 
+        // accept() drains the backlog until it would block, a blocking listener
+        // would hang there instead
+        const int flags = fcntl(sock, F_GETFL);
+        if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)
+            return error_code(error_domain::network_error, error_value::could_not_listen);
+
         #if defined(UNORTHODOX_OS_LINUX)
         epoll_event event{};
         event.events = EPOLLIN;
@@ -111,7 +118,7 @@ namespace unorthodox::net::os
         return error_code::success;
     }
 
-    int socket_specifics::block_until_listen_event(platform_event_type* output, uint32_t max_events, std::chrono::milliseconds timeout) noexcept
+    inline int socket_specifics::block_until_listen_event(platform_event_type* output, uint32_t max_events, std::chrono::milliseconds timeout) noexcept
     {
         #if defined(UNORTHODOX_OS_LINUX)
             if (timeout.count() < 0)
@@ -141,7 +148,7 @@ namespace unorthodox::net::os
         #endif
     }
 
-    socket_type socket_specifics::platform_get_socket_from_event(platform_event_type& event) const noexcept
+    inline socket_type socket_specifics::platform_get_socket_from_event(platform_event_type& event) const noexcept
     {        
         #if defined(UNORTHODOX_OS_LINUX)
         return event.data.fd;
@@ -0,0 +1,157 @@
+#ifndef UNORTHODOX_RECORD_CHUNKS_HPP
+#define UNORTHODOX_RECORD_CHUNKS_HPP
+
+#include <string_view>
+#include <algorithm>
+#include <vector>
+#include <future>
+
+#include "file.hpp"
+#include "thread_pool.hpp"
+
+namespace unorthodox
+{
+    using record_chunk = std::span<const std::byte>;
+
+    namespace detail
+    {
+        template <typename R> struct chunk_results       { using type = std::vector<R>; };
+        template <>           struct chunk_results<void> { using type = void; };
+    }
+
+    // std::vector of whatever the per-chunk callback returns, or void
+    template <typename F>
+    using record_chunk_results = typename detail::chunk_results<std::invoke_result_t<F, record_chunk, std::size_t>>::type;
+
+    // Splits data into at most chunk_count pieces of roughly equal size.  Every
+    // piece but the last ends right after a delimiter, so no record is cut in two.
+    // Records longer than a chunk make for fewer, larger chunks.
+    std::vector<record_chunk> split_records(record_chunk data, std::size_t chunk_count, std::string_view delimiter = "\n") noexcept;
+
+    // Runs fn(chunk, chunk_index) for every chunk of a mapped file on the pool and
+    // returns the results in chunk order, ready to be merged front to back.
+    // file_not_mapped if the file was not opened with file::MMAP.
+    template <typename F>
+    auto for_each_record_chunk(const file& source, std::size_t chunk_count, F&& fn,
+                               thread_pool& pool, std::string_view delimiter = "\n")
+        -> tl::expected<record_chunk_results<F>, error_code>;
+
+    // Same, with a pool for the duration of the call, one thread per chunk up
+    // to the hardware concurrency
+    template <typename F>
+    auto for_each_record_chunk(const file& source, std::size_t chunk_count, F&& fn, std::string_view delimiter = "\n")
+        -> tl::expected<record_chunk_results<F>, error_code>;
+}
+
+namespace unorthodox
+{
+    namespace detail
+    {
+        // returns the position right after the first delimiter at or after from
+        inline std::size_t next_record_boundary(record_chunk data, std::size_t from, std::string_view delimiter) noexcept
+        {
+            if (from >= data.size())
+                return data.size();
+
+            const std::byte* first = data.data() + from;
+            const std::byte* last = data.data() + data.size();
+
+            if (delimiter.size() == 1)
+            {
+                const void* found = std::memchr(first, delimiter[0], static_cast<std::size_t>(last - first));
+                if (found == nullptr)
+                    return data.size();
+
+                return static_cast<std::size_t>(static_cast<const std::byte*>(found) - data.data()) + 1;
+            }
+
+            const std::byte* delimiter_first = reinterpret_cast<const std::byte*>(delimiter.data());
+            const std::byte* found = std::search(first, last, delimiter_first, delimiter_first + delimiter.size());
+            if (found == last)
+                return data.size();
+
+            return static_cast<std::size_t>(found - data.data()) + delimiter.size();
+        }
+    }
+
+    inline std::vector<record_chunk> split_records(record_chunk data, std::size_t chunk_count, std::string_view delimiter) noexcept
+    {
+        std::vector<record_chunk> rval;
+        if (data.empty())
+            return rval;
+
+        chunk_count = std::max<std::size_t>(chunk_count, 1);
+        rval.reserve(chunk_count);
+
+        if (delimiter.empty())
+            delimiter = "\n";
+
+        const std::size_t target_size = (data.size() + chunk_count - 1) / chunk_count;
+
+        std::size_t start = 0;
+        while (start < data.size())
+        {
+            // the boundary search starts one byte early, so a delimiter sitting
+            // right at the end of the nominal chunk still ends that chunk
+            const std::size_t nominal_end = std::min(start + target_size, data.size());
+            const std::size_t search_from = std::max(start, nominal_end - std::min(nominal_end, delimiter.size()));
+
+            const std::size_t end = rval.size() + 1 == chunk_count ? data.size()
+                                                                   : detail::next_record_boundary(data, search_from, delimiter);
+
+            rval.push_back(data.subspan(start, end - start));
+            start = end;
+        }
+
+        return rval;
+    }
+
+    template <typename F>
+    auto for_each_record_chunk(const file& source, std::size_t chunk_count, F&& fn,
+                               thread_pool& pool, std::string_view delimiter)
+        -> tl::expected<record_chunk_results<F>, error_code>
+    {
+        using result_type = std::invoke_result_t<F, record_chunk, std::size_t>;
+
+        if (!source.is_mapped())
+            return tl::unexpected(error_code(error_domain::file_error, error_code::file_not_mapped));
+
+        // every chunk is read once front to back
+        source.advise(file::access_hint::sequential);
+
+        const std::vector<record_chunk> chunks = split_records(source.span(), chunk_count, delimiter);
+
+        std::vector<std::future<result_type>> pending;
+        pending.reserve(chunks.size());
+
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+            pending.push_back(pool.submit([&fn, chunk = chunks[i], i]{ return fn(chunk, i); }));
+
+        if constexpr (std::is_void_v<result_type>)
+        {
+            for (auto& result : pending)
+                result.get();
+
+            return {};
+        } else {
+            std::vector<result_type> rval;
+            rval.reserve(pending.size());
+
+            for (auto& result : pending)
+                rval.push_back(result.get());
+
+            return rval;
+        }
+    }
+
+    template <typename F>
+    auto for_each_record_chunk(const file& source, std::size_t chunk_count, F&& fn, std::string_view delimiter)
+        -> tl::expected<record_chunk_results<F>, error_code>
+    {
+        const std::size_t threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        thread_pool pool(std::clamp<std::size_t>(chunk_count, 1, threads));
+        return for_each_record_chunk(source, chunk_count, std::forward<F>(fn), pool, delimiter);
+    }
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef UNORTHODOX_THREAD_POOL_HPP
+#define UNORTHODOX_THREAD_POOL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <deque>
+#include <vector>
+
+namespace unorthodox
+{
+    // Fixed amount of worker threads running posted tasks in FIFO order.
+    // The destructor finishes everything that was posted before joining.
+    class thread_pool
+    {
+        public:
+            using task_type = std::function<void()>;
+
+            explicit thread_pool(std::size_t thread_count = std::thread::hardware_concurrency());
+           ~thread_pool();
+
+            thread_pool(const thread_pool&) = delete;
+            thread_pool& operator=(const thread_pool&) = delete;
+
+            template <typename F>
+            void post(F&& task);
+
+            template <typename F>
+            auto submit(F&& task) -> std::future<std::invoke_result_t<F>>;
+
+            std::size_t size() const noexcept { return workers.size(); }
+
+        private:
+            void worker_loop() noexcept;
+
+            std::vector<std::thread>    workers;
+            std::deque<task_type>       tasks;
+
+            std::mutex                  queue_mutex;
+            std::condition_variable     queue_signal;
+            bool                        stopping = false;
+    };
+}
+
+namespace unorthodox
+{
+    inline thread_pool::thread_pool(std::size_t thread_count)
+    {
+        if (thread_count == 0)
+            thread_count = 1;
+
+        workers.reserve(thread_count);
+        for (std::size_t i = 0; i < thread_count; ++i)
+            workers.emplace_back([this]{ worker_loop(); });
+    }
+
+    inline thread_pool::~thread_pool()
+    {
+        {
+            std::lock_guard lock(queue_mutex);
+            stopping = true;
+        }
+        queue_signal.notify_all();
+
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    template <typename F>
+    void thread_pool::post(F&& task)
+    {
+        {
+            std::lock_guard lock(queue_mutex);
+            tasks.emplace_back(std::forward<F>(task));
+        }
+        queue_signal.notify_one();
+    }
+
+    template <typename F>
+    auto thread_pool::submit(F&& task) -> std::future<std::invoke_result_t<F>>
+    {
+        using result_type = std::invoke_result_t<F>;
+
+        // std::function wants something copyable
+        auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(task));
+        std::future<result_type> rval = packaged->get_future();
+
+        post([packaged]{ (*packaged)(); });
+        return rval;
+    }
+
+    inline void thread_pool::worker_loop() noexcept
+    {
+        while (true)
+        {
+            task_type task;
+            {
+                std::unique_lock lock(queue_mutex);
+                queue_signal.wait(lock, [this]{ return stopping || !tasks.empty(); });
+
+                if (tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+}
+
+#endif
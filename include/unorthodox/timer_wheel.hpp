@@ -0,0 +1,402 @@
+#ifndef UNORTHODOX_TIMER_WHEEL_HPP
+#define UNORTHODOX_TIMER_WHEEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+namespace unorthodox
+{
+    class timer;
+    class timer_wheel;
+
+    // What runs when a timer fires, a context pointer and a plain function so
+    // arming a timer never allocates
+    struct timer_handler
+    {
+        using function_type = void (*)(void* context, timer& expired) noexcept;
+
+        function_type   function    = nullptr;
+        void*           context     = nullptr;
+
+        // Calls object->Method(expired)
+        template <auto Method, typename T>
+        static timer_handler member(T* object) noexcept
+        {
+            return { [](void* context, timer& expired) noexcept {
+                         (static_cast<T*>(context)->*Method)(expired);
+                     }, object };
+        }
+    };
+
+    namespace detail
+    {
+        struct timer_link
+        {
+            timer_link* prev    = nullptr;
+            timer_link* next    = nullptr;
+        };
+    }
+
+    // One timeout, kept inside whatever it times out (a connection, a request)
+    // and linked into the wheel's slot lists directly.  It cannot move while
+    // scheduled; destroying it cancels it.
+    class timer : private detail::timer_link
+    {
+        public:
+            timer() noexcept = default;
+           ~timer();
+
+            timer(const timer&) = delete;
+            timer& operator=(const timer&) = delete;
+
+            bool        scheduled() const noexcept { return owner != nullptr; }
+
+            // in wheel ticks, milliseconds since the wheel was made
+            uint64_t    deadline() const noexcept { return expiry; }
+
+        private:
+            friend class timer_wheel;
+
+            timer_wheel*    owner       = nullptr;
+            uint64_t        expiry      = 0;
+            timer_handler   handler;
+
+            // level * 256 + slot it is linked into
+            uint16_t        position    = 0;
+    };
+
+    // Hierarchical timing wheel with millisecond ticks: four levels of 256
+    // slots, each slot a list of timers.  Scheduling and cancelling unlink and
+    // link one node, nothing is sorted.  A timer waits in a coarse slot until
+    // the wheel gets near it and is moved down a level, most idle timeouts are
+    // reset long before that ever happens.
+    //
+    // Not thread-safe, it belongs to one event loop.
+    class timer_wheel
+    {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            explicit timer_wheel(clock::time_point start = clock::now()) noexcept;
+           ~timer_wheel();
+
+            timer_wheel(const timer_wheel&) = delete;
+            timer_wheel& operator=(const timer_wheel&) = delete;
+
+            // (Re)arms the timer to fire after the given time has passed
+            void schedule(timer& target, std::chrono::milliseconds after, timer_handler handler, clock::time_point now = clock::now()) noexcept;
+            void cancel(timer& target) noexcept;
+
+            // Fires everything that is due, returns how many.  Handlers may
+            // schedule and cancel any timer, including the one firing.
+            std::size_t advance(clock::time_point now = clock::now()) noexcept;
+
+            // How long until the next timer might fire, for a poll timeout.  -1 if
+            // nothing is scheduled.  Timers far out report when they move down a
+            // level, which is never later than when they fire.
+            std::chrono::milliseconds next_timeout(clock::time_point now = clock::now()) const noexcept;
+
+            std::size_t size() const noexcept { return count; }
+            bool        empty() const noexcept { return count == 0; }
+
+        private:
+            constexpr static unsigned   slot_bits   = 8;
+            constexpr static unsigned   slots       = 1u << slot_bits;
+            constexpr static unsigned   levels      = 4;
+            constexpr static uint64_t   slot_mask   = slots - 1;
+
+            // the top level spans this much, anything further is parked there
+            constexpr static uint64_t   range       = uint64_t(1) << (slot_bits * levels);
+
+            struct level
+            {
+                std::array<detail::timer_link, slots>   heads;
+                std::array<uint64_t, slots / 64>        occupied{};
+            };
+
+            uint64_t    tick_of(clock::time_point now) const noexcept;
+
+            void        place(timer& target) noexcept;
+            void        unlink(timer& target) noexcept;
+
+            // moves a whole slot's list onto into, leaving the slot empty
+            void        detach(unsigned level_index, unsigned slot, detail::timer_link& into) noexcept;
+            void        cascade(unsigned level_index, unsigned slot) noexcept;
+
+            // the first tick with something to do, a cascade or timers firing
+            uint64_t    next_tick() const noexcept;
+            int         next_occupied(unsigned level_index, unsigned from) const noexcept;
+
+            clock::time_point               origin;
+
+            // every tick before this one has been handled
+            uint64_t                        current     = 0;
+            std::size_t                     count       = 0;
+
+            std::array<level, levels>       wheel;
+    };
+}
+
+namespace unorthodox
+{
+    inline timer::~timer()
+    {
+        if (owner != nullptr)
+            owner->cancel(*this);
+    }
+
+    inline timer_wheel::timer_wheel(clock::time_point start) noexcept : origin(start)
+    {
+        for (level& l : wheel)
+        {
+            for (detail::timer_link& head : l.heads)
+                head.prev = head.next = &head;
+        }
+    }
+
+    inline timer_wheel::~timer_wheel()
+    {
+        // the timers outlive the wheel, they must not point into it
+        for (level& l : wheel)
+        {
+            for (detail::timer_link& head : l.heads)
+            {
+                while (head.next != &head)
+                    cancel(*static_cast<timer*>(head.next));
+            }
+        }
+    }
+
+    inline uint64_t timer_wheel::tick_of(clock::time_point now) const noexcept
+    {
+        if (now <= origin)
+            return 0;
+
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - origin).count());
+    }
+
+    inline void timer_wheel::schedule(timer& target, std::chrono::milliseconds after, timer_handler handler, clock::time_point now) noexcept
+    {
+        if (target.owner != nullptr)
+            target.owner->cancel(target);
+
+        // never before the tick being handled, that one is done
+        const uint64_t deadline = tick_of(now) + static_cast<uint64_t>(std::max<int64_t>(after.count(), 0));
+
+        target.owner = this;
+        target.expiry = std::max(deadline, current);
+        target.handler = handler;
+        ++count;
+
+        place(target);
+    }
+
+    inline void timer_wheel::cancel(timer& target) noexcept
+    {
+        if (target.owner != this)
+            return;
+
+        unlink(target);
+        target.owner = nullptr;
+        --count;
+    }
+
+    inline void timer_wheel::place(timer& target) noexcept
+    {
+        // the level is the highest group of bits where the deadline and the
+        // wheel differ, the slot is the deadline's bits at that level
+        const uint64_t expiry = std::min(target.expiry, current + range - 1);
+
+        unsigned index = levels - 1;
+        for (unsigned l = 0; l < levels - 1; ++l)
+        {
+            if ((expiry >> (slot_bits * (l + 1))) == (current >> (slot_bits * (l + 1))))
+            {
+                index = l;
+                break;
+            }
+        }
+
+        const unsigned slot = static_cast<unsigned>((expiry >> (slot_bits * index)) & slot_mask);
+
+        level& l = wheel[index];
+        detail::timer_link& head = l.heads[slot];
+
+        target.position = static_cast<uint16_t>(index * slots + slot);
+        target.prev = head.prev;
+        target.next = &head;
+        head.prev->next = &target;
+        head.prev = &target;
+
+        l.occupied[slot / 64] |= uint64_t(1) << (slot % 64);
+    }
+
+    inline void timer_wheel::unlink(timer& target) noexcept
+    {
+        target.prev->next = target.next;
+        target.next->prev = target.prev;
+        target.prev = target.next = nullptr;
+
+        // the last one out of a slot clears its bit.  A timer waiting to fire has
+        // been detached already, then this only looks at whatever is there now.
+        const unsigned slot = target.position % slots;
+        level& l = wheel[target.position / slots];
+
+        if (l.heads[slot].next == &l.heads[slot])
+            l.occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    }
+
+    inline void timer_wheel::detach(unsigned level_index, unsigned slot, detail::timer_link& into) noexcept
+    {
+        level& l = wheel[level_index];
+        detail::timer_link& head = l.heads[slot];
+
+        into.prev = into.next = &into;
+        if (head.next == &head)
+            return;
+
+        into.next = head.next;
+        into.prev = head.prev;
+        into.next->prev = &into;
+        into.prev->next = &into;
+
+        head.prev = head.next = &head;
+        l.occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    }
+
+    inline void timer_wheel::cascade(unsigned level_index, unsigned slot) noexcept
+    {
+        // taken off as a whole, then every timer is placed again from here
+        detail::timer_link moving;
+        detach(level_index, slot, moving);
+
+        while (moving.next != &moving)
+        {
+            timer& target = *static_cast<timer*>(moving.next);
+
+            moving.next = target.next;
+            target.next->prev = &moving;
+
+            place(target);
+        }
+    }
+
+    inline int timer_wheel::next_occupied(unsigned level_index, unsigned from) const noexcept
+    {
+        const level& l = wheel[level_index];
+
+        for (unsigned word = from / 64; word < slots / 64; ++word)
+        {
+            uint64_t bits = l.occupied[word];
+            if (word == from / 64)
+                bits &= ~uint64_t(0) << (from % 64);
+
+            if (bits != 0)
+                return static_cast<int>(word * 64 + static_cast<unsigned>(std::countr_zero(bits)));
+        }
+
+        return -1;
+    }
+
+    inline uint64_t timer_wheel::next_tick() const noexcept
+    {
+        uint64_t next = ~uint64_t(0);
+
+        // level 0 holds exact ticks from the current one on
+        const int due = next_occupied(0, static_cast<unsigned>(current & slot_mask));
+        if (due >= 0)
+            next = (current & ~slot_mask) | static_cast<uint64_t>(due);
+
+        // higher levels are due when their slot starts and gets cascaded
+        for (unsigned l = 1; l < levels; ++l)
+        {
+            const unsigned shift = slot_bits * l;
+            const unsigned position = static_cast<unsigned>((current >> shift) & slot_mask);
+            const uint64_t base = (current >> (shift + slot_bits)) << (shift + slot_bits);
+
+            // the slot current is in was cascaded when it started, unless that
+            // start is current itself and has not been handled yet
+            const bool started = (current & ((uint64_t(1) << shift) - 1)) != 0;
+            const unsigned from = started ? position + 1 : position;
+
+            int slot = next_occupied(l, from < slots ? from : slots);
+            uint64_t start = base;
+
+            // only the top level wraps around, onto the next turn
+            if (slot < 0 && l == levels - 1)
+            {
+                slot = next_occupied(l, 0);
+                start += uint64_t(1) << (shift + slot_bits);
+            }
+
+            if (slot >= 0)
+                next = std::min(next, start | (static_cast<uint64_t>(slot) << shift));
+        }
+
+        return next;
+    }
+
+    inline std::size_t timer_wheel::advance(clock::time_point now) noexcept
+    {
+        const uint64_t target = tick_of(now);
+        std::size_t fired = 0;
+
+        while (current <= target)
+        {
+            // nothing to do in between, the wheel can jump ahead
+            const uint64_t next = count == 0 ? ~uint64_t(0) : next_tick();
+            if (next > target)
+            {
+                current = target + 1;
+                break;
+            }
+
+            current = std::max(current, next);
+
+            // crossing into a new slot of a higher level moves its timers down,
+            // from the top so they can fall through more than one level
+            for (unsigned l = levels - 1; l > 0; --l)
+            {
+                const uint64_t below = (uint64_t(1) << (slot_bits * l)) - 1;
+                if ((current & below) == 0)
+                    cascade(l, static_cast<unsigned>((current >> (slot_bits * l)) & slot_mask));
+            }
+
+            // the current tick is done before anything fires, so timers armed by
+            // the handlers land on a later one
+            detail::timer_link due;
+            detach(0, static_cast<unsigned>(current & slot_mask), due);
+            ++current;
+
+            while (due.next != &due)
+            {
+                timer& expired = *static_cast<timer*>(due.next);
+                const timer_handler handler = expired.handler;
+
+                cancel(expired);
+                ++fired;
+
+                if (handler.function != nullptr)
+                    handler.function(handler.context, expired);
+            }
+        }
+
+        return fired;
+    }
+
+    inline std::chrono::milliseconds timer_wheel::next_timeout(clock::time_point now) const noexcept
+    {
+        if (count == 0)
+            return std::chrono::milliseconds(-1);
+
+        const uint64_t next = next_tick();
+        const uint64_t at = tick_of(now);
+
+        return std::chrono::milliseconds(next > at ? static_cast<int64_t>(next - at) : 0);
+    }
+}
+
+#endif
@@ -2,81 +2,649 @@
 #define UNORTHODOX_UNIX_PIPES_HPP
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <cstdlib>
 
 #include <array>
+#include <vector>
+#include <string>
+#include <span>
+
+#include <unorthodox/error_codes.hpp>
+#include <unorthodox/buffer.hpp>
+#include <unorthodox/unix/sigpipe_guard.hpp>
+
+extern char** environ;
 
 namespace unorthodox::unix
 {
+    enum class spawn_method
+    {
+        // fork() + execvp(), has to copy the page tables of the parent
+        fork,
+
+        // the child borrows the parent's memory until it execs (vfork-style in
+        // glibc and musl), cost does not depend on the size of the parent
+        posix_spawn,
+    };
+
+    struct command;
+    class pipeline;
+
+    // A child with pipes to its stdin and stdout.  Destroying or assigning over
+    // a process closes its pipes and waits for the child to exit, so none is
+    // left behind as a zombie; one that neither reads nor writes is waited for
+    // until it exits on its own.
     class process
     {
         public:
             template <typename... Args>
-            process(const char* command, Args... args)
+            process(const char* command, Args... args) noexcept
+                : process(spawn_method::posix_spawn, command, args...) {}
+
+            template <typename... Args>
+            process(spawn_method method, const char* command, Args... args) noexcept
+            {
+                const char* argv[] = { command, args..., nullptr };
+                status = spawn(method, argv);
+            }
+
+            explicit process(const command& program, spawn_method method = spawn_method::posix_spawn) noexcept;
+
+            process(process&& other) noexcept;
+            process& operator=(process&& other) noexcept;
+
+            process(const process&) = delete;
+            process& operator=(const process&) = delete;
+
+            ~process();
+
+            // true if the child was started
+            operator bool() const noexcept { return pid > 0; }
+            error_code error() const noexcept { return status; }
+
+            // Does not block, reaps the child if it has exited
+            bool running() noexcept;
+
+            // Blocks until the child exits, returns the exit status, or 128 + signal
+            // number if it was killed
+            tl::expected<int, error_code> wait() noexcept;
+
+            // Lets the child see end of file on its stdin
+            void close_stdin() noexcept;
+
+            pid_t id() const noexcept { return pid; }
+
+            // pidfd, becomes readable when the child exits.  -1 if the kernel has no pidfds.
+            int pollable_fd() const noexcept { return pid_fd; }
+
+            // Parent ends of the pipes to the child's stdin and stdout.  They are
+            // non-blocking, wait for them with poll/epoll.
+            int stdin_fd() const noexcept { return write_fd; }
+            int stdout_fd() const noexcept { return read_fd; }
+
+            // Writes as much as fits in the pipe without blocking, returns the amount
+            // written or would_block if the pipe is full.  broken_pipe once the
+            // child closed its stdin or exited.
+            tl::expected<size_t, error_code> write(std::span<const std::byte> data) noexcept;
+            tl::expected<size_t, error_code> write(const buffer& data) noexcept { return write(std::span<const std::byte>(data.data(), data.size())); }
+
+            // Appends whatever is available to target, returns 0 once the child has
+            // closed its stdout and would_block if there is nothing to read yet
+            tl::expected<size_t, error_code> read(buffer& target, size_t max_bytes = 64 * 1024) noexcept;
+            tl::expected<buffer, error_code> read() noexcept;
+
+            bool stdout_closed() const noexcept { return output_closed; }
+
+        private:
+            friend class pipeline;
+
+            constexpr static int READ_FD = 0;
+            constexpr static int WRITE_FD = 1;
+
+            process() noexcept = default;
+
+            // child_stdin and child_stdout replace the pipe on that side when >= 0,
+            // the parent then has no end for it
+            // the fds in inherited stay open in the child under the same number
+            error_code spawn(spawn_method method, const char* const argv[], int child_stdin = -1, int child_stdout = -1,
+                             std::span<const int> inherited = {}) noexcept;
+            void reap(int wait_status) noexcept;
+            void release() noexcept;
+
+            pid_t       pid         = -1;
+            int         pid_fd      = -1;
+            int         write_fd    = -1;
+            int         read_fd     = -1;
+
+            int         exit_code   = -1;
+            bool        exited      = false;
+            bool        output_closed = false;
+
+            error_code  status      = error_code(error_code::uninitialised_value);
+    };
+
+    // A program and its arguments, one stage of a pipeline
+    struct command
+    {
+        template <typename... Args>
+        command(const char* program, Args... args) : arguments{ std::string(program), std::string(args)... } {}
+
+        // Keeps fd open in the child under the same number, everything else
+        // except stdin, stdout and stderr is closed on exec
+        command& inherit(int fd) { inherited_fds.push_back(fd); return *this; }
+
+        // null-terminated, points into arguments
+        std::vector<const char*> argv() const;
+
+        std::vector<std::string> arguments;
+        std::vector<int>         inherited_fds;
+    };
+
+    struct command_chain
+    {
+        std::vector<command> commands;
+    };
+
+    inline command_chain operator|(command first, command second) { return { { std::move(first), std::move(second) } }; }
+    inline command_chain operator|(command_chain chain, command next) { chain.commands.push_back(std::move(next)); return chain; }
+
+    // Children connected stdout to stdin like a shell does for a | b | c.  The
+    // data goes from one child straight to the next and never passes through
+    // us, we only hold the stdin of the first and the stdout of the last.
+    class pipeline
+    {
+        public:
+            pipeline(command_chain chain, spawn_method method = spawn_method::posix_spawn) noexcept;
+            pipeline(command single, spawn_method method = spawn_method::posix_spawn) noexcept
+                : pipeline(command_chain{ { std::move(single) } }, method) {}
+
+            pipeline(pipeline&&) noexcept = default;
+            pipeline& operator=(pipeline&&) noexcept = default;
+
+           ~pipeline();
+
+            // true if every stage was started
+            operator bool() const noexcept { return !status; }
+            error_code error() const noexcept { return status; }
+
+            process& front() noexcept { return stages.front(); }
+            process& back() noexcept { return stages.back(); }
+
+            process& operator[](std::size_t index) noexcept { return stages[index]; }
+            std::size_t size() const noexcept { return stages.size(); }
+
+            int stdin_fd() const noexcept { return stages.front().stdin_fd(); }
+            int stdout_fd() const noexcept { return stages.back().stdout_fd(); }
+
+            // Waits for every stage, returns the exit status of the last one
+            tl::expected<int, error_code> wait() noexcept;
+
+        private:
+            std::vector<process>    stages;
+            error_code              status  = error_code(error_code::uninitialised_value);
+    };
+
+#if defined(__linux__)
+    // Moves up to length bytes from in_fd to out_fd inside the kernel, at least
+    // one of them has to be a pipe.  Returns the amount moved, 0 at end of input,
+    // or would_block if either side is not ready.
+    tl::expected<size_t, error_code> splice(int in_fd, int out_fd, size_t length) noexcept;
+
+    // Copies up to length bytes from one pipe to another without consuming them,
+    // in_pipe can still be read or spliced afterwards
+    tl::expected<size_t, error_code> tee(int in_pipe, int out_pipe, size_t length) noexcept;
+
+    // from's stdout into to's stdin
+    inline tl::expected<size_t, error_code> splice(const process& from, const process& to, size_t length) noexcept
+    {
+        return splice(from.stdout_fd(), to.stdin_fd(), length);
+    }
+#endif
+}
+
+namespace unorthodox::unix
+{
+    inline std::vector<const char*> command::argv() const
+    {
+        std::vector<const char*> rval;
+        rval.reserve(arguments.size() + 1);
+        for (const std::string& argument : arguments)
+            rval.push_back(argument.c_str());
+        rval.push_back(nullptr);
+
+        return rval;
+    }
+
+    inline process::process(const command& program, spawn_method method) noexcept
+    {
+        status = spawn(method, program.argv().data(), -1, -1, program.inherited_fds);
+    }
+
+    inline process::process(process&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline process& process::operator=(process&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        release();
+
+        pid = other.pid;
+        pid_fd = other.pid_fd;
+        write_fd = other.write_fd;
+        read_fd = other.read_fd;
+        exit_code = other.exit_code;
+        exited = other.exited;
+        output_closed = other.output_closed;
+        status = other.status;
+
+        other.pid = -1;
+        other.pid_fd = other.write_fd = other.read_fd = -1;
+        other.exited = false;
+        other.status = error_code(error_code::uninitialised_value);
+
+        return *this;
+    }
+
+    inline process::~process()
+    {
+        release();
+    }
+
+    inline bool process::running() noexcept
+    {
+        if (pid <= 0 || exited)
+            return false;
+
+        // a pidfd lets us check without a wait call
+        if (pid_fd >= 0)
+        {
+            pollfd check{ pid_fd, POLLIN, 0 };
+            if (poll(&check, 1, 0) == 0)
+                return true;
+        }
+
+        int wait_status = 0;
+        pid_t result = waitpid(pid, &wait_status, WNOHANG);
+        if (result == 0)
+            return true;
+
+        if (result == pid)
+            reap(wait_status);
+        else
+            exited = true;
+
+        return false;
+    }
+
+    inline tl::expected<int, error_code> process::wait() noexcept
+    {
+        if (pid <= 0)
+            return tl::unexpected(error_code(error_code::no_such_process));
+
+        if (exited)
+            return exit_code;
+
+        int wait_status = 0;
+        pid_t result;
+        do
+        {
+            result = waitpid(pid, &wait_status, 0);
+        } while (result == -1 && errno == EINTR);
+
+        if (result == -1)
+            return tl::unexpected(error_code(error_code::no_such_process));
+
+        reap(wait_status);
+        return exit_code;
+    }
+
+    inline void process::close_stdin() noexcept
+    {
+        if (write_fd >= 0)
+            ::close(write_fd);
+        write_fd = -1;
+    }
+
+    inline tl::expected<size_t, error_code> process::write(std::span<const std::byte> data) noexcept
+    {
+        if (write_fd < 0)
+            return tl::unexpected(error_code(error_code::no_such_process));
+
+        // a child that is gone would take us with it
+        detail::sigpipe_guard guard;
+
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t n = ::write(write_fd, data.data() + written, data.size() - written);
+            if (n >= 0)
             {
-                pipe(parent_write_pipe);
-                pipe(parent_read_pipe);
-
-                pid = fork();
-
-                if (pid == -1)
-                {
-                    close(parent_write_pipe[0]);
-                    close(parent_write_pipe[1]);
-                    close(parent_read_pipe[0]);
-                    close(parent_read_pipe[1]);
-                    return;
-                }
-                if (pid == 0) // child
-                {
-                    dup2(parent_write_pipe[READ_FD], STDIN_FILENO);
-                    dup2(parent_read_pipe[WRITE_FD], STDOUT_FILENO);
-
-                    close(parent_write_pipe[READ_FD]);
-                    close(parent_read_pipe[WRITE_FD]);
-
-                    close(parent_read_pipe[READ_FD]);
-                    close(parent_write_pipe[WRITE_FD]);
-
-                    execlp(command, command, args..., nullptr);
-                }
-
-                // parent
-                close(parent_write_pipe[READ_FD]);
-                close(parent_read_pipe[WRITE_FD]);
+                written += n;
+                continue;
             }
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EPIPE)
+                return tl::unexpected(error_code(error_code::broken_pipe));
+
+            return tl::unexpected(error_code(error_code::connection_reset));
+        }
 
-            ~process()
+        if (written == 0 && !data.empty())
+            return tl::unexpected(error_code(error_code::would_block));
+
+        return written;
+    }
+
+    inline tl::expected<size_t, error_code> process::read(buffer& target, size_t max_bytes) noexcept
+    {
+        if (read_fd < 0)
+            return tl::unexpected(error_code(error_code::no_such_process));
+
+        // read straight into the end of the buffer, which only grows when it
+        // has less than max_bytes to spare, and then geometrically
+        const std::span<std::byte> space = target.prepare(max_bytes);
+        if (space.size() < max_bytes)
+            return tl::unexpected(error_code(error_code::undefined_error));
+
+        size_t total = 0;
+        while (total < max_bytes)
+        {
+            ssize_t n = ::read(read_fd, space.data() + total, max_bytes - total);
+            if (n > 0)
             {
-                close(parent_write_pipe[WRITE_FD]);
-                close(parent_write_pipe[READ_FD]);
-                close(parent_read_pipe[WRITE_FD]);
-                close(parent_read_pipe[READ_FD]);
+                total += n;
+                continue;
             }
+            if (n == 0)
+            {
+                output_closed = true;
+                break;
+            }
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            return tl::unexpected(error_code(error_code::connection_reset));
+        }
+
+        target.commit(total);
+
+        if (total == 0 && !output_closed)
+            return tl::unexpected(error_code(error_code::would_block));
+
+        return total;
+    }
 
-            operator bool()
+    inline tl::expected<buffer, error_code> process::read() noexcept
+    {
+        buffer rval;
+        auto result = read(rval);
+        if (!result)
+            return tl::unexpected(result.error());
+
+        return rval;
+    }
+
+    inline error_code process::spawn(spawn_method method, const char* const argv[], int child_stdin, int child_stdout,
+                                     std::span<const int> inherited) noexcept
+    {
+        // everything is close-on-exec, the child only gets what is dup2'd to
+        // its stdin and stdout
+        int to_child[2] = { child_stdin, -1 };
+        int from_child[2] = { -1, child_stdout };
+
+        if (child_stdin < 0 && pipe2(to_child, O_CLOEXEC) == -1)
+            return error_code(error_code::cannot_create_pipe);
+
+        if (child_stdout < 0 && pipe2(from_child, O_CLOEXEC) == -1)
+        {
+            if (child_stdin < 0)
             {
-                if (pid < 0)
-                    return false;
+                ::close(to_child[READ_FD]);
+                ::close(to_child[WRITE_FD]);
+            }
+            return error_code(error_code::cannot_create_pipe);
+        }
+
+        char* const* child_argv = const_cast<char* const*>(argv);
+
+        if (method == spawn_method::posix_spawn)
+        {
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            posix_spawn_file_actions_adddup2(&actions, to_child[READ_FD], STDIN_FILENO);
+            posix_spawn_file_actions_adddup2(&actions, from_child[WRITE_FD], STDOUT_FILENO);
+
+            // dup2 onto itself only clears close-on-exec
+            for (int fd : inherited)
+                posix_spawn_file_actions_adddup2(&actions, fd, fd);
+
+            // do not let the child inherit whatever signals we have blocked
+            posix_spawnattr_t attributes;
+            posix_spawnattr_init(&attributes);
 
-                int status = 0;
-                if (waitpid(pid, &status, WNOHANG) != 0)
-                    return false;
+            sigset_t no_signals;
+            sigemptyset(&no_signals);
+            posix_spawnattr_setsigmask(&attributes, &no_signals);
+            posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
 
+            if (posix_spawnp(&pid, argv[0], &actions, &attributes, child_argv, environ) != 0)
                 pid = -1;
-                return true;
+
+            posix_spawnattr_destroy(&attributes);
+            posix_spawn_file_actions_destroy(&actions);
+        } else {
+            pid = fork();
+            if (pid == 0) // child
+            {
+                dup2(to_child[READ_FD], STDIN_FILENO);
+                dup2(from_child[WRITE_FD], STDOUT_FILENO);
+
+                for (int fd : inherited)
+                    fcntl(fd, F_SETFD, 0);
+
+                execvp(argv[0], child_argv);
+                _exit(127);
             }
+        }
 
-        private:
-            constexpr static int READ_FD = 0;
-            constexpr static int WRITE_FD = 1;
+        // child ends belong to the child now, the ones we were given belong to the caller
+        if (child_stdin < 0)
+            ::close(to_child[READ_FD]);
+        if (child_stdout < 0)
+            ::close(from_child[WRITE_FD]);
 
-            int parent_write_pipe[2];
-            int parent_read_pipe[2];
+        if (pid <= 0)
+        {
+            pid = -1;
+            if (child_stdin < 0)
+                ::close(to_child[WRITE_FD]);
+            if (child_stdout < 0)
+                ::close(from_child[READ_FD]);
+            return error_code(error_code::cannot_spawn_process);
+        }
 
-            pid_t pid;
-    };
+        write_fd = to_child[WRITE_FD];
+        read_fd = from_child[READ_FD];
+
+        // our ends do not block, the child's ends are separate descriptions and do
+        if (write_fd >= 0)
+            fcntl(write_fd, F_SETFL, fcntl(write_fd, F_GETFL) | O_NONBLOCK);
+        if (read_fd >= 0)
+            fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) | O_NONBLOCK);
+
+        #if defined(__NR_pidfd_open)
+        // pidfd_open is always close-on-exec
+        pid_fd = static_cast<int>(syscall(__NR_pidfd_open, pid, 0));
+        #endif
+
+        return error_code::success;
+    }
+
+    inline void process::reap(int wait_status) noexcept
+    {
+        exited = true;
+
+        if (WIFEXITED(wait_status))
+            exit_code = WEXITSTATUS(wait_status);
+        else if (WIFSIGNALED(wait_status))
+            exit_code = 128 + WTERMSIG(wait_status);
+
+        if (pid_fd >= 0)
+            ::close(pid_fd);
+        pid_fd = -1;
+    }
+
+    inline void process::release() noexcept
+    {
+        if (write_fd >= 0)
+            ::close(write_fd);
+        if (read_fd >= 0)
+            ::close(read_fd);
+        if (pid_fd >= 0)
+            ::close(pid_fd);
+
+        write_fd = read_fd = pid_fd = -1;
+
+        // with its pipes closed the child sees end of file on stdin and a broken
+        // pipe on stdout, collect it once that made it exit
+        if (pid > 0 && !exited)
+        {
+            int wait_status = 0;
+            pid_t result;
+            do
+            {
+                result = waitpid(pid, &wait_status, 0);
+            } while (result == -1 && errno == EINTR);
+
+            if (result == pid)
+                reap(wait_status);
+            else
+                exited = true;
+        }
+    }
+
+    inline pipeline::pipeline(command_chain chain, spawn_method method) noexcept
+    {
+        stages.reserve(chain.commands.size());
+
+        // read end of the pipe from the previous stage
+        int previous_output = -1;
+
+        for (std::size_t i = 0; i < chain.commands.size(); ++i)
+        {
+            const bool last = i + 1 == chain.commands.size();
+
+            int link[2] = { -1, -1 };
+            if (!last && pipe2(link, O_CLOEXEC) == -1)
+            {
+                status = error_code(error_code::cannot_create_pipe);
+                break;
+            }
+
+            const std::vector<const char*> argv = chain.commands[i].argv();
+
+            process stage;
+            stage.status = stage.spawn(method, argv.data(), previous_output, link[process::WRITE_FD],
+                                       chain.commands[i].inherited_fds);
+
+            // the children have their copies now
+            if (previous_output >= 0)
+                ::close(previous_output);
+            if (link[process::WRITE_FD] >= 0)
+                ::close(link[process::WRITE_FD]);
+
+            previous_output = link[process::READ_FD];
+
+            if (stage.status)
+            {
+                status = stage.status;
+                break;
+            }
+
+            stages.push_back(std::move(stage));
+        }
+
+        // only left over if we stopped early
+        if (previous_output >= 0)
+            ::close(previous_output);
+
+        if (!stages.empty() && stages.size() == chain.commands.size())
+            status = error_code::success;
+        else if (!status)
+            status = error_code(error_code::cannot_spawn_process);
+    }
+
+    inline pipeline::~pipeline()
+    {
+        // front to back, every stage has seen its input end before it is waited for
+        for (process& stage : stages)
+            stage.release();
+    }
+
+    inline tl::expected<int, error_code> pipeline::wait() noexcept
+    {
+        if (stages.empty())
+            return tl::unexpected(error_code(error_code::no_such_process));
+
+        tl::expected<int, error_code> rval = tl::unexpected(error_code(error_code::no_such_process));
+        for (process& stage : stages)
+            rval = stage.wait();
+
+        return rval;
+    }
+
+#if defined(__linux__)
+    namespace detail
+    {
+        inline tl::expected<size_t, error_code> splice_result(ssize_t moved) noexcept
+        {
+            if (moved >= 0)
+                return static_cast<size_t>(moved);
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return tl::unexpected(error_code(error_code::would_block));
+
+            return tl::unexpected(error_code(error_code::connection_reset));
+        }
+    }
+
+    inline tl::expected<size_t, error_code> splice(int in_fd, int out_fd, size_t length) noexcept
+    {
+        ssize_t moved;
+        do
+        {
+            moved = ::splice(in_fd, nullptr, out_fd, nullptr, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } while (moved == -1 && errno == EINTR);
+
+        return detail::splice_result(moved);
+    }
+
+    inline tl::expected<size_t, error_code> tee(int in_pipe, int out_pipe, size_t length) noexcept
+    {
+        ssize_t copied;
+        do
+        {
+            copied = ::tee(in_pipe, out_pipe, length, SPLICE_F_NONBLOCK);
+        } while (copied == -1 && errno == EINTR);
+
+        return detail::splice_result(copied);
+    }
+#endif
 }
 
 #endif
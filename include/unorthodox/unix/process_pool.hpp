@@ -0,0 +1,335 @@
+#ifndef UNORTHODOX_UNIX_PROCESS_POOL_HPP
+#define UNORTHODOX_UNIX_PROCESS_POOL_HPP
+
+#include <poll.h>
+#include <signal.h>
+
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <unorthodox/unix/pipe.hpp>
+#include <unorthodox/unix/sigpipe_guard.hpp>
+
+namespace unorthodox::unix
+{
+    enum class worker_selection
+    {
+        // the worker with the fewest jobs in flight
+        least_loaded,
+
+        // every worker in turn
+        round_robin,
+    };
+
+    struct process_pool_options
+    {
+        std::size_t         workers         = std::max(std::thread::hardware_concurrency(), 1u);
+        worker_selection    selection       = worker_selection::least_loaded;
+
+        // queued jobs go out to a worker with one write once this much is waiting,
+        // or on the next flush/poll
+        std::size_t         batch_bytes     = 64 * 1024;
+
+        spawn_method        method          = spawn_method::posix_spawn;
+    };
+
+    struct job_result
+    {
+        uint64_t    job_id  = 0;
+        buffer      output;
+        error_code  error   = error_code::success;
+    };
+
+    // Keeps a number of worker processes running and hands them jobs over their
+    // stdin.  Every job and every result is framed with a native-endian uint32_t
+    // length; a worker answers its jobs in the order it gets them.  Workers that
+    // die are started again, the jobs they had fail with process_crashed.
+    // Not thread-safe.
+    class process_pool
+    {
+        public:
+            process_pool(command worker_command, process_pool_options options = {}) noexcept;
+
+            process_pool(const process_pool&) = delete;
+            process_pool& operator=(const process_pool&) = delete;
+
+            // true if every worker was started
+            operator bool() const noexcept { return !status; }
+            error_code error() const noexcept { return status; }
+
+            // Queues a job on a worker and returns its id, it is written once a
+            // batch is full or on the next flush() or poll()
+            tl::expected<uint64_t, error_code> submit(std::span<const std::byte> payload) noexcept;
+
+            // Writes whatever the pipes take without blocking
+            void flush() noexcept;
+
+            // Flushes, waits up to timeout_ms (-1 for ever) for results and appends
+            // the ones that are complete to results.  Returns how many were added,
+            // right away if there is nothing in flight to wait for.
+            std::size_t poll(std::vector<job_result>& results, int timeout_ms = -1) noexcept;
+
+            std::size_t size() const noexcept { return workers.size(); }
+            std::size_t in_flight() const noexcept;
+            std::size_t restarts() const noexcept { return restart_count; }
+
+            pid_t worker_id(std::size_t index) const noexcept { return workers[index].child.id(); }
+
+        private:
+            using frame_length = uint32_t;
+
+            struct worker
+            {
+                explicit worker(process&& started) noexcept : child(std::move(started)) {}
+
+                process                 child;
+
+                // framed jobs not yet taken by the pipe, starting at outgoing_sent
+                buffer                  outgoing;
+                std::size_t             outgoing_sent   = 0;
+
+                // partial results
+                buffer                  incoming;
+
+                // ids of the jobs sent to it, oldest first
+                std::deque<uint64_t>    jobs;
+            };
+
+            std::size_t pick_worker() noexcept;
+            void        flush(worker& target) noexcept;
+            std::size_t collect(worker& source, std::vector<job_result>& results) noexcept;
+            std::size_t restart(worker& target, std::vector<job_result>& results) noexcept;
+
+            command                 worker_command;
+            process_pool_options    opts;
+
+            std::vector<worker>     workers;
+            std::vector<pollfd>     poll_set;
+
+            uint64_t                next_job        = 0;
+            std::size_t             next_worker     = 0;
+            std::size_t             restart_count   = 0;
+
+            error_code              status          = error_code::success;
+    };
+}
+
+namespace unorthodox::unix
+{
+    inline process_pool::process_pool(command in_command, process_pool_options options) noexcept
+        : worker_command(std::move(in_command)), opts(options)
+    {
+        const std::size_t count = std::max<std::size_t>(opts.workers, 1);
+        workers.reserve(count);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            workers.emplace_back(process(worker_command, opts.method));
+            if (!workers.back().child)
+                status = workers.back().child.error();
+        }
+    }
+
+    inline std::size_t process_pool::in_flight() const noexcept
+    {
+        std::size_t rval = 0;
+        for (const worker& w : workers)
+            rval += w.jobs.size();
+
+        return rval;
+    }
+
+    inline std::size_t process_pool::pick_worker() noexcept
+    {
+        if (opts.selection == worker_selection::round_robin)
+            return next_worker++ % workers.size();
+
+        // ties go round the pool so idle workers share the work
+        std::size_t best = next_worker % workers.size();
+        for (std::size_t i = 1; i < workers.size(); ++i)
+        {
+            const std::size_t candidate = (next_worker + i) % workers.size();
+            if (workers[candidate].jobs.size() < workers[best].jobs.size())
+                best = candidate;
+        }
+
+        next_worker = best + 1;
+        return best;
+    }
+
+    inline tl::expected<uint64_t, error_code> process_pool::submit(std::span<const std::byte> payload) noexcept
+    {
+        if (workers.empty())
+            return tl::unexpected(error_code(error_code::no_such_process));
+
+        if (payload.size() > std::numeric_limits<frame_length>::max())
+            return tl::unexpected(error_code(error_code::invalid_argument));
+
+        worker& target = workers[pick_worker()];
+
+        const frame_length length = static_cast<frame_length>(payload.size());
+        target.outgoing.append(reinterpret_cast<const std::byte*>(&length), sizeof(length));
+        target.outgoing.append(payload);
+
+        const uint64_t id = next_job++;
+        target.jobs.push_back(id);
+
+        if (target.outgoing.size() - target.outgoing_sent >= opts.batch_bytes)
+        {
+            detail::sigpipe_guard guard;
+            flush(target);
+        }
+
+        return id;
+    }
+
+    inline void process_pool::flush() noexcept
+    {
+        detail::sigpipe_guard guard;
+
+        for (worker& w : workers)
+            flush(w);
+    }
+
+    inline void process_pool::flush(worker& target) noexcept
+    {
+        if (target.outgoing_sent == target.outgoing.size())
+            return;
+
+        auto pending = std::span<const std::byte>(target.outgoing.data() + target.outgoing_sent,
+                                                  target.outgoing.size() - target.outgoing_sent);
+
+        // a broken pipe shows up as end of file on the worker's stdout in poll()
+        auto written = target.child.write(pending);
+        if (!written)
+            return;
+
+        target.outgoing_sent += *written;
+        if (target.outgoing_sent == target.outgoing.size())
+        {
+            target.outgoing.clear();
+            target.outgoing_sent = 0;
+        }
+    }
+
+    inline std::size_t process_pool::poll(std::vector<job_result>& results, int timeout_ms) noexcept
+    {
+        flush();
+
+        // idle workers never write, waiting on them would never end.  They are
+        // still looked at once, so one that died is restarted.
+        if (in_flight() == 0)
+            timeout_ms = 0;
+
+        poll_set.resize(workers.size());
+        for (std::size_t i = 0; i < workers.size(); ++i)
+        {
+            const worker& w = workers[i];
+            poll_set[i].fd = w.child.stdout_fd();
+            poll_set[i].events = POLLIN;
+            poll_set[i].revents = 0;
+        }
+
+        int ready;
+        do
+        {
+            ready = ::poll(poll_set.data(), poll_set.size(), timeout_ms);
+        } while (ready == -1 && errno == EINTR);
+
+        if (ready <= 0)
+            return 0;
+
+        std::size_t added = 0;
+        for (std::size_t i = 0; i < workers.size(); ++i)
+        {
+            if (poll_set[i].revents == 0)
+                continue;
+
+            added += collect(workers[i], results);
+
+            if (workers[i].child.stdout_closed() || (poll_set[i].revents & (POLLERR | POLLNVAL)))
+                added += restart(workers[i], results);
+        }
+
+        // room may have opened up in the pipes
+        flush();
+
+        return added;
+    }
+
+    inline std::size_t process_pool::collect(worker& source, std::vector<job_result>& results) noexcept
+    {
+        while (true)
+        {
+            auto got = source.child.read(source.incoming);
+            if (!got || *got == 0)
+                break;
+        }
+
+        std::size_t added = 0;
+        std::size_t consumed = 0;
+
+        while (!source.jobs.empty() && source.incoming.size() - consumed >= sizeof(frame_length))
+        {
+            frame_length length;
+            std::memcpy(&length, source.incoming.data() + consumed, sizeof(length));
+
+            if (source.incoming.size() - consumed - sizeof(length) < length)
+                break;
+
+            job_result result;
+            result.job_id = source.jobs.front();
+            result.output.append(source.incoming.data() + consumed + sizeof(length), length);
+            results.push_back(std::move(result));
+
+            source.jobs.pop_front();
+            consumed += sizeof(length) + length;
+            ++added;
+        }
+
+        // keep the partial frame at the front
+        if (consumed > 0)
+        {
+            const std::size_t left = source.incoming.size() - consumed;
+            std::memmove(source.incoming.data(), source.incoming.data() + consumed, left);
+            source.incoming.resize(left);
+        }
+
+        return added;
+    }
+
+    inline std::size_t process_pool::restart(worker& target, std::vector<job_result>& results) noexcept
+    {
+        const std::size_t failed = target.jobs.size();
+        for (uint64_t id : target.jobs)
+        {
+            job_result result;
+            result.job_id = id;
+            result.error = error_code(error_code::process_crashed);
+            results.push_back(std::move(result));
+        }
+
+        target.jobs.clear();
+        target.outgoing.clear();
+        target.outgoing_sent = 0;
+        target.incoming.clear();
+
+        // it may only have closed its stdout, make sure it is gone before
+        // collecting it and starting the new one
+        if (target.child.running())
+            kill(target.child.id(), SIGKILL);
+        target.child.wait();
+        target.child = process(worker_command, opts.method);
+        ++restart_count;
+
+        if (!target.child)
+            status = target.child.error();
+
+        return failed;
+    }
+}
+
+#endif
@@ -0,0 +1,457 @@
+#ifndef UNORTHODOX_UNIX_SHM_CHANNEL_HPP
+#define UNORTHODOX_UNIX_SHM_CHANNEL_HPP
+
+#if !defined(__linux__)
+# error shm_channel needs memfd and futex, which are Linux only
+#endif
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <span>
+
+#include <unorthodox/error_codes.hpp>
+#include <unorthodox/buffer.hpp>
+
+namespace unorthodox::unix
+{
+    // One-way message channel between two processes, a single-producer
+    // single-consumer ring in memory shared through a memfd.  A message is a
+    // copy into the ring and a copy (or a peek) out of it, the kernel is only
+    // involved when one side has to sleep: the consumer on an empty ring, the
+    // producer on a full one.
+    //
+    // The parent creates the channel and passes native_handle() to the child
+    // with command::inherit(), the child attaches to that fd.  Use two channels
+    // for traffic in both directions.
+    class shm_channel
+    {
+        public:
+            // capacity is rounded up to a power of two of at least a page
+            static shm_channel create(std::size_t capacity = 1024 * 1024) noexcept;
+
+            // Maps a channel created by another process, takes ownership of fd
+            static shm_channel attach(int fd) noexcept;
+
+            shm_channel(shm_channel&& other) noexcept;
+            shm_channel& operator=(shm_channel&& other) noexcept;
+
+            shm_channel(const shm_channel&) = delete;
+            shm_channel& operator=(const shm_channel&) = delete;
+
+           ~shm_channel();
+
+            operator bool() const noexcept { return shared != nullptr; }
+            error_code error() const noexcept { return status; }
+
+            // producer
+
+            // would_block if the ring is full, invalid_argument if the message is
+            // larger than max_message_size()
+            error_code try_send(std::span<const std::byte> message) noexcept;
+
+            // Sleeps while the ring is full, would_block once timeout_ms has
+            // passed, -1 waits for ever
+            error_code send(std::span<const std::byte> message, int timeout_ms = -1) noexcept;
+
+            // consumer
+
+            // The oldest message, left in the ring until pop().  Empty if there is
+            // no message.
+            std::span<const std::byte> peek() noexcept;
+            void pop() noexcept;
+
+            // Append the oldest message to target and remove it, would_block if
+            // there is none yet
+            tl::expected<std::size_t, error_code> try_receive(buffer& target) noexcept;
+            tl::expected<std::size_t, error_code> receive(buffer& target, int timeout_ms = -1) noexcept;
+
+            std::size_t capacity() const noexcept { return ring_size; }
+            std::size_t max_message_size() const noexcept { return ring_size / 2 - sizeof(record_length); }
+
+            int native_handle() const noexcept { return memfd; }
+
+        private:
+            using record_length = uint32_t;
+            constexpr static record_length wrap_marker = ~record_length(0);
+
+            // Lives at the start of the shared mapping, the ring follows it.  The
+            // positions only ever grow, masking gives the offset in the ring.
+            struct control_block
+            {
+                alignas(64) std::atomic<uint64_t>   head;               // written by the producer
+                alignas(64) std::atomic<uint64_t>   tail;               // written by the consumer
+
+                // futex words, 1 while that side sleeps or is about to
+                alignas(64) std::atomic<uint32_t>   consumer_waiting;
+                            std::atomic<uint32_t>   producer_waiting;
+
+                            uint64_t                ring_size;
+            };
+
+            constexpr static std::size_t control_size = (sizeof(control_block) + 63) / 64 * 64;
+
+            shm_channel() noexcept = default;
+
+            error_code map(std::size_t total_size) noexcept;
+            void       release() noexcept;
+
+            std::byte* ring() const noexcept { return reinterpret_cast<std::byte*>(shared) + control_size; }
+
+            // true once the condition holds, false on timeout
+            template <typename F>
+            bool wait_for(std::atomic<uint32_t>& waiting, F&& ready, int timeout_ms) noexcept;
+            void wake(std::atomic<uint32_t>& waiting) noexcept;
+
+            int             memfd       = -1;
+            control_block*  shared      = nullptr;
+            std::size_t     ring_size   = 0;
+            std::size_t     mapped_size = 0;
+
+            // our side's view, refreshed from the shared positions only when the
+            // ring looks full (producer) or empty (consumer)
+            uint64_t        cached_tail = 0;
+            uint64_t        cached_head = 0;
+
+            // length of the message peek() returned, valid while has_peeked
+            std::size_t     peeked      = 0;
+            bool            has_peeked  = false;
+
+            error_code      status      = error_code(error_code::uninitialised_value);
+    };
+}
+
+namespace unorthodox::unix
+{
+    namespace detail
+    {
+        // Shared futexes, the words are in a MAP_SHARED mapping seen by both processes
+        inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, int timeout_ms) noexcept
+        {
+            timespec timeout{ timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected,
+                    timeout_ms < 0 ? nullptr : &timeout, nullptr, 0);
+        }
+
+        inline void futex_wake(std::atomic<uint32_t>& word) noexcept
+        {
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+
+        constexpr std::size_t record_size(std::size_t length) noexcept
+        {
+            return (sizeof(uint32_t) + length + 7) & ~std::size_t(7);
+        }
+    }
+
+    inline shm_channel shm_channel::create(std::size_t capacity) noexcept
+    {
+        shm_channel rval;
+
+        const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        const std::size_t ring = std::bit_ceil(std::max(capacity, page));
+
+        rval.memfd = memfd_create("unorthodox-shm-channel", MFD_CLOEXEC);
+        if (rval.memfd == -1)
+        {
+            rval.status = error_code(error_code::cannot_create_pipe);
+            return rval;
+        }
+
+        if (ftruncate(rval.memfd, static_cast<off_t>(control_size + ring)) == -1)
+        {
+            rval.status = error_code(error_code::cannot_create_pipe);
+            return rval;
+        }
+
+        rval.status = rval.map(control_size + ring);
+        if (rval.status)
+            return rval;
+
+        // a fresh memfd is zero filled, the positions and flags start out right
+        rval.shared->ring_size = ring;
+        rval.ring_size = ring;
+
+        return rval;
+    }
+
+    inline shm_channel shm_channel::attach(int fd) noexcept
+    {
+        shm_channel rval;
+        rval.memfd = fd;
+
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) == -1 || static_cast<std::size_t>(info.st_size) <= control_size)
+        {
+            rval.status = error_code(error_code::invalid_argument);
+            return rval;
+        }
+
+        rval.status = rval.map(static_cast<std::size_t>(info.st_size));
+        if (rval.status)
+            return rval;
+
+        rval.ring_size = rval.shared->ring_size;
+        if (control_size + rval.ring_size != rval.mapped_size || !std::has_single_bit(rval.ring_size))
+        {
+            rval.release();
+            rval.status = error_code(error_code::invalid_argument);
+            return rval;
+        }
+
+        rval.cached_head = rval.shared->head.load(std::memory_order_acquire);
+        rval.cached_tail = rval.shared->tail.load(std::memory_order_acquire);
+
+        return rval;
+    }
+
+    inline shm_channel::shm_channel(shm_channel&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline shm_channel& shm_channel::operator=(shm_channel&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        release();
+
+        memfd = other.memfd;
+        shared = other.shared;
+        ring_size = other.ring_size;
+        mapped_size = other.mapped_size;
+        cached_tail = other.cached_tail;
+        cached_head = other.cached_head;
+        peeked = other.peeked;
+        has_peeked = other.has_peeked;
+        status = other.status;
+
+        other.memfd = -1;
+        other.shared = nullptr;
+        other.ring_size = other.mapped_size = 0;
+        other.has_peeked = false;
+        other.status = error_code(error_code::uninitialised_value);
+
+        return *this;
+    }
+
+    inline shm_channel::~shm_channel()
+    {
+        release();
+    }
+
+    inline error_code shm_channel::map(std::size_t total_size) noexcept
+    {
+        void* memory = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, memfd, 0);
+        if (memory == MAP_FAILED)
+            return error_code(error_domain::file_error, error_code::cannot_map_file);
+
+        shared = static_cast<control_block*>(memory);
+        mapped_size = total_size;
+
+        return error_code::success;
+    }
+
+    inline void shm_channel::release() noexcept
+    {
+        if (shared != nullptr)
+            munmap(shared, mapped_size);
+        if (memfd >= 0)
+            ::close(memfd);
+
+        shared = nullptr;
+        memfd = -1;
+    }
+
+    template <typename F>
+    bool shm_channel::wait_for(std::atomic<uint32_t>& waiting, F&& ready, int timeout_ms) noexcept
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+        while (true)
+        {
+            // announce that we are going to sleep, then look again so a wake
+            // that raced with us is not lost
+            waiting.store(1, std::memory_order_seq_cst);
+            if (ready())
+            {
+                waiting.store(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            int remaining = -1;
+            if (timeout_ms >= 0)
+            {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0)
+                {
+                    waiting.store(0, std::memory_order_relaxed);
+                    return false;
+                }
+                remaining = static_cast<int>(left.count());
+            }
+
+            detail::futex_wait(waiting, 1, remaining);
+        }
+    }
+
+    inline void shm_channel::wake(std::atomic<uint32_t>& waiting) noexcept
+    {
+        // pairs with the store in wait_for, either it sees our position or we see its flag
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) != 0)
+        {
+            waiting.store(0, std::memory_order_relaxed);
+            detail::futex_wake(waiting);
+        }
+    }
+
+    inline error_code shm_channel::try_send(std::span<const std::byte> message) noexcept
+    {
+        if (shared == nullptr)
+            return error_code(error_code::uninitialised_value);
+
+        if (message.size() > max_message_size())
+            return error_code(error_code::invalid_argument);
+
+        const std::size_t needed = detail::record_size(message.size());
+
+        uint64_t position = shared->head.load(std::memory_order_relaxed);
+        const std::size_t offset = position & (ring_size - 1);
+        const std::size_t to_end = ring_size - offset;
+
+        // records do not wrap, a short end of the ring is skipped
+        const std::size_t total = to_end < needed ? to_end + needed : needed;
+
+        if (position + total - cached_tail > ring_size)
+        {
+            cached_tail = shared->tail.load(std::memory_order_acquire);
+            if (position + total - cached_tail > ring_size)
+                return error_code(error_code::would_block);
+        }
+
+        if (to_end < needed)
+        {
+            std::memcpy(ring() + offset, &wrap_marker, sizeof(wrap_marker));
+            position += to_end;
+        }
+
+        std::byte* record = ring() + (position & (ring_size - 1));
+        const record_length length = static_cast<record_length>(message.size());
+        std::memcpy(record, &length, sizeof(length));
+        if (!message.empty())
+            std::memcpy(record + sizeof(length), message.data(), message.size());
+
+        shared->head.store(position + needed, std::memory_order_release);
+        wake(shared->consumer_waiting);
+
+        return error_code::success;
+    }
+
+    inline error_code shm_channel::send(std::span<const std::byte> message, int timeout_ms) noexcept
+    {
+        error_code result = try_send(message);
+        if (result.code != error_code::would_block)
+            return result;
+
+        const bool sent = wait_for(shared->producer_waiting, [&]{
+            result = try_send(message);
+            return result.code != error_code::would_block;
+        }, timeout_ms);
+
+        return sent ? result : error_code(error_code::would_block);
+    }
+
+    inline std::span<const std::byte> shm_channel::peek() noexcept
+    {
+        has_peeked = false;
+        if (shared == nullptr)
+            return {};
+
+        uint64_t position = shared->tail.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            if (position == cached_head)
+            {
+                cached_head = shared->head.load(std::memory_order_acquire);
+                if (position == cached_head)
+                    return {};
+            }
+
+            const std::size_t offset = position & (ring_size - 1);
+
+            record_length length;
+            std::memcpy(&length, ring() + offset, sizeof(length));
+
+            if (length != wrap_marker)
+            {
+                peeked = length;
+                has_peeked = true;
+                return { ring() + offset + sizeof(length), length };
+            }
+
+            // the producer skipped the end of the ring, hand that space back
+            position += ring_size - offset;
+            shared->tail.store(position, std::memory_order_release);
+        }
+    }
+
+    inline void shm_channel::pop() noexcept
+    {
+        if (!has_peeked)
+        {
+            peek();
+            if (!has_peeked)
+                return;
+        }
+
+        const uint64_t position = shared->tail.load(std::memory_order_relaxed);
+        shared->tail.store(position + detail::record_size(peeked), std::memory_order_release);
+        has_peeked = false;
+
+        wake(shared->producer_waiting);
+    }
+
+    inline tl::expected<std::size_t, error_code> shm_channel::try_receive(buffer& target) noexcept
+    {
+        if (shared == nullptr)
+            return tl::unexpected(error_code(error_code::uninitialised_value));
+
+        auto message = peek();
+        if (!has_peeked)
+            return tl::unexpected(error_code(error_code::would_block));
+
+        target.append(message);
+        pop();
+
+        return message.size();
+    }
+
+    inline tl::expected<std::size_t, error_code> shm_channel::receive(buffer& target, int timeout_ms) noexcept
+    {
+        auto result = try_receive(target);
+        if (result || result.error().code != error_code::would_block)
+            return result;
+
+        const bool received = wait_for(shared->consumer_waiting, [&]{
+            result = try_receive(target);
+            return result || result.error().code != error_code::would_block;
+        }, timeout_ms);
+
+        if (!received)
+            return tl::unexpected(error_code(error_code::would_block));
+
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef UNORTHODOX_UNIX_SIGPIPE_GUARD_HPP
+#define UNORTHODOX_UNIX_SIGPIPE_GUARD_HPP
+
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+namespace unorthodox::unix
+{
+    namespace detail
+    {
+        // Writing to a pipe or socket whose reader has gone away raises SIGPIPE,
+        // which would kill us.  Block it on this thread while writing and throw
+        // away any that were raised, the failed write tells us the same thing.
+        // For calls that have no MSG_NOSIGNAL: write(), sendfile(), splice().
+        class sigpipe_guard
+        {
+            public:
+                sigpipe_guard() noexcept
+                {
+                    sigset_t pending;
+                    sigpending(&pending);
+                    was_pending = sigismember(&pending, SIGPIPE);
+
+                    sigset_t block;
+                    sigemptyset(&block);
+                    sigaddset(&block, SIGPIPE);
+                    pthread_sigmask(SIG_BLOCK, &block, &old_mask);
+                }
+
+               ~sigpipe_guard()
+                {
+                    if (!was_pending)
+                    {
+                        sigset_t pending;
+                        sigpending(&pending);
+                        if (sigismember(&pending, SIGPIPE))
+                        {
+                            sigset_t pipe_only;
+                            sigemptyset(&pipe_only);
+                            sigaddset(&pipe_only, SIGPIPE);
+
+                            const timespec no_wait{ 0, 0 };
+                            while (sigtimedwait(&pipe_only, nullptr, &no_wait) == -1 && errno == EINTR) {}
+                        }
+                    }
+
+                    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+                }
+
+                sigpipe_guard(const sigpipe_guard&) = delete;
+                sigpipe_guard& operator=(const sigpipe_guard&) = delete;
+
+            private:
+                sigset_t    old_mask;
+                bool        was_pending = false;
+        };
+    }
+}
+
+#endif
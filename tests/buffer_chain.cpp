@@ -0,0 +1,96 @@
+#include "doctest.h"
+
+#include <unorthodox/buffer_chain.hpp>
+
+#include <string>
+#include <vector>
+
+TEST_SUITE("Buffer chain") {
+    using unorthodox::buffer_chain;
+
+    std::span<const std::byte> bytes_of(const std::string& text)
+    {
+        return std::as_bytes(std::span(text.data(), text.size()));
+    }
+
+    std::string contents(const buffer_chain& chain)
+    {
+        std::array<iovec, 16> regions;
+        std::string text;
+
+        const std::size_t count = chain.gather(regions);
+        for (std::size_t i = 0; i < count; ++i)
+            text.append(static_cast<const char*>(regions[i].iov_base), regions[i].iov_len);
+
+        return text;
+    }
+
+    TEST_CASE("Appending and consuming") {
+        buffer_chain chain(8);
+        REQUIRE(chain.empty());
+
+        REQUIRE(chain.append(bytes_of("hello ")));
+        REQUIRE(chain.append(bytes_of("world, this does not fit")));
+        REQUIRE(chain.size() == 30);
+        REQUIRE(contents(chain) == "hello world, this does not fit");
+
+        // the rest of a big append goes into one block
+        std::array<iovec, 16> regions;
+        REQUIRE(chain.gather(regions) == 2);
+
+        chain.consume(4);
+        REQUIRE(contents(chain) == "o world, this does not fit");
+
+        chain.consume(10);
+        REQUIRE(chain.gather(regions) == 1);
+        REQUIRE(contents(chain) == "his does not fit");
+
+        REQUIRE(chain.append(bytes_of("!")));
+        REQUIRE(contents(chain) == "his does not fit!");
+
+        chain.consume(100);
+        REQUIRE(chain.empty());
+        REQUIRE(chain.gather(regions) == 0);
+
+        REQUIRE(chain.append(bytes_of("again")));
+        REQUIRE(contents(chain) == "again");
+    }
+
+    TEST_CASE("Gather stops at the regions given") {
+        buffer_chain chain(4);
+        std::string expected;
+
+        for (int i = 0; i < 10; ++i)
+        {
+            const std::string part(4, static_cast<char>('a' + i));
+            REQUIRE(chain.append(bytes_of(part)));
+            expected += part;
+        }
+
+        std::array<iovec, 3> regions;
+        REQUIRE(chain.gather(regions) == 3);
+
+        std::string drained;
+        while (!chain.empty())
+        {
+            const std::size_t count = chain.gather(regions);
+            drained.append(static_cast<const char*>(regions[0].iov_base), regions[0].iov_len);
+            chain.consume(regions[0].iov_len);
+            REQUIRE(count >= 1);
+        }
+
+        REQUIRE(drained == expected);
+    }
+
+    TEST_CASE("Moving") {
+        buffer_chain first;
+        REQUIRE(first.append(bytes_of("moved")));
+
+        buffer_chain second(std::move(first));
+        REQUIRE(first.empty());
+        REQUIRE(contents(second) == "moved");
+
+        first = std::move(second);
+        REQUIRE(contents(first) == "moved");
+    }
+}
@@ -0,0 +1,508 @@
+#include "doctest.h"
+
+#include <unorthodox/file.hpp>
+#include <unorthodox/buffered_file.hpp>
+#include <unorthodox/async_file.hpp>
+#include <unorthodox/record_chunks.hpp>
+#include <unorthodox/append_log.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <thread>
+
+#include <signal.h>
+#include <sys/resource.h>
+
+namespace
+{
+    std::string temporary_path(const char* name)
+    {
+        const char* dir = getenv("TMPDIR");
+        return std::string(dir == nullptr ? "/tmp" : dir) + "/unorthodox_" + name + "_" + std::to_string(getpid());
+    }
+
+    std::span<const std::byte> as_bytes(const std::string& str)
+    {
+        return { reinterpret_cast<const std::byte*>(str.data()), str.size() };
+    }
+
+    // A write past RLIMIT_FSIZE raises SIGXFSZ on the thread that made it.  The
+    // handler says so and holds that thread until it is let go.
+    int file_too_large_reached[2];
+    int file_too_large_release[2];
+
+    void on_file_too_large(int)
+    {
+        char signal_byte = 0;
+        (void) !write(file_too_large_reached[1], &signal_byte, 1);
+        (void) !read(file_too_large_release[0], &signal_byte, 1);
+    }
+}
+
+TEST_SUITE("File") {
+    TEST_CASE("Open and create") {
+        const std::string path = temporary_path("open");
+
+        auto missing = unorthodox::file::open(path.c_str(), unorthodox::file::READ);
+        REQUIRE(!missing);
+        REQUIRE(missing.error().code == unorthodox::error_code::cannot_open_file);
+
+        auto created = unorthodox::file::create(path.c_str(), unorthodox::file::RW | unorthodox::file::TRUNCATE);
+        REQUIRE(created);
+        REQUIRE(created.size() == 0);
+
+        const std::string text = "first line\nsecond line\n";
+        REQUIRE(created.write(as_bytes(text), 0).value_or(0) == text.size());
+        REQUIRE(created.size() == text.size());
+
+        std::string readback(6, ' ');
+        auto count = created.read({ reinterpret_cast<std::byte*>(readback.data()), readback.size() }, 11);
+        REQUIRE(count.value_or(0) == 6);
+        REQUIRE(readback == "second");
+
+        auto moved = std::move(created);
+        REQUIRE(moved);
+        REQUIRE(!created);
+
+        unlink(path.c_str());
+    }
+
+    TEST_CASE("Memory mapped") {
+        const std::string path = temporary_path("mmap");
+        const std::string text = "0123456789abcdef";
+
+        {
+            auto out = unorthodox::file::create(path.c_str(), unorthodox::file::WRITE | unorthodox::file::TRUNCATE);
+            REQUIRE(out);
+            out.write(as_bytes(text), 0);
+        }
+
+        SUBCASE("Read-only") {
+            auto mapped = unorthodox::file::open(path.c_str(), unorthodox::file::READ | unorthodox::file::MMAP);
+            REQUIRE(mapped);
+            REQUIRE(mapped.is_mapped());
+            REQUIRE(mapped.size() == text.size());
+            REQUIRE(!mapped.advise(unorthodox::file::access_hint::sequential));
+            REQUIRE(!mapped.advise(unorthodox::file::access_hint::willneed, 3, 4));
+
+            std::string contents(reinterpret_cast<const char*>(mapped.begin()), mapped.size());
+            REQUIRE(contents == text);
+            REQUIRE(std::count(mapped.span().begin(), mapped.span().end(), std::byte('a')) == 1);
+        }
+
+        SUBCASE("Shared write") {
+            {
+                auto mapped = unorthodox::file::open(path.c_str(), unorthodox::file::RW | unorthodox::file::MMAP);
+                REQUIRE(mapped);
+                mapped.span()[0] = std::byte('X');
+
+                REQUIRE(!mapped.resize(text.size() * 2));
+                REQUIRE(mapped.size() == text.size() * 2);
+                mapped.span().back() = std::byte('Y');
+                REQUIRE(!mapped.sync());
+            }
+
+            auto plain = unorthodox::file::open(path.c_str(), unorthodox::file::READ);
+            std::byte first, last;
+            plain.read({ &first, 1 }, 0);
+            plain.read({ &last, 1 }, text.size() * 2 - 1);
+            REQUIRE(first == std::byte('X'));
+            REQUIRE(last == std::byte('Y'));
+        }
+
+        SUBCASE("Empty file") {
+            auto out = unorthodox::file::create(path.c_str(), unorthodox::file::RW | unorthodox::file::TRUNCATE | unorthodox::file::MMAP);
+            REQUIRE(out);
+            REQUIRE(out.is_mapped());
+            REQUIRE(out.empty());
+            REQUIRE(out.begin() == out.end());
+        }
+
+        unlink(path.c_str());
+    }
+}
+
+TEST_SUITE("Buffered file") {
+    TEST_CASE("Write and read back") {
+        const std::string path = temporary_path("buffered");
+
+        unorthodox::buffered_file_options options;
+        options.block_size = 4096;
+        options.batch_blocks = 3;
+        options.read_ahead = 2;
+
+        // deterministic, not block-aligned content
+        std::string expected;
+        for (int i = 0; expected.size() < 5 * options.block_size + 123; ++i)
+            expected += std::to_string(i) + ",";
+
+        SUBCASE("Buffered") {}
+        SUBCASE("Direct I/O") { options.direct_io = true; }
+
+        {
+            auto out = unorthodox::file::create(path.c_str(), unorthodox::file::WRITE | unorthodox::file::TRUNCATE);
+            unorthodox::buffered_file_writer writer(out, options);
+            REQUIRE(!writer.error());
+
+            // small writes, then one larger than a block
+            std::size_t pos = 0;
+            for (; pos < 3 * options.block_size; pos += 100)
+                REQUIRE(writer.write(as_bytes(expected.substr(pos, 100))).value_or(0) == 100);
+
+            REQUIRE(!writer.flush());
+            REQUIRE(out.size() == pos);
+
+            REQUIRE(writer.write(as_bytes(expected.substr(pos))).value_or(0) == expected.size() - pos);
+            REQUIRE(writer.tell() == expected.size());
+        }
+
+        auto in = unorthodox::file::open(path.c_str(), unorthodox::file::READ);
+        REQUIRE(in.size() == expected.size());
+
+        unorthodox::buffered_file_reader reader(in, options);
+        unorthodox::buffer contents;
+
+        REQUIRE(reader.read(contents, 10).value_or(0) == 10);
+        while (reader.read(contents).value_or(0) > 0);
+
+        REQUIRE(reader.eof());
+        REQUIRE(contents.read_string() == expected);
+
+        contents.clear();
+        REQUIRE(!reader.seek(4100));
+        REQUIRE(reader.read(contents, 50).value_or(0) == 50);
+        REQUIRE(contents.read_string() == expected.substr(4100, 50));
+
+        unlink(path.c_str());
+    }
+}
+
+TEST_SUITE("Async file") {
+    TEST_CASE("Reads and writes at offsets") {
+        const std::string path = temporary_path("async");
+
+        unorthodox::async_file_options options;
+        options.queue_depth = 8;
+
+        SUBCASE("Default backend") {}
+        SUBCASE("Thread pool") { options.use_io_uring = false; }
+
+        unorthodox::async_file_engine engine(options);
+        auto f = unorthodox::file::create(path.c_str(), unorthodox::file::RW | unorthodox::file::TRUNCATE);
+        REQUIRE(f);
+
+        if (engine.backend() == unorthodox::async_file_engine::backend_type::io_uring)
+            REQUIRE(!engine.register_file(f));
+
+        constexpr int block_count = 16;
+        constexpr std::size_t block_size = 512;
+
+        std::vector<unorthodox::buffer> blocks(block_count);
+        for (int i = 0; i < block_count; ++i)
+        {
+            std::string text(block_size, static_cast<char>('a' + i));
+            blocks[i].append(as_bytes(text));
+            REQUIRE(!engine.write(f, i * block_size, blocks[i], i));
+        }
+
+        REQUIRE(engine.submit().has_value());
+
+        std::vector<unorthodox::file_completion> done(block_count);
+        std::size_t completed = 0;
+        while (completed < block_count)
+            completed += engine.reap(std::span(done).subspan(completed), 1);
+
+        for (auto& completion : done)
+        {
+            REQUIRE(!completion.error);
+            REQUIRE(completion.bytes == block_size);
+        }
+        REQUIRE(f.size() == block_count * block_size);
+
+        // read back in reverse, the last one past the end of the file
+        std::vector<unorthodox::buffer> targets(block_count);
+        std::vector<unorthodox::buffer*> registered;
+        for (auto& target : targets)
+        {
+            target.reserve(block_size * 2);
+            registered.push_back(&target);
+        }
+        if (engine.backend() == unorthodox::async_file_engine::backend_type::io_uring)
+            REQUIRE(!engine.register_buffers(registered));
+
+        for (int i = block_count - 1; i >= 0; --i)
+            REQUIRE(!engine.read(f, i * block_size + block_size / 2, targets[i], block_size, i));
+
+        engine.submit();
+
+        completed = 0;
+        while (engine.in_flight() > 0)
+            completed += engine.reap(std::span(done).subspan(completed), 1);
+        REQUIRE(completed == block_count);
+
+        for (int i = 0; i < block_count; ++i)
+        {
+            const std::string text = targets[i].read_string();
+            if (i == block_count - 1)
+            {
+                REQUIRE(text == std::string(block_size / 2, static_cast<char>('a' + i)));
+                continue;
+            }
+            REQUIRE(text == std::string(block_size / 2, static_cast<char>('a' + i))
+                          + std::string(block_size / 2, static_cast<char>('a' + i + 1)));
+        }
+
+        engine.unregister_file(f);
+        unlink(path.c_str());
+    }
+
+    TEST_CASE("Reaping submits what is queued") {
+        const std::string path = temporary_path("async_reap");
+
+        unorthodox::async_file_options options;
+        SUBCASE("Default backend") {}
+        SUBCASE("Thread pool") { options.use_io_uring = false; }
+
+        unorthodox::async_file_engine engine(options);
+        auto f = unorthodox::file::create(path.c_str(), unorthodox::file::RW | unorthodox::file::TRUNCATE);
+        REQUIRE(f);
+
+        unorthodox::buffer block("queued");
+        REQUIRE(!engine.write(f, 0, block, 7));
+
+        // no submit() first, this must not wait forever
+        unorthodox::file_completion done[1];
+        REQUIRE(engine.reap(done, 1) == 1);
+        REQUIRE(done[0].user_data == 7);
+        REQUIRE(done[0].bytes == block.size());
+        REQUIRE(engine.in_flight() == 0);
+
+        unlink(path.c_str());
+    }
+
+    TEST_CASE("Short transfers are finished") {
+        unorthodox::async_file_engine engine;
+        if (engine.backend() != unorthodox::async_file_engine::backend_type::io_uring)
+            return;
+
+        // a pipe hands over what it has, the rest of the read has to follow
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        auto source = unorthodox::file::open(("/proc/self/fd/" + std::to_string(fds[0])).c_str(), unorthodox::file::READ);
+        REQUIRE(source);
+
+        REQUIRE(write(fds[1], "first", 5) == 5);
+
+        unorthodox::buffer target;
+        REQUIRE(!engine.read(source, 0, target, 10, 1));
+        REQUIRE(engine.submit().has_value());
+
+        unorthodox::file_completion done[1];
+        REQUIRE(engine.reap(done, 0) == 0);
+
+        REQUIRE(write(fds[1], "later", 5) == 5);
+        REQUIRE(engine.reap(done, 1) == 1);
+        REQUIRE(!done[0].error);
+        REQUIRE(done[0].bytes == 10);
+        REQUIRE(target.read_string() == "firstlater");
+
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+TEST_SUITE("Record chunks") {
+    TEST_CASE("Splitting at record boundaries") {
+        const std::string text = "aa\nbbbb\nc\ndddddd\ne\nff\n";
+        const unorthodox::record_chunk data = as_bytes(text);
+
+        for (std::size_t count = 1; count < 10; ++count)
+        {
+            auto chunks = unorthodox::split_records(data, count);
+            REQUIRE(chunks.size() <= count);
+
+            std::string joined;
+            for (auto chunk : chunks)
+            {
+                REQUIRE(!chunk.empty());
+                REQUIRE(chunk.back() == std::byte('\n'));
+                joined.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+            }
+            REQUIRE(joined == text);
+        }
+
+        const std::string crlf = "one\r\ntwo\r\nthree\r\nfour";
+        auto chunks = unorthodox::split_records(as_bytes(crlf), 2, "\r\n");
+        REQUIRE(chunks.size() == 2);
+        REQUIRE(std::string(reinterpret_cast<const char*>(chunks[0].data()), chunks[0].size()) == "one\r\ntwo\r\nthree\r\n");
+
+        REQUIRE(unorthodox::split_records({}, 4).empty());
+    }
+
+    TEST_CASE("Parallel over a mapped file") {
+        const std::string path = temporary_path("records");
+
+        std::string text;
+        for (int i = 0; i < 10000; ++i)
+            text += "record " + std::to_string(i) + "\n";
+
+        {
+            auto out = unorthodox::file::create(path.c_str(), unorthodox::file::WRITE | unorthodox::file::TRUNCATE);
+            out.write(as_bytes(text), 0);
+        }
+
+        auto mapped = unorthodox::file::open(path.c_str(), unorthodox::file::READ | unorthodox::file::MMAP);
+        REQUIRE(mapped);
+
+        auto counts = unorthodox::for_each_record_chunk(mapped, 8, [](unorthodox::record_chunk chunk, std::size_t) {
+            return std::count(chunk.begin(), chunk.end(), std::byte('\n'));
+        });
+
+        REQUIRE(counts);
+        REQUIRE(counts->size() == 8);
+
+        std::ptrdiff_t total = 0;
+        for (auto count : *counts)
+            total += count;
+        REQUIRE(total == 10000);
+
+        // first record of every chunk, in order
+        unorthodox::thread_pool pool(3);
+        auto firsts = unorthodox::for_each_record_chunk(mapped, 5, [](unorthodox::record_chunk chunk, std::size_t) {
+            return std::stoi(std::string(reinterpret_cast<const char*>(chunk.data()) + 7, 6));
+        }, pool);
+        REQUIRE(firsts);
+        REQUIRE(std::is_sorted(firsts->begin(), firsts->end()));
+        REQUIRE(firsts->front() == 0);
+
+        // more chunks than threads
+        auto many = unorthodox::for_each_record_chunk(mapped, 1000, [](unorthodox::record_chunk chunk, std::size_t) {
+            return chunk.size();
+        });
+        REQUIRE(many);
+        REQUIRE(many->size() > std::thread::hardware_concurrency());
+
+        std::size_t covered = 0;
+        for (auto size : *many)
+            covered += size;
+        REQUIRE(covered == text.size());
+
+        // without a mapping there is nothing to split
+        auto plain = unorthodox::file::open(path.c_str(), unorthodox::file::READ);
+        REQUIRE(plain);
+
+        auto unmapped = unorthodox::for_each_record_chunk(plain, 4, [](unorthodox::record_chunk, std::size_t) {});
+        REQUIRE(!unmapped);
+        REQUIRE(unmapped.error().code == unorthodox::error_code::file_not_mapped);
+
+        unlink(path.c_str());
+    }
+}
+
+TEST_SUITE("Append log") {
+    TEST_CASE("Group commit from many writers") {
+        const std::string path = temporary_path("append_log");
+
+        constexpr int writer_count = 8;
+        constexpr int records_per_writer = 50;
+
+        std::vector<std::vector<std::pair<uint64_t, std::string>>> written(writer_count);
+
+        {
+            unorthodox::append_log_options options;
+            options.max_latency = std::chrono::milliseconds(1);
+            options.segment_size = 64 * 1024;
+
+            unorthodox::append_log log(unorthodox::file::create(path.c_str(), unorthodox::file::WRITE | unorthodox::file::TRUNCATE), options);
+            REQUIRE(!log.error());
+
+            std::vector<std::thread> writers;
+            for (int w = 0; w < writer_count; ++w)
+            {
+                writers.emplace_back([&, w]{
+                    for (int i = 0; i < records_per_writer; ++i)
+                    {
+                        std::string record = "writer " + std::to_string(w) + " record " + std::to_string(i) + "\n";
+                        auto offset = log.append(as_bytes(record)).get();
+                        if (offset)
+                            written[w].emplace_back(*offset, record);
+                    }
+                });
+            }
+
+            for (auto& writer : writers)
+                writer.join();
+
+            unorthodox::buffer moved("last\n");
+            auto last = log.append(std::move(moved)).get();
+            REQUIRE(last.value_or(0) + 5 == log.durable_offset());
+        }
+
+        auto contents = unorthodox::file::open(path.c_str(), unorthodox::file::READ | unorthodox::file::MMAP);
+        REQUIRE(contents);
+
+        for (const auto& records : written)
+        {
+            REQUIRE(records.size() == records_per_writer);
+            for (const auto& [offset, record] : records)
+                REQUIRE(std::string(reinterpret_cast<const char*>(contents.data()) + offset, record.size()) == record);
+        }
+
+        unlink(path.c_str());
+    }
+
+    TEST_CASE("Nothing is durable after a failed commit") {
+        const std::string path = temporary_path("append_log_failure");
+
+        REQUIRE(pipe(file_too_large_reached) == 0);
+        REQUIRE(pipe(file_too_large_release) == 0);
+
+        struct sigaction handler{};
+        struct sigaction previous_handler{};
+        handler.sa_handler = on_file_too_large;
+        sigaction(SIGXFSZ, &handler, &previous_handler);
+
+        rlimit previous_limit;
+        getrlimit(RLIMIT_FSIZE, &previous_limit);
+
+        rlimit limit = previous_limit;
+        limit.rlim_cur = 64 * 1024;
+        REQUIRE(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+        {
+            unorthodox::append_log_options options;
+            options.max_latency = std::chrono::milliseconds(1);
+            options.segment_size = 0;
+
+            unorthodox::append_log log(unorthodox::file::create(path.c_str(), unorthodox::file::WRITE | unorthodox::file::TRUNCATE), options);
+            REQUIRE(!log.error());
+
+            auto first = log.append(as_bytes(std::string(128 * 1024, 'a')));
+
+            // the committer is stuck in the write that failed, this one goes
+            // into the next batch, which would succeed on its own
+            char signal_byte;
+            REQUIRE(read(file_too_large_reached[0], &signal_byte, 1) == 1);
+
+            auto second = log.append(as_bytes("after the hole\n"));
+
+            setrlimit(RLIMIT_FSIZE, &previous_limit);
+            REQUIRE(write(file_too_large_release[1], &signal_byte, 1) == 1);
+
+            REQUIRE(!first.get());
+            REQUIRE(!second.get());
+            REQUIRE(log.error());
+            REQUIRE(log.durable_offset() == 0);
+
+            REQUIRE(!log.append(as_bytes("too late\n")).get());
+        }
+
+        sigaction(SIGXFSZ, &previous_handler, nullptr);
+        for (int fd : { file_too_large_reached[0], file_too_large_reached[1], file_too_large_release[0], file_too_large_release[1] })
+            close(fd);
+
+        unlink(path.c_str());
+    }
+}
@@ -0,0 +1,194 @@
+#include "doctest.h"
+
+#include <unorthodox/network/framing.hpp>
+
+#include <string>
+#include <vector>
+
+TEST_SUITE("Framing") {
+    using namespace unorthodox::net;
+    using unorthodox::error_code;
+
+    static std::span<const std::byte> bytes_of(const std::string& text)
+    {
+        return std::as_bytes(std::span(text.data(), text.size()));
+    }
+
+    static std::string text_of(std::span<const std::byte> data)
+    {
+        return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    TEST_CASE("Headers") {
+        std::array<std::byte, 10> header;
+
+        SUBCASE("Fixed widths are big-endian") {
+            const frame_format format{ frame_prefix::u16 };
+            REQUIRE(encode_frame_header(format, 0x1234, header) == 2);
+            REQUIRE(header[0] == std::byte(0x12));
+            REQUIRE(header[1] == std::byte(0x34));
+
+            auto decoded = decode_frame_header(format, std::span(header).first(2));
+            REQUIRE(decoded);
+            REQUIRE(decoded->header_size == 2);
+            REQUIRE(decoded->length == 0x1234);
+
+            REQUIRE(decode_frame_header(format, std::span(header).first(1)).error().code == error_code::would_block);
+
+            // too long for the prefix
+            REQUIRE(encode_frame_header(format, 0x10000, header) == 0);
+        }
+
+        SUBCASE("Varints") {
+            const frame_format format{ frame_prefix::varint };
+            REQUIRE(varint_size(127) == 1);
+            REQUIRE(varint_size(128) == 2);
+            REQUIRE(varint_size(~uint64_t(0)) == 10);
+
+            REQUIRE(encode_frame_header(format, 300, header) == 2);
+            REQUIRE(header[0] == std::byte(0xac));
+            REQUIRE(header[1] == std::byte(0x02));
+
+            auto decoded = decode_frame_header(format, header);
+            REQUIRE(decoded);
+            REQUIRE(decoded->header_size == 2);
+            REQUIRE(decoded->length == 300);
+
+            REQUIRE(decode_frame_header(format, std::span(header).first(1)).error().code == error_code::would_block);
+
+            // padded is just as good
+            const std::byte padded[] = { std::byte(0x85), std::byte(0x80), std::byte(0x00) };
+            REQUIRE(decode_frame_header(format, padded)->length == 5);
+            REQUIRE(decode_frame_header(format, padded)->header_size == 3);
+
+            // more continuation bytes than 64 bits need
+            std::array<std::byte, 11> endless;
+            endless.fill(std::byte(0x80));
+            REQUIRE(decode_frame_header(format, endless).error().code == error_code::invalid_frame);
+        }
+
+        SUBCASE("Limits") {
+            const frame_format format{ frame_prefix::u32, 1000 };
+            REQUIRE(encode_frame_header(format, 1001, header) == 4);
+            REQUIRE(decode_frame_header(format, std::span(header).first(4)).error().code == error_code::invalid_frame);
+        }
+    }
+
+    TEST_CASE("Round trip") {
+        for (frame_prefix prefix : { frame_prefix::u8, frame_prefix::u16, frame_prefix::u32, frame_prefix::u64, frame_prefix::varint })
+        {
+            CAPTURE(static_cast<int>(prefix));
+            const frame_format format{ prefix, 200 };
+
+            unorthodox::buffer encoded;
+            frame_encoder encoder(encoded, format);
+
+            REQUIRE(!encoder.write(bytes_of("first")));
+            REQUIRE(!encoder.write(bytes_of("")));
+            REQUIRE(!encoder.write(bytes_of(std::string(200, 'x'))));
+            REQUIRE(encoder.write(bytes_of(std::string(201, 'x'))).code == error_code::invalid_frame);
+
+            // the rejected one leaves nothing behind
+            REQUIRE(encoded.size() == 3 * encoder.reserved() + 205);
+
+            // payload written in place between begin and end
+            REQUIRE(encoder.begin());
+            encoded.append(bytes_of("in "));
+            encoded.append(bytes_of("place"));
+            REQUIRE(!encoder.end());
+
+            frame_decoder decoder(format);
+
+            // a byte at a time, every partial frame waits
+            std::vector<std::string> frames;
+            for (std::size_t i = 0; i < encoded.size(); ++i)
+            {
+                decoder.feed(std::span(encoded.data() + i, 1));
+
+                for (auto frame = decoder.next(); frame; frame = decoder.next())
+                    frames.push_back(text_of(*frame));
+            }
+
+            REQUIRE(frames.size() == 4);
+            REQUIRE(frames[0] == "first");
+            REQUIRE(frames[1].empty());
+            REQUIRE(frames[2] == std::string(200, 'x'));
+            REQUIRE(frames[3] == "in place");
+
+            REQUIRE(decoder.buffered() == 0);
+            REQUIRE(decoder.next().error().code == error_code::would_block);
+        }
+    }
+
+    TEST_CASE("Views point into the receive buffer") {
+        unorthodox::buffer encoded;
+        frame_encoder encoder(encoded);
+        REQUIRE(!encoder.write(bytes_of("one")));
+        REQUIRE(!encoder.write(bytes_of("two")));
+
+        frame_decoder decoder;
+        decoder.feed(std::span(encoded.data(), encoded.size()));
+
+        auto first = decoder.next();
+        auto second = decoder.next();
+        REQUIRE(first);
+        REQUIRE(second);
+
+        // back to back, the header in between
+        REQUIRE(second->data() == first->data() + 3 + 4);
+        REQUIRE(text_of(*second) == "two");
+    }
+
+    TEST_CASE("Broken streams stay broken") {
+        frame_decoder decoder(frame_format{ frame_prefix::u8, 4 });
+
+        const std::byte data[] = { std::byte(5), std::byte(1), std::byte(2), std::byte(3), std::byte(4), std::byte(5) };
+        decoder.feed(data);
+
+        REQUIRE(decoder.next().error().code == error_code::invalid_frame);
+        REQUIRE(decoder.next().error().code == error_code::invalid_frame);
+
+        // the length says four and only two are there
+        const std::byte partial[] = { std::byte(4), std::byte(1), std::byte(2) };
+        decoder.clear();
+        decoder.feed(partial);
+        REQUIRE(decoder.next().error().code == error_code::would_block);
+    }
+
+    TEST_CASE("Reading from a socket") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+        unix_socket sender(pair[0], AF_UNIX);
+        unix_socket receiver(pair[1], AF_UNIX);
+        receiver.recv_size = 64;
+
+        const frame_format format{ frame_prefix::varint };
+
+        unorthodox::buffer encoded;
+        frame_encoder encoder(encoded, format);
+
+        std::vector<std::string> sent;
+        for (std::size_t i = 0; i < 50; ++i)
+        {
+            sent.push_back(std::string(i * 7, static_cast<char>('a' + i % 26)));
+            REQUIRE(!encoder.write(bytes_of(sent.back())));
+        }
+
+        const iovec region[] = { { encoded.data(), encoded.size() } };
+        REQUIRE(sender.send(region).value_or(0) == encoded.size());
+
+        frame_decoder decoder(format);
+        std::vector<std::string> received;
+
+        while (received.size() < sent.size())
+        {
+            REQUIRE(decoder.read_from(receiver).value_or(0) > 0);
+
+            for (auto frame = decoder.next(); frame; frame = decoder.next())
+                received.push_back(text_of(*frame));
+        }
+
+        REQUIRE(received == sent);
+    }
+}
@@ -0,0 +1,399 @@
+#include "doctest.h"
+
+#include <unorthodox/unix/pipe.hpp>
+#include <unorthodox/unix/process_pool.hpp>
+#include <unorthodox/unix/shm_channel.hpp>
+
+#include <string>
+#include <algorithm>
+
+#include <poll.h>
+
+namespace
+{
+    // our pipe ends do not block, wait for data before each read
+    std::string read_all(int fd)
+    {
+        std::string rval;
+        char chunk[256];
+        while (true)
+        {
+            pollfd readable{ fd, POLLIN, 0 };
+            poll(&readable, 1, 5000);
+
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n > 0)
+                rval.append(chunk, n);
+            else if (n == 0 || errno != EAGAIN)
+                return rval;
+        }
+    }
+
+    std::string to_string(const unorthodox::buffer& data)
+    {
+        return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+}
+
+TEST_SUITE("Process") {
+    TEST_CASE_TEMPLATE_DEFINE("Spawning", T, spawn_test_id) {
+        constexpr auto method = T::value;
+
+        SUBCASE("Pipes to stdin and stdout") {
+            unorthodox::unix::process child(method, "cat");
+            REQUIRE(child);
+            REQUIRE(child.running());
+
+            const std::string text = "through the pipes\n";
+            REQUIRE(write(child.stdin_fd(), text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+            child.close_stdin();
+
+            REQUIRE(read_all(child.stdout_fd()) == text);
+            REQUIRE(child.wait().value_or(-1) == 0);
+            REQUIRE(!child.running());
+        }
+
+        SUBCASE("Non-blocking reads and writes") {
+            unorthodox::unix::process child(method, "cat");
+            REQUIRE(child);
+
+            // nothing written yet
+            auto empty = child.read();
+            REQUIRE(!empty);
+            REQUIRE(empty.error() == unorthodox::error_code(unorthodox::error_code::would_block));
+
+            unorthodox::buffer text;
+            text.append(reinterpret_cast<const std::byte*>("non-blocking\n"), 13);
+            REQUIRE(child.write(text).value_or(0) == text.size());
+            child.close_stdin();
+
+            unorthodox::buffer output;
+            while (!child.stdout_closed())
+            {
+                pollfd readable{ child.stdout_fd(), POLLIN, 0 };
+                REQUIRE(poll(&readable, 1, 5000) == 1);
+                child.read(output);
+            }
+
+            REQUIRE(to_string(output) == "non-blocking\n");
+            REQUIRE(child.wait().value_or(-1) == 0);
+        }
+
+        SUBCASE("Writing to a child that exited") {
+            unorthodox::unix::process child(method, "sh", "-c", "exit 0");
+            REQUIRE(child.wait().value_or(-1) == 0);
+
+            // an error instead of SIGPIPE
+            unorthodox::buffer text("nobody reads this\n");
+            auto written = child.write(text);
+            REQUIRE(!written);
+            REQUIRE(written.error() == unorthodox::error_code(unorthodox::error_code::broken_pipe));
+        }
+
+        SUBCASE("Exit status") {
+            unorthodox::unix::process child(method, "sh", "-c", "exit 3");
+            REQUIRE(child.wait().value_or(-1) == 3);
+
+            // moving keeps the result
+            auto moved = std::move(child);
+            REQUIRE(moved.wait().value_or(-1) == 3);
+            REQUIRE(!child.wait());
+        }
+
+        SUBCASE("Pipes do not leak to children") {
+            unorthodox::unix::process first(method, "cat");
+            unorthodox::unix::process second(method, "sh", "-c", "ls /proc/self/fd");
+
+            // stdin, stdout, stderr and the fd ls itself opens
+            second.close_stdin();
+            std::string fds = read_all(second.stdout_fd());
+            REQUIRE(std::count(fds.begin(), fds.end(), '\n') <= 4);
+        }
+
+        SUBCASE("Dropped while running") {
+            pid_t replaced;
+            pid_t dropped;
+            {
+                unorthodox::unix::process child(method, "cat");
+                REQUIRE(child.running());
+                replaced = child.id();
+
+                child = unorthodox::unix::process(method, "cat");
+                REQUIRE(child.running());
+                dropped = child.id();
+            }
+
+            // both were collected, neither is left as a zombie
+            int wait_status;
+            REQUIRE(waitpid(replaced, &wait_status, WNOHANG) == -1);
+            REQUIRE(waitpid(dropped, &wait_status, WNOHANG) == -1);
+        }
+    }
+
+    TEST_CASE_TEMPLATE_INVOKE(spawn_test_id,
+        std::integral_constant<unorthodox::unix::spawn_method, unorthodox::unix::spawn_method::fork>,
+        std::integral_constant<unorthodox::unix::spawn_method, unorthodox::unix::spawn_method::posix_spawn>);
+
+    TEST_CASE("Missing executable") {
+        unorthodox::unix::process child("unorthodox-this-does-not-exist");
+        REQUIRE(!child);
+        REQUIRE(child.error().code == unorthodox::error_code::cannot_spawn_process);
+    }
+}
+
+TEST_SUITE("Pipeline") {
+    using unorthodox::unix::command;
+    using unorthodox::unix::pipeline;
+
+    TEST_CASE("Stages are connected to each other") {
+        pipeline chain(command("sort") | command("uniq", "-c") | command("wc", "-l"));
+        REQUIRE(chain);
+        REQUIRE(chain.size() == 3);
+
+        // only the ends of the chain are ours
+        REQUIRE(chain[0].stdout_fd() == -1);
+        REQUIRE(chain[1].stdin_fd() == -1);
+        REQUIRE(chain[1].stdout_fd() == -1);
+        REQUIRE(chain[2].stdin_fd() == -1);
+
+        const std::string text = "b\na\nb\nc\na\n";
+        REQUIRE(write(chain.stdin_fd(), text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        chain.front().close_stdin();
+
+        REQUIRE(read_all(chain.stdout_fd()) == "3\n");
+        REQUIRE(chain.wait().value_or(-1) == 0);
+    }
+
+    TEST_CASE("Exit status of the last stage") {
+        pipeline chain(command("true") | command("sh", "-c", "exit 4"));
+        REQUIRE(chain);
+        REQUIRE(chain.wait().value_or(-1) == 4);
+    }
+
+    TEST_CASE("Dropped while running") {
+        pid_t first;
+        pid_t last;
+        {
+            pipeline chain(command("cat") | command("cat") | command("cat"));
+            REQUIRE(chain);
+            first = chain.front().id();
+            last = chain.back().id();
+        }
+
+        int wait_status;
+        REQUIRE(waitpid(first, &wait_status, WNOHANG) == -1);
+        REQUIRE(waitpid(last, &wait_status, WNOHANG) == -1);
+    }
+
+    TEST_CASE("Missing program") {
+        pipeline chain(command("cat") | command("/nonexistent/program"));
+        REQUIRE(!chain);
+        REQUIRE(chain.error() == unorthodox::error_code(unorthodox::error_code::cannot_spawn_process));
+    }
+
+    TEST_CASE("Splice and tee between processes") {
+        unorthodox::unix::process source("printf", "spliced");
+        unorthodox::unix::process first("cat");
+        unorthodox::unix::process second("cat");
+        REQUIRE(source);
+        REQUIRE(first);
+        REQUIRE(second);
+
+        pollfd readable{ source.stdout_fd(), POLLIN, 0 };
+        REQUIRE(poll(&readable, 1, 5000) == 1);
+
+        // tee leaves the data in place for the splice that follows
+        REQUIRE(unorthodox::unix::tee(source.stdout_fd(), second.stdin_fd(), 64).value_or(0) == 7);
+        REQUIRE(unorthodox::unix::splice(source, first, 64).value_or(0) == 7);
+
+        first.close_stdin();
+        second.close_stdin();
+
+        REQUIRE(read_all(first.stdout_fd()) == "spliced");
+        REQUIRE(read_all(second.stdout_fd()) == "spliced");
+        REQUIRE(source.wait().value_or(-1) == 0);
+    }
+}
+
+TEST_SUITE("Process pool") {
+    using unorthodox::unix::process_pool;
+    using unorthodox::unix::job_result;
+
+    // cat answers every job with the job itself
+    std::vector<job_result> run_jobs(process_pool& pool, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            const std::string payload = "job " + std::to_string(i);
+            REQUIRE(pool.submit(std::as_bytes(std::span(payload))));
+        }
+
+        std::vector<job_result> results;
+        while (pool.in_flight() > 0)
+            REQUIRE(pool.poll(results, 5000) > 0);
+
+        return results;
+    }
+
+    TEST_CASE_TEMPLATE_DEFINE("Results come back for every job", T, pool_test_id) {
+        unorthodox::unix::process_pool_options options;
+        options.workers = 3;
+        options.selection = T::value;
+
+        process_pool pool(unorthodox::unix::command("cat"), options);
+        REQUIRE(pool);
+        REQUIRE(pool.size() == 3);
+
+        auto results = run_jobs(pool, 100);
+        REQUIRE(results.size() == 100);
+
+        // nothing left to wait for, this must not block
+        REQUIRE(pool.poll(results) == 0);
+
+        std::sort(results.begin(), results.end(), [](const auto& a, const auto& b){ return a.job_id < b.job_id; });
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            REQUIRE(results[i].job_id == i);
+            REQUIRE(!results[i].error);
+            REQUIRE(to_string(results[i].output) == "job " + std::to_string(i));
+        }
+    }
+
+    TEST_CASE_TEMPLATE_INVOKE(pool_test_id,
+        std::integral_constant<unorthodox::unix::worker_selection, unorthodox::unix::worker_selection::least_loaded>,
+        std::integral_constant<unorthodox::unix::worker_selection, unorthodox::unix::worker_selection::round_robin>);
+
+    TEST_CASE("Crashed workers are restarted") {
+        unorthodox::unix::process_pool_options options;
+        options.workers = 1;
+
+        process_pool pool(unorthodox::unix::command("cat"), options);
+        REQUIRE(pool);
+
+        const pid_t first = pool.worker_id(0);
+
+        const std::string payload = "lost";
+        const uint64_t lost = pool.submit(std::as_bytes(std::span(payload))).value_or(~0ull);
+        kill(first, SIGKILL);
+
+        std::vector<job_result> results;
+        while (pool.in_flight() > 0)
+            pool.poll(results, 5000);
+
+        REQUIRE(results.size() == 1);
+        REQUIRE(results[0].job_id == lost);
+        REQUIRE(results[0].error == unorthodox::error_code(unorthodox::error_code::process_crashed));
+
+        REQUIRE(pool.restarts() == 1);
+        REQUIRE(pool.worker_id(0) != first);
+
+        // the new worker takes jobs as usual
+        auto after = run_jobs(pool, 1);
+        REQUIRE(after.size() == 1);
+        REQUIRE(!after[0].error);
+
+        // an idle worker that dies is noticed without a job on it
+        const pid_t second = pool.worker_id(0);
+        kill(second, SIGKILL);
+        while (pool.restarts() < 2)
+            REQUIRE(pool.poll(results) == 0);
+        REQUIRE(pool.worker_id(0) != second);
+    }
+}
+
+TEST_SUITE("Shared memory channel") {
+    using unorthodox::unix::shm_channel;
+
+    std::string message_text(int i)
+    {
+        // lengths that do not line up with the ring
+        return std::string(static_cast<std::size_t>(i % 97), 'a' + i % 26) + std::to_string(i);
+    }
+
+    TEST_CASE("Messages come out in order") {
+        auto channel = shm_channel::create(4096);
+        REQUIRE(channel);
+        REQUIRE(channel.capacity() == 4096);
+
+        unorthodox::buffer received;
+        REQUIRE(channel.try_receive(received).error().code == unorthodox::error_code::would_block);
+
+        // goes round the ring many times
+        for (int i = 0; i < 2000; ++i)
+        {
+            const std::string text = message_text(i);
+            REQUIRE(!channel.try_send(std::as_bytes(std::span(text))));
+
+            auto view = channel.peek();
+            REQUIRE(std::string(reinterpret_cast<const char*>(view.data()), view.size()) == text);
+            channel.pop();
+        }
+
+        REQUIRE(channel.peek().empty());
+    }
+
+    TEST_CASE("Full ring and oversized messages") {
+        auto channel = shm_channel::create(4096);
+
+        const std::vector<std::byte> too_large(channel.max_message_size() + 1);
+        REQUIRE(channel.try_send(too_large).code == unorthodox::error_code::invalid_argument);
+
+        const std::vector<std::byte> message(1000);
+        int sent = 0;
+        while (!channel.try_send(message))
+            ++sent;
+
+        REQUIRE(sent == 4);
+        REQUIRE(channel.try_send(message).code == unorthodox::error_code::would_block);
+        REQUIRE(channel.send(message, 10).code == unorthodox::error_code::would_block);
+
+        unorthodox::buffer received;
+        REQUIRE(channel.try_receive(received).value_or(0) == 1000);
+        REQUIRE(!channel.try_send(message));
+    }
+
+    TEST_CASE("Between processes") {
+        auto channel = shm_channel::create(4096);
+        REQUIRE(channel);
+
+        constexpr int count = 20000;
+
+        pid_t child = fork();
+        if (child == 0)
+        {
+            auto producer = shm_channel::attach(dup(channel.native_handle()));
+            for (int i = 0; i < count; ++i)
+            {
+                const std::string text = message_text(i);
+                if (producer.send(std::as_bytes(std::span(text)), 5000))
+                    _exit(1);
+            }
+            _exit(0);
+        }
+
+        bool in_order = true;
+        for (int i = 0; i < count && in_order; ++i)
+        {
+            unorthodox::buffer received;
+            REQUIRE(channel.receive(received, 5000));
+            in_order = to_string(received) == message_text(i);
+        }
+        REQUIRE(in_order);
+
+        int child_status = -1;
+        waitpid(child, &child_status, 0);
+        REQUIRE(WEXITSTATUS(child_status) == 0);
+    }
+
+    TEST_CASE("Children inherit the channel") {
+        auto channel = shm_channel::create();
+        const std::string fd = std::to_string(channel.native_handle());
+        const std::string check = "test -e /proc/self/fd/" + fd;
+
+        unorthodox::unix::process inherited(unorthodox::unix::command("sh", "-c", check.c_str()).inherit(channel.native_handle()));
+        REQUIRE(inherited.wait().value_or(-1) == 0);
+
+        unorthodox::unix::process not_inherited(unorthodox::unix::command("sh", "-c", check.c_str()));
+        REQUIRE(not_inherited.wait().value_or(-1) == 1);
+    }
+}
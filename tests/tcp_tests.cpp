@@ -1,8 +1,15 @@
 #include "doctest.h"
 
 #include <unorthodox/network/sockets.hpp>
+#include <unorthodox/network/reactor.hpp>
+#include <unorthodox/network/acceptor_group.hpp>
+#include <unorthodox/network/coroutines.hpp>
+#include <unorthodox/network/socket_engine.hpp>
+#include <unorthodox/network/connector.hpp>
 #include <thread>
 #include <iostream>
+#include <poll.h>
+#include <fcntl.h>
 
 using namespace std::chrono_literals;
 
@@ -41,3 +48,1262 @@ TEST_CASE("TCP") {
     server_thread.join();
     */
 }
+
+TEST_CASE("Send file") {
+    const std::string path = std::string("/tmp/unorthodox_sendfile_") + std::to_string(getpid());
+
+    std::string contents;
+    for (int i = 0; contents.size() < 200000; ++i)
+        contents += std::to_string(i) + "\n";
+
+    {
+        auto out = unorthodox::file::create(path.c_str(), unorthodox::file::WRITE | unorthodox::file::TRUNCATE);
+        out.write(std::span<const std::byte>(reinterpret_cast<const std::byte*>(contents.data()), contents.size()), 0);
+    }
+
+    int pair[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+    // reading end is drained on another thread so the sender never stalls
+    std::string received;
+    std::thread reader([&]{
+        char chunk[4096];
+        ssize_t n;
+        while ((n = read(pair[1], chunk, sizeof(chunk))) > 0)
+            received.append(chunk, n);
+    });
+
+    {
+        unorthodox::net::tcp_socket sender(pair[0], AF_INET);
+        auto source = unorthodox::file::open(path.c_str(), unorthodox::file::READ);
+
+        SUBCASE("Whole file") {
+            REQUIRE(sender.send(source).value_or(0) == contents.size());
+        }
+        SUBCASE("Range") {
+            REQUIRE(sender.send_file(source, 100, 5000).value_or(0) == 5000);
+            contents = contents.substr(100, 5000);
+        }
+    }
+
+    reader.join();
+    close(pair[1]);
+    unlink(path.c_str());
+
+    REQUIRE(received == contents);
+}
+
+TEST_CASE("Send file to a peer that went away") {
+    const std::string path = std::string("/tmp/unorthodox_sendfile_closed_") + std::to_string(getpid());
+    {
+        auto out = unorthodox::file::create(path.c_str(), unorthodox::file::WRITE | unorthodox::file::TRUNCATE);
+        out.write(std::span<const std::byte>(reinterpret_cast<const std::byte*>("contents"), 8), 0);
+    }
+
+    int pair[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+    close(pair[1]);
+
+    {
+        // SIGPIPE would end the test run right here
+        unorthodox::net::tcp_socket sender(pair[0], AF_INET);
+        auto source = unorthodox::file::open(path.c_str(), unorthodox::file::READ);
+
+        auto sent = sender.send(source);
+        REQUIRE(!sent);
+        REQUIRE(sent.error().code == unorthodox::error_code::failed_to_send_data);
+    }
+
+    sigset_t pending;
+    sigpending(&pending);
+    REQUIRE(!sigismember(&pending, SIGPIPE));
+
+    unlink(path.c_str());
+}
+
+TEST_SUITE("Reactor") {
+    using unorthodox::net::reactor;
+    using unorthodox::net::reactor_handler;
+
+    struct counting_handler
+    {
+        void on_event(int fd, uint32_t events) noexcept
+        {
+            last_fd = fd;
+            last_events = events;
+            ++calls;
+        }
+
+        int         last_fd     = -1;
+        uint32_t    last_events = 0;
+        int         calls       = 0;
+    };
+
+    TEST_CASE("Edge-triggered readiness") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+        reactor loop(16);
+        REQUIRE(loop);
+
+        counting_handler handler;
+        REQUIRE(!loop.add(pair[0], reactor::readable, reactor_handler::member<&counting_handler::on_event>(&handler)));
+        REQUIRE(loop.size() == 1);
+
+        // nothing to read yet
+        REQUIRE(loop.run_once(0ms).value_or(99) == 0);
+
+        REQUIRE(write(pair[1], "ping", 4) == 4);
+        REQUIRE(loop.run_once(1s).value_or(0) == 1);
+        REQUIRE(handler.calls == 1);
+        REQUIRE(handler.last_fd == pair[0]);
+        REQUIRE((handler.last_events & EPOLLIN));
+
+        // not drained, but edge-triggered only reports new data
+        REQUIRE(loop.run_once(0ms).value_or(99) == 0);
+
+        REQUIRE(write(pair[1], "pong", 4) == 4);
+        REQUIRE(loop.run_once(1s).value_or(0) == 1);
+        REQUIRE(handler.calls == 2);
+
+        // registered sockets do not block
+        char drained[16];
+        REQUIRE(read(pair[0], drained, sizeof(drained)) == 8);
+        REQUIRE(read(pair[0], drained, sizeof(drained)) == -1);
+        REQUIRE(errno == EAGAIN);
+
+        // the peer going away is reported as well
+        ::close(pair[1]);
+        REQUIRE(loop.run_once(1s).value_or(0) == 1);
+        REQUIRE((handler.last_events & reactor::closed));
+
+        REQUIRE(!loop.remove(pair[0]));
+        REQUIRE(loop.size() == 0);
+        ::close(pair[0]);
+    }
+
+    TEST_CASE("Handlers can remove sockets during dispatch") {
+        int first[2], second[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, first) == 0);
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, second) == 0);
+
+        struct removing_handler
+        {
+            void on_event(int fd, uint32_t) noexcept
+            {
+                // whichever comes first takes both out
+                loop->remove(fd);
+                loop->remove(fd == fds[0] ? fds[1] : fds[0]);
+                ++calls;
+            }
+
+            reactor*    loop;
+            int         fds[2];
+            int         calls = 0;
+        };
+
+        reactor loop;
+        removing_handler handler{ &loop, { first[0], second[0] } };
+        auto callback = reactor_handler::member<&removing_handler::on_event>(&handler);
+
+        REQUIRE(!loop.add(first[0], reactor::readable, callback));
+        REQUIRE(!loop.add(second[0], reactor::readable, callback));
+
+        REQUIRE(write(first[1], "a", 1) == 1);
+        REQUIRE(write(second[1], "b", 1) == 1);
+
+        REQUIRE(loop.run_once(1s).value_or(0) == 1);
+        REQUIRE(handler.calls == 1);
+        REQUIRE(loop.size() == 0);
+
+        for (int fd : { first[0], first[1], second[0], second[1] })
+            ::close(fd);
+    }
+
+    TEST_CASE("Sockets closed without remove") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+        reactor loop;
+        counting_handler handler;
+        auto callback = reactor_handler::member<&counting_handler::on_event>(&handler);
+
+        REQUIRE(!loop.add(pair[0], reactor::readable, callback));
+        const int reused = pair[0];
+        ::close(pair[0]);
+
+        // epoll forgot it already, the count stays
+        REQUIRE(loop.remove(reused));
+        REQUIRE(loop.size() == 1);
+
+        // the same number again takes the old slot instead of counting twice
+        int again[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, again) == 0);
+        REQUIRE(again[0] == reused);
+
+        REQUIRE(!loop.add(again[0], reactor::readable, callback));
+        REQUIRE(loop.size() == 1);
+
+        REQUIRE(!loop.remove(again[0]));
+        REQUIRE(loop.size() == 0);
+
+        for (int fd : { pair[1], again[0], again[1] })
+            ::close(fd);
+    }
+
+    TEST_CASE("Listening sockets") {
+        unorthodox::net::tcp_socket server;
+        REQUIRE(!server.listen(16027));
+
+        reactor loop;
+        counting_handler handler;
+        REQUIRE(!loop.add(server, reactor::readable, reactor_handler::member<&counting_handler::on_event>(&handler)));
+
+        unorthodox::net::tcp_socket client;
+        REQUIRE(!client.connect("127.0.0.1", 16027));
+
+        REQUIRE(loop.run_once(1s).value_or(0) == 1);
+        REQUIRE(handler.last_fd == server.native_handle());
+
+        REQUIRE(!loop.remove(server));
+    }
+
+    TEST_CASE("Idle timeouts") {
+        using unorthodox::timer;
+        using unorthodox::timer_handler;
+
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+        // every read pushes the timeout back, going quiet closes it
+        struct idle_connection
+        {
+            void on_event(int, uint32_t) noexcept
+            {
+                char drained[16];
+                while (read(fd, drained, sizeof(drained)) > 0)
+                    ;
+
+                loop->timers().schedule(idle, 100ms, timer_handler::member<&idle_connection::on_idle>(this));
+            }
+
+            void on_idle(timer&) noexcept
+            {
+                loop->remove(fd);
+                ::close(fd);
+                fd = -1;
+            }
+
+            reactor*    loop;
+            int         fd;
+            timer       idle;
+        };
+
+        reactor loop;
+        idle_connection connection{ &loop, pair[0], {} };
+
+        REQUIRE(!loop.add(pair[0], reactor::readable, reactor_handler::member<&idle_connection::on_event>(&connection)));
+        loop.timers().schedule(connection.idle, 100ms, timer_handler::member<&idle_connection::on_idle>(&connection));
+
+        for (int i = 0; i < 3; ++i)
+        {
+            std::this_thread::sleep_for(50ms);
+            REQUIRE(write(pair[1], "ping", 4) == 4);
+            REQUIRE(loop.run_once(0ms).value_or(0) == 1);
+            REQUIRE(connection.fd == pair[0]);
+        }
+
+        // the wait ends with the timer instead of blocking for ever
+        const auto started = std::chrono::steady_clock::now();
+        while (connection.fd != -1)
+            REQUIRE(loop.run_once().has_value());
+
+        REQUIRE(std::chrono::steady_clock::now() - started < 1s);
+        REQUIRE(loop.size() == 0);
+        REQUIRE(loop.timers().empty());
+
+        ::close(pair[1]);
+    }
+}
+
+TEST_SUITE("Acceptor group") {
+    TEST_CASE("Listeners can share a port") {
+        unorthodox::net::listen_options options;
+        options.reuse_port = true;
+
+        unorthodox::net::tcp_socket first, second, third;
+        REQUIRE(!first.listen(16033, options));
+        REQUIRE(!second.listen(16033, options));
+
+        // without SO_REUSEPORT the port is taken
+        REQUIRE(third.listen(16033));
+    }
+
+    TEST_CASE("Connections are spread over the workers") {
+        constexpr int connections = 64;
+
+        std::atomic<int> accepted = 0;
+        std::array<std::atomic<int>, 2> per_worker{};
+
+        unorthodox::net::acceptor_group_options options;
+        options.threads = 2;
+        options.pin_threads = false;
+
+        SUBCASE("Kernel hash") {}
+        SUBCASE("Incoming CPU") { options.steering = unorthodox::net::connection_steering::incoming_cpu; }
+        SUBCASE("CBPF") { options.steering = unorthodox::net::connection_steering::cbpf; }
+
+        unorthodox::net::acceptor_group<> group([&](std::size_t worker, unorthodox::net::reactor&, unorthodox::net::tcp_socket&&) {
+            ++per_worker[worker];
+            ++accepted;
+        }, options);
+
+        REQUIRE(!group.start(16034));
+        REQUIRE(group.size() == 2);
+
+        std::vector<unorthodox::net::tcp_socket> clients(connections);
+        for (auto& client : clients)
+            REQUIRE(!client.connect("127.0.0.1", 16034));
+
+        for (int i = 0; i < 200 && accepted < connections; ++i)
+            std::this_thread::sleep_for(10ms);
+
+        group.stop();
+
+        REQUIRE(accepted == connections);
+        REQUIRE(per_worker[0] + per_worker[1] == connections);
+    }
+}
+
+TEST_SUITE("Receiving into caller memory") {
+    struct socket_pair
+    {
+        socket_pair()
+        {
+            REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+            receiver = unorthodox::net::tcp_socket(fds[0], AF_INET);
+        }
+
+        void send(const std::string& text) { REQUIRE(write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size())); }
+
+        int fds[2];
+        unorthodox::net::tcp_socket receiver;
+    };
+
+    TEST_CASE("Span") {
+        socket_pair pair;
+        std::array<std::byte, 8> target;
+
+        REQUIRE(pair.receiver.recv_into(target).error().code == unorthodox::error_code::would_block);
+
+        pair.send("0123456789");
+        REQUIRE(pair.receiver.recv_into(target).value_or(0) == 8);
+        REQUIRE(pair.receiver.recv_into(target).value_or(0) == 2);
+        REQUIRE(std::memcmp(target.data(), "89", 2) == 0);
+
+        ::close(pair.fds[1]);
+        REQUIRE(pair.receiver.recv_into(target).value_or(99) == 0);
+    }
+
+    TEST_CASE("Buffer") {
+        socket_pair pair;
+        pair.receiver.recv_size = 4;
+
+        unorthodox::buffer target;
+        target.append(reinterpret_cast<const std::byte*>(">"), 1);
+
+        pair.send("0123456789");
+
+        SUBCASE("Once") {
+            REQUIRE(pair.receiver.recv_into(target).value_or(0) == 4);
+            REQUIRE(target.read_string(target.size()) == ">0123");
+        }
+        SUBCASE("Drain") {
+            REQUIRE(pair.receiver.recv_into(target, unorthodox::net::recv_mode::drain).value_or(0) == 10);
+            REQUIRE(target.read_string(target.size()) == ">0123456789");
+
+            REQUIRE(pair.receiver.recv_into(target, unorthodox::net::recv_mode::drain).error().code == unorthodox::error_code::would_block);
+        }
+
+        ::close(pair.fds[1]);
+    }
+
+    TEST_CASE("Scatter") {
+        socket_pair pair;
+        char header[4];
+        char body[16];
+
+        const std::array<iovec, 2> regions{ iovec{ header, sizeof(header) }, iovec{ body, sizeof(body) } };
+
+        pair.send("HEADbody");
+        REQUIRE(pair.receiver.recv_into(regions).value_or(0) == 8);
+        REQUIRE(std::string(header, 4) == "HEAD");
+        REQUIRE(std::string(body, 4) == "body");
+
+        ::close(pair.fds[1]);
+    }
+
+    TEST_CASE("Whole messages with recv") {
+        socket_pair pair;
+        pair.receiver.recv_size = 3;
+
+        // a short read is not the end anymore, everything queued comes back
+        pair.send("0123456789");
+        REQUIRE(pair.receiver.recv<std::string>().value_or("") == "0123456789");
+
+        // any container of bytes
+        pair.send("abcdefg");
+        auto bytes = pair.receiver.recv<std::vector<std::byte>>();
+        REQUIRE(bytes);
+        REQUIRE(bytes->size() == 7);
+        REQUIRE(std::string(reinterpret_cast<const char*>(bytes->data()), bytes->size()) == "abcdefg");
+
+        ::close(pair.fds[1]);
+    }
+}
+
+TEST_SUITE("Sending") {
+    std::string drain(int fd)
+    {
+        std::string received;
+        char chunk[4096];
+        ssize_t n;
+        while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+            received.append(chunk, n);
+
+        return received;
+    }
+
+    TEST_CASE("Gather") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+        std::string expected;
+        std::vector<std::string> parts;
+        for (int i = 0; i < 200; ++i)
+            parts.push_back(std::string(i * 37 % 1000, static_cast<char>('a' + i % 26)));
+
+        std::vector<iovec> regions;
+        for (auto& part : parts)
+        {
+            regions.push_back(iovec{ part.data(), part.size() });
+            expected += part;
+        }
+
+        std::string received;
+        std::thread reader([&]{ received = drain(pair[1]); });
+
+        {
+            unorthodox::net::tcp_socket sender(pair[0], AF_INET);
+            REQUIRE(sender.send(regions).value_or(0) == expected.size());
+
+            const std::array<char, 3> letters{ 'x', 'y', 'z' };
+            REQUIRE(sender.send(letters).value_or(0) == 3);
+            expected += "xyz";
+        }
+
+        reader.join();
+        close(pair[1]);
+
+        REQUIRE(received == expected);
+    }
+
+    TEST_CASE("Non-blocking sockets return what went out") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) == 0);
+
+        unorthodox::net::tcp_socket sender(pair[0], AF_INET);
+        const std::string big(8 * 1024 * 1024, 'x');
+
+        auto sent = sender.send(big);
+        REQUIRE(sent);
+        REQUIRE(*sent > 0);
+        REQUIRE(*sent < big.size());
+
+        REQUIRE(sender.send(big).error().code == unorthodox::error_code::would_block);
+
+        close(pair[1]);
+    }
+
+    TEST_CASE("A closed peer is an error, not SIGPIPE") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+        close(pair[1]);
+
+        unorthodox::net::tcp_socket sender(pair[0], AF_INET);
+        REQUIRE(sender.send(std::string("hello")).error().code == unorthodox::error_code::failed_to_send_data);
+    }
+
+    TEST_CASE("Queued writes") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+        const int small_buffer = 16 * 1024;
+        setsockopt(pair[0], SOL_SOCKET, SO_SNDBUF, &small_buffer, sizeof(small_buffer));
+
+        struct producer
+        {
+            void on_watermark(bool above) noexcept
+            {
+                blocked = above;
+                ++crossings;
+            }
+
+            bool    blocked     = false;
+            int     crossings   = 0;
+        };
+
+        producer watcher;
+
+        // a blocking socket, queued writes still never wait
+        unorthodox::net::tcp_socket sender(pair[0], AF_INET);
+        sender.set_watermarks(64 * 1024, 256 * 1024, unorthodox::net::watermark_handler::member<&producer::on_watermark>(&watcher));
+
+        std::string expected;
+        for (int i = 0; !watcher.blocked; ++i)
+        {
+            const std::string chunk(10000, static_cast<char>('a' + i % 26));
+            expected += chunk;
+
+            REQUIRE(sender.send_queued(std::as_bytes(std::span(chunk.data(), chunk.size()))));
+            REQUIRE(i < 1000);
+        }
+
+        REQUIRE(watcher.crossings == 1);
+        REQUIRE(sender.above_watermark());
+        REQUIRE(sender.queued() >= 256 * 1024);
+
+        // nothing drained yet, the socket is still full
+        REQUIRE(sender.flush().value_or(99) == 0);
+
+        std::string received;
+        char chunk[4096];
+        while (received.size() < expected.size())
+        {
+            const ssize_t n = read(pair[1], chunk, sizeof(chunk));
+            REQUIRE(n > 0);
+            received.append(chunk, n);
+
+            REQUIRE(sender.flush());
+        }
+
+        REQUIRE(received == expected);
+        REQUIRE(sender.queued() == 0);
+        REQUIRE(watcher.crossings == 2);
+        REQUIRE(!watcher.blocked);
+
+        close(pair[1]);
+        REQUIRE(sender.send_queued(std::as_bytes(std::span("x", 1))).error().code == unorthodox::error_code::failed_to_send_data);
+    }
+
+    struct tcp_pair
+    {
+        tcp_pair()
+        {
+            REQUIRE(!server.listen(16039));
+            REQUIRE(!client.connect("127.0.0.1", 16039));
+            REQUIRE(!server.accept(connection, 2s));
+        }
+
+        unorthodox::net::tcp_socket server;
+        unorthodox::net::tcp_socket client;
+        unorthodox::net::tcp_socket connection;
+    };
+
+    TEST_CASE("Zero copy") {
+        tcp_pair pair;
+        REQUIRE(!pair.client.enable_zerocopy());
+        pair.client.zerocopy_threshold = 4096;
+
+        const std::string small(100, 's');
+        const std::string big(64 * 1024, 'b');
+
+        REQUIRE(pair.client.send(small).value_or(0) == small.size());
+        REQUIRE(pair.client.zerocopy_sequence() == 0);
+
+        REQUIRE(pair.client.send(big).value_or(0) == big.size());
+        REQUIRE(pair.client.zerocopy_sequence() > 0);
+
+        std::string received;
+        const int fd = pair.connection.native_handle();
+        while (received.size() < small.size() + big.size())
+        {
+            char chunk[4096];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            REQUIRE(n > 0);
+            received.append(chunk, n);
+        }
+        REQUIRE(received == small + big);
+
+        // the completions arrive once the data is acknowledged
+        for (int i = 0; i < 100 && pair.client.zerocopy_completed() < pair.client.zerocopy_sequence(); ++i)
+        {
+            REQUIRE(pair.client.reap_zerocopy());
+            std::this_thread::sleep_for(1ms);
+        }
+
+        REQUIRE(pair.client.zerocopy_completed() == pair.client.zerocopy_sequence());
+
+        // loopback never sends from user memory
+        REQUIRE(pair.client.zerocopy_copied());
+    }
+
+    TEST_CASE("Cork") {
+        tcp_pair pair;
+        const int fd = pair.connection.native_handle();
+
+        {
+            auto corked = pair.client.cork();
+
+            REQUIRE(pair.client.send(std::string("one ")).value_or(0) == 4);
+            REQUIRE(pair.client.send(std::string("two")).value_or(0) == 3);
+
+            pollfd waiting{ fd, POLLIN, 0 };
+            REQUIRE(poll(&waiting, 1, 50) == 0);
+        }
+
+        std::string received;
+        while (received.size() < 7)
+        {
+            char chunk[16];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            REQUIRE(n > 0);
+            received.append(chunk, n);
+        }
+        REQUIRE(received == "one two");
+    }
+}
+
+TEST_SUITE("Accepting") {
+    TEST_CASE("Draining the backlog") {
+        unorthodox::net::tcp_socket server;
+        REQUIRE(!server.listen(16041, 64));
+
+        std::vector<unorthodox::net::tcp_socket> clients(10);
+        for (auto& client : clients)
+            REQUIRE(!client.connect("127.0.0.1", 16041));
+
+        std::vector<unorthodox::net::accepted_connection<unorthodox::net::tcp_socket_details>> accepted;
+        accepted.reserve(16);
+
+        for (int tries = 0; tries < 10 && accepted.size() < clients.size(); ++tries)
+            REQUIRE(!server.accept(accepted, 100ms, unorthodox::net::accept_mode::drain));
+
+        REQUIRE(accepted.size() == clients.size());
+
+        for (auto& entry : accepted)
+        {
+            REQUIRE(entry.peer.family() == AF_INET);
+            REQUIRE(entry.peer.to_string().rfind("127.0.0.1:", 0) == 0);
+
+            const int fd = entry.connection.native_handle();
+            REQUIRE((fcntl(fd, F_GETFL) & O_NONBLOCK) != 0);
+            REQUIRE((fcntl(fd, F_GETFD) & FD_CLOEXEC) != 0);
+        }
+
+        // nothing left, the timeout passes without an error
+        REQUIRE(!server.accept(accepted, 10ms, unorthodox::net::accept_mode::drain));
+        REQUIRE(accepted.size() == clients.size());
+    }
+
+    TEST_CASE("One at a time") {
+        unorthodox::net::tcp_socket server;
+        REQUIRE(!server.listen(16042));
+
+        unorthodox::net::tcp_socket first;
+        unorthodox::net::tcp_socket second;
+        REQUIRE(!first.connect("127.0.0.1", 16042));
+        REQUIRE(!second.connect("127.0.0.1", 16042));
+
+        unorthodox::net::accepted_connection<unorthodox::net::tcp_socket_details> accepted;
+        REQUIRE(!server.accept(accepted, 2s));
+        REQUIRE(accepted.peer.port() != 0);
+
+        // blocking like before, unless drained
+        REQUIRE((fcntl(accepted.connection.native_handle(), F_GETFL) & O_NONBLOCK) == 0);
+
+        unorthodox::net::tcp_socket plain;
+        REQUIRE(!server.accept(plain, 2s));
+        REQUIRE(plain.native_handle() >= 0);
+    }
+}
+
+TEST_SUITE("Resolver") {
+    using unorthodox::net::resolver;
+    using unorthodox::net::resolver_options;
+
+    TEST_CASE("Literals are not looked up") {
+        resolver names;
+
+        auto v4 = names.resolve("127.0.0.1", 80);
+        REQUIRE(v4.wait_for(0s) == std::future_status::ready);
+
+        auto addresses = v4.get();
+        REQUIRE(addresses);
+        REQUIRE(addresses->size() == 1);
+        REQUIRE(addresses->front().to_string() == "127.0.0.1:80");
+
+        auto v6 = names.resolve("::1", 443).get();
+        REQUIRE(v6);
+        REQUIRE(v6->front().to_string() == "[::1]:443");
+
+        REQUIRE(names.lookups() == 0);
+        REQUIRE(names.cached() == 0);
+    }
+
+    TEST_CASE("Names are cached") {
+        resolver names;
+
+        // from /etc/hosts, no network needed
+        auto first = names.resolve("localhost", 8080).get();
+        REQUIRE(first);
+        REQUIRE(!first->empty());
+        for (const auto& entry : *first)
+            REQUIRE(entry.port() == 8080);
+
+        auto again = names.resolve("localhost", 9090);
+        REQUIRE(again.wait_for(0s) == std::future_status::ready);
+
+        auto second = again.get();
+        REQUIRE(second);
+        REQUIRE(second->size() == first->size());
+        REQUIRE(second->front().port() == 9090);
+        REQUIRE(second->front().host() == first->front().host());
+
+        REQUIRE(names.lookups() == 1);
+        REQUIRE(names.cached() == 1);
+
+        names.clear();
+        REQUIRE(names.resolve("localhost", 80).get());
+        REQUIRE(names.lookups() == 2);
+    }
+
+    TEST_CASE("Lookups in flight are shared") {
+        resolver names;
+
+        std::vector<std::future<unorthodox::net::resolve_result>> waiting;
+        for (uint16_t port = 1; port <= 16; ++port)
+            waiting.push_back(names.resolve("localhost", port));
+
+        for (uint16_t port = 1; port <= 16; ++port)
+        {
+            auto result = waiting[port - 1].get();
+            REQUIRE(result);
+            REQUIRE(result->front().port() == port);
+        }
+
+        REQUIRE(names.lookups() == 1);
+    }
+
+    TEST_CASE("Entries expire") {
+        resolver_options options;
+        options.ttl = 0s;
+
+        resolver names(options);
+        REQUIRE(names.resolve("localhost", 80).get());
+        REQUIRE(names.resolve("localhost", 80).get());
+        REQUIRE(names.lookups() == 2);
+    }
+
+    TEST_CASE("Unknown names") {
+        resolver names;
+
+        auto missing = names.resolve("does-not-exist.invalid", 80).get();
+        REQUIRE(!missing);
+        REQUIRE(missing.error().code == unorthodox::error_code::host_not_found);
+
+        // remembered as well
+        REQUIRE(!names.resolve("does-not-exist.invalid", 80).get());
+        REQUIRE(names.lookups() == 1);
+
+        REQUIRE(unorthodox::net::helpers::deduce_protocol_from_address("does-not-exist.invalid") == AF_UNSPEC);
+        REQUIRE(unorthodox::net::helpers::deduce_protocol_from_address("::1") == AF_INET6);
+    }
+
+    TEST_CASE("Connecting by name") {
+        unorthodox::net::tcp_socket server;
+        REQUIRE(!server.listen(16049));
+
+        unorthodox::net::tcp_socket client;
+        REQUIRE(!client.connect("localhost", 16049));
+
+        unorthodox::net::tcp_socket connection;
+        REQUIRE(!server.accept(connection, 2s));
+        REQUIRE(connection.native_handle() >= 0);
+    }
+}
+
+TEST_SUITE("Connecting without blocking") {
+    using unorthodox::net::address;
+    using unorthodox::net::connector;
+    using unorthodox::net::connect_options;
+
+    TEST_CASE("By name") {
+        unorthodox::net::tcp_socket server;
+        REQUIRE(!server.listen(16050));
+
+        unorthodox::net::tcp_socket client;
+        auto connected = client.connect_async("localhost", 16050);
+        REQUIRE(connected.wait_for(2s) == std::future_status::ready);
+        REQUIRE(!connected.get());
+
+        unorthodox::net::tcp_socket connection;
+        REQUIRE(!server.accept(connection, 2s));
+
+        REQUIRE(client.send(std::string("hello")).value_or(0) == 5);
+        REQUIRE(connection.recv<std::string>().value_or("") == "hello");
+
+        // a socket that is open already is left alone
+        REQUIRE(client.connect_async("localhost", 16050).get().code == unorthodox::error_code::socket_already_open);
+    }
+
+    TEST_CASE("Failures") {
+        unorthodox::net::tcp_socket refused;
+        REQUIRE(refused.connect_async("127.0.0.1", 16051).get().code == unorthodox::error_code::cannot_open_socket);
+
+        unorthodox::net::tcp_socket unknown;
+        REQUIRE(unknown.connect_async("does-not-exist.invalid", 16051).get().code == unorthodox::error_code::host_not_found);
+
+        auto nothing = connector::global().connect({}, SOCK_STREAM).get();
+        REQUIRE(!nothing);
+        REQUIRE(nothing.error().code == unorthodox::error_code::host_not_found);
+
+        REQUIRE(connector::global().in_flight() == 0);
+    }
+
+    TEST_CASE("The first address to answer wins") {
+        unorthodox::net::tcp_socket server;
+        REQUIRE(!server.listen(16052));
+
+        // nothing listens on the first one, refused right away moves on
+        std::vector<address> candidates = {
+            *address::from_string("127.0.0.1", 16051),
+            *address::from_string("::1", 16051),
+            *address::from_string("127.0.0.1", 16052),
+        };
+
+        connect_options options;
+        options.attempt_delay = 50ms;
+
+        connector racing;
+        REQUIRE(racing);
+
+        auto connected = racing.connect(candidates, SOCK_STREAM, options).get();
+        REQUIRE(connected);
+        REQUIRE(connected->peer.to_string() == "127.0.0.1:16052");
+
+        // handed over blocking, like connect() does
+        REQUIRE(!(fcntl(connected->fd, F_GETFL) & O_NONBLOCK));
+        ::close(connected->fd);
+
+        REQUIRE(racing.in_flight() == 0);
+    }
+
+    TEST_CASE("Attempts that hang are timed out") {
+        // a full backlog leaves the handshake hanging without an answer
+        int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(listener >= 0);
+
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(16053);
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        const int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        REQUIRE(::bind(listener, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0);
+        REQUIRE(::listen(listener, 0) == 0);
+
+        connect_options options;
+        options.attempt_delay = 20ms;
+        options.timeout = 200ms;
+
+        connector racing;
+
+        // fill the backlog, the attempts after that get no answer
+        std::vector<std::future<unorthodox::net::connect_result>> attempts;
+        for (int i = 0; i < 8; ++i)
+            attempts.push_back(racing.connect({ address(reinterpret_cast<sockaddr*>(&local), sizeof(local)) }, SOCK_STREAM, options));
+
+        const auto started = std::chrono::steady_clock::now();
+
+        std::size_t timed_out = 0;
+        for (auto& attempt : attempts)
+        {
+            auto result = attempt.get();
+            if (result)
+                ::close(result->fd);
+            else
+                ++timed_out;
+        }
+
+        REQUIRE(timed_out > 0);
+        REQUIRE(std::chrono::steady_clock::now() - started < 2s);
+        REQUIRE(racing.in_flight() == 0);
+
+        ::close(listener);
+    }
+}
+
+TEST_SUITE("Connection table") {
+    TEST_CASE("Peers are looked up once") {
+        unorthodox::net::connection_table table;
+
+        unorthodox::net::tcp_socket server;
+        REQUIRE(!server.listen(16048));
+
+        unorthodox::net::tcp_socket client;
+        REQUIRE(!client.connect("127.0.0.1", 16048));
+
+        unorthodox::net::accepted_connection<unorthodox::net::tcp_socket_details> accepted;
+        REQUIRE(!server.accept(accepted, 2s));
+
+        const int fd = accepted.connection.native_handle();
+        table.record(fd, accepted.peer);
+        REQUIRE(table.size() == 1);
+
+        std::string host;
+        uint16_t port = 0;
+        REQUIRE(table.visit(fd, [&](const unorthodox::net::connection_info& info) { host = info.host; port = info.peer.port(); }));
+        REQUIRE(host == "127.0.0.1");
+        REQUIRE(port == accepted.peer.port());
+
+        // the client side was never recorded, getpeername fills it in
+        REQUIRE(table.visit(client.native_handle(), [&](const unorthodox::net::connection_info& info) { port = info.peer.port(); }));
+        REQUIRE(port == 16048);
+        REQUIRE(table.size() == 2);
+
+        table.forget(fd);
+        table.forget(client.native_handle());
+        REQUIRE(table.size() == 0);
+
+        // a listener has no peer
+        REQUIRE(!table.visit(server.native_handle(), [](const unorthodox::net::connection_info&) {}));
+    }
+}
+
+TEST_SUITE("Coroutines") {
+    namespace net = unorthodox::net;
+
+    std::span<const std::byte> as_bytes(const std::string& text)
+    {
+        return std::span<const std::byte>(reinterpret_cast<const std::byte*>(text.data()), text.size());
+    }
+
+    net::task<int> add(int a, int b) { co_return a + b; }
+
+    net::task<int> add_twice(int a, int b)
+    {
+        int first = co_await add(a, b);
+        co_return co_await add(first, b);
+    }
+
+    // answers every message with the same bytes until the client goes away
+    net::task<> echo(net::tcp_socket connection)
+    {
+        std::array<std::byte, 256> chunk;
+        while (true)
+        {
+            auto got = co_await connection.async_recv(chunk);
+            if (!got || *got == 0)
+                break;
+
+            auto sent = co_await connection.async_send(std::span<const std::byte>(chunk.data(), *got));
+            if (!sent)
+                break;
+        }
+
+        net::io_scheduler::current()->release(connection.native_handle());
+    }
+
+    template <typename Executor>
+    net::task<> serve(Executor& executor, net::tcp_socket& server, int connections)
+    {
+        for (int i = 0; i < connections; ++i)
+        {
+            auto accepted = co_await server.async_accept();
+            if (!accepted)
+                co_return;
+
+            executor.spawn(echo(std::move(accepted->connection)));
+        }
+    }
+
+    net::task<> ping(uint16_t port, std::string message, int& replies)
+    {
+        net::tcp_socket client;
+        if (co_await client.async_connect(*net::address::from_string("127.0.0.1", port)))
+            co_return;
+
+        // enough to need several sends and receives
+        std::string payload;
+        while (payload.size() < 100000)
+            payload += message;
+
+        auto sent = co_await client.async_send(as_bytes(payload));
+        if (!sent || *sent != payload.size())
+            co_return;
+
+        std::string received;
+        std::array<std::byte, 4096> chunk;
+        while (received.size() < payload.size())
+        {
+            auto got = co_await client.async_recv(chunk);
+            if (!got || *got == 0)
+                co_return;
+            received.append(reinterpret_cast<const char*>(chunk.data()), *got);
+        }
+
+        if (received == payload)
+            ++replies;
+
+        net::io_scheduler::current()->release(client.native_handle());
+    }
+
+    TEST_CASE("Tasks") {
+        net::single_thread_executor executor;
+        int result = 0;
+
+        executor.spawn([](int& out) -> net::task<> { out = co_await add_twice(1, 2); }(result));
+        REQUIRE(!executor.run());
+        REQUIRE(result == 5);
+        REQUIRE(executor.size() == 0);
+    }
+
+    TEST_CASE("Frames are pooled") {
+        void* first = unorthodox::allocators::frame_pool::allocate(200);
+        unorthodox::allocators::frame_pool::deallocate(first, 200);
+
+        // anything in the same 64 byte step gets the block back
+        void* second = unorthodox::allocators::frame_pool::allocate(250);
+        REQUIRE(second == first);
+        unorthodox::allocators::frame_pool::deallocate(second, 250);
+    }
+
+    TEST_CASE("Echo on one thread") {
+        net::tcp_socket server;
+        REQUIRE(!server.listen(16043));
+
+        net::single_thread_executor executor;
+        REQUIRE(executor);
+
+        int replies = 0;
+        executor.spawn(serve(executor, server, 3));
+        for (int i = 0; i < 3; ++i)
+            executor.spawn(ping(16043, "hello " + std::to_string(i), replies));
+
+        REQUIRE(!executor.run());
+        REQUIRE(replies == 3);
+    }
+
+    TEST_CASE("Echo with work stealing") {
+        net::tcp_socket server;
+        REQUIRE(!server.listen(16044, 128));
+
+        std::atomic<int> replies = 0;
+        {
+            net::work_stealing_executor executor(4);
+            REQUIRE(executor);
+            REQUIRE(executor.size() == 4);
+
+            constexpr int clients = 40;
+            std::vector<int> counts(clients, 0);
+
+            executor.spawn(serve(executor, server, clients));
+            for (int i = 0; i < clients; ++i)
+                executor.spawn(ping(16044, "client " + std::to_string(i), counts[i]));
+
+            executor.wait();
+
+            for (int count : counts)
+                replies += count;
+        }
+
+        REQUIRE(replies == 40);
+    }
+
+    TEST_CASE("Connection refused") {
+        net::single_thread_executor executor;
+        unorthodox::error_code result;
+
+        executor.spawn([](unorthodox::error_code& out) -> net::task<> {
+            net::tcp_socket client;
+            out = co_await client.async_connect(*net::address::from_string("127.0.0.1", 16045));
+        }(result));
+
+        REQUIRE(!executor.run());
+        REQUIRE(result.code == unorthodox::error_code::cannot_open_socket);
+    }
+
+    TEST_CASE("Closing a socket lets go of what waits on it") {
+        int pair[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) == 0);
+
+        net::unix_socket reading(pair[0], AF_UNIX);
+        net::unix_socket writing(pair[1], AF_UNIX);
+
+        net::single_thread_executor executor;
+        unorthodox::error_code result;
+
+        executor.spawn([](net::unix_socket& from, unorthodox::error_code& out) -> net::task<> {
+            std::array<std::byte, 16> chunk;
+            auto got = co_await from.async_recv(chunk);
+            out = got ? unorthodox::error_code(unorthodox::error_code::success) : got.error();
+        }(reading, result));
+
+        // parked on recv by now, its fd number is free once this returns
+        executor.spawn([](net::unix_socket& target) -> net::task<> {
+            target.close();
+            co_return;
+        }(reading));
+
+        REQUIRE(!executor.run());
+        REQUIRE(result.code == unorthodox::error_code::connection_reset);
+    }
+
+    TEST_CASE("Timers fire on a shared scheduler") {
+        struct flag
+        {
+            std::atomic<bool> set = false;
+            void on_timer(unorthodox::timer&) noexcept { set = true; }
+        } fired;
+
+        unorthodox::timer timeout;
+
+        net::work_stealing_executor executor(2);
+        REQUIRE(executor);
+
+        // every worker is idle, one of them polls with nothing but the timer to wait for
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        executor.scheduler().schedule(timeout, std::chrono::milliseconds(20), unorthodox::timer_handler::member<&flag::on_timer>(&fired));
+
+        for (int i = 0; i < 200 && !fired.set; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        REQUIRE(fired.set);
+    }
+}
+
+TEST_SUITE("Socket engine") {
+    namespace net = unorthodox::net;
+
+    TEST_CASE("Echo") {
+        net::socket_engine_options options;
+
+        SUBCASE("Default backend") {}
+        SUBCASE("Epoll") { options.use_io_uring = false; }
+        SUBCASE("Few small buffers") { options.recv_buffers = 2; options.recv_buffer_size = 64; }
+
+        net::socket_engine engine(options);
+        REQUIRE(engine);
+        if (!options.use_io_uring)
+            REQUIRE(engine.backend() == net::socket_engine::backend_type::epoll);
+
+        net::tcp_socket server;
+        REQUIRE(!server.listen(16046));
+
+        enum : uint64_t { listener_tag, server_tag, client_tag };
+        REQUIRE(!engine.accept(server, listener_tag));
+        REQUIRE(!engine.connect(*net::address::from_string("127.0.0.1", 16046), client_tag));
+
+        std::string payload;
+        while (payload.size() < 100000)
+            payload += "engine " + std::to_string(payload.size());
+
+        // what the server sends back has to outlive the send
+        std::deque<std::string> echoed;
+        std::string received;
+
+        int client = -1;
+        int connection = -1;
+        std::size_t sent = 0;
+
+        std::array<net::socket_completion, 64> completions;
+        for (int rounds = 0; rounds < 10000 && received.size() < payload.size(); ++rounds)
+        {
+            const std::size_t count = engine.reap(completions, 1);
+            REQUIRE(count > 0);
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const net::socket_completion& done = completions[i];
+                REQUIRE(!done.error);
+
+                if (done.operation == net::socket_operation::accept)
+                {
+                    REQUIRE(done.more);
+                    REQUIRE((fcntl(done.fd, F_GETFL) & O_NONBLOCK) != 0);
+                    connection = done.fd;
+                    REQUIRE(!engine.recv(connection, server_tag));
+                }
+                else if (done.operation == net::socket_operation::connect)
+                {
+                    REQUIRE(done.user_data == client_tag);
+                    client = done.fd;
+                    REQUIRE(!engine.recv(client, client_tag));
+                    REQUIRE(!engine.send(client, std::as_bytes(std::span(payload)), client_tag));
+                }
+                else if (done.operation == net::socket_operation::recv && done.user_data == server_tag)
+                {
+                    REQUIRE(done.more);
+                    echoed.emplace_back(reinterpret_cast<const char*>(done.data.data()), done.data.size());
+                    REQUIRE(!engine.send(connection, std::as_bytes(std::span(echoed.back())), server_tag));
+                }
+                else if (done.operation == net::socket_operation::recv)
+                    received.append(reinterpret_cast<const char*>(done.data.data()), done.data.size());
+                else if (done.user_data == client_tag)
+                    sent += done.bytes;
+            }
+        }
+
+        REQUIRE(sent == payload.size());
+        REQUIRE(received == payload);
+
+        // every operation ends once more, without an error
+        for (int fd : { client, connection })
+            REQUIRE(!engine.cancel(fd));
+        for (int fd : server.native_handles())
+        {
+            if (fd >= 0)
+                REQUIRE(!engine.cancel(fd));
+        }
+
+        for (int rounds = 0; rounds < 100 && engine.in_flight() > 0; ++rounds)
+        {
+            const std::size_t count = engine.reap(completions, 1);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                REQUIRE(!completions[i].error);
+                REQUIRE((completions[i].more || completions[i].operation != net::socket_operation::accept || completions[i].fd >= 0));
+            }
+        }
+
+        REQUIRE(engine.in_flight() == 0);
+
+        ::close(client);
+        ::close(connection);
+    }
+
+    TEST_CASE("Connection refused") {
+        net::socket_engine_options options;
+
+        SUBCASE("Default backend") {}
+        SUBCASE("Epoll") { options.use_io_uring = false; }
+
+        net::socket_engine engine(options);
+        REQUIRE(engine);
+
+        REQUIRE(!engine.connect(*net::address::from_string("127.0.0.1", 16047), 7));
+
+        std::array<net::socket_completion, 4> completions;
+        std::size_t count = 0;
+        for (int rounds = 0; rounds < 100 && count == 0; ++rounds)
+            count = engine.reap(completions, 1);
+
+        REQUIRE(count == 1);
+        REQUIRE(completions[0].user_data == 7);
+        REQUIRE(completions[0].error.code == unorthodox::error_code::cannot_open_socket);
+        REQUIRE(completions[0].fd == unorthodox::net::os::invalid_socket);
+        REQUIRE(engine.in_flight() == 0);
+    }
+}
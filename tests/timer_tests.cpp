@@ -0,0 +1,186 @@
+#include "doctest.h"
+
+#include <unorthodox/timer_wheel.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_SUITE("Timer wheel") {
+    using unorthodox::timer;
+    using unorthodox::timer_wheel;
+    using unorthodox::timer_handler;
+
+    // counts what fired and when, in wheel ticks
+    struct tracked
+    {
+        timer       entry;
+        uint64_t    fired_at    = 0;
+        int         fired       = 0;
+
+        timer_wheel*    wheel   = nullptr;
+        uint64_t*       now     = nullptr;
+
+        void on_fire(timer&) noexcept
+        {
+            fired_at = *now;
+            ++fired;
+        }
+    };
+
+    static const timer_wheel::clock::time_point start = timer_wheel::clock::now();
+
+    TEST_CASE("Fires once it is due, not before") {
+        timer_wheel wheel(start);
+        uint64_t now = 0;
+
+        tracked t;
+        t.now = &now;
+
+        wheel.schedule(t.entry, 10ms, timer_handler::member<&tracked::on_fire>(&t), start);
+        REQUIRE(t.entry.scheduled());
+        REQUIRE(wheel.size() == 1);
+        REQUIRE(wheel.next_timeout(start) == 10ms);
+
+        now = 9;
+        REQUIRE(wheel.advance(start + 9ms) == 0);
+        REQUIRE(wheel.next_timeout(start + 9ms) == 1ms);
+
+        now = 10;
+        REQUIRE(wheel.advance(start + 10ms) == 1);
+        REQUIRE(t.fired == 1);
+        REQUIRE(!t.entry.scheduled());
+        REQUIRE(wheel.empty());
+        REQUIRE(wheel.next_timeout(start + 10ms) == -1ms);
+    }
+
+    TEST_CASE("Cancel and re-arm") {
+        timer_wheel wheel(start);
+        uint64_t now = 0;
+
+        tracked a, b;
+        a.now = b.now = &now;
+
+        wheel.schedule(a.entry, 5ms, timer_handler::member<&tracked::on_fire>(&a), start);
+        wheel.schedule(b.entry, 5ms, timer_handler::member<&tracked::on_fire>(&b), start);
+        wheel.cancel(a.entry);
+
+        // an idle timeout pushed back on every read
+        for (int i = 1; i <= 10; ++i)
+        {
+            now = static_cast<uint64_t>(i) * 4;
+            wheel.schedule(b.entry, 5ms, timer_handler::member<&tracked::on_fire>(&b), start + std::chrono::milliseconds(now));
+            REQUIRE(wheel.advance(start + std::chrono::milliseconds(now)) == 0);
+        }
+
+        now = 45;
+        REQUIRE(wheel.advance(start + 45ms) == 1);
+        REQUIRE(a.fired == 0);
+        REQUIRE(b.fired == 1);
+
+        {
+            tracked gone;
+            gone.now = &now;
+            wheel.schedule(gone.entry, 1ms, timer_handler::member<&tracked::on_fire>(&gone), start + 45ms);
+            REQUIRE(wheel.size() == 1);
+        }
+
+        // destroying a timer takes it out
+        REQUIRE(wheel.empty());
+    }
+
+    TEST_CASE("Far timers move down the levels") {
+        timer_wheel wheel(start);
+        uint64_t now = 0;
+
+        // one per level, and one past what the wheel spans
+        const std::vector<std::chrono::milliseconds> delays = { 200ms, 70000ms, 20000000ms, 4000000000ms, 6000000000ms };
+
+        std::vector<tracked> timers(delays.size());
+        for (std::size_t i = 0; i < delays.size(); ++i)
+        {
+            timers[i].now = &now;
+            wheel.schedule(timers[i].entry, delays[i], timer_handler::member<&tracked::on_fire>(&timers[i]), start);
+        }
+
+        for (std::size_t i = 0; i < delays.size(); ++i)
+        {
+            const uint64_t due = static_cast<uint64_t>(delays[i].count());
+
+            // the wheel may wake up early to move timers down, never late
+            REQUIRE(wheel.next_timeout(start + std::chrono::milliseconds(now)).count() <= static_cast<int64_t>(due - now));
+
+            now = due - 1;
+            wheel.advance(start + std::chrono::milliseconds(now));
+            REQUIRE(timers[i].fired == 0);
+
+            now = due;
+            REQUIRE(wheel.advance(start + std::chrono::milliseconds(now)) == 1);
+            REQUIRE(timers[i].fired == 1);
+            REQUIRE(timers[i].fired_at == due);
+        }
+    }
+
+    TEST_CASE("Matches a sorted reference") {
+        timer_wheel wheel(start);
+        uint64_t now = 0;
+
+        std::mt19937_64 random(42);
+        std::vector<tracked> timers(5000);
+        std::vector<uint64_t> deadlines(timers.size());
+
+        for (std::size_t i = 0; i < timers.size(); ++i)
+        {
+            deadlines[i] = random() % 400000;
+            timers[i].now = &now;
+            wheel.schedule(timers[i].entry, std::chrono::milliseconds(deadlines[i]), timer_handler::member<&tracked::on_fire>(&timers[i]), start);
+        }
+
+        while (!wheel.empty())
+        {
+            const uint64_t previous = now;
+            now += random() % 3000;
+            wheel.advance(start + std::chrono::milliseconds(now));
+
+            for (std::size_t i = 0; i < timers.size(); ++i)
+            {
+                const bool due = deadlines[i] <= now;
+                REQUIRE(timers[i].fired == (due ? 1 : 0));
+                if (due && deadlines[i] > previous)
+                    REQUIRE(timers[i].fired_at == now);
+            }
+        }
+    }
+
+    TEST_CASE("Handlers can re-arm themselves") {
+        timer_wheel wheel(start);
+
+        struct periodic
+        {
+            timer           entry;
+            timer_wheel*    wheel   = nullptr;
+            uint64_t*       now     = nullptr;
+            int             ticks   = 0;
+
+            void on_fire(timer&) noexcept
+            {
+                ++ticks;
+                wheel->schedule(entry, 100ms, timer_handler::member<&periodic::on_fire>(this), start + std::chrono::milliseconds(*now));
+            }
+        };
+
+        uint64_t now = 0;
+        periodic p;
+        p.wheel = &wheel;
+        p.now = &now;
+
+        wheel.schedule(p.entry, 100ms, timer_handler::member<&periodic::on_fire>(&p), start);
+
+        for (now = 0; now <= 1000; now += 10)
+            wheel.advance(start + std::chrono::milliseconds(now));
+
+        REQUIRE(p.ticks == 10);
+        REQUIRE(wheel.size() == 1);
+    }
+}
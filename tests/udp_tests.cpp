@@ -0,0 +1,158 @@
+#include "doctest.h"
+
+#include <unorthodox/network/sockets.hpp>
+
+#include <fcntl.h>
+#include <string>
+#include <vector>
+
+TEST_CASE("Addresses") {
+    auto v4 = unorthodox::net::address::from_string("127.0.0.1", 5300);
+    REQUIRE(v4);
+    REQUIRE(v4->family() == AF_INET);
+    REQUIRE(v4->port() == 5300);
+    REQUIRE(v4->to_string() == "127.0.0.1:5300");
+
+    auto v6 = unorthodox::net::address::from_string("::1", 53);
+    REQUIRE(v6);
+    REQUIRE(v6->family() == AF_INET6);
+    REQUIRE(v6->to_string() == "[::1]:53");
+
+    REQUIRE(!unorthodox::net::address::from_string("localhost", 53));
+    REQUIRE(unorthodox::net::address().empty());
+
+    REQUIRE(*v4 == *unorthodox::net::address::from_string("127.0.0.1", 5300));
+    REQUIRE(!(*v4 == *unorthodox::net::address::from_string("127.0.0.1", 5301)));
+}
+
+TEST_SUITE("Datagram batches") {
+    struct udp_pair
+    {
+        udp_pair()
+        {
+            REQUIRE(!receiver.open(nullptr, 16040));
+            REQUIRE(!sender.open(nullptr, 16041));
+
+            // nothing below may block the test for ever
+            for (int fd : receiver.native_handles())
+                if (fd >= 0)
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+            destination = *unorthodox::net::address::from_string("127.0.0.1", 16040);
+        }
+
+        std::span<const std::byte> bytes(const std::string& text)
+        {
+            return std::span<const std::byte>(reinterpret_cast<const std::byte*>(text.data()), text.size());
+        }
+
+        // datagrams on loopback arrive right away, but not necessarily in one call
+        std::vector<std::string> receive(unorthodox::net::datagram_batch& batch, size_t expected)
+        {
+            std::vector<std::string> received;
+            for (int tries = 0; tries < 100 && received.size() < expected; ++tries)
+            {
+                auto got = receiver.recv_batch(batch);
+                if (!got)
+                {
+                    REQUIRE(got.error().code == unorthodox::error_code::would_block);
+                    usleep(1000);
+                    continue;
+                }
+
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    REQUIRE(batch[i].from.port() == 16041);
+                    received.emplace_back(reinterpret_cast<const char*>(batch[i].payload.data()), batch[i].payload.size());
+                }
+            }
+
+            return received;
+        }
+
+        unorthodox::net::udp_socket receiver;
+        unorthodox::net::udp_socket sender;
+        unorthodox::net::address destination;
+    };
+
+    TEST_CASE("Round trip") {
+        udp_pair pair;
+        unorthodox::net::datagram_batch batch(16, 64);
+        REQUIRE(batch);
+
+        REQUIRE(pair.receiver.recv_batch(batch).error().code == unorthodox::error_code::would_block);
+
+        std::vector<std::string> messages;
+        std::vector<unorthodox::net::outgoing_datagram> outgoing;
+        for (int i = 0; i < 100; ++i)
+            messages.push_back("message " + std::to_string(i));
+        for (auto& message : messages)
+            outgoing.push_back({ pair.bytes(message), &pair.destination });
+
+        REQUIRE(pair.sender.send_batch(outgoing).value_or(0) == messages.size());
+
+        auto received = pair.receive(batch, messages.size());
+        REQUIRE(received == messages);
+    }
+
+    TEST_CASE("Truncation") {
+        udp_pair pair;
+        unorthodox::net::datagram_batch batch(4, 4);
+
+        const std::string message = "too long";
+        const unorthodox::net::outgoing_datagram outgoing{ pair.bytes(message), &pair.destination };
+        REQUIRE(pair.sender.send_batch(std::span(&outgoing, 1)).value_or(0) == 1);
+
+        auto received = pair.receive(batch, 1);
+        REQUIRE(received == std::vector<std::string>{ "too " });
+        REQUIRE(batch[0].truncated);
+    }
+
+    TEST_CASE("Segmentation offload") {
+        udp_pair pair;
+        unorthodox::net::datagram_batch batch(16, 64 * 1024);
+
+        std::string payload;
+        for (int i = 0; i < 3; ++i)
+            payload += std::string(1000, static_cast<char>('a' + i));
+        payload += "tail";
+
+        const unorthodox::net::outgoing_datagram outgoing{ pair.bytes(payload), &pair.destination, 1000 };
+
+        SUBCASE("Separate datagrams") {
+            REQUIRE(pair.sender.send_batch(std::span(&outgoing, 1)).value_or(0) == 1);
+
+            auto received = pair.receive(batch, 4);
+            REQUIRE(received.size() == 4);
+            REQUIRE(received[0] == std::string(1000, 'a'));
+            REQUIRE(received[3] == "tail");
+        }
+        SUBCASE("Coalesced") {
+            REQUIRE(!pair.receiver.enable_gro());
+            REQUIRE(pair.sender.send_batch(std::span(&outgoing, 1)).value_or(0) == 1);
+
+            // however the kernel grouped them, every segment is accounted for
+            std::string joined;
+            size_t datagrams = 0;
+            for (int tries = 0; tries < 100 && joined.size() < payload.size(); ++tries)
+            {
+                auto got = pair.receiver.recv_batch(batch);
+                if (!got)
+                {
+                    usleep(1000);
+                    continue;
+                }
+
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    const size_t segment = batch[i].segment_size ? batch[i].segment_size : batch[i].payload.size();
+                    datagrams += (batch[i].payload.size() + segment - 1) / segment;
+                    joined.append(reinterpret_cast<const char*>(batch[i].payload.data()), batch[i].payload.size());
+                }
+            }
+
+            REQUIRE(joined == payload);
+            REQUIRE(datagrams == 4);
+        }
+    }
+}
@@ -0,0 +1,153 @@
+#include "doctest.h"
+
+#include <unorthodox/network/sockets.hpp>
+
+#include <fcntl.h>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_SUITE("Unix sockets") {
+    using unorthodox::net::address;
+
+    static std::span<const std::byte> bytes_of(const std::string& text)
+    {
+        return std::as_bytes(std::span(text.data(), text.size()));
+    }
+
+    static std::string text_of(std::span<const std::byte> data)
+    {
+        return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    TEST_CASE("Addresses") {
+        auto path = address::from_unix_path("/tmp/unorthodox.sock");
+        REQUIRE(path);
+        REQUIRE(path->family() == AF_UNIX);
+        REQUIRE(path->to_string() == "/tmp/unorthodox.sock");
+
+        auto abstract = address::from_unix_path("@unorthodox");
+        REQUIRE(abstract);
+        REQUIRE(abstract->host() == "@unorthodox");
+        REQUIRE(!(*abstract == *address::from_unix_path("@unorthodox2")));
+
+        REQUIRE(!address::from_unix_path(""));
+        REQUIRE(!address::from_unix_path("@"));
+        REQUIRE(!address::from_unix_path(std::string(200, 'x')));
+    }
+
+    TEST_CASE("Streams on a path") {
+        const std::string path = "/tmp/unorthodox_unix_" + std::to_string(getpid());
+        auto local = address::from_unix_path(path);
+        REQUIRE(local);
+
+        unorthodox::net::unix_socket server;
+        REQUIRE(!server.listen(*local));
+
+        // the path is taken now
+        unorthodox::net::unix_socket second;
+        REQUIRE(second.listen(*local).code == unorthodox::error_code::cannot_open_socket);
+
+        unorthodox::net::unix_socket client;
+        REQUIRE(!client.connect(*local));
+
+        unorthodox::net::accepted_connection<unorthodox::net::unix_socket_details<>> accepted;
+        REQUIRE(!server.accept(accepted, 2s));
+        REQUIRE(accepted.peer.family() == AF_UNIX);
+
+        // clients that never bound have no name
+        REQUIRE(accepted.peer.host().empty());
+
+        REQUIRE(client.send(std::string("over unix")).value_or(0) == 9);
+        REQUIRE(accepted.connection.recv<std::string>().value_or("") == "over unix");
+
+        unlink(path.c_str());
+    }
+
+    TEST_CASE("Seqpacket keeps messages apart") {
+        const std::string name = "@unorthodox_seqpacket_" + std::to_string(getpid());
+        auto local = address::from_unix_path(name);
+
+        unorthodox::net::unix_seqpacket_socket server;
+        REQUIRE(!server.listen(*local));
+
+        unorthodox::net::unix_seqpacket_socket client;
+        REQUIRE(!client.connect(*local));
+
+        unorthodox::net::unix_seqpacket_socket connection;
+        REQUIRE(!server.accept(connection, 2s));
+
+        REQUIRE(client.send(std::string("first")).value_or(0) == 5);
+        REQUIRE(client.send(std::string("second")).value_or(0) == 6);
+
+        std::array<std::byte, 64> received;
+        REQUIRE(connection.recv_into(std::span(received)).value_or(0) == 5);
+        REQUIRE(connection.recv_into(std::span(received)).value_or(0) == 6);
+        REQUIRE(text_of(std::span(received).first(6)) == "second");
+    }
+
+    TEST_CASE("Passing fds") {
+        const std::string name = "@unorthodox_fds_" + std::to_string(getpid());
+        auto local = address::from_unix_path(name);
+
+        unorthodox::net::unix_socket server;
+        REQUIRE(!server.listen(*local));
+
+        unorthodox::net::unix_socket client;
+        REQUIRE(!client.connect(*local));
+
+        unorthodox::net::unix_socket connection;
+        REQUIRE(!server.accept(connection, 2s));
+
+        int first[2], second[2];
+        REQUIRE(pipe(first) == 0);
+        REQUIRE(pipe(second) == 0);
+
+        const int sending[] = { first[0], second[0] };
+        REQUIRE(client.send_fds(bytes_of("fds"), sending).value_or(0) == 3);
+
+        std::array<std::byte, 16> data;
+        std::array<int, 4> fds;
+
+        auto message = connection.recv_fds(data, fds);
+        REQUIRE(message);
+        REQUIRE(message->bytes == 3);
+        REQUIRE(message->fds == 2);
+        REQUIRE(!message->truncated);
+
+        // new fds for the same pipes
+        REQUIRE(fds[0] != first[0]);
+        REQUIRE((fcntl(fds[0], F_GETFD) & FD_CLOEXEC));
+
+        REQUIRE(write(first[1], "a", 1) == 1);
+        REQUIRE(write(second[1], "b", 1) == 1);
+
+        char byte;
+        REQUIRE(read(fds[0], &byte, 1) == 1);
+        REQUIRE(byte == 'a');
+        REQUIRE(read(fds[1], &byte, 1) == 1);
+        REQUIRE(byte == 'b');
+
+        ::close(fds[0]);
+        ::close(fds[1]);
+
+        SUBCASE("More than there is room for") {
+            REQUIRE(client.send_fds(bytes_of("two"), sending).value_or(0) == 3);
+
+            std::array<int, 1> one;
+            auto cut = connection.recv_fds(data, one);
+            REQUIRE(cut);
+            REQUIRE(cut->fds == 1);
+            REQUIRE(cut->truncated);
+            ::close(one[0]);
+        }
+
+        SUBCASE("Data is required") {
+            REQUIRE(client.send_fds({}, sending).error().code == unorthodox::error_code::invalid_argument);
+        }
+
+        for (int fd : { first[0], first[1], second[0], second[1] })
+            ::close(fd);
+    }
+}